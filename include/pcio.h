@@ -88,6 +88,11 @@ extern "C" {
 #define PCIO_ERRNO_BASE (NTCAN_ERRNO_BASE + 4096)
 #define PCIO_ERR_MODULE (PCIO_ERRNO_BASE + 1)
 
+/// Bit rate the busses are opened with
+#define PCIO_BITRATE 1000000
+/// Bits on the wire of a standard CAN frame with len data bytes, not counting stuff bits
+#define PCIO_CAN_FRAME_BITS( len ) ( 47 + 8*(len) )
+
     typedef enum {
         // Bitmask for flags in long state DWORD
         PCIO_STATE_HOME_OK = 0x2,			// Set after successful homing procedure.
@@ -120,6 +125,28 @@ extern "C" {
         PCIO_STATE_LOGIC_VOLT = 0x8000000	// Error: logic voltage dropped/over-voltage.
     } pcio_state_t;
 
+/// Bits of the long state word that report an error
+#define PCIO_STATE_FAULTS ( PCIO_STATE_ERROR | PCIO_STATE_POWERFAULT | PCIO_STATE_TOW_ERROR | \
+                            PCIO_STATE_COMM_ERROR | PCIO_STATE_POW_VOLT_ERR |           \
+                            PCIO_STATE_POW_FET_TEMP | PCIO_STATE_POW_WDG_TEMP |         \
+                            PCIO_STATE_POW_SHORTCUR | PCIO_STATE_POW_HALLERR |          \
+                            PCIO_STATE_POW_INTEGRAL_ERR | PCIO_STATE_CPU_OVERLOAD |     \
+                            PCIO_STATE_BEYOND_HARD | PCIO_STATE_BEYOND_SOFT |           \
+                            PCIO_STATE_LOGIC_VOLT )
+
+/// Bits of the long state word that report a condition rather than an error
+#define PCIO_STATE_INFOS ( PCIO_STATE_HOME_OK | PCIO_STATE_HALTED | PCIO_STATE_SWR |       \
+                           PCIO_STATE_SW1 | PCIO_STATE_SW2 | PCIO_STATE_BRAKEACTIVE |      \
+                           PCIO_STATE_CURLIMIT | PCIO_STATE_MOTION | PCIO_STATE_RAMP_ACC | \
+                           PCIO_STATE_RAMP_STEADY | PCIO_STATE_RAMP_DEC |                  \
+                           PCIO_STATE_RAMP_END | PCIO_STATE_INPROGRESS |                   \
+                           PCIO_STATE_FULLBUFFER )
+
+/// Info bits of the long state word that the short state byte of an ack also carries
+#define PCIO_STATE_SHORT_INFOS ( PCIO_STATE_SWR | PCIO_STATE_SW1 | PCIO_STATE_SW2 |      \
+                                 PCIO_STATE_MOTION | PCIO_STATE_RAMP_END |             \
+                                 PCIO_STATE_INPROGRESS | PCIO_STATE_FULLBUFFER )
+
 
     /// Amtec proto cmd id's
     typedef enum {
@@ -135,6 +162,7 @@ extern "C" {
     /// Amtec proto motion id's
     typedef enum {
         PCIO_FRAMP = 14,
+        PCIO_FSTEP_ACK = 16,
         PCIO_FVEL_ACK = 17,
         PCIO_FCUR_ACK = 18
     } pcio_motion_id;
@@ -199,55 +227,254 @@ extern "C" {
     /// Structure representing a single powercube module
     typedef struct {
         int id; //< module ID
-        uint8_t state;
         double min_pos;
         double max_pos;
         double max_acc;
-        double last_pos;
+        uint32_t config; //< config word, read by pcio_group_init
+        uint32_t cube_version; //< firmware version, read by pcio_group_init
     } pcio_module_t;
 
+    /** CAN access of a group.
+
+        Each function takes the transport_cx of the group and returns an
+        NTCAN result code. open must also set the baudrate; write and
+        read take the number of frames offered in *len and return the
+        number transferred there, like canWrite and canRead. take is
+        read without waiting, like canTake: it succeeds with *len set to
+        0 when no frame is waiting.
+
+        wait is optional. It blocks until a frame waits on any handle
+        opened through cx, or until timeout_ms pass, and then returns
+        NTCAN_SUCCESS or NTCAN_RX_TIMEOUT. With it, replies are taken
+        from all busses of the group as they arrive; without it, they
+        are read bus after bus.
+
+        flush is optional too. With it, write may only queue the frames,
+        and flush hands what is queued on all busses of cx to the driver
+        at once. It is called at the end of every burst.
+    */
+    typedef struct {
+        const char *name;
+        int (*open)( void *cx, int net, int32_t queue_size, NTCAN_HANDLE *handle );
+        int (*close)( void *cx, NTCAN_HANDLE handle );
+        int (*id_add)( void *cx, NTCAN_HANDLE handle, int32_t id );
+        int (*write)( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len );
+        int (*read)( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len );
+        int (*take)( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len );
+        int (*wait)( void *cx, int timeout_ms );
+        int (*flush)( void *cx );
+    } pcio_transport_t;
+
+    /// The ESD ntcan library, used when a group has no transport set
+    extern const pcio_transport_t pcio_transport_ntcan;
+
+    /// Traffic of a bus since it was allocated. Only the thread using the bus updates it.
+    typedef struct {
+        uint64_t writes;    //< write calls
+        uint64_t reads;     //< read and take calls
+        uint64_t frames_tx;
+        uint64_t frames_rx;
+        uint64_t bits;      //< PCIO_CAN_FRAME_BITS of the frames sent and received
+        uint64_t timeouts;  //< reads and writes that timed out
+        uint64_t errors;    //< reads and writes that failed otherwise
+        uint64_t stray;     //< frames received that answered no request, and frames flushed
+    } pcio_bus_stats_t;
+
     /// Structure representing a several powercubes on a single CAN bus
     typedef struct {
         int net; //< NTCAN net number
         NTCAN_HANDLE handle; //< handle to open can descriptor
         size_t module_cnt; //< number of modules on the bus
         pcio_module_t *module; //< array of the modules
+        uint32_t txid; //< transaction in progress on the bus, for the capture
+        int result; //< first CAN failure since the caller cleared it, NTCAN_SUCCESS if none
+        pcio_bus_stats_t stats; //< traffic counters
     } pcio_bus_t;
 
+    /** Modules of a group in group order, one array per field.
+
+        Built by pcio_group_init so that the per-cycle loops are single
+        passes over contiguous arrays. The limits are copies of those in
+        pcio_module_t; state and last_pos are only kept here.
+    */
+    typedef struct {
+        size_t n;           //< number of modules in the group
+        size_t *bus_off;    //< index of the first module of each bus, bus_off[bus_cnt] == n
+        uint16_t *slot;     //< slot[i*32 + id] is 1 + the index of module id on bus i, 0 if none
+        int *id;            //< module id
+        size_t *bus;        //< bus index
+        double *min_pos;
+        double *max_pos;
+        double *max_acc;
+        double *last_pos;   //< last position acknowledged or read
+        uint8_t *state;     //< short state byte of the last ack
+        double *step_run;   //< when the running step ends, CLOCK_MONOTONIC seconds, 0 if none
+        double *step_buf;   //< when the buffered step ends, 0 if none
+        CMSG *msg;          //< one frame per module, g->msg[i] points into it
+    } pcio_flat_t;
+
+    struct pcio_trace;
+
     /// Structure representing a several powercubes on multiple CAN busses
     typedef struct {
         size_t bus_cnt; //< number of busses
         pcio_bus_t *bus; //< array of busses
         CMSG **msg; //< ragged 2-D array of messages, one per module
+        pcio_flat_t flat; //< flat module table, built by pcio_group_init
+        const pcio_transport_t *transport; //< CAN access, NULL for ntcan
+        void *transport_cx; //< passed to every transport function
+        struct pcio_trace *trace; //< capture of every frame, or NULL
+        uint32_t txid; //< last transaction id handed out
     } pcio_group_t;
 
 
     /** Initialize a powercube group.
 
+        The busses are opened and initialized concurrently. Each bus
+        takes one reset round trip, then the error word, config word and
+        limits of all its modules are read in one pipelined burst.
+
         \pre g->bus and g->bus[i]->module are allocated, counts are set
-        correctly, g->bus[i]->net is set correctly.
+        correctly, g->bus[i]->net is set correctly. g->transport,
+        g->transport_cx and g->trace are set or zero.
 
-        \post CAN handles are opened, CAN ids properly bound, g->msg is allocated correctly
+        \post CAN handles are opened, CAN ids properly bound, g->msg and
+        g->flat are allocated correctly. On failure nothing is left open
+        or allocated, and the init may be tried again.
     */
     int pcio_group_init( pcio_group_t *g );
 
 
+    /// Magic number at the start of a snapshot file ("PCSN")
+#define PCIO_SNAPSHOT_MAGIC 0x4e534350
+    /// Layout version of a snapshot file
+#define PCIO_SNAPSHOT_VERSION 1
+
+    /// Header of a module snapshot file, followed by one record per module
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t module_cnt;
+        uint32_t reserved;
+    } pcio_snapshot_header_t;
+
+    /// Snapshot record of one module, in group order
+    typedef struct {
+        int32_t net;
+        int32_t id;
+        uint32_t config;
+        uint32_t cube_version;
+        double min_pos; //< limits as stored in pcio_module_t
+        double max_pos;
+        double max_acc;
+    } pcio_snapshot_module_t;
+
+    /** Initialize a powercube group, attaching without a reset if possible.
+
+        If snapshot names a file written by a previous run for the same
+        modules, each bus is verified with one pipelined read of the
+        error, config and position words and the limits. A bus whose
+        modules report no error and whose config words match the
+        snapshot is attached without reset, with the limits just read.
+        Any other bus gets the full pcio_group_init treatment. The
+        snapshot is rewritten after a cold init or when the limits no
+        longer match it.
+
+        \param warm if not NULL, set to 1 if every bus was attached warm
+    */
+    int pcio_group_init_warm( pcio_group_t *g, const char *snapshot, int *warm );
+
+    /** Write the limits, config and version of every module to path.
+        \return 0 on success, -1 with errno set on failure
+    */
+    int pcio_group_save_snapshot( pcio_group_t *g, const char *path );
+
     /** Destroy previously initialized powercube group
-        \post CAN handles are closed, g->msg is free'ed
+        \post CAN handles are closed, g->msg and g->flat are free'ed
     */
     int pcio_group_destroy ( pcio_group_t *g );
 
     /** returns number of modules in group. */
     size_t pcio_group_size( pcio_group_t *g );
 
+    /** Send a command to every module and collect one reply from each.
+
+        txvals, if not NULL, holds one 32-bit payload per module;
+        rxvals receives the first rx_bits of each reply payload and
+        state the short state byte of each reply.
+    */
+    int pcio_group_do( pcio_group_t *g, int id_mask,
+                       int cmd_id, int parm_id,
+                       const void *txvals, int tx_bits, size_t n_tx,
+                       void *rxvals, int rx_bits, uint8_t *state, size_t n_rx,
+                       int continue_on_error );
+
+    /** pcio_group_do, only to the modules k with mask[k] set; all
+        modules if mask is NULL. The other modules get no frame, no
+        reply is awaited from them, and their entries of rxvals and
+        state are left alone. */
+    int pcio_group_do_mask( pcio_group_t *g, int id_mask,
+                            int cmd_id, int parm_id,
+                            const void *txvals, int tx_bits, size_t n_tx,
+                            void *rxvals, int rx_bits, uint8_t *state, size_t n_rx,
+                            int continue_on_error, const uint8_t *mask );
+
+    /** Broadcast a command to all modules of every bus, without reply. */
+    int pcio_group_all( pcio_group_t *g, int cmd_id, int parm_id );
+
     /** Sends a motion command and receives a position acknowledgment. */
     int pcio_group_cmd_ack( pcio_group_t *g, double *ack, size_t cnt,
                             int motion_id, const double *cmd );
 
+    /** pcio_group_cmd_ack, only to the modules k with mask[k] set; all
+        modules if mask is NULL. The other modules get no frame, and
+        their entries of ack hold their last known position. */
+    int pcio_group_cmd_ack_mask( pcio_group_t *g, double *ack, size_t cnt,
+                                 int motion_id, const double *cmd, const uint8_t *mask );
+
+    /** Queue a step motion: module k moves to pos[k] in time_ms[k]
+        milliseconds, at a constant velocity, once its current step is
+        done. A module holds one step besides the one it executes. The
+        group keeps when each module's steps end, corrected by the
+        buffer bit of each ack, and a module whose buffer is still full
+        gets no frame; its entry of ack holds its last known position.
+        A step ends time_ms[k] after the call whether the module is idle
+        or still running its last one, so a module that fell behind
+        catches up, and the newest position covers those held back.
+
+        \param sent if not NULL, only the modules k with sent[k] set
+               are considered, and on return sent[k] tells whether
+               module k got the step
+    */
+    int pcio_group_step_ack( pcio_group_t *g, double *ack, size_t cnt,
+                             const double *pos, const uint16_t *time_ms, uint8_t *sent );
+
     /** Get a floating point (double) parameter from all modules. */
     int pcio_group_getd( pcio_group_t *g, int parm_id,
                          double *vals, size_t n_vals );
 
+    /** pcio_group_getd, only from the modules k with mask[k] set; all
+        modules if mask is NULL. The other entries of vals are left
+        alone. */
+    int pcio_group_getd_mask( pcio_group_t *g, int parm_id,
+                              double *vals, size_t n_vals, const uint8_t *mask );
+
+    /** Get several 32-bit parameters from all modules in one pipelined burst.
+
+        All requests are sent on all busses before any reply is awaited.
+        vals[p*n_vals + k] receives the raw word of parm_ids[p] from
+        module k; float parameters must be reinterpreted by the caller.
+        At most 8 parameters may be requested at once.
+    */
+    int pcio_group_getv( pcio_group_t *g, const int *parm_ids, size_t n_parm,
+                         uint32_t *vals, size_t n_vals );
+
+    /** pcio_group_getv, requesting parm_ids[p] only from the modules k
+        with mask[p*n_vals + k] set; all of them if mask is NULL. The
+        entries of vals of the other modules are left alone. */
+    int pcio_group_getv_mask( pcio_group_t *g, const int *parm_ids, size_t n_parm,
+                              uint32_t *vals, size_t n_vals, const uint8_t *mask );
+
     /** Get a int16 parameter from all modules. */
     int pcio_group_get16( pcio_group_t *g, int parm_id,
                           int16_t *vals, size_t n_vals );
@@ -260,10 +487,22 @@ extern "C" {
     int pcio_group_getu32( pcio_group_t *g, int parm_id,
                            uint32_t *vals, size_t n_vals );
 
+    /** pcio_group_getu32, only from the modules k with mask[k] set; all
+        modules if mask is NULL. The other entries of vals are left
+        alone. */
+    int pcio_group_getu32_mask( pcio_group_t *g, int parm_id,
+                                uint32_t *vals, size_t n_vals, const uint8_t *mask );
+
     /** Set a floating point (double) parameter to all modules. */
     int pcio_group_setd( pcio_group_t *g, int parm_id,
                          const double *vals, size_t n_vals );
 
+    /** pcio_group_setd, only to the modules k with mask[k] set; all
+        modules if mask is NULL. The other entries of vals are
+        ignored. */
+    int pcio_group_setd_mask( pcio_group_t *g, int parm_id,
+                              const double *vals, size_t n_vals, const uint8_t *mask );
+
     /** Set a int32 parameter from all modules. */
     int pcio_group_set32( pcio_group_t *g, int parm_id,
                           const int32_t *vals, size_t n_vals );
@@ -272,6 +511,12 @@ extern "C" {
     int pcio_group_setu32( pcio_group_t *g, int parm_id,
                            const uint32_t *vals, size_t n_vals );
 
+    /** pcio_group_setu32, only to the modules k with mask[k] set; all
+        modules if mask is NULL. The other entries of vals are
+        ignored. */
+    int pcio_group_setu32_mask( pcio_group_t *g, int parm_id,
+                                const uint32_t *vals, size_t n_vals, const uint8_t *mask );
+
     /** Sends powercubes to pos. */
     int pcio_group_setpos( pcio_group_t *g,
                            const double *pos, size_t n_pos,
@@ -283,7 +528,8 @@ extern "C" {
                                double acc, double vel, double *ack);
 
 
-    /** Enables or disables current limit */
+    /** Enables or disables current limit. Only the modules that do not
+        have the bit in the requested state yet are written. */
     int pcio_group_set_fullcur( pcio_group_t *g, int enable );
 
     /** Sends reset command to group */
@@ -295,6 +541,49 @@ extern "C" {
     /** Send home command to group */
     int pcio_group_home( pcio_group_t *g );
 
+    /** Home the group and wait until every module has finished.
+
+        At most batch modules of each bus home at once, to limit the
+        current drawn from the supply; all of them if batch is 0. The
+        state words of the modules still homing are read in one
+        pipelined burst until each reports PCIO_STATE_HOME_OK or an
+        error, or timeout seconds have passed. PCIO_STATE_HOME_OK only
+        counts once the module has been seen in motion or without it,
+        so that one homed before is not taken as done at once.
+
+        \param elapsed receives the seconds module k took to home, or
+        -1 if it failed or timed out
+        \return NTCAN_SUCCESS if every module homed, NTCAN_RX_TIMEOUT
+        if one did not finish in time, PCIO_ERR_MODULE if one reported
+        an error, or the error of a failed transaction
+    */
+    int pcio_group_home_wait( pcio_group_t *g, size_t batch, double timeout, double *elapsed );
+
+    /** Discard the frames waiting on bus i, such as late replies to a
+        failed transaction.
+        \param n if not NULL, set to the number of frames discarded
+    */
+    int pcio_bus_flush( pcio_group_t *g, size_t i, size_t *n );
+
+    /** Bind the ack ids of the modules on bus i again. */
+    int pcio_bus_rebind( pcio_group_t *g, size_t i );
+
+    /** Close and reopen the CAN handle of bus i and bind its ack ids.
+        The modules are not touched. */
+    int pcio_bus_reopen( pcio_group_t *g, size_t i );
+
+    /** Read the long state word of every module on bus i in one burst.
+        error[j] receives the word of g->bus[i].module[j]. */
+    int pcio_bus_get_error( pcio_group_t *g, size_t i, uint32_t *error );
+
+    /** Reset the modules j of bus i for which reset[j] is set, or all of
+        them if reset is NULL, and wait for their acks. */
+    int pcio_bus_reset( pcio_group_t *g, size_t i, const uint8_t *reset );
+
+    /** Halt every module of bus i and wait for their acks, whatever the
+        other busses of the group do. */
+    int pcio_bus_halt( pcio_group_t *g, size_t i );
+
     int pcio_group_dump_config( pcio_group_t *g );
 
     int pcio_group_dump_error(pcio_group_t *g);
@@ -316,6 +605,18 @@ extern "C" {
     void pcio_state_error_to_string( char *buf, size_t n, uint32_t msg );
     int pcio_state_word_contains_errors( uint32_t msg );
 
+    /** Split a long state word into its error bits, PCIO_STATE_FAULTS,
+        and its other bits, PCIO_STATE_INFOS. */
+    static inline void pcio_state_decode( uint32_t msg, uint32_t *fault, uint32_t *info ) {
+        *fault = msg & PCIO_STATE_FAULTS;
+        *info = msg & PCIO_STATE_INFOS;
+    }
+
+    /** The bits of the long state word that short state byte state
+        reports, a subset of PCIO_STATE_SHORT_INFOS. PCIO_SHORT_NOT_OK
+        has no single long state bit and is left out. */
+    uint32_t pcio_short_state_word( uint8_t state );
+
     pcio_group_t *pcio_group_alloc( size_t bus_cnt,
                                     int *bus_nets,
                                     size_t *module_cnts,
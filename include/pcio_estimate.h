@@ -0,0 +1,150 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef PCIO_ESTIMATE_H
+#define PCIO_ESTIMATE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+/** \file pcio_estimate.h
+ *
+ *  State estimate of a group of modules between CAN polls.
+ *
+ *  Each joint carries a constant velocity Kalman filter over position
+ *  and velocity. Measurements (position acks and velocity reads)
+ *  correct it; the last command shapes the prediction, which ramps the
+ *  velocity to the commanded one at the acceleration limit of the
+ *  module, or follows the ramp a position command was sent with and
+ *  stops at its position.
+ *
+ *  The estimate holds no lock: the caller serializes measurements,
+ *  commands and predictions.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// What the last command tells about the motion until the next measurement
+    typedef enum {
+        PCIO_ESTIMATE_FREE = 0, //< nothing, keep the measured velocity
+        PCIO_ESTIMATE_VEL,      //< ramp to the commanded velocity
+        PCIO_ESTIMATE_POS,      //< move to the commanded position at a bounded velocity
+        PCIO_ESTIMATE_STOP      //< ramp down to rest
+    } pcio_estimate_cmd_t;
+
+    /// Filter of each joint and the command it is predicting with
+    typedef struct {
+        size_t n;
+        double *pos;           //< filtered position at the last measurement
+        double *vel;           //< filtered velocity at the last measurement
+        double *p_pp;          //< position variance
+        double *p_pv;          //< position and velocity covariance
+        double *p_vv;          //< velocity variance
+        double *max_acc;       //< acceleration limit of each module, 0 for none
+        double *u;             //< commanded velocity or position
+        double pos_vel;        //< velocity of the ramps of position commands
+        double pos_acc;        //< their acceleration, 0 for the module's limit
+        double acc_var;        //< process noise, variance of the unmodeled acceleration
+        double pos_var;        //< variance of a position measurement
+        double vel_var;        //< variance of a velocity measurement
+        pcio_estimate_cmd_t cmd;
+        int measured;          //< a measurement has been made
+        struct timespec t;     //< time of the last measurement
+        uint64_t seq;          //< measurements made
+    } pcio_estimate_t;
+
+    /// One predicted joint state
+    typedef struct {
+        double pos;
+        double vel;
+        double pos_var;
+        double vel_var;
+    } pcio_estimate_joint_t;
+
+    /** Allocate the filters of n joints with the given acceleration limits.
+
+        Position commands are predicted as ramps at velocity pos_vel and
+        acceleration pos_acc, the ones they are sent with; a pos_acc of 0
+        ramps at the acceleration limit instead. The noise variances get
+        defaults for the modules that the caller may change.
+
+        \return 0 on success, -1 if out of memory
+    */
+    int pcio_estimate_init( pcio_estimate_t *est, size_t n, const double *max_acc,
+                            double pos_vel, double pos_acc );
+
+    /** Free the filters */
+    void pcio_estimate_destroy( pcio_estimate_t *est );
+
+    /** Correct the filters with the measurements taken at time t.
+        Either of pos or vel may be NULL when it was not read. Only the
+        joints i with pos_mask[i] set, or all if pos_mask is NULL, were
+        read in pos, and likewise for vel; the others are only predicted
+        to t. The first measurement seeds every joint from pos, those
+        not read with the variance of an unknown position.
+    */
+    void pcio_estimate_measure( pcio_estimate_t *est, const struct timespec *t,
+                                const double *pos, const uint8_t *pos_mask,
+                                const double *vel, const uint8_t *vel_mask );
+
+    /** Record the command just sent, n entries of u. u is ignored for
+        PCIO_ESTIMATE_FREE and PCIO_ESTIMATE_STOP and may be NULL.
+
+        The command shapes the prediction from the last measurement on,
+        which the daemon takes right after commanding.
+    */
+    void pcio_estimate_command( pcio_estimate_t *est, pcio_estimate_cmd_t cmd, const double *u );
+
+    /** Predict the state of every joint at time t into x, n entries.
+        \return nanoseconds from the last measurement to t, or -1 if
+        nothing was measured yet and x is untouched
+    */
+    int64_t pcio_estimate_predict( const pcio_estimate_t *est, const struct timespec *t,
+                                   pcio_estimate_joint_t *x );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
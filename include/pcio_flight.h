@@ -0,0 +1,178 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+#ifndef PCIO_FLIGHT_H
+#define PCIO_FLIGHT_H
+#include <stdint.h>
+#include <stddef.h>
+/** \file pcio_flight.h
+ *
+ *  Flight recorder: the last cycles of a group, kept in memory and
+ *  written out only when something goes wrong.
+ *
+ *  Each cycle adds a row holding the reference in effect, the state
+ *  published, the short state bytes of the last acks and how long the
+ *  transactions of the cycle took. The rows live in a ring allocated
+ *  and touched once at start, so adding one costs a copy and nothing
+ *  else.
+ *
+ *  A dump writes the header and the ring as they are in memory, with
+ *  one open and a few writes and nothing else, so it may be called
+ *  from a signal handler. Readers put the rows back in order.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Magic number at the start of a dump ("PCFR")
+#define PCIO_FLIGHT_MAGIC 0x52464350
+/// Layout version of a dump
+#define PCIO_FLIGHT_VERSION 1
+
+    /// Fixed part of a row; the per joint arrays follow, see pcio_flight_u and friends
+    typedef struct {
+        uint64_t t_ns;       //< tick of the cycle, CLOCK_MONOTONIC
+        int64_t work_ns;     //< time the cycle spent on its transactions
+        uint64_t ref_seq;    //< sequence number of the reference in effect
+        uint64_t state_seq;  //< sequence number of the state published
+        int32_t ref_mode;    //< mode of the reference
+        int32_t result;      //< NTCAN result of the last failure of the group
+        uint32_t step;       //< pcio_recover_step_t in progress
+        uint32_t transactions; //< CAN transactions of the cycle
+    } pcio_flight_row_t;
+
+    /// Header of the ring, and of a dump; the rows follow
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t n;            //< joints in a row
+        uint32_t row_size;     //< bytes of a row, with its arrays
+        uint64_t capacity;     //< rows the ring holds
+        uint64_t head;         //< rows ever added
+        uint64_t t0_ns;        //< CLOCK_MONOTONIC when the ring was created
+        int64_t t0_realtime_ns; //< CLOCK_REALTIME at the same instant
+        uint64_t dump_ns;      //< CLOCK_MONOTONIC of the dump
+        char name[32];         //< group
+        char reason[96];       //< why the dump was written
+    } pcio_flight_header_t;
+
+    /// A flight recorder, or a dump read back
+    typedef struct {
+        pcio_flight_header_t *hdr; //< followed by the rows
+        size_t size;               //< of the header and the rows
+    } pcio_flight_t;
+
+    /** Set up a ring of capacity rows for the n joints of group name.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_flight_init( pcio_flight_t *f, const char *name, size_t n, size_t capacity );
+
+    /** Release the ring */
+    void pcio_flight_destroy( pcio_flight_t *f );
+
+    /// Row k of the ring, counted from the start of the recording
+    static inline pcio_flight_row_t *pcio_flight_row( const pcio_flight_t *f, uint64_t k ) {
+        return (pcio_flight_row_t*)((uint8_t*)(f->hdr + 1) +
+                                    (k % f->hdr->capacity) * f->hdr->row_size);
+    }
+
+    /// Reference of row r, n values
+    static inline double *pcio_flight_u( pcio_flight_row_t *r ) {
+        return (double*)(r + 1);
+    }
+
+    /// Positions of row r, n values
+    static inline double *pcio_flight_pos( const pcio_flight_t *f, pcio_flight_row_t *r ) {
+        return pcio_flight_u( r ) + f->hdr->n;
+    }
+
+    /// Velocities of row r, n values
+    static inline double *pcio_flight_vel( const pcio_flight_t *f, pcio_flight_row_t *r ) {
+        return pcio_flight_u( r ) + 2 * f->hdr->n;
+    }
+
+    /// Short state bytes of row r, n values
+    static inline uint8_t *pcio_flight_state( const pcio_flight_t *f, pcio_flight_row_t *r ) {
+        return (uint8_t*)(pcio_flight_u( r ) + 3 * f->hdr->n);
+    }
+
+    /** The row to fill in next. It is only kept once pcio_flight_commit
+        is called; until then a dump leaves it out. */
+    static inline pcio_flight_row_t *pcio_flight_next( const pcio_flight_t *f ) {
+        return pcio_flight_row( f, f->hdr->head );
+    }
+
+    /** Keep the row returned by pcio_flight_next */
+    void pcio_flight_commit( pcio_flight_t *f );
+
+    /** Copy ring src into dst, set up by pcio_flight_init for as many
+        joints and rows, so that another thread may write it out while
+        rows are added. Call it from the thread that adds the rows. */
+    void pcio_flight_copy( pcio_flight_t *dst, const pcio_flight_t *src );
+
+    /** Write the ring to path, creating or replacing it, noting reason.
+        Async-signal-safe; call it from the thread that adds the rows,
+        or from a signal handler that interrupted that thread. A copy
+        may be written from any thread.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_flight_dump( pcio_flight_t *f, const char *path, const char *reason );
+
+    /** Read dump path back, free with pcio_flight_destroy.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_flight_open( pcio_flight_t *f, const char *path );
+
+    /** Number of rows in a dump */
+    uint64_t pcio_flight_count( const pcio_flight_t *f );
+
+    /** The k-th oldest row of a dump */
+    pcio_flight_row_t *pcio_flight_get( const pcio_flight_t *f, uint64_t k );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+#ifndef PCIO_LOG_H
+#define PCIO_LOG_H
+#include <stdint.h>
+#include <stddef.h>
+#include <syslog.h>
+/** \file pcio_log.h
+ *
+ *  Logging that never blocks the control loop.
+ *
+ *  A message is formatted into a preallocated slot of a lock-free
+ *  ring, and a thread at idle priority writes the ring out. Any thread
+ *  may log. When the ring is full the message is dropped and counted
+ *  instead of waiting. Each call site of PCIO_LOG passes at most
+ *  PCIO_LOG_SITE_BURST messages per second; the next one that passes
+ *  tells how many were suppressed.
+ *
+ *  Until pcio_log_start is called, and after pcio_log_stop, messages
+ *  are written right away, so tools need not start the thread.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Messages the ring holds
+#define PCIO_LOG_SLOTS 256
+
+/// Longest message, including the terminating null; longer ones are truncated
+#define PCIO_LOG_LINE 160
+
+/// Messages per second a call site may log
+#define PCIO_LOG_SITE_BURST 5
+
+/// How often the writer thread looks at the ring when it is empty
+#define PCIO_LOG_DRAIN_NS 10000000
+
+    /// Rate limit of one call site
+    typedef struct {
+        int64_t second;      //< second of the messages counted
+        uint32_t count;      //< messages logged in that second
+        uint32_t suppressed; //< messages suppressed since the last one logged
+    } pcio_log_site_t;
+
+    /// Least important syslog priority logged, LOG_INFO to start with
+    extern int pcio_log_level;
+
+    /// Writes one message; level is a syslog priority
+    typedef void pcio_log_sink_fun( int level, const char *line );
+
+    /** Start the writer thread.
+        \param sink writes the messages, NULL for stderr
+        \return 0 on success, or an errno value
+    */
+    int pcio_log_start( pcio_log_sink_fun *sink );
+
+    /** Wait for the messages being put in the ring, write them out and
+        stop the writer thread */
+    void pcio_log_stop( void );
+
+    /** Log a message at level from call site site, subject to its rate limit */
+    void pcio_log_site( pcio_log_site_t *site, int level, const char *fmt, ... )
+        __attribute__((format(printf, 3, 4)));
+
+    /** Messages dropped because the ring was full */
+    uint64_t pcio_log_dropped( void );
+
+/// Log a message, rate limited per call site; level is a syslog priority
+#define PCIO_LOG( level, ... ) do {                                     \
+        static pcio_log_site_t _pcio_log_site;                          \
+        if( (level) <= pcio_log_level )                                 \
+            pcio_log_site( &_pcio_log_site, level, __VA_ARGS__ );       \
+    } while(0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
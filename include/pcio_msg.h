@@ -0,0 +1,267 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef PCIO_MSG_H
+#define PCIO_MSG_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <sns.h>
+/** \file pcio_msg.h
+ *
+ *  Messages pcio-sns publishes for each group next to the motor state:
+ *  the status, how the group is recovering from CAN failures and what
+ *  each module last reported; the estimate, the state predicted
+ *  between polls; the sample, the state with the time each joint was
+ *  last sampled; and the telemetry, counters of how well the daemon
+ *  and its busses keep up.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// Recovery steps, cheapest first; a group moves down the list while it keeps failing
+    typedef enum {
+        PCIO_RECOVER_NONE = 0, //< operating normally
+        PCIO_RECOVER_RETRY,    //< discard stale frames and try again
+        PCIO_RECOVER_REBIND,   //< bind the ack ids again
+        PCIO_RECOVER_RESET,    //< reset the modules that report an error
+        PCIO_RECOVER_REOPEN,   //< close and reopen the bus, then reset its modules
+        PCIO_RECOVER_FAULT,    //< given up until the modules answer again or a reset is commanded
+        PCIO_RECOVER_STEP_CNT
+    } pcio_recover_step_t;
+
+    /// Classes of failure
+    typedef enum {
+        PCIO_FAULT_NONE = 0,
+        PCIO_FAULT_TIMEOUT,    //< a module did not answer in time
+        PCIO_FAULT_BUS_OFF,    //< the CAN controller or handle is unusable
+        PCIO_FAULT_MODULE,     //< a module reports an error that a reset clears
+        PCIO_FAULT_POWER,      //< a module reports a power fault, which takes a power cycle
+    } pcio_fault_t;
+
+    /// Status of one module
+    struct pcio_msg_status_joint {
+        uint32_t error;   //< long state word, pcio_state_t, as last read
+        uint8_t state;    //< short state byte of the last ack
+        uint8_t bus;      //< index of the bus in the group
+        uint8_t affected; //< the bus is being recovered
+        uint8_t reserved;
+        float current;    //< pseudo current as last polled
+        float bus_voltage; //< as last polled
+        float bus_current; //< as last polled
+        uint32_t fault;   //< error bits of the state, PCIO_STATE_FAULTS
+        uint32_t info;    //< other bits of the state, PCIO_STATE_INFOS; those the ack also
+                          //< carries, PCIO_STATE_SHORT_INFOS, are as of the last ack
+    };
+
+    /// Status of a group; header.n is the number of modules
+    struct pcio_msg_status {
+        struct sns_msg_header header;
+        uint32_t step;         //< pcio_recover_step_t in progress
+        uint32_t fault;        //< pcio_fault_t being recovered from
+        int32_t result;        //< NTCAN result of the last failure
+        uint32_t bus_mask;     //< busses being recovered, bit i for bus i
+        uint64_t recoveries;   //< recoveries started
+        uint64_t recovered;    //< recoveries that brought the group back
+        uint64_t faults;       //< recoveries that gave up
+        uint64_t attempts[PCIO_RECOVER_STEP_CNT]; //< actions taken, by step
+        int64_t elapsed_ns;    //< time spent in the recovery in progress
+        int64_t last_ns;       //< duration of the last finished recovery
+        int64_t max_ns;        //< longest finished recovery
+        struct pcio_msg_status_joint joint[1];
+    };
+
+    /// Size of a status message for n modules
+    static inline size_t pcio_msg_status_size_n( uint32_t n ) {
+        return sizeof(struct pcio_msg_status) - sizeof(struct pcio_msg_status_joint) +
+            n * sizeof(struct pcio_msg_status_joint);
+    }
+
+    /// Size of status message msg
+    static inline size_t pcio_msg_status_size( const struct pcio_msg_status *msg ) {
+        return pcio_msg_status_size_n( msg->header.n );
+    }
+
+    /// Allocate a zeroed status message for n modules, free() it
+    static inline struct pcio_msg_status *pcio_msg_status_heap_alloc( uint32_t n ) {
+        struct pcio_msg_status *msg =
+            (struct pcio_msg_status*)calloc( 1, pcio_msg_status_size_n( n ) );
+        if( msg ) msg->header.n = n;
+        return msg;
+    }
+
+    /// The joint state of an estimate sample was just measured rather than predicted
+#define PCIO_MSG_ESTIMATE_MEASURED 0x1
+
+    /// Estimated state of one module
+    struct pcio_msg_estimate_joint {
+        double pos;
+        double vel;
+        double pos_var;  //< variance of pos
+        double vel_var;  //< variance of vel
+    };
+
+    /// Estimated state of a group; header.n is the number of modules and the header time is
+    /// the time the state is estimated for
+    struct pcio_msg_estimate {
+        struct sns_msg_header header;
+        uint32_t flags;      //< PCIO_MSG_ESTIMATE_MEASURED
+        uint32_t reserved;
+        int64_t age_ns;      //< time since the measurement the sample is predicted from
+        uint64_t measured;   //< measurements the estimate has seen
+        struct pcio_msg_estimate_joint joint[1];
+    };
+
+    /// Size of an estimate message for n modules
+    static inline size_t pcio_msg_estimate_size_n( uint32_t n ) {
+        return sizeof(struct pcio_msg_estimate) - sizeof(struct pcio_msg_estimate_joint) +
+            n * sizeof(struct pcio_msg_estimate_joint);
+    }
+
+    /// Size of estimate message msg
+    static inline size_t pcio_msg_estimate_size( const struct pcio_msg_estimate *msg ) {
+        return pcio_msg_estimate_size_n( msg->header.n );
+    }
+
+    /// Allocate a zeroed estimate message for n modules, free() it
+    static inline struct pcio_msg_estimate *pcio_msg_estimate_heap_alloc( uint32_t n ) {
+        struct pcio_msg_estimate *msg =
+            (struct pcio_msg_estimate*)calloc( 1, pcio_msg_estimate_size_n( n ) );
+        if( msg ) msg->header.n = n;
+        return msg;
+    }
+
+    /// Sampled state of one module
+    struct pcio_msg_sample_joint {
+        double pos;
+        double vel;
+        int64_t pos_ns;   //< CLOCK_MONOTONIC time pos was sampled, 0 if never
+        int64_t vel_ns;   //< CLOCK_MONOTONIC time vel was sampled, 0 if never
+        uint32_t divider; //< cycles between the turns of the module to be commanded and polled
+        uint32_t reserved;
+    };
+
+    /// Sampled state of a group; header.n is the number of modules and the header time is the
+    /// tick of the cycle, as in the motor state. Modules that run at a fraction of the cycle rate
+    /// keep their last sample between their turns.
+    struct pcio_msg_sample {
+        struct sns_msg_header header;
+        struct pcio_msg_sample_joint joint[1];
+    };
+
+    /// Size of a sample message for n modules
+    static inline size_t pcio_msg_sample_size_n( uint32_t n ) {
+        return sizeof(struct pcio_msg_sample) - sizeof(struct pcio_msg_sample_joint) +
+            n * sizeof(struct pcio_msg_sample_joint);
+    }
+
+    /// Size of sample message msg
+    static inline size_t pcio_msg_sample_size( const struct pcio_msg_sample *msg ) {
+        return pcio_msg_sample_size_n( msg->header.n );
+    }
+
+    /// Allocate a zeroed sample message for n modules, free() it
+    static inline struct pcio_msg_sample *pcio_msg_sample_heap_alloc( uint32_t n ) {
+        struct pcio_msg_sample *msg =
+            (struct pcio_msg_sample*)calloc( 1, pcio_msg_sample_size_n( n ) );
+        if( msg ) msg->header.n = n;
+        return msg;
+    }
+
+    /// Traffic of one bus since the daemon started
+    struct pcio_msg_telemetry_bus {
+        uint64_t frames_tx;
+        uint64_t frames_rx;
+        uint64_t timeouts;   //< reads and writes that timed out
+        uint64_t errors;     //< reads and writes that failed otherwise
+        uint64_t stray;      //< frames that answered no request, and frames flushed
+        float utilization;   //< fraction of the bit rate used since the last message
+        uint32_t reserved;
+    };
+
+    /// Telemetry of a group; header.n is the number of busses. Counters run from the start of
+    /// the daemon, the cycle statistics cover the cycles since the last message.
+    struct pcio_msg_telemetry {
+        struct sns_msg_header header;
+        uint64_t cycles;          //< cycles run
+        uint64_t overruns;        //< cycles whose work ran past the next tick
+        uint64_t retries;         //< recovery actions taken
+        uint64_t stale_refs;      //< references overwritten before they were read
+        uint64_t zero_vels;       //< zero velocity commands sent for expired references
+        uint64_t polls_shed;      //< polled fields left for a later cycle for lack of time
+        uint64_t suppressed;      //< motion frames skipped as repeating the last command
+        int64_t cycle_min_ns;     //< shortest work of a cycle
+        int64_t cycle_mean_ns;
+        int64_t cycle_max_ns;     //< longest work of a cycle
+        float transactions_mean;  //< CAN transactions per cycle
+        uint32_t transactions_max;
+        uint32_t poll_limit;      //< polled fields allowed per cycle now
+        uint32_t reserved;
+        struct pcio_msg_telemetry_bus bus[1];
+    };
+
+    /// Size of a telemetry message for n busses
+    static inline size_t pcio_msg_telemetry_size_n( uint32_t n ) {
+        return sizeof(struct pcio_msg_telemetry) - sizeof(struct pcio_msg_telemetry_bus) +
+            n * sizeof(struct pcio_msg_telemetry_bus);
+    }
+
+    /// Size of telemetry message msg
+    static inline size_t pcio_msg_telemetry_size( const struct pcio_msg_telemetry *msg ) {
+        return pcio_msg_telemetry_size_n( msg->header.n );
+    }
+
+    /// Allocate a zeroed telemetry message for n busses, free() it
+    static inline struct pcio_msg_telemetry *pcio_msg_telemetry_heap_alloc( uint32_t n ) {
+        struct pcio_msg_telemetry *msg =
+            (struct pcio_msg_telemetry*)calloc( 1, pcio_msg_telemetry_size_n( n ) );
+        if( msg ) msg->header.n = n;
+        return msg;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
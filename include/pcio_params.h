@@ -0,0 +1,85 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+
+#ifndef PCIO_PARAMS_H
+#define PCIO_PARAMS_H
+/** \file pcio_params.h
+ *
+ *  Backups of the parameters of the modules of a group.
+ *
+ *  A dump is a JSON file with one object per module, keyed by its bus
+ *  and id, and a member per entry of pcio_param_codes. Double
+ *  parameters are written as numbers that read back to the same
+ *  float, all others as the raw unsigned word.
+ */
+
+#include "pcio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Read every entry of pcio_param_codes from all modules of g and
+        write them to path, or to stdout if path is "-".
+        \return NTCAN_SUCCESS, the error of a failed transaction, or -1
+        if the file could not be written
+    */
+    int pcio_params_dump( pcio_group_t *g, const char *path );
+
+    /** Write the settable parameters of a dump back to the modules of
+        g: the config word, the position limits, max vel, acc, cur and
+        delta pos, and the home offset. The modules are matched by bus
+        and id; one not in the dump is left alone. Only the values that
+        differ are written, and they are read back to check them.
+        \return NTCAN_SUCCESS, the error of a failed transaction, or -1
+        if the dump could not be read or a module did not take a value
+    */
+    int pcio_params_restore( pcio_group_t *g, const char *path );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
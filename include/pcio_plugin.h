@@ -0,0 +1,118 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+#ifndef PCIO_PLUGIN_H
+#define PCIO_PLUGIN_H
+#include <stdint.h>
+#include <stddef.h>
+/** \file pcio_plugin.h
+ *
+ *  Controllers that run inside pcio-sns.
+ *
+ *  A controller built as a shared object and loaded with --plugin runs
+ *  in the I/O thread of its group. Each cycle the daemon polls and
+ *  publishes the state, hands it to step, and sends the reference step
+ *  filled in right away. A command thus reaches the modules in the same
+ *  cycle as the state it was computed from, with no ach channel and no
+ *  thread wakeup in between.
+ *
+ *  The shared object exports one pcio_plugin_t named pcio_plugin:
+ *
+ *      const pcio_plugin_t pcio_plugin = {
+ *          .abi_version = PCIO_PLUGIN_ABI_VERSION,
+ *          .name = "hold",
+ *          .init = hold_init,
+ *          .step = hold_step,
+ *          .destroy = hold_destroy,
+ *      };
+ *
+ *  step runs in the cycle, so it must not block or allocate. The
+ *  command channel still halts and resets the group: a halt, from
+ *  the channel or from step, stops calling step until the next reset
+ *  read from the channel.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Version of pcio_plugin_t; a plugin built against another one is refused
+#define PCIO_PLUGIN_ABI_VERSION 1
+/// Name of the pcio_plugin_t a plugin exports
+#define PCIO_PLUGIN_SYMBOL "pcio_plugin"
+
+    struct sns_msg_motor_state;
+    struct sns_msg_motor_ref;
+    struct pcio_msg_status;
+
+    /// The entry points of a controller plugin
+    typedef struct {
+        uint32_t abi_version;   //< PCIO_PLUGIN_ABI_VERSION
+        const char *name;
+
+        /** Set up a controller of n joints cycling every period_sec seconds.
+            arg is what followed the colon in --plugin, or NULL.
+            \param cx receives the pointer passed to step and destroy
+            \return 0 on success
+        */
+        int (*init)( void **cx, const char *arg, size_t n, double period_sec );
+
+        /** Compute the reference of one cycle.
+            \param state positions and velocities just read, stamped with the cycle
+            \param status faults, currents and recovery of the group
+            \param ref has header.n set to n; fill in mode and u
+            \return 1 to send ref, 0 to send nothing this cycle, negative to halt the group
+        */
+        int (*step)( void *cx, const struct sns_msg_motor_state *state,
+                     const struct pcio_msg_status *status, struct sns_msg_motor_ref *ref );
+
+        /** Release the controller; may be NULL */
+        void (*destroy)( void *cx );
+    } pcio_plugin_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef PCIO_POLL_H
+#define PCIO_POLL_H
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "pcio.h"
+/** \file pcio_poll.h
+ *
+ *  Scheduler of the parameters a group reads every cycle.
+ *
+ *  Each field has its own rate and priority. Every cycle, the fields
+ *  that are due are read in one pipelined burst, most important first,
+ *  up to a number of fields per cycle that the busses have time for.
+ *  When cycles overrun, that number shrinks, so the least important
+ *  fields are shed instead of the loop slipping; it grows back while
+ *  the cycles keep up.
+ *
+ *  A cycle may also be the turn of only some of the modules, when
+ *  they run at a fraction of the cycle rate. A field that comes due
+ *  outside the turn of a module is owed to it and read on its next
+ *  turn, so every module gets every field at the lower of the two
+ *  rates.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Most fields a scheduler holds
+#define PCIO_POLL_FIELD_MAX 16
+
+/// Cycles without an overrun before the scheduler allows one more field per cycle
+#define PCIO_POLL_CALM_CYCLES 50
+
+    /// A parameter read at its own rate
+    typedef struct {
+        int parm_id;         //< pcio_param_id
+        int priority;        //< fields with a lower priority are shed first
+        int64_t period_ns;   //< time between reads, 0 for every cycle
+        struct timespec due; //< next read
+        struct timespec t;   //< last read, zero if never
+        uint32_t *vals;      //< raw word of each module as last read
+        uint8_t *got;        //< modules that have the field in the cycle, marked or read
+        uint8_t *owed;       //< modules left out of a read for not having their turn
+        uint64_t reads;      //< times read
+        uint64_t shed;       //< cycles it was due but shed
+    } pcio_poll_field_t;
+
+    /// The fields of a group and how many the busses take per cycle
+    typedef struct {
+        size_t n;            //< modules in the group
+        size_t n_field;
+        pcio_poll_field_t field[PCIO_POLL_FIELD_MAX];
+        size_t budget;       //< fields per cycle the busses have time for
+        size_t limit;        //< fields per cycle allowed now, at most budget
+        unsigned calm;       //< cycles since the last overrun or change of limit
+        uint32_t read;       //< bit i is set if field i was read or marked in the cycle, from
+                             //< the modules in its got
+    } pcio_poll_t;
+
+    /** Start a scheduler without fields for a group of n modules and a
+        budget of fields per cycle. */
+    void pcio_poll_init( pcio_poll_t *p, size_t n, size_t budget );
+
+    /** Free the fields */
+    void pcio_poll_destroy( pcio_poll_t *p );
+
+    /** Fields per cycle that fit in share of the bus time of a cycle of
+        period_sec, given the busiest bus of g. At least 1 and at most
+        the 8 parameters of a burst. */
+    size_t pcio_poll_budget( const pcio_group_t *g, double period_sec, double share );
+
+    /** Add a field read at rate per second, or every cycle if rate is 0.
+        \return index of the field, or -1 if full or out of memory
+    */
+    int pcio_poll_add( pcio_poll_t *p, int parm_id, double rate, int priority );
+
+    /** Field reading parm_id, or NULL */
+    pcio_poll_field_t *pcio_poll_find( pcio_poll_t *p, int parm_id );
+
+    /** Note that parm_id was obtained at time now some other way, such
+        as the position in a motion ack, from the modules k with mask[k]
+        set, or from all of them if mask is NULL. Once every module has
+        it, it counts as read in the cycle; until then, pcio_poll_run
+        reads it from the others only, if it is due. Marks do not count against the
+        budget, and the caller keeps the values it got.
+    */
+    void pcio_poll_mark( pcio_poll_t *p, int parm_id, const struct timespec *now,
+                         const uint8_t *mask );
+
+    /** Read the fields due at time now that fit in the cycle. p->read
+        tells which were read.
+        \return the NTCAN result of the burst
+    */
+    int pcio_poll_run( pcio_poll_t *p, pcio_group_t *g, const struct timespec *now );
+
+    /** Like pcio_poll_run, but read only from the modules k with
+        turn[k] set, or from all of them if turn is NULL. A field that
+        is due is owed to the others until their turn.
+    */
+    int pcio_poll_run_turn( pcio_poll_t *p, pcio_group_t *g, const struct timespec *now,
+                            const uint8_t *turn );
+
+    /** End the cycle, telling whether it overran. Clears p->read and
+        the got of the fields. */
+    void pcio_poll_end( pcio_poll_t *p, int overran );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
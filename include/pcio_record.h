@@ -0,0 +1,244 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+#ifndef PCIO_RECORD_H
+#define PCIO_RECORD_H
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+/** \file pcio_record.h
+ *
+ *  Compact recording of the state of a group over long runs.
+ *
+ *  Each cycle adds a row: the time, and the position, velocity,
+ *  current and state word of every joint. The control loop only
+ *  copies the row into a ring; a writer thread gathers the rows into
+ *  blocks of a fixed number of rows and writes them out.
+ *
+ *  Within a block the rows are stored as columns, one per quantity
+ *  and joint. Positions, velocities and currents are quantized to a
+ *  fixed step and stored as the difference to the previous row, and
+ *  state words as the bits that changed, each as a variable length
+ *  integer. A joint at rest thus costs a byte per quantity and row.
+ *  The times are stored as the change of the difference, which is
+ *  zero while the cycle keeps its period.
+ *
+ *  Every block starts with a header giving its first row, its time
+ *  span and its size, so a recording cut short by a crash can still
+ *  be read up to its last complete block. Closing a recording appends
+ *  an index of the blocks by time, used to seek without reading the
+ *  whole file.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Magic number at the start of a recording ("PCRC")
+#define PCIO_RECORD_MAGIC 0x43524350
+/// Magic number at the start of a block ("PCRB")
+#define PCIO_RECORD_BLOCK_MAGIC 0x42524350
+/// Magic number of the trailer that closes a recording ("PCRI")
+#define PCIO_RECORD_INDEX_MAGIC 0x49524350
+/// Layout version of a recording
+#define PCIO_RECORD_VERSION 1
+
+/// Default rows in a block
+#define PCIO_RECORD_DEFAULT_BLOCK_ROWS 512
+/// Rows the ring between the control loop and the writer holds
+#define PCIO_RECORD_RING_ROWS 4096
+/// How often the writer thread looks at the ring when it is empty
+#define PCIO_RECORD_DRAIN_NS 20000000
+
+/// Default quantization steps of the position (rad), velocity (rad/s) and current (A)
+#define PCIO_RECORD_POS_STEP 1e-6
+#define PCIO_RECORD_VEL_STEP 1e-5
+#define PCIO_RECORD_CUR_STEP 1e-3
+
+    /// Quantized quantities of a joint, in the order of their columns
+    typedef enum {
+        PCIO_RECORD_POS = 0,
+        PCIO_RECORD_VEL,
+        PCIO_RECORD_CUR,
+        PCIO_RECORD_QUANTITIES
+    } pcio_record_quantity_t;
+
+    /// Header at the start of a recording
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t n;                 //< joints in a row
+        uint32_t block_rows;        //< rows in a full block
+        double step[PCIO_RECORD_QUANTITIES]; //< quantization step of each quantity
+        uint64_t t0_ns;             //< CLOCK_MONOTONIC when the recording was created
+        int64_t t0_realtime_ns;     //< CLOCK_REALTIME at the same instant
+        char name[32];              //< group recorded
+    } pcio_record_header_t;
+
+    /// Header of a block; size bytes of columns follow
+    typedef struct {
+        uint32_t magic;
+        uint32_t rows;
+        uint64_t size;
+        uint64_t row;               //< index of the first row in the recording
+        uint64_t t_first_ns;
+        uint64_t t_last_ns;
+    } pcio_record_block_t;
+
+    /// Index entry of a block
+    typedef struct {
+        uint64_t offset;            //< of the block header from the start of the file
+        uint64_t row;
+        uint64_t t_first_ns;
+        uint64_t t_last_ns;
+    } pcio_record_index_t;
+
+    /// Last bytes of a closed recording, after its index
+    typedef struct {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t blocks;            //< entries in the index
+        uint64_t index_offset;      //< of the first entry from the start of the file
+        uint64_t dropped;           //< rows lost because the writer fell behind
+    } pcio_record_trailer_t;
+
+    /// A recording being written
+    typedef struct pcio_record {
+        int fd;
+        size_t n;
+        pcio_record_header_t hdr;
+
+        // ring of rows, filled by pcio_record_put and emptied by the writer thread
+        uint64_t *ring_t;
+        double *ring_val;           //< PCIO_RECORD_QUANTITIES * n values per row
+        uint32_t *ring_status;      //< n words per row
+        uint64_t head;              //< rows put
+        uint64_t tail;              //< rows taken by the writer
+
+        // only touched by the writer thread
+        uint64_t *blk_t;
+        int64_t *blk_q;             //< quantized columns of the block being filled
+        uint32_t *blk_status;
+        size_t blk_rows;
+        uint8_t *buf;               //< encoded block
+        pcio_record_index_t *index;
+        size_t n_index;
+        size_t cap_index;
+        uint64_t rows;              //< rows written out
+        uint64_t offset;            //< end of the file
+        int error;                  //< errno of the first failed write, which stops the recording
+
+        uint64_t dropped;           //< rows lost to a full ring
+        int stop;
+        pthread_t thread;
+    } pcio_record_t;
+
+    /** Create recording path for n joints of group name, with blocks of
+        block_rows rows (0 for the default), and start its writer thread.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_record_create( pcio_record_t *r, const char *path, const char *name, size_t n,
+                            size_t block_rows );
+
+    /** Add a row taken at t_ns. Never blocks; when the writer falls too
+        far behind, the row is dropped and counted. Call from one thread
+        only. status may be NULL.
+    */
+    void pcio_record_put( pcio_record_t *r, uint64_t t_ns, const double *pos, const double *vel,
+                          const double *cur, const uint32_t *status );
+
+    /** Write out the rows still in the ring, append the index and close
+        the file.
+        \return 0, or the errno of the first failed write
+    */
+    int pcio_record_close( pcio_record_t *r );
+
+
+    /// Rows of one block, decoded. The values of row i and joint j are at i*n + j.
+    typedef struct {
+        size_t rows;
+        uint64_t row;               //< index of the first row in the recording
+        uint64_t *t_ns;
+        double *val[PCIO_RECORD_QUANTITIES];
+        uint32_t *status;
+    } pcio_record_rows_t;
+
+    /// A recording being read
+    typedef struct {
+        int fd;
+        pcio_record_header_t hdr;
+        pcio_record_index_t *index;
+        size_t blocks;
+        int indexed;                //< the file has its index, it was closed properly
+        uint64_t dropped;           //< rows lost while recording, if indexed
+        uint64_t size;              //< of the file
+        uint8_t *buf;
+        size_t cap_buf;
+        int64_t *q;
+        pcio_record_rows_t rows;    //< the block last read
+    } pcio_record_reader_t;
+
+    /** Open recording path. The index is rebuilt from the block headers
+        if the recording was not closed.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_record_open( pcio_record_reader_t *r, const char *path );
+
+    /** Close the recording */
+    void pcio_record_reader_close( pcio_record_reader_t *r );
+
+    /** Index of the first block with rows at or after t_ns, or the
+        number of blocks if there is none. */
+    size_t pcio_record_find( const pcio_record_reader_t *r, uint64_t t_ns );
+
+    /** Decode block k.
+        \return its rows, valid until the next call, or NULL with errno set
+    */
+    const pcio_record_rows_t *pcio_record_read( pcio_record_reader_t *r, size_t k );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
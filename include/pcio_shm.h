@@ -0,0 +1,122 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef PCIO_SHM_H
+#define PCIO_SHM_H
+#include <stdint.h>
+#include <stddef.h>
+/** \file pcio_shm.h
+ *
+ *  Seqlock protected POSIX shared memory mirror of the latest message
+ *  published by pcio-sns.
+ *
+ *  There is exactly one writer per region, the thread that publishes
+ *  the state of a group. Readers on the same host never take a lock
+ *  and never block the writer: they copy the payload and retry if the
+ *  sequence number changed underneath them.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Magic number at the start of a region ("PCSH")
+#define PCIO_SHM_MAGIC 0x48534350
+/// Layout version of a region
+#define PCIO_SHM_VERSION 1
+
+/// Returned by pcio_shm_read when nothing was published since last_seq
+#define PCIO_SHM_UNCHANGED 1
+
+    /// Header at the start of the shared region, the payload follows at data_offset
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t size;        //< payload size in bytes
+        uint64_t data_offset; //< offset of the payload from the start of the region
+        uint64_t seq;         //< sequence number, odd while the writer is updating
+    } pcio_shm_header_t;
+
+    /// Handle on a mapped region
+    typedef struct {
+        int fd;
+        int writer;             //< created by this process
+        size_t map_size;
+        pcio_shm_header_t *hdr;
+        uint8_t *data;
+        char *name;
+    } pcio_shm_t;
+
+    /** Create (or replace) region name holding size bytes and map it for writing.
+        Other users may only read it.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_shm_create( pcio_shm_t *shm, const char *name, size_t size );
+
+    /** Map an existing region read-only.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_shm_open( pcio_shm_t *shm, const char *name );
+
+    /** Unmap the region, and unlink it if this process created it */
+    void pcio_shm_close( pcio_shm_t *shm );
+
+    /** Replace the payload. Only one thread may write a region. */
+    void pcio_shm_write( pcio_shm_t *shm, const void *buf, size_t size );
+
+    /** Copy the latest consistent payload into buf.
+
+        If last_seq is not NULL and nothing was written since *last_seq,
+        nothing is copied and PCIO_SHM_UNCHANGED is returned; otherwise
+        *last_seq is updated to the sequence number of the copy.
+
+        \return 0 on success, PCIO_SHM_UNCHANGED, or -1 with errno
+        EAGAIN if no consistent copy could be made within a bounded
+        number of attempts, or EINVAL if size is too small.
+    */
+    int pcio_shm_read( const pcio_shm_t *shm, void *buf, size_t size, uint64_t *last_seq );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
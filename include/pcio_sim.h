@@ -0,0 +1,176 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef PCIO_SIM_H
+#define PCIO_SIM_H
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pcio.h"
+/** \file pcio_sim.h
+ *
+ *  Simulated CAN busses of PowerCube modules, with fault injection.
+ *
+ *  The simulated modules answer the commands pcio.c sends: reset,
+ *  home, halt, get and set parameter and the motion commands. Each
+ *  frame takes its nominal time on a 1 Mbit/s bus, so transactions
+ *  last about as long as on the hardware.
+ *
+ *  Faults are drawn from a pseudo random generator per bus, seeded
+ *  from the simulation seed and the net number. For a given seed and
+ *  sequence of writes the same frames are hit, whatever the thread
+ *  timing.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Most busses in a simulation
+#define PCIO_SIM_BUS_MAX 8
+/// Replies a simulated bus can hold back
+#define PCIO_SIM_QUEUE_MAX 1024
+
+    /// Fault mix, probabilities are per frame
+    typedef struct {
+        double drop;         //< a request, or independently its reply, is lost
+        double delay;        //< a reply is held back by delay_ns
+        uint64_t delay_ns;
+        double duplicate;    //< a reply is sent twice
+        double error;        //< a motion command raises a tow error
+        double power_fault;  //< a motion command raises a power fault, which reset does not clear
+        double bus_off;      //< a write takes the bus off
+        uint64_t bus_off_ns; //< how long the bus stays off, 0 until it is reopened
+    } pcio_sim_faults_t;
+
+    /// Faults injected so far
+    typedef struct {
+        uint64_t drop;
+        uint64_t delay;
+        uint64_t duplicate;
+        uint64_t error;
+        uint64_t power_fault;
+        uint64_t bus_off;
+    } pcio_sim_count_t;
+
+    /// A simulated module
+    typedef struct {
+        int present;
+        uint32_t state;     //< long state word, pcio_state_t
+        uint32_t config;
+        float pos;
+        float vel;
+        float cur;
+        float min_pos;
+        float max_pos;
+        float max_acc;
+        uint64_t t_ns;      //< when pos was last integrated
+        uint64_t home_ns;   //< time a homing run takes, 0 for instant, too fast for a state word to show
+        uint64_t homed_ns;  //< when the running homing ends, 0 if not homing
+        float step_from;    //< position the running step started at
+        float step_to;      //< target of the running step
+        uint64_t step_t0_ns; //< when the running step started
+        uint64_t step_t1_ns; //< when it ends, 0 if no step is running
+        float next_pos;     //< target of the buffered step
+        uint16_t next_ms;   //< duration of the buffered step
+        int next;           //< a step is buffered
+    } pcio_sim_module_t;
+
+    /// A reply on its way to the host
+    typedef struct {
+        uint64_t due_ns;
+        CMSG msg;
+    } pcio_sim_reply_t;
+
+    /// A simulated bus
+    typedef struct {
+        int net;
+        int open;
+        uint64_t rng;
+        uint64_t busy_ns;    //< the bus is transmitting until then
+        uint64_t off_ns;     //< bus off until then; UINT64_MAX until reopened
+        pcio_sim_module_t module[32]; //< indexed by module id
+        size_t n_reply;
+        pcio_sim_reply_t reply[PCIO_SIM_QUEUE_MAX];
+        pthread_mutex_t mutex;
+    } pcio_sim_bus_t;
+
+    /// A simulation, used as the transport_cx of a group
+    typedef struct {
+        uint64_t seed;
+        pcio_sim_faults_t faults;
+        uint64_t turnaround_ns;  //< time a module takes to answer
+        uint64_t rx_timeout_ns;  //< read timeout, as given to canOpen
+        size_t bus_cnt;
+        pcio_sim_bus_t bus[PCIO_SIM_BUS_MAX];
+        pcio_sim_count_t count;
+    } pcio_sim_t;
+
+    /// Transport to the simulated busses
+    extern const pcio_transport_t pcio_transport_sim;
+
+    /** Start a fault free simulation without modules */
+    void pcio_sim_init( pcio_sim_t *s, uint64_t seed );
+
+    /** Release the simulation */
+    void pcio_sim_destroy( pcio_sim_t *s );
+
+    /** Add a homed module without errors.
+        \return the module, or NULL if there are too many busses
+    */
+    pcio_sim_module_t *pcio_sim_add_module( pcio_sim_t *s, int net, int id );
+
+    /** Add every module of g and point g at the simulation */
+    int pcio_sim_attach( pcio_sim_t *s, pcio_group_t *g );
+
+    /** The module id on net, or NULL */
+    pcio_sim_module_t *pcio_sim_module( pcio_sim_t *s, int net, int id );
+
+    /** Clear the power faults and errors of every module, as if powered off and on */
+    void pcio_sim_power_cycle( pcio_sim_t *s );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+#ifndef PCIO_SOCKETCAN_H
+#define PCIO_SOCKETCAN_H
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <linux/can.h>
+#include "pcio.h"
+#include "pcio_uring.h"
+/** \file pcio_socketcan.h
+ *
+ *  Transport over Linux SocketCAN interfaces.
+ *
+ *  Each bus is a nonblocking raw CAN socket, and all sockets of a
+ *  context share one epoll set. The wait of the transport sleeps on
+ *  that set, so a group collects the replies of all its busses in the
+ *  order they arrive instead of blocking on one bus after another.
+ *  Frames are moved with sendmmsg and recvmmsg, one system call per
+ *  burst.
+ *
+ *  The io_uring engine keeps a multishot receive armed on every
+ *  socket, so received frames collect in memory shared with the kernel
+ *  and are taken without a system call. Writes fill registered buffers
+ *  and are only queued; the flush at the end of a burst hands the
+ *  frames of all busses to the kernel in one io_uring_enter. A failed
+ *  write is reported by the next read or take of its bus.
+ *
+ *  The bitrate is a property of the interface and is set with ip link,
+ *  not by open.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Most busses a context can have open
+#define PCIO_SOCKETCAN_BUS_MAX 16
+/// Most ids a bus receives
+#define PCIO_SOCKETCAN_ID_MAX 32
+
+/// Frames a bus of the io_uring engine holds until they are taken
+#define PCIO_SOCKETCAN_URING_QUEUE 256
+/// Receive buffers of the io_uring engine, shared by all busses; a power of two
+#define PCIO_SOCKETCAN_URING_RX 256
+/// Frames the io_uring engine can have in flight
+#define PCIO_SOCKETCAN_URING_TX 256
+
+    /// A bus of the io_uring engine
+    typedef struct {
+        uint32_t gen;           //< sockets closed so far; completions of older ones are ignored
+        int armed;              //< the multishot receive is running
+        int result;             //< failure to report with the next read or take
+        size_t head, tail;      //< frames in q not taken yet
+        CMSG q[PCIO_SOCKETCAN_URING_QUEUE];
+    } pcio_socketcan_uring_bus_t;
+
+    /// A frame written by the io_uring engine
+    typedef struct {
+        int handle;
+        uint32_t gen;
+        uint64_t full_ns;       //< when the interface queue was first found full, 0 if not
+    } pcio_socketcan_uring_tx_t;
+
+    /// The io_uring engine of a context
+    typedef struct {
+        pcio_uring_t ring;
+        pthread_mutex_t mutex;
+        pthread_cond_t reaped;  //< broadcast after completions are sorted or the ring is left
+        int in_ring;            //< a thread sleeps in the ring, the others wait on reaped
+        int woken;              //< the thread in the ring has been sent a no-op to wake it
+        struct io_uring_buf_ring *rx_ring; //< receive buffers handed to the kernel
+        struct can_frame rx[PCIO_SOCKETCAN_URING_RX];
+        struct can_frame tx[PCIO_SOCKETCAN_URING_TX]; //< registered buffer of the writes
+        pcio_socketcan_uring_tx_t tx_slot[PCIO_SOCKETCAN_URING_TX];
+        uint16_t tx_free[PCIO_SOCKETCAN_URING_TX];
+        size_t n_tx_free;
+        struct io_uring_sqe *last; //< last queued write, linked to the next one of its bus
+        int last_handle;
+        uint64_t retries;       //< writes repeated because the interface queue was full
+        uint64_t overruns;      //< frames dropped because a bus queue was full
+        pcio_socketcan_uring_bus_t bus[PCIO_SOCKETCAN_BUS_MAX];
+    } pcio_socketcan_uring_t;
+
+    /// An open bus
+    typedef struct {
+        int fd;                 //< raw CAN socket, -1 if the slot is free
+        int net;
+        size_t n_id;
+        uint32_t id[PCIO_SOCKETCAN_ID_MAX]; //< ids passed by the receive filter
+    } pcio_socketcan_bus_t;
+
+    /// SocketCAN interfaces, used as the transport_cx of a group
+    typedef struct {
+        const char *ifname;     //< printf format of the interface name of a net, e.g. "can%d"
+        int timeout_ms;         //< read and write timeout
+        int epoll_fd;           //< readiness of all open busses
+        pcio_socketcan_bus_t bus[PCIO_SOCKETCAN_BUS_MAX]; //< indexed by handle
+        pthread_mutex_t mutex;  //< busses are opened from several threads
+        pcio_socketcan_uring_t *uring; //< io_uring engine, NULL for plain sockets
+    } pcio_socketcan_t;
+
+    /// Transport to the SocketCAN interfaces of a context
+    extern const pcio_transport_t pcio_transport_socketcan;
+
+    /// Transport to the SocketCAN interfaces of a context set up with pcio_socketcan_init_uring
+    extern const pcio_transport_t pcio_transport_socketcan_uring;
+
+    /** Start a context without open busses.
+        \param ifname printf format turning a net number into an interface name, NULL for "can%d"
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_socketcan_init( pcio_socketcan_t *s, const char *ifname );
+
+    /** Start a context whose frames go through io_uring.
+        \return 0 on success, -1 on failure with errno set, e.g. ENOSYS
+        if the kernel has no io_uring
+    */
+    int pcio_socketcan_init_uring( pcio_socketcan_t *s, const char *ifname );
+
+    /** Close every bus of the context */
+    void pcio_socketcan_destroy( pcio_socketcan_t *s );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
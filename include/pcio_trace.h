@@ -0,0 +1,208 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef PCIO_TRACE_H
+#define PCIO_TRACE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "pcio.h"
+/** \file pcio_trace.h
+ *
+ *  Capture of every CAN frame a group writes and reads, and a
+ *  transport that replays such a capture.
+ *
+ *  The capture is a fixed size file mapped into memory. Recording a
+ *  frame costs one atomic increment, one clock_gettime and a 48 byte
+ *  copy; it never calls into the kernel and never blocks, so it may
+ *  stay enabled in production. The first records are pinned so the
+ *  initialization of the group is always kept; after that the
+ *  remaining records form a ring holding the most recent traffic.
+ *
+ *  Frames of one pcio_group_do (or one init burst) share a
+ *  transaction id, so the replies of a cycle can be told apart from
+ *  those of the next.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Magic number at the start of a capture ("PCTR")
+#define PCIO_TRACE_MAGIC 0x52544350
+/// Layout version of a capture
+#define PCIO_TRACE_VERSION 1
+
+/// Default number of records in a capture (48 MB)
+#define PCIO_TRACE_DEFAULT_CAPACITY (1 << 20)
+/// Default number of records at the start that are never overwritten
+#define PCIO_TRACE_DEFAULT_PINNED 4096
+
+    /// Flags of a record
+    typedef enum {
+        PCIO_TRACE_TX = 0x1,  //< frame written by the host
+        PCIO_TRACE_RX = 0x2,  //< frame read by the host
+        PCIO_TRACE_ERR = 0x4, //< the call failed with result, no frame
+    } pcio_trace_flag_t;
+
+    /// Header of a capture file, the records follow at record_offset
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t capacity;      //< number of record slots
+        uint64_t pinned;        //< slots at the start that are written only once
+        uint64_t record_offset; //< offset of the first slot from the start of the file
+        uint64_t head;          //< number of records ever written
+        uint64_t t0_ns;         //< CLOCK_MONOTONIC when the capture was created
+        int64_t t0_realtime_ns; //< CLOCK_REALTIME at the same instant
+    } pcio_trace_header_t;
+
+    /// One captured frame
+    typedef struct {
+        uint64_t t_ns;   //< CLOCK_MONOTONIC after the call returned
+        uint64_t seq;    //< index of the record plus one, written last; 0 while incomplete
+        uint32_t txid;   //< transaction the frame belongs to
+        int32_t result;  //< NTCAN result of the call
+        int32_t id;      //< CAN id
+        int16_t net;     //< NTCAN net number
+        uint8_t flags;   //< pcio_trace_flag_t
+        uint8_t len;
+        uint8_t data[8];
+        uint8_t reserved[8];
+    } pcio_trace_record_t;
+
+    /// A mapped capture
+    typedef struct pcio_trace {
+        int fd;
+        int writer;              //< created by this process
+        size_t map_size;
+        pcio_trace_header_t *hdr;
+        pcio_trace_record_t *rec;
+    } pcio_trace_t;
+
+    /** Create capture file path with room for capacity records, the
+        first pinned of which are never overwritten.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_trace_create( pcio_trace_t *t, const char *path, size_t capacity, size_t pinned );
+
+    /** Map an existing capture read-only.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_trace_open( pcio_trace_t *t, const char *path );
+
+    /** Unmap the capture */
+    void pcio_trace_close( pcio_trace_t *t );
+
+    /** Record the outcome of one read or write call.
+
+        Each of the n frames in msg gets a record. If result is not
+        NTCAN_SUCCESS, a record flagged PCIO_TRACE_ERR follows. Safe to
+        call from several threads at once.
+    */
+    void pcio_trace_frames( pcio_trace_t *t, int net, int dir, uint32_t txid, int result,
+                            const CMSG *msg, int32_t n );
+
+    /** Number of records retained, at most the capacity */
+    uint64_t pcio_trace_count( const pcio_trace_t *t );
+
+    /** The k-th oldest retained record, or NULL if it was torn by a
+        writer that did not finish. The pinned records come first, then
+        the ring; a gap may separate the two. */
+    const pcio_trace_record_t *pcio_trace_get( const pcio_trace_t *t, uint64_t k );
+
+
+    /** Replay transport.
+
+        Writes are checked against the frames of the capture and reads
+        return the captured replies of the same net, in order. Set
+        transport to &pcio_transport_replay and transport_cx to a
+        pcio_replay_t to drive a group from a capture instead of the
+        hardware.
+
+        When a written frame differs from the next captured one, the
+        capture is searched forward for it and the frames in between
+        are skipped. If timed is set, each reply is held back by the
+        delay recorded between it and the frame written before it, so
+        the bus and module latencies of the capture are reproduced.
+    */
+    extern const pcio_transport_t pcio_transport_replay;
+
+    /// Most busses in a replayed capture
+#define PCIO_REPLAY_NET_MAX 16
+
+    /// Replay position on one net
+    typedef struct {
+        int net;
+        uint64_t cursor;        //< next record to consider
+        uint64_t last;          //< one past the last record of this net
+        uint64_t tx_ns;         //< capture time of the last frame written
+        struct timespec tx_now; //< replay time of the last frame written
+    } pcio_replay_net_t;
+
+    /// State of a replay
+    typedef struct {
+        pcio_trace_t trace;
+        int timed;            //< reproduce the captured reply delays
+        size_t net_cnt;
+        pcio_replay_net_t net[PCIO_REPLAY_NET_MAX];
+        uint64_t mismatch;    //< written frames not found in the capture
+        uint64_t skipped;     //< captured frames skipped to follow the writes
+    } pcio_replay_t;
+
+    /** Map capture path for replay.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_replay_open( pcio_replay_t *r, const char *path, int timed );
+
+    /** Unmap the capture */
+    void pcio_replay_close( pcio_replay_t *r );
+
+    /** Nonzero once every net has consumed its last captured frame */
+    int pcio_replay_done( const pcio_replay_t *r );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
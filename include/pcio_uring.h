@@ -0,0 +1,136 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+#ifndef PCIO_URING_H
+#define PCIO_URING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+/** \file pcio_uring.h
+ *
+ *  A minimal io_uring, driven through the system calls directly.
+ *
+ *  Submission entries are filled in place and handed to the kernel
+ *  together by pcio_uring_submit; completions are read from the
+ *  shared completion ring without entering the kernel. The caller
+ *  serializes access; only pcio_uring_wait may run concurrently with
+ *  the other functions.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// An io_uring and its mapped rings
+    typedef struct {
+        int fd;
+        uint32_t features;     //< IORING_FEAT_* of the kernel
+        void *sq_map;
+        size_t sq_map_len;
+        void *cq_map;          //< same as sq_map with IORING_FEAT_SINGLE_MMAP
+        size_t cq_map_len;
+        struct io_uring_sqe *sqes;
+        size_t sqes_len;
+        unsigned *sq_head;
+        unsigned *sq_tail;
+        unsigned *sq_array;
+        unsigned sq_mask;
+        unsigned sq_entries;
+        unsigned sq_local;     //< tail including the entries not submitted yet
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        struct io_uring_cqe *cqes;
+        unsigned cq_mask;
+        uint64_t enters;       //< io_uring_enter calls
+    } pcio_uring_t;
+
+    /** Set up a ring with room for entries submissions.
+        \return 0 on success, -1 on failure with errno set
+    */
+    int pcio_uring_init( pcio_uring_t *u, unsigned entries );
+
+    /** Tear down the ring; pending requests are cancelled by the kernel */
+    void pcio_uring_destroy( pcio_uring_t *u );
+
+    /** A cleared submission entry to fill in, or NULL if the queue is full */
+    struct io_uring_sqe *pcio_uring_sqe( pcio_uring_t *u );
+
+    /// Submission entries filled in but not submitted yet
+    static inline unsigned pcio_uring_queued( const pcio_uring_t *u ) {
+        return u->sq_local - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE );
+    }
+
+    /** Hand every queued entry to the kernel in one io_uring_enter.
+        \return 0 on success, -errno on failure
+    */
+    int pcio_uring_submit( pcio_uring_t *u );
+
+    /** Wait until a completion is pending or timeout_ms pass.
+        \return 0, -ETIME on timeout or another -errno
+    */
+    int pcio_uring_wait( pcio_uring_t *u, int timeout_ms );
+
+    /** The oldest pending completion, or NULL */
+    struct io_uring_cqe *pcio_uring_cqe( pcio_uring_t *u );
+
+    /** Release the completion returned by pcio_uring_cqe */
+    void pcio_uring_cqe_seen( pcio_uring_t *u );
+
+    /** Register buffers for IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED.
+        \return 0 on success, -errno on failure
+    */
+    int pcio_uring_register_buffers( pcio_uring_t *u, const struct iovec *iov, unsigned n );
+
+    /** Register a ring of entries buffers the kernel picks from for group bgid.
+        \return 0 on success, -errno on failure
+    */
+    int pcio_uring_register_buf_ring( pcio_uring_t *u, struct io_uring_buf_ring *br,
+                                      unsigned entries, uint16_t bgid );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
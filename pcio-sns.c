@@ -46,6 +46,12 @@
  */
 
 #include <argp.h>
+#include <pthread.h>
+#include <errno.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdarg.h>
 //#include <stdlib.h>
 //#include <stdio.h>
 //#include <string.h>
@@ -61,6 +67,16 @@
 //#include <sns/msg.h>
 
 #include "pcio.h"
+#include "pcio_shm.h"
+#include "pcio_trace.h"
+#include "pcio_socketcan.h"
+#include "pcio_msg.h"
+#include "pcio_estimate.h"
+#include "pcio_poll.h"
+#include "pcio_log.h"
+#include "pcio_plugin.h"
+#include "pcio_record.h"
+#include "pcio_flight.h"
 
 
 /* ******************************************************************************************** */
@@ -83,7 +99,126 @@ typedef struct pciod_arg_bus {
 	pciod_arg_mod_t *mod;
 } pciod_arg_bus_t;
 
+/// The rate of some joints of a group, a fraction of the cycle rate
+typedef struct pciod_arg_rate {
+	size_t first, last; // joint indices, inclusive
+	double hz;
+	struct pciod_arg_rate *next;
+} pciod_arg_rate_t;
+
+/// The structure for a group (one arm): its busses and channels
+typedef struct pciod_arg_group {
+	const char *name;
+	const char *cmd_chan;
+	const char *state_chan;
+	const char *shm; // shared memory mirror of the state channel, or NULL
+	const char *snapshot; // module snapshot file for warm attach, or NULL
+	const char *capture; // file to capture every CAN frame into, or NULL
+	const char *replay; // capture to replay instead of talking to the busses, or NULL
+	const char *socketcan; // SocketCAN interface name format, or NULL for ntcan
+	int uring; // move the SocketCAN frames through io_uring
+	const char *plugin; // controller shared object, with its argument after a colon, or NULL
+	const char *record; // file to record the state of the group into, or NULL
+	const char *flight; // prefix of the flight recorder dumps, or NULL
+	const char *status_chan; // channel for the recovery status, or NULL
+	const char *estimate_chan; // channel for the estimated state, or NULL
+	const char *telemetry_chan; // channel for the telemetry, or NULL
+	const char *sample_chan; // channel for the state with its sample times, or NULL
+	pciod_arg_rate_t *rate; // joints slower than the cycle, most recent first
+	pciod_arg_bus_t *bus;
+	struct pciod_arg_group *next;
+} pciod_arg_group_t;
+
+/// The clock shared by all group threads so that their cycles have a common phase
+typedef struct {
+	struct timespec epoch;  ///< CLOCK_MONOTONIC start of cycle 0
+	int64_t period_ns;      ///< cycle period
+} pciod_clock_t;
+
+/// Recovery of a group from failed CAN transactions. The step, the failure and the counters are
+/// kept in the status message itself.
+typedef struct {
+	int pending;                 ///< the action of the current step is still to be taken
+	int attempts;                ///< actions taken in the current step
+	struct timespec start;       ///< start of the recovery
+	struct timespec step_start;  ///< start of the current step
+	struct timespec next_poll;   ///< when a group that gave up looks at its modules again
+	struct timespec published;   ///< last publication of the status
+	uint32_t published_step;     ///< step at the last publication
+	int fresh;                   ///< the modules reported something new since the publication
+	int halted;                  ///< a halt was commanded; only a commanded reset lifts it
+	uint32_t halt_due;           ///< busses the commanded halt has yet to reach, bit i for bus i
+	struct pcio_msg_status *msg; ///< published on the status channel
+} pciod_recover_t;
+
+/// Performance of a group's cycles. The running totals are kept in the telemetry message itself,
+/// this holds what the cycle statistics of the next message are made of.
+typedef struct {
+	struct timespec published;        ///< last publication
+	uint64_t cycles;                  ///< cycles since the last publication
+	int64_t work_min, work_max, work_sum; ///< work of those cycles
+	uint64_t transactions;            ///< CAN transactions of those cycles
+	uint32_t transactions_max;
+	uint32_t txid;                    ///< transaction id at the start of the cycle
+	uint64_t ref_seq;                 ///< sequence number of the last reference read, 0 if none
+	uint64_t *bits;                   ///< bits on each bus at the last publication
+	struct pcio_msg_telemetry *msg;   ///< published on the telemetry channel
+} pciod_telemetry_t;
+
+/// Joints commanded and polled at a fraction of the cycle rate. A joint has its turn every
+/// divider cycles; the joints of a bus with the same divider take their turns at different
+/// phases, so that their frames spread over the cycles.
+typedef struct {
+	int slow;                    ///< some joint has a divider above 1
+	uint32_t *divider;           ///< cycles between the turns of each joint
+	uint32_t *phase;             ///< cycle of its turn within the divider
+	uint8_t *turn;               ///< joints whose turn it is in the current cycle
+	struct timespec *pos_t;      ///< when the position of each joint was last sampled, zero if never
+	struct timespec *vel_t;      ///< when its velocity was
+	struct pcio_msg_sample *msg; ///< published on the sample channel
+} pciod_rate_t;
+
+/// Suppression of the motion frames that repeat the last command of a module
+typedef struct {
+	int mode;               ///< motion id of the last command, 0 to send to every module
+	double *u;              ///< value last sent to each module
+	struct timespec *sent;  ///< when it was sent
+} pciod_delta_t;
+
+/// A controller loaded from a shared object, run in the cycle in place of the command channel
+typedef struct {
+	void *dl;                  ///< dlopen handle
+	const pcio_plugin_t *api;  ///< entry points, NULL without a plugin
+	void *cx;                  ///< context of the plugin
+	uint64_t seq;              ///< references it produced
+} pciod_plugin_t;
+
+/// Most flight recorder dumps a group writes in a run
+#define PCIOD_FLIGHT_DUMPS_MAX 100
+
+/// The last cycles of a group, written out when a fault, a halt or a signal calls for it. The
+/// cycle copies the ring and a writer thread writes the copy out, so the cycle never waits on the
+/// disk; only the fatal signal handler writes the ring itself.
+typedef struct {
+	pcio_flight_t ring;
+	char reason[96];           ///< why a dump is due at the end of the cycle, empty if none is
+	unsigned dumps;            ///< dumps handed to the writer
+	char *crash_path;          ///< dump written by the fatal signal handler
+	pcio_flight_t copy;        ///< the ring as it was when the dump being written was due
+	char copy_reason[96];      ///< why that dump was due
+	char *copy_path;           ///< where it goes
+	int busy;                  ///< the writer has the copy
+	int stop;                  ///< the writer ends once the copy is written
+	pthread_t writer;
+	pthread_mutex_t lock;      ///< guards busy and stop
+	pthread_cond_t cond;       ///< signals the writer
+} pciod_flight_t;
+
 /* ******************************************************************************************** */
+/// Acceleration and velocity of the ramps to commanded positions
+#define PCIOD_RAMP_ACC 0.5
+#define PCIOD_RAMP_VEL 4.0
+
 /// Default command channel name
 #define PCIOD_CMD_CHANNEL_NAME "pciod-cmd"
 
@@ -93,9 +228,33 @@ typedef struct pciod_arg_bus {
 typedef struct {
     // somatic_d_t d;
     // somatic_d_opts_t d_opts;
+    pciod_arg_group_t *arg; // command line description of this group
+    pthread_t thread; // I/O thread of this group
+    struct timespec tick; // start of the current cycle on the shared clock
     size_t n; // module count
     ach_channel_t cmd_chan;
     ach_channel_t state_chan;
+    ach_channel_t status_chan; // recovery status, if requested
+    pciod_recover_t recover;
+    ach_channel_t telemetry_chan; // telemetry, if requested
+    pciod_telemetry_t telemetry;
+    pcio_poll_t poll; // fields read every cycle
+    pciod_delta_t delta; // repeated motion commands, if suppressed
+    pciod_rate_t rate; // turns of the joints and when they were sampled
+    ach_channel_t sample_chan; // state with its sample times, if requested
+    ach_channel_t estimate_chan; // estimated state, if requested
+    pthread_t estimate_thread; // publisher of the predicted samples
+    pthread_mutex_t estimate_lock; // guards estimate and estimate_seq between the two threads
+    pcio_estimate_t estimate;
+    uint32_t estimate_seq; // sequence number of the last estimate sample
+    struct pcio_msg_estimate *estimate_msg; // measured samples, published by the I/O thread
+    pcio_shm_t state_shm; // seqlock mirror of the latest state, if requested
+    pcio_trace_t trace; // frame capture, if requested
+    pcio_replay_t replay; // replayed capture, if requested
+    pcio_socketcan_t socketcan; // SocketCAN interfaces, if requested
+    pciod_plugin_t plugin; // controller run in the cycle, if requested
+    pcio_record_t record; // state recording, if requested
+    pciod_flight_t flight; // flight recorder, if requested
     pcio_group_t group;
 		struct sns_msg_motor_state* state_msg;
 		struct sns_msg_motor_ref* ref_msg;
@@ -110,11 +269,9 @@ typedef struct {
 /* ******************************************************************************************** */
 // The input variables
 
-static const char *opt_cmd_chan = PCIOD_CMD_CHANNEL_NAME;
-static const char *opt_state_chan = PCIOD_STATE_CHANNEL_NAME;
 static double opt_frequency = 30; // refresh at 30 hz
 static int opt_full_cur = 0;
-static pciod_arg_bus_t *opt_bus = NULL;
+static pciod_arg_group_t *opt_group = NULL; // most recent group first
 static const char *opt_query = NULL;
 static const char *opt_set = NULL;
 static double opt_period_sec = 0.0; // derived from opt_frequency in init
@@ -123,6 +280,31 @@ static int opt_param_type = 0;
 static int opt_reset = 0;
 static int opt_list = 0;
 static int opt_home = 0;
+static size_t opt_capture_frames = PCIO_TRACE_DEFAULT_CAPACITY;
+static size_t opt_record_rows = PCIO_RECORD_DEFAULT_BLOCK_ROWS;
+static double opt_estimate_rate = 0; // estimate rate, 0 for four times opt_frequency
+static double opt_poll_share = 0.5; // share of the bus time a cycle may poll for
+static double opt_delta = -1; // tolerance of repeated motion commands, negative to send them all
+static double opt_keepalive = 2; // rate at which repeated motion commands are sent anyway
+static size_t opt_home_batch = 0; // modules of a bus homing at once, 0 for all
+static double opt_home_timeout = 60; // seconds homing may take
+static int opt_step = 0; // send position commands as step motions
+static double opt_flight_seconds = 10; // seconds the flight recorder keeps
+
+/// Fields polled by update_state, by decreasing priority. A rate of 0 polls every cycle, a
+/// negative one never.
+static struct {
+	const char *name;
+	int parm_id;
+	double rate;
+} opt_poll[] = {
+	{"pos", PCIO_ACT_FPOS, 0},
+	{"vel", PCIO_ACT_FVEL, 0},
+	{"error", PCIO_PARAM_ERROR, 5},
+	{"cur", PCIO_ACT_FPSEUDOCURRENT, 10},
+	{"voltage", PCIO_PARAM_BUSVOLTAGE, 1},
+	{"buscur", PCIO_PARAM_BUSCURRENT, 1},
+};
 
 static const char* opt_config_enable = NULL;
 static const char* opt_config_disable = NULL;
@@ -131,6 +313,31 @@ uint32_t opt_flag;
 #define ARG_KEY_DISABLE_FULL_CUR 302
 #define ARG_KEY_ENABLE_FULL_CUR 303
 #define ARG_KEY_PARAM_MAX_DELTA_POS 304
+#define ARG_KEY_SHM 305
+#define ARG_KEY_WARM_ATTACH 306
+#define ARG_KEY_CAPTURE 307
+#define ARG_KEY_CAPTURE_FRAMES 308
+#define ARG_KEY_REPLAY 309
+#define ARG_KEY_STATUS_CHAN 310
+#define ARG_KEY_ESTIMATE_CHAN 311
+#define ARG_KEY_ESTIMATE_RATE 312
+#define ARG_KEY_TELEMETRY_CHAN 313
+#define ARG_KEY_POLL 314
+#define ARG_KEY_POLL_SHARE 315
+#define ARG_KEY_DELTA 316
+#define ARG_KEY_KEEPALIVE 317
+#define ARG_KEY_HOME_BATCH 318
+#define ARG_KEY_HOME_TIMEOUT 319
+#define ARG_KEY_STEP 320
+#define ARG_KEY_RATE 321
+#define ARG_KEY_SAMPLE_CHAN 322
+#define ARG_KEY_SOCKETCAN 323
+#define ARG_KEY_URING 324
+#define ARG_KEY_PLUGIN 325
+#define ARG_KEY_RECORD 326
+#define ARG_KEY_RECORD_ROWS 327
+#define ARG_KEY_FLIGHT 328
+#define ARG_KEY_FLIGHT_SECONDS 329
 
 /* ******************************************************************************************** */
 /* Options Struct */
@@ -151,6 +358,56 @@ static struct argp_option options[] = {
 	{"bus", 'b', "CAN_bus", 0, "Define a CAN bus for a module"},
 	{"cmd-chan", 'c', "pcio_cmd_channel", 0, "ach channel to send powercube commands to"},
   {"state-chan", 's', "pcio_state_channel", 0, "ach channel to listen for commands on"},
+	{"shm", ARG_KEY_SHM, "name", 0, "Also mirror the state into POSIX shared memory 'name'"},
+	{"warm-attach", ARG_KEY_WARM_ATTACH, "file", 0,
+	 "Skip the module reset if the modules match the snapshot 'file' of the previous run"},
+	{"capture", ARG_KEY_CAPTURE, "file", 0, "Capture every CAN frame of the group into 'file'"},
+	{"capture-frames", ARG_KEY_CAPTURE_FRAMES, "count", 0,
+	 "Frames a capture holds before the oldest are overwritten (default 1048576)"},
+	{"record", ARG_KEY_RECORD, "file", 0,
+	 "Record the position, velocity, current and state word of every joint into 'file' each cycle"},
+	{"record-rows", ARG_KEY_RECORD_ROWS, "count", 0,
+	 "Rows of a recording compressed together, the granularity of seeking (default 512)"},
+	{"flight", ARG_KEY_FLIGHT, "prefix", 0,
+	 "Keep the last cycles of the group in memory, and write them to 'prefix'.<time>.<n> on a fault, a halt or shutdown"},
+	{"flight-seconds", ARG_KEY_FLIGHT_SECONDS, "seconds", 0,
+	 "Seconds of cycles the flight recorder keeps (default 10)"},
+	{"replay", ARG_KEY_REPLAY, "file", 0,
+	 "Replay the capture 'file' with its timing instead of using the CAN busses"},
+	{"socketcan", ARG_KEY_SOCKETCAN, "format", 0,
+	 "Use the SocketCAN interfaces named by printf 'format' of the bus number (e.g. can%d) instead of ntcan"},
+	{"uring", ARG_KEY_URING, NULL, 0,
+	 "With --socketcan, move the frames through io_uring, one system call per burst"},
+	{"plugin", ARG_KEY_PLUGIN, "file[:arg]", 0,
+	 "Run the controller of shared object 'file' in each cycle instead of reading the command channel"},
+	{"status-chan", ARG_KEY_STATUS_CHAN, "channel", 0,
+	 "ach channel to publish the communication recovery status of the group on"},
+	{"estimate-chan", ARG_KEY_ESTIMATE_CHAN, "channel", 0,
+	 "ach channel to publish the state of the group predicted between polls on"},
+	{"estimate-rate", ARG_KEY_ESTIMATE_RATE, "freq", 0,
+	 "rate of the predicted state, above the frequency (default four times the frequency)"},
+	{"telemetry-chan", ARG_KEY_TELEMETRY_CHAN, "channel", 0,
+	 "ach channel to publish the cycle and bus counters of the group on, once a second"},
+	{"poll", ARG_KEY_POLL, "field=rate", 0,
+	 "Poll field (pos, vel, error, cur, voltage, buscur) at rate hz, 0 for every cycle, off for never"},
+	{"poll-share", ARG_KEY_POLL_SHARE, "fraction", 0,
+	 "Share of the bus time of a cycle that polling may use (default 0.5)"},
+	{"delta", ARG_KEY_DELTA, "tolerance", 0,
+	 "Skip velocity and current frames of modules whose command changed by at most 'tolerance'"},
+	{"keepalive", ARG_KEY_KEEPALIVE, "freq", 0,
+	 "Rate at which skipped frames are sent anyway (default 2 hz)"},
+	{"home-batch", ARG_KEY_HOME_BATCH, "count", 0,
+	 "Modules of each bus that home at once with -H, to limit the current drawn (default all)"},
+	{"home-timeout", ARG_KEY_HOME_TIMEOUT, "seconds", 0,
+	 "Time homing may take before the daemon gives up (default 60)"},
+	{"step", ARG_KEY_STEP, NULL, 0,
+	 "Send position commands as step motions of one period, timed by the modules"},
+	{"rate", ARG_KEY_RATE, "joints=freq", 0,
+	 "Command and poll the joints (index or first-last) only at freq hz, below the frequency"},
+	{"sample-chan", ARG_KEY_SAMPLE_CHAN, "channel", 0,
+	 "ach channel to publish the state with the time each joint was sampled on"},
+	{"group", 'g', "name", 0,
+	 "Start a new group (arm); following -b/-m/-c/-s apply to it; no two groups may share a -c or -s"},
 	{"daemonize", 'd', NULL, 0, "fork off daemon process"},
 	{"ident", 'I', "IDENT", 0, "identifier for this daemon"},
 	{NULL, 0, NULL, 0, NULL}
@@ -159,7 +416,6 @@ static struct argp_option options[] = {
 /* ******************************************************************************************** */
 /// argp parsing function
 static int parse_opt(int key, char *arg, struct argp_state *state) {
-	pciod_t *cx = (pciod_t*)state->input;
 	double parsef() {
 		char *endptr = NULL;
 		double f = strtod( arg, &endptr );
@@ -180,17 +436,45 @@ static int parse_opt(int key, char *arg, struct argp_state *state) {
 	}
 	(void) state; // ignore unused parameter
 
+	// Start a new group; options given before the first -g go to an implicit group
+	pciod_arg_group_t *new_group(const char *name) {
+		pciod_arg_group_t *grp = AA_NEW0( pciod_arg_group_t );
+		grp->name = name;
+		grp->cmd_chan = PCIOD_CMD_CHANNEL_NAME;
+		grp->state_chan = PCIOD_STATE_CHANNEL_NAME;
+		grp->next = opt_group;
+		opt_group = grp;
+		return grp;
+	}
+	if( NULL == opt_group && ('b' == key || 'c' == key || 's' == key || ARG_KEY_SHM == key ||
+	                          ARG_KEY_WARM_ATTACH == key || ARG_KEY_CAPTURE == key ||
+	                          ARG_KEY_REPLAY == key || ARG_KEY_STATUS_CHAN == key ||
+	                          ARG_KEY_ESTIMATE_CHAN == key || ARG_KEY_TELEMETRY_CHAN == key ||
+	                          ARG_KEY_RATE == key || ARG_KEY_SAMPLE_CHAN == key ||
+	                          ARG_KEY_SOCKETCAN == key || ARG_KEY_URING == key ||
+	                          ARG_KEY_PLUGIN == key || ARG_KEY_RECORD == key ||
+	                          ARG_KEY_FLIGHT == key) )
+		new_group("default");
+
 	int r;
 	switch (key) {
 
+		// Start a new group with its own busses, channels and I/O thread
+		case 'g': {
+			new_group(strdup(arg));
+			SNS_LOG(LOG_INFO, "Arg group: %s\n", arg);
+		} break;
+
 		// Add a new module to the list, and set its CAN bus number and command index 
 		case 'm': {
-			aa_hard_assert(NULL != opt_bus, "Must specify bus before module\n");
+			aa_hard_assert(NULL != opt_group && NULL != opt_group->bus,
+			               "Must specify bus before module\n");
+			pciod_arg_bus_t *bus = opt_group->bus;
 			pciod_arg_mod_t *mod = AA_NEW0(pciod_arg_mod_t);
 			mod->id = parseu();
-			mod->next = opt_bus->mod;
-			opt_bus->mod = mod;
-			SNS_LOG(LOG_INFO, "Arg mod: %d on bus %d\n", mod->id, opt_bus->net);
+			mod->next = bus->mod;
+			bus->mod = mod;
+			SNS_LOG(LOG_INFO, "Arg mod: %d on bus %d\n", mod->id, bus->net);
 		} break;
 
 		// Parse the bus number
@@ -198,8 +482,8 @@ static int parse_opt(int key, char *arg, struct argp_state *state) {
 			pciod_arg_bus_t *bus = AA_NEW0( pciod_arg_bus_t );
 			bus->net = parseu();
 			SNS_LOG(LOG_INFO, "Arg bus: %d\n", bus->net);
-			bus->next = opt_bus;
-			opt_bus = bus;
+			bus->next = opt_group->bus;
+			opt_group->bus = bus;
 		}	break;
 
 		// Set the requested parameter value if it is not config or state (?)
@@ -239,20 +523,68 @@ static int parse_opt(int key, char *arg, struct argp_state *state) {
 		// Get the value for the given specified parameter before with 'S' and check its type
 		case 'x':	{
 			SNS_REQUIRE( NULL != opt_set, "value only valid for -S\n");
+			aa_hard_assert(NULL != opt_group && NULL != opt_group->bus && NULL != opt_group->bus->mod,
+			               "Must specify module before value\n");
+			pciod_arg_bus_t *bus = opt_group->bus;
 			if(AA_TYPE_DOUBLE == opt_param_type) {								
-				opt_bus->mod->d = parsef();
-				SNS_LOG(LOG_INFO, "param %d.%d: %f\n", opt_bus->net, opt_bus->mod->id, opt_bus->mod->d);
+				bus->mod->d = parsef();
+				SNS_LOG(LOG_INFO, "param %d.%d: %f\n", bus->net, bus->mod->id, bus->mod->d);
 			} 
 			else if (AA_TYPE_UINT32 == opt_param_type) {
-				opt_bus->mod->u32 = parseu();
-				SNS_LOG(LOG_INFO, "param %d.%d: %u\n",opt_bus->net, opt_bus->mod->id, opt_bus->mod->u32);
+				bus->mod->u32 = parseu();
+				SNS_LOG(LOG_INFO, "param %d.%d: %u\n",bus->net, bus->mod->id, bus->mod->u32);
 			} 
 			else SNS_REQUIRE( 0, "Unknown type: %d\n", opt_param_type );
 		} break;
 
 		// Set the rest of the flags to true or increment them
-		case 'c': opt_cmd_chan = strdup(arg); break;
-		case 's': opt_state_chan = strdup(arg); break;
+		case 'c': opt_group->cmd_chan = strdup(arg); break;
+		case 's': opt_group->state_chan = strdup(arg); break;
+		case ARG_KEY_SHM: opt_group->shm = strdup(arg); break;
+		case ARG_KEY_WARM_ATTACH: opt_group->snapshot = strdup(arg); break;
+		case ARG_KEY_CAPTURE: opt_group->capture = strdup(arg); break;
+		case ARG_KEY_REPLAY: opt_group->replay = strdup(arg); break;
+		case ARG_KEY_SOCKETCAN: opt_group->socketcan = strdup(arg); break;
+		case ARG_KEY_URING: opt_group->uring = 1; break;
+		case ARG_KEY_PLUGIN: opt_group->plugin = strdup(arg); break;
+		case ARG_KEY_RECORD: opt_group->record = strdup(arg); break;
+		case ARG_KEY_FLIGHT: opt_group->flight = strdup(arg); break;
+		case ARG_KEY_STATUS_CHAN: opt_group->status_chan = strdup(arg); break;
+		case ARG_KEY_ESTIMATE_CHAN: opt_group->estimate_chan = strdup(arg); break;
+		case ARG_KEY_ESTIMATE_RATE: opt_estimate_rate = parsef(); break;
+		case ARG_KEY_TELEMETRY_CHAN: opt_group->telemetry_chan = strdup(arg); break;
+		case ARG_KEY_SAMPLE_CHAN: opt_group->sample_chan = strdup(arg); break;
+		case ARG_KEY_RATE: {
+			pciod_arg_rate_t *rate = AA_NEW0(pciod_arg_rate_t);
+			char *end = NULL;
+			rate->first = rate->last = strtoul(arg, &end, 10);
+			if( '-' == *end ) rate->last = strtoul(end + 1, &end, 10);
+			SNS_REQUIRE( '=' == *end && rate->first <= rate->last, "Bad joint rate: %s\n", arg );
+			arg = end + 1;
+			rate->hz = parsef();
+			SNS_REQUIRE( rate->hz > 0, "Bad joint rate: %s\n", arg );
+			rate->next = opt_group->rate;
+			opt_group->rate = rate;
+		} break;
+		case ARG_KEY_POLL: {
+			char *eq = strchr(arg, '=');
+			size_t i = 0;
+			while( eq && i < sizeof(opt_poll)/sizeof(opt_poll[0]) &&
+			       (strlen(opt_poll[i].name) != (size_t)(eq - arg) ||
+			        strncmp(opt_poll[i].name, arg, (size_t)(eq - arg))) ) i++;
+			SNS_REQUIRE( eq && i < sizeof(opt_poll)/sizeof(opt_poll[0]), "Unknown poll field: %s\n", arg );
+			arg = eq + 1;
+			opt_poll[i].rate = strcmp(arg, "off") ? parsef() : -1;
+		} break;
+		case ARG_KEY_POLL_SHARE: opt_poll_share = parsef(); break;
+		case ARG_KEY_DELTA: opt_delta = parsef(); break;
+		case ARG_KEY_KEEPALIVE: opt_keepalive = parsef(); break;
+		case ARG_KEY_HOME_BATCH: opt_home_batch = parseu(); break;
+		case ARG_KEY_HOME_TIMEOUT: opt_home_timeout = parsef(); break;
+		case ARG_KEY_STEP: opt_step = 1; break;
+		case ARG_KEY_CAPTURE_FRAMES: opt_capture_frames = parseu(); break;
+		case ARG_KEY_RECORD_ROWS: opt_record_rows = parseu(); break;
+		case ARG_KEY_FLIGHT_SECONDS: opt_flight_seconds = parsef(); break;
 		case 'R': opt_reset = 1; break;
 		case 'L': opt_list = 1; break;
 		case 'H': opt_home = 1; break;
@@ -275,16 +607,98 @@ static char doc[] = "reads somatic messages and sends pcio motor commands";
 static struct argp argp = {options, parse_opt, NULL, doc, NULL, NULL, NULL };
 
 /* ******************************************************************************************** */
-int build_pcio_group(pcio_group_t *group);
+int build_pcio_group(pcio_group_t *group, pciod_arg_bus_t *arg_bus);
 int execute_and_update_state(pciod_t *cx);
-static void update_state(pciod_t *cx, double *pos_acks);
+static int update_state(pciod_t *cx, const double *pos_acks, const uint8_t *ack_mask);
+static int pciod_execute(pciod_t *cx, double *ack_vals, uint8_t *ack_mask, int *got_ack);
+static void pciod_estimate_command( pciod_t *cx, pcio_estimate_cmd_t cmd, const double *u );
+static void *pciod_flight_run( void *arg );
+
+/* ******************************************************************************************** */
+/// Writes the messages of the log ring through the sns log, from the log thread
+static void pciod_log_sink( int level, const char *line ) {
+	SNS_LOG(level, "%s\n", line);
+}
+
+/// Formats x as [x0::x1::...] into buf for the log, truncated to size
+static const char *pciod_log_vector( char *buf, size_t size, const double *x, size_t n ) {
+	size_t k = (size_t)snprintf(buf, size, "[");
+	for(size_t i = 0; i < n && k < size; i++)
+		k += (size_t)snprintf(buf + k, size - k, i ? "::%lf" : "%lf", x[i]);
+	if( k < size ) snprintf(buf + k, size - k, "]");
+	return buf;
+}
+
+/* ******************************************************************************************** */
+/// Refuses a group without busses or modules, such as the implicit one that options before the
+/// first -g start, and two groups that would share a command or state channel
+static void check_groups( const pciod_arg_group_t *groups ) {
+	for(const pciod_arg_group_t *grp = groups; grp; grp = grp->next) {
+		aa_hard_assert(NULL != grp->bus, "group %s has no busses, specify them with -b\n", grp->name);
+		for(const pciod_arg_bus_t *bus = grp->bus; bus; bus = bus->next)
+			aa_hard_assert(NULL != bus->mod, "group %s: bus %d has no modules, specify them with -m\n",
+			               grp->name, bus->net);
+	}
+	for(const pciod_arg_group_t *grp = groups; grp; grp = grp->next) {
+		for(const pciod_arg_group_t *o = grp->next; o; o = o->next) {
+			aa_hard_assert(0 != strcmp(grp->cmd_chan, o->cmd_chan),
+			               "groups %s and %s share the command channel %s, give one -c\n",
+			               o->name, grp->name, grp->cmd_chan);
+			aa_hard_assert(0 != strcmp(grp->state_chan, o->state_chan),
+			               "groups %s and %s share the state channel %s, give one -s\n",
+			               o->name, grp->name, grp->state_chan);
+		}
+	}
+}
 
 /* ******************************************************************************************** */
 /// Builds a pcio group and initializes it
 static void init_group( pciod_t *cx ) {
-	build_pcio_group(&cx->group);
-	int r = pcio_group_init( &cx->group );
+	build_pcio_group(&cx->group, cx->arg->bus);
+
+	// Talk to a recorded capture instead of the busses
+	if( cx->arg->replay ) {
+		int r = pcio_replay_open(&cx->replay, cx->arg->replay, 1);
+		aa_hard_assert(0 == r, "Couldn't open replay %s: %s\n", cx->arg->replay, strerror(errno));
+		cx->group.transport = &pcio_transport_replay;
+		cx->group.transport_cx = &cx->replay;
+	} else if( cx->arg->socketcan ) {
+		// All busses of the group share one epoll set, so replies are taken as they arrive
+		int r = cx->arg->uring ? pcio_socketcan_init_uring(&cx->socketcan, cx->arg->socketcan)
+		                       : pcio_socketcan_init(&cx->socketcan, cx->arg->socketcan);
+		aa_hard_assert(0 == r, "Couldn't set up SocketCAN: %s\n", strerror(errno));
+		cx->group.transport = cx->arg->uring ? &pcio_transport_socketcan_uring : &pcio_transport_socketcan;
+		cx->group.transport_cx = &cx->socketcan;
+	}
+
+	// Record every frame, starting with the initialization
+	if( cx->arg->capture ) {
+		int r = pcio_trace_create(&cx->trace, cx->arg->capture, opt_capture_frames,
+		                          AA_MIN(PCIO_TRACE_DEFAULT_PINNED, opt_capture_frames / 2));
+		aa_hard_assert(0 == r, "Couldn't create capture %s: %s\n", cx->arg->capture, strerror(errno));
+		cx->group.trace = &cx->trace;
+	}
+
+	int warm = 0;
+	int r = pcio_group_init_warm( &cx->group, cx->arg->snapshot, &warm );
 	aa_hard_assert(r == NTCAN_SUCCESS, "pcio group init failed: %s,%i\n", canResultString(r), r);
+	if( cx->arg->snapshot ) SNS_LOG(LOG_INFO, "group %s attached %s\n", cx->arg->name, warm ? "warm" : "cold");
+}
+
+/* ******************************************************************************************** */
+/// Homes the group and waits for every module to finish before the daemon goes on
+static void home_group( pciod_t *cx ) {
+	size_t n = pcio_group_size(&cx->group);
+	double elapsed[n];
+	int r = pcio_group_home_wait(&cx->group, opt_home_batch, opt_home_timeout, elapsed);
+	size_t k = 0;
+	for(size_t i = 0; i < cx->group.bus_cnt; i++)
+		for(size_t j = 0; j < cx->group.bus[i].module_cnt; j++, k++)
+			if( elapsed[k] >= 0 )
+				SNS_LOG(LOG_INFO, "group %s: bus %d module %d homed in %.2f s\n", cx->arg->name,
+				        cx->group.bus[i].net, cx->group.bus[i].module[j].id, elapsed[k]);
+	aa_hard_assert(r == NTCAN_SUCCESS, "group %s: homing failed: %s,%i\n",
+	               cx->arg->name, canResultString(r), r);
 }
 
 /* ******************************************************************************************** */
@@ -292,36 +706,261 @@ static void init_group( pciod_t *cx ) {
 void setupMessage (pciod_t* cx) {
 	cx->state_msg = sns_msg_motor_state_heap_alloc(cx->n);
   cx->ref_msg = sns_msg_motor_ref_heap_alloc (cx->n);
+
+	// The status tells which bus each module is on
+	cx->recover.msg = pcio_msg_status_heap_alloc(cx->n);
+	size_t k = 0;
+	for(size_t i = 0; i < cx->group.bus_cnt; i++)
+		for(size_t j = 0; j < cx->group.bus[i].module_cnt; j++)
+			cx->recover.msg->joint[k++].bus = (uint8_t)i;
+
+	// The telemetry keeps counting when it is not published
+	cx->telemetry.msg = pcio_msg_telemetry_heap_alloc((uint32_t)cx->group.bus_cnt);
+	cx->telemetry.bits = AA_NEW0_AR(uint64_t, cx->group.bus_cnt);
+	cx->telemetry.work_min = INT64_MAX;
+
+	// The last command of each module, to tell a repeated one
+	cx->delta.u = AA_NEW0_AR(double, cx->n);
+	cx->delta.sent = AA_NEW0_AR(struct timespec, cx->n);
+
+	// The estimate predicts with the acceleration limits of the modules, and position commands
+	// with the ramps they are sent with
+	if( cx->arg->estimate_chan ) {
+		cx->estimate_msg = pcio_msg_estimate_heap_alloc(cx->n);
+		int r = pcio_estimate_init(&cx->estimate, cx->n, cx->group.flat.max_acc,
+		                           PCIOD_RAMP_VEL, PCIOD_RAMP_ACC);
+		aa_hard_assert(0 == r && cx->estimate_msg, "Couldn't allocate the estimate\n");
+		pthread_mutex_init(&cx->estimate_lock, NULL);
+	}
 }
 
 /* ******************************************************************************************** */
-/// Initializes the daemon, channels and sets up the messages
-static void init( pciod_t *cx ) {
+/// The shared cycle clock: every group thread waits for the same ticks, epoch + k * period
+static pciod_clock_t pciod_clock;
+
+/// Starts the shared clock at the current time
+static void pciod_clock_start( double period_sec ) {
+	clock_gettime( CLOCK_MONOTONIC, &pciod_clock.epoch );
+	pciod_clock.period_ns = (int64_t)(period_sec * 1e9);
+}
+
+/// Returns the start of the cycle containing now, or of the one after it if next is set
+static struct timespec pciod_clock_tick( const struct timespec *now, int next ) {
+	int64_t elapsed = (int64_t)(now->tv_sec - pciod_clock.epoch.tv_sec) * 1000000000 +
+		(now->tv_nsec - pciod_clock.epoch.tv_nsec);
+	int64_t k = elapsed / pciod_clock.period_ns + (next ? 1 : 0);
+	int64_t ns = pciod_clock.epoch.tv_nsec + k * pciod_clock.period_ns;
+	struct timespec t;
+	t.tv_sec = pciod_clock.epoch.tv_sec + (time_t)(ns / 1000000000);
+	t.tv_nsec = (long)(ns % 1000000000);
+	return t;
+}
+
+/* ******************************************************************************************** */
+/// Gives each joint its divider of the cycle rate and the phase of its turns
+static void pciod_rate_init( pciod_t *cx ) {
+	pciod_rate_t *rt = &cx->rate;
+	rt->divider = AA_NEW0_AR(uint32_t, cx->n);
+	rt->phase = AA_NEW0_AR(uint32_t, cx->n);
+	rt->turn = AA_NEW0_AR(uint8_t, cx->n);
+	rt->pos_t = AA_NEW0_AR(struct timespec, cx->n);
+	rt->vel_t = AA_NEW0_AR(struct timespec, cx->n);
+	memset(rt->turn, 1, cx->n);
+
+	// The last --rate given for a joint wins
+	for( pciod_arg_rate_t *a = cx->arg->rate; a; a = a->next ) {
+		aa_hard_assert(a->last < cx->n, "group %s: no joint %lu for the rate\n",
+		               cx->arg->name, (unsigned long)a->last);
+		uint32_t d = (uint32_t)AA_MAX(1, lround(opt_frequency / a->hz));
+		for( size_t i = a->first; i <= a->last; i++ )
+			if( 0 == rt->divider[i] ) rt->divider[i] = d;
+	}
+
+	// Count off the joints of each bus that share a divider
+	const pcio_flat_t *f = &cx->group.flat;
+	for( size_t i = 0; i < cx->n; i++ ) {
+		if( 0 == rt->divider[i] ) rt->divider[i] = 1;
+		uint32_t rank = 0;
+		for( size_t j = 0; j < i; j++ )
+			rank += f->bus[j] == f->bus[i] && rt->divider[j] == rt->divider[i];
+		rt->phase[i] = rank % rt->divider[i];
+		if( rt->divider[i] > 1 ) {
+			rt->slow = 1;
+			SNS_LOG(LOG_INFO, "group %s: joint %lu every %u cycles (%.1f hz)\n", cx->arg->name,
+			        (unsigned long)i, rt->divider[i], opt_frequency / rt->divider[i]);
+		}
+	}
+
+	// Without setpos_ack, the ramps take the targets set here
+	if( rt->slow && !opt_step ) {
+		double acc[cx->n], vel[cx->n];
+		aa_fset(acc, PCIOD_RAMP_ACC, cx->n);
+		aa_fset(vel, PCIOD_RAMP_VEL, cx->n);
+		int r = pcio_group_setd(&cx->group, PCIO_TARGET_ACC, acc, cx->n);
+		if( NTCAN_SUCCESS == r ) r = pcio_group_setd(&cx->group, PCIO_TARGET_VEL, vel, cx->n);
+		aa_hard_assert(r == NTCAN_SUCCESS, "group %s: couldn't set the ramp targets: %s\n",
+		               cx->arg->name, canResultString(r));
+	}
+
+	if( cx->arg->sample_chan ) {
+		rt->msg = pcio_msg_sample_heap_alloc(cx->n);
+		aa_hard_assert(NULL != rt->msg, "Couldn't allocate the sample message\n");
+	}
+}
+
+/// Works out which joints have their turn in the cycle starting at cx->tick
+static void pciod_rate_turn( pciod_t *cx ) {
+	pciod_rate_t *rt = &cx->rate;
+	if( !rt->slow ) return;
+	int64_t k = ((int64_t)(cx->tick.tv_sec - pciod_clock.epoch.tv_sec) * 1000000000 +
+	             (cx->tick.tv_nsec - pciod_clock.epoch.tv_nsec)) / pciod_clock.period_ns;
+	for( size_t i = 0; i < cx->n; i++ )
+		rt->turn[i] = 0 == (k + rt->phase[i]) % rt->divider[i];
+}
+
+/// Publishes the state with the time each joint was sampled
+static void pciod_publish_sample( pciod_t *cx ) {
+	pciod_rate_t *rt = &cx->rate;
+	struct pcio_msg_sample *msg = rt->msg;
+	for( size_t i = 0; i < cx->n; i++ ) {
+		msg->joint[i].pos = cx->state_msg->X[i].pos;
+		msg->joint[i].vel = cx->state_msg->X[i].vel;
+		msg->joint[i].pos_ns = (int64_t)rt->pos_t[i].tv_sec * 1000000000 + rt->pos_t[i].tv_nsec;
+		msg->joint[i].vel_ns = (int64_t)rt->vel_t[i].tv_sec * 1000000000 + rt->vel_t[i].tv_nsec;
+		msg->joint[i].divider = rt->divider[i];
+	}
+	msg->header.seq = cx->state_msg->header.seq;
+	sns_msg_set_time( &msg->header, &cx->tick, 2*pciod_clock.period_ns );
+	ach_status_t r = ach_put( &cx->sample_chan, msg, pcio_msg_sample_size(msg) );
+	if( ACH_OK != r ) PCIO_LOG(LOG_WARNING, "sample: ach result: %s", ach_result_to_string(r));
+}
+
+/// Adds the state of the cycle, with the current and state word of the status, to the recording
+static void pciod_record( pciod_t *cx ) {
+	const struct pcio_msg_status_joint *joint = cx->recover.msg->joint;
+	double pos[cx->n], vel[cx->n], cur[cx->n];
+	uint32_t status[cx->n];
+	for( size_t i = 0; i < cx->n; i++ ) {
+		pos[i] = cx->state_msg->X[i].pos;
+		vel[i] = cx->state_msg->X[i].vel;
+		cur[i] = joint[i].current;
+		status[i] = joint[i].error;
+	}
+	pcio_record_put( &cx->record, (uint64_t)cx->tick.tv_sec * 1000000000 + (uint64_t)cx->tick.tv_nsec,
+	                 pos, vel, cur, status );
+}
+
+/// Asks for a flight recorder dump at the end of the cycle, unless one is already due
+static void pciod_flight_note( pciod_t *cx, const char *fmt, ... ) {
+	if( NULL == cx->arg->flight || cx->flight.reason[0] ) return;
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(cx->flight.reason, sizeof(cx->flight.reason), fmt, ap);
+	va_end(ap);
+}
+
+/* ******************************************************************************************** */
+/// Loads the controller plugin of the group and sets it up
+static void pciod_plugin_init( pciod_t *cx ) {
+	pciod_plugin_t *pl = &cx->plugin;
+	char path[strlen(cx->arg->plugin) + 1];
+	strcpy(path, cx->arg->plugin);
+	char *arg = strchr(path, ':');
+	if( arg ) *arg++ = '\0';
+
+	pl->dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	aa_hard_assert(NULL != pl->dl, "Couldn't load plugin %s: %s\n", path, dlerror());
+	pl->api = (const pcio_plugin_t*)dlsym(pl->dl, PCIO_PLUGIN_SYMBOL);
+	aa_hard_assert(NULL != pl->api, "Plugin %s has no %s\n", path, PCIO_PLUGIN_SYMBOL);
+	aa_hard_assert(PCIO_PLUGIN_ABI_VERSION == pl->api->abi_version && pl->api->init && pl->api->step,
+	               "Plugin %s was built for ABI %u, not %u\n", path, pl->api->abi_version,
+	               PCIO_PLUGIN_ABI_VERSION);
+	int r = pl->api->init(&pl->cx, arg, cx->n, opt_period_sec);
+	aa_hard_assert(0 == r, "Plugin %s failed to start: %d\n", path, r);
+	SNS_LOG(LOG_INFO, "group %s: controller %s runs in the cycle\n", cx->arg->name,
+	        pl->api->name ? pl->api->name : path);
+}
+
+static void pciod_plugin_destroy( pciod_t *cx ) {
+	pciod_plugin_t *pl = &cx->plugin;
+	if( pl->api && pl->api->destroy ) pl->api->destroy(pl->cx);
+	if( pl->dl ) dlclose(pl->dl);
+	memset(pl, 0, sizeof(*pl));
+}
 
-	// Initialize the daemon
-	sns_init();
+/* ******************************************************************************************** */
+/// Initializes the group, its channels and sets up the messages
+static void init( pciod_t *cx ) {
 
 	// Initialize the group and home it if necessary
 	init_group(cx);
-	if (opt_home) pcio_group_home(&cx->group);
+	if (opt_home) home_group(cx);
 
 	/// Initialize the state and command ach channels 
-	sns_chan_open (&cx->cmd_chan, opt_cmd_chan, NULL);
-	sns_chan_open (&cx->state_chan, opt_state_chan, NULL);
-
-	// Get the group size
+	sns_chan_open (&cx->cmd_chan, cx->arg->cmd_chan, NULL);
+	sns_chan_open (&cx->state_chan, cx->arg->state_chan, NULL);
+	if( cx->arg->status_chan ) sns_chan_open (&cx->status_chan, cx->arg->status_chan, NULL);
+	if( cx->arg->estimate_chan ) sns_chan_open (&cx->estimate_chan, cx->arg->estimate_chan, NULL);
+	if( cx->arg->telemetry_chan ) sns_chan_open (&cx->telemetry_chan, cx->arg->telemetry_chan, NULL);
+	if( cx->arg->sample_chan ) sns_chan_open (&cx->sample_chan, cx->arg->sample_chan, NULL);
+	clock_gettime( CLOCK_MONOTONIC, &cx->telemetry.published );
+
+	// Get the group size; recovery keeps the affected busses in a 32-bit mask
 	cx->n = pcio_group_size(&cx->group);
+	aa_hard_assert(cx->group.bus_cnt <= 32, "At most 32 busses per group\n");
 
 	/// Set up the message we will be sending to motors with position, velocity and current values
 	setupMessage(cx);
-	
-	// Set the frequency
-	opt_period_sec = 1.0 / opt_frequency;
+	pciod_rate_init(cx);
+
+	// Schedule the fields to poll within the bus time of a cycle, most important first
+	size_t budget = pcio_poll_budget(&cx->group, opt_period_sec, opt_poll_share);
+	pcio_poll_init(&cx->poll, cx->n, budget);
+	size_t n_poll = sizeof(opt_poll)/sizeof(opt_poll[0]);
+	for( size_t i = 0; i < n_poll; i++ )
+		if( opt_poll[i].rate >= 0 ) pcio_poll_add(&cx->poll, opt_poll[i].parm_id, opt_poll[i].rate, (int)(n_poll - i));
+	SNS_LOG(LOG_INFO, "group %s: polling %lu of %lu fields per cycle\n", cx->arg->name,
+	        (unsigned long)AA_MIN(budget, cx->poll.n_field), (unsigned long)cx->poll.n_field);
+
+	// Create the shared memory mirror of the state
+	cx->state_shm.fd = -1;
+	if( cx->arg->shm ) {
+		int r = pcio_shm_create(&cx->state_shm, cx->arg->shm, sns_msg_motor_state_size_n(cx->n));
+		aa_hard_assert(0 == r, "Couldn't create shared memory %s: %s\n", cx->arg->shm, strerror(errno));
+	}
+
+	// Start the recording; its writer thread takes the rows off the cycle
+	if( cx->arg->record ) {
+		int r = pcio_record_create(&cx->record, cx->arg->record, cx->arg->name, cx->n, opt_record_rows);
+		aa_hard_assert(0 == r, "Couldn't create recording %s: %s\n", cx->arg->record, strerror(errno));
+	}
+
+	// Keep the last cycles in memory for the post-mortem of a fault
+	if( cx->arg->flight ) {
+		size_t rows = (size_t)ceil(opt_flight_seconds / opt_period_sec) + 1;
+		int r = pcio_flight_init(&cx->flight.ring, cx->arg->name, cx->n, rows);
+		if( 0 == r ) r = pcio_flight_init(&cx->flight.copy, cx->arg->name, cx->n, rows);
+		aa_hard_assert(0 == r, "Couldn't set up the flight recorder: %s\n", strerror(errno));
+		cx->flight.crash_path = AA_NEW0_AR(char, strlen(cx->arg->flight) + sizeof(".crash"));
+		sprintf(cx->flight.crash_path, "%s.crash", cx->arg->flight);
+		cx->flight.copy_path = AA_NEW0_AR(char, strlen(cx->arg->flight) + 48);
+		pthread_mutex_init(&cx->flight.lock, NULL);
+		pthread_cond_init(&cx->flight.cond, NULL);
+		r = pthread_create(&cx->flight.writer, NULL, pciod_flight_run, cx);
+		aa_hard_assert(0 == r, "Couldn't start the flight recorder writer: %s\n", strerror(r));
+	}
 
 	// Set the current mode
 	SNS_LOG(LOG_INFO, "Full Current: %s\n", opt_full_cur ? "yes" : "no" );
 	int r = pcio_group_set_fullcur(&cx->group, opt_full_cur);
 	aa_hard_assert(r == NTCAN_SUCCESS, "Failed to set full current\n");
+
+	// The config word may have changed, keep the snapshot in sync for the next warm attach
+	if( cx->arg->snapshot && pcio_group_save_snapshot(&cx->group, cx->arg->snapshot) )
+		SNS_LOG(LOG_WARNING, "Couldn't write snapshot %s: %s\n", cx->arg->snapshot, strerror(errno));
+
+	// The controller starts once everything it may read is set up
+	if( cx->arg->plugin ) pciod_plugin_init(cx);
 }
 
 
@@ -329,18 +968,20 @@ static void init( pciod_t *cx ) {
  * @function 
  * @brief Set zero velocity command when message is expired
  */
-void zero_vel( pciod_t *_cx ) {
+int zero_vel( pciod_t *_cx ) {
    size_t n = _cx->n;
    double ack_vals[n];
    double u[n]; for( size_t i = 0; i < n; ++i ) { u[i] = 0; }
    int got_ack = 0;
-   int r;
+   int r = NTCAN_SUCCESS;
    pcio_group_t *g = &_cx->group;
 
    
    // If velocity is already in zero, leave it, otherwise send the command
    // (no need to constantly send messages if you can avoid it)
+   // A halted group has nothing to stop, and its modules would not take the command
    int doHalt = 0;
+   if( _cx->recover.halted ) return r;
    for( size_t i = 0; i < n; ++i ) {
      if( _cx->state_msg->X[i].vel != 0 ) { doHalt = 1; break; }
    }
@@ -351,49 +992,740 @@ void zero_vel( pciod_t *_cx ) {
   // printf(" Actually halting - n: %d \n", n);
    r = pcio_group_cmd_ack( g, ack_vals, n, PCIO_FVEL_ACK, u );
     got_ack = 1;
-    if( sns_cx.verbosity >= 3 ) { fprintf( stdout, "Setting motor to halt (vel zero) :["); }
-    if( r != NTCAN_SUCCESS  ) { pcio_group_dump_error(g); }
+    _cx->telemetry.msg->zero_vels++;
+    _cx->delta.mode = 0;
+    if( r == NTCAN_SUCCESS ) pciod_estimate_command( _cx, PCIO_ESTIMATE_STOP, NULL );
+    PCIO_LOG(LOG_DEBUG, "Setting motor to halt (vel zero)");
   }
+  return r;
+}
+
+
+/* ******************************************************************************************** */
+// Recovery from failed CAN transactions. A failure is classified and the cheapest step that can
+// fix it is taken, one action per cycle; the cycle after the action tells whether it worked.
+// A step that runs out of attempts or time gives way to the next one, up to giving up.
+
+/// Budget of each recovery step before escalating to the next one
+static const struct {
+	const char *name;
+	int attempts;         ///< actions taken before escalating
+	int64_t deadline_ns;  ///< time in the step before escalating
+} pciod_recover_budget[PCIO_RECOVER_STEP_CNT] = {
+	[PCIO_RECOVER_NONE]   = { "none",   0, 0 },
+	[PCIO_RECOVER_RETRY]  = { "retry",  2, 100000000 },
+	[PCIO_RECOVER_REBIND] = { "rebind", 1, 200000000 },
+	[PCIO_RECOVER_RESET]  = { "reset",  2, 500000000 },
+	[PCIO_RECOVER_REOPEN] = { "reopen", 3, 2000000000 },
+	[PCIO_RECOVER_FAULT]  = { "fault",  0, 0 },
+};
+
+/// How often a group that gave up looks at its modules again
+#define PCIOD_FAULT_POLL_NS 1000000000
+/// How often the status is published while nothing changes
+#define PCIOD_STATUS_PERIOD_NS 1000000000
+
+/// Nanoseconds from a to b
+static int64_t pciod_ns( const struct timespec *a, const struct timespec *b ) {
+	return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000 + (b->tv_nsec - a->tv_nsec);
+}
+
+/// Class of failure r, as returned by the pcio functions
+static pcio_fault_t pciod_classify( int r ) {
+	switch( r ) {
+	case 1: // pcio_group_cmd_ack found a module in error
+	case PCIO_ERR_MODULE:
+		return PCIO_FAULT_MODULE;
+	case NTCAN_CONTR_OFF_BUS:
+	case NTCAN_CONTR_BUSY:
+	case NTCAN_TX_ERROR:
+	case NTCAN_INVALID_HANDLE:
+	case NTCAN_NET_NOT_FOUND:
+	case NTCAN_INVALID_HARDWARE:
+	case NTCAN_INVALID_DRIVER:
+		return PCIO_FAULT_BUS_OFF;
+	default:
+		return PCIO_FAULT_TIMEOUT;
+	}
+}
+
+/// Cheapest step that may recover from failure r of class fault
+static pcio_recover_step_t pciod_first_step( pcio_fault_t fault, int r ) {
+	switch( fault ) {
+	case PCIO_FAULT_MODULE: return PCIO_RECOVER_RESET;
+	case PCIO_FAULT_BUS_OFF: return PCIO_RECOVER_REOPEN;
+	case PCIO_FAULT_POWER: return PCIO_RECOVER_FAULT;
+	default:
+		// the driver no longer passes the acks on
+		if( NTCAN_NO_ID_ENABLED == r || NTCAN_ID_NOT_ENABLED == r ) return PCIO_RECOVER_REBIND;
+		return PCIO_RECOVER_RETRY;
+	}
+}
+
+/// Busses with a failure since the last call, bit i for bus i; all of them if none is known
+static uint32_t pciod_failed_busses( pcio_group_t *g, pcio_fault_t fault ) {
+	uint32_t mask = 0;
+	for( size_t i = 0; i < g->bus_cnt; i++ ) {
+		if( NTCAN_SUCCESS != g->bus[i].result ) mask |= 1u << i;
+		g->bus[i].result = NTCAN_SUCCESS;
+	}
+	// pcio_group_cmd_ack halts the whole group on a module error
+	if( PCIO_FAULT_MODULE == fault || 0 == mask ) mask = (uint32_t)((1ull << g->bus_cnt) - 1);
+	return mask;
+}
+
+/// Move the recovery to step, its action is taken at the next cycle
+static void pciod_recover_enter( pciod_t *cx, pcio_recover_step_t step,
+                                 const struct timespec *now ) {
+	pciod_recover_t *rec = &cx->recover;
+	PCIO_LOG(LOG_WARNING, "group %s: recovery %s -> %s after %s", cx->arg->name,
+	        pciod_recover_budget[rec->msg->step].name, pciod_recover_budget[step].name,
+	        canResultString(rec->msg->result));
+	rec->msg->step = step;
+	rec->attempts = 0;
+	rec->step_start = *now;
+	rec->pending = 1;
+	if( PCIO_RECOVER_FAULT == step ) {
+		pciod_flight_note( cx, "recovery gave up after %s", canResultString(rec->msg->result) );
+		rec->msg->faults++;
+		rec->next_poll = *now;
+		rec->next_poll.tv_sec += PCIOD_FAULT_POLL_NS / 1000000000;
+	}
+}
+
+/// Note failure r of a cycle or of a recovery action: start a recovery or escalate it
+static void pciod_recover_fail( pciod_t *cx, int r ) {
+	pciod_recover_t *rec = &cx->recover;
+	struct pcio_msg_status *msg = rec->msg;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	pcio_fault_t fault = pciod_classify( r );
+	pcio_recover_step_t step = pciod_first_step( fault, r );
+	msg->result = r;
+	msg->bus_mask |= pciod_failed_busses( &cx->group, fault );
+
+	if( PCIO_RECOVER_NONE == msg->step ) {
+		msg->recoveries++;
+		msg->fault = fault;
+		rec->start = now;
+		pciod_flight_note( cx, "failure: %s", canResultString(r) );
+		pciod_recover_enter( cx, step, &now );
+		return;
+	}
+
+	// A group that gave up stays there until its modules answer again
+	if( PCIO_RECOVER_FAULT == msg->step ) return;
+	if( PCIO_FAULT_POWER != msg->fault ) msg->fault = fault;
+
+	// A worse failure jumps ahead, a spent step gives way to the next one
+	if( step <= (pcio_recover_step_t)msg->step &&
+	    ( rec->attempts >= pciod_recover_budget[msg->step].attempts ||
+	      pciod_ns( &rec->step_start, &now ) >= pciod_recover_budget[msg->step].deadline_ns ) )
+		step = (pcio_recover_step_t)(msg->step + 1);
+	if( step > (pcio_recover_step_t)msg->step ) pciod_recover_enter( cx, step, &now );
+	else rec->pending = 1;
+}
+
+/// Note a cycle that worked, which ends a recovery in progress
+static void pciod_recover_ok( pciod_t *cx ) {
+	struct pcio_msg_status *msg = cx->recover.msg;
+	if( PCIO_RECOVER_NONE == msg->step ) return;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	int64_t ns = pciod_ns( &cx->recover.start, &now );
+	PCIO_LOG(LOG_NOTICE, "group %s: recovered by %s in %.1f ms", cx->arg->name,
+	        pciod_recover_budget[msg->step].name, (double)ns / 1e6);
+	msg->recovered++;
+	msg->last_ns = ns;
+	if( ns > msg->max_ns ) msg->max_ns = ns;
+	msg->elapsed_ns = 0;
+	msg->step = PCIO_RECOVER_NONE;
+	msg->fault = PCIO_FAULT_NONE;
+	msg->bus_mask = 0;
+	for( size_t i = 0; i < cx->group.bus_cnt; i++ ) cx->group.bus[i].result = NTCAN_SUCCESS;
+}
+
+/// Result r of a cycle
+static void pciod_recover_result( pciod_t *cx, int r ) {
+	if( NTCAN_SUCCESS == r ) pciod_recover_ok(cx);
+	else pciod_recover_fail(cx, r);
+}
+
+/// Read the state words of the affected busses and reset the modules in error, or all of them.
+/// A power fault is not reset, the recovery gives up instead. While a commanded halt holds, only
+/// the modules in error are reset.
+static int pciod_recover_reset( pciod_t *cx, int all ) {
+	pcio_group_t *g = &cx->group;
+	struct pcio_msg_status *msg = cx->recover.msg;
+	size_t k = 0;
+	for( size_t i = 0; i < g->bus_cnt; k += g->bus[i++].module_cnt ) {
+		if( ! (msg->bus_mask & (1u << i)) ) continue;
+		size_t m = g->bus[i].module_cnt;
+		uint32_t error[m];
+		int r = pcio_bus_get_error( g, i, error );
+		if( NTCAN_SUCCESS != r ) return r;
+
+		uint8_t reset[m];
+		size_t n_reset = 0;
+		for( size_t j = 0; j < m; j++ ) {
+			msg->joint[k+j].error = error[j];
+			if( error[j] & PCIO_STATE_POWERFAULT ) {
+				PCIO_LOG(LOG_ERR, "group %s: power fault on bus %d id %d", cx->arg->name,
+				        g->bus[i].net, g->bus[i].module[j].id);
+				msg->fault = PCIO_FAULT_POWER;
+			}
+			// A commanded halt is not the recovery's to lift, only the modules in error are
+			// reset and they are halted again after
+			if( cx->recover.halted ) reset[j] = !!(error[j] & PCIO_STATE_ERROR);
+			else reset[j] = all || (error[j] & (PCIO_STATE_ERROR | PCIO_STATE_HALTED)) ||
+				(g->flat.state[k+j] & PCIO_SHORT_NOT_OK);
+			n_reset += reset[j];
+		}
+		if( PCIO_FAULT_POWER == msg->fault ) return PCIO_ERR_MODULE;
+		if( n_reset ) {
+			r = pcio_bus_reset( g, i, reset );
+			if( NTCAN_SUCCESS != r ) return r;
+			if( cx->recover.halted ) cx->recover.halt_due |= 1u << i;
+		}
+	}
+	return NTCAN_SUCCESS;
+}
+
+/// Look at the modules of a group that gave up; once they all answer without a power fault,
+/// reset them.
+static void pciod_recover_poll( pciod_t *cx, const struct timespec *now ) {
+	pciod_recover_t *rec = &cx->recover;
+	if( pciod_ns( &rec->next_poll, now ) < 0 ) return;
+	rec->next_poll = *now;
+	rec->next_poll.tv_sec += PCIOD_FAULT_POLL_NS / 1000000000;
+	rec->msg->attempts[PCIO_RECOVER_FAULT]++;
+
+	pcio_group_t *g = &cx->group;
+	size_t k = 0;
+	for( size_t i = 0; i < g->bus_cnt; k += g->bus[i++].module_cnt ) {
+		if( ! (rec->msg->bus_mask & (1u << i)) ) continue;
+		if( PCIO_FAULT_POWER != rec->msg->fault && NTCAN_SUCCESS != pcio_bus_reopen( g, i ) ) return;
+		uint32_t error[g->bus[i].module_cnt];
+		if( NTCAN_SUCCESS != pcio_bus_get_error( g, i, error ) ) return;
+		for( size_t j = 0; j < g->bus[i].module_cnt; j++ ) {
+			rec->msg->joint[k+j].error = error[j];
+			if( error[j] & PCIO_STATE_POWERFAULT ) return;
+		}
+	}
+	rec->msg->fault = PCIO_FAULT_MODULE;
+	pciod_recover_enter( cx, PCIO_RECOVER_RESET, now );
+}
+
+/// Take the action of the current recovery step, if any. Returns whether the cycle may go on to
+/// talk to the modules; a group that gave up only passes a reset command on.
+static int pciod_recover_step( pciod_t *cx, int reset_commanded ) {
+	pciod_recover_t *rec = &cx->recover;
+	struct pcio_msg_status *msg = rec->msg;
+	if( PCIO_RECOVER_NONE == msg->step ) return 1;
+	pcio_group_t *g = &cx->group;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	msg->elapsed_ns = pciod_ns( &rec->start, &now );
+
+	if( PCIO_RECOVER_FAULT == msg->step ) {
+		pciod_recover_poll( cx, &now );
+		return reset_commanded;
+	}
+	if( ! rec->pending ) return 1;
+	rec->pending = 0;
+	rec->attempts++;
+	msg->attempts[msg->step]++;
+
+	// Late replies of the failed transaction must not pass for the next one's
+	int r = NTCAN_SUCCESS;
+	for( size_t i = 0; i < g->bus_cnt && NTCAN_SUCCESS == r; i++ ) {
+		if( ! (msg->bus_mask & (1u << i)) ) continue;
+		switch( msg->step ) {
+		case PCIO_RECOVER_REBIND: r = pcio_bus_rebind( g, i ); break;
+		case PCIO_RECOVER_REOPEN: r = pcio_bus_reopen( g, i ); break;
+		default: break;
+		}
+		if( NTCAN_SUCCESS == r && PCIO_RECOVER_REOPEN != msg->step ) r = pcio_bus_flush( g, i, NULL );
+	}
+	if( NTCAN_SUCCESS == r && PCIO_RECOVER_RESET <= msg->step )
+		r = pciod_recover_reset( cx, PCIO_RECOVER_REOPEN == msg->step );
+
+	if( PCIO_FAULT_POWER == msg->fault ) {
+		pciod_recover_enter( cx, PCIO_RECOVER_FAULT, &now );
+		return 0;
+	}
+	if( NTCAN_SUCCESS != r ) {
+		pciod_recover_fail( cx, r );
+		return 0;
+	}
+	return 1;
+}
+
+/// Latch a commanded halt. It is sent to every bus, and holds through any recovery until a reset
+/// is commanded.
+static void pciod_halt_latch( pciod_t *cx ) {
+	if( ! cx->recover.halted ) pciod_flight_note( cx, "halt commanded" );
+	cx->recover.halted = 1;
+	cx->recover.halt_due = (uint32_t)((1ull << cx->group.bus_cnt) - 1);
+}
+
+/// Send the latched halt to the busses it has yet to reach, each on its own so that a bus that
+/// does not answer keeps it from none of the others. Returns the first failure.
+static int pciod_halt_send( pciod_t *cx ) {
+	pciod_recover_t *rec = &cx->recover;
+	pcio_group_t *g = &cx->group;
+	int r = NTCAN_SUCCESS;
+	for( size_t i = 0; i < g->bus_cnt; i++ ) {
+		if( ! (rec->halt_due & (1u << i)) ) continue;
+		int s = pcio_bus_halt( g, i );
+		if( NTCAN_SUCCESS == s ) {
+			rec->halt_due &= ~(1u << i);
+			continue;
+		}
+		PCIO_LOG(LOG_ERR, "group %s: couldn't halt bus %d: %s", cx->arg->name, g->bus[i].net,
+		         canResultString(s));
+		if( NTCAN_SUCCESS == r ) r = s;
+	}
+	return r;
+}
+
+/// Take the recovery step due before the cycle, for the mode just read from the command channel,
+/// 0 if none was. Returns whether the cycle may go on to talk to the modules. A commanded halt is
+/// latched whatever the recovery does; when the cycle can't send it, it goes out here to the
+/// busses that still answer, and to the ones it missed at every cycle after.
+static int pciod_recover( pciod_t *cx, int mode ) {
+	int go = pciod_recover_step( cx, SNS_MOTOR_MODE_RESET == mode );
+	if( SNS_MOTOR_MODE_HALT == mode ) pciod_halt_latch( cx );
+	if( cx->recover.halt_due && !(go && SNS_MOTOR_MODE_HALT == mode) ) pciod_halt_send( cx );
+	return go;
+}
+
+/// Hands the flight recorder to the writer thread for the reason noted, at most
+/// PCIOD_FLIGHT_DUMPS_MAX times. A dump due while the writer is still busy with the last one is
+/// dropped rather than waited for.
+static void pciod_flight_dump( pciod_t *cx ) {
+	pciod_flight_t *fl = &cx->flight;
+	if( ! fl->reason[0] ) return;
+	if( fl->dumps >= PCIOD_FLIGHT_DUMPS_MAX ) {
+		PCIO_LOG(LOG_WARNING, "group %s: flight recorder not written after %s, %u dumps already",
+		         cx->arg->name, fl->reason, fl->dumps);
+	} else {
+		pthread_mutex_lock( &fl->lock );
+		int busy = fl->busy;
+		if( ! busy ) {
+			pcio_flight_copy( &fl->copy, &fl->ring );
+			strcpy( fl->copy_reason, fl->reason );
+			snprintf( fl->copy_path, strlen(cx->arg->flight) + 48, "%s.%ld.%u", cx->arg->flight,
+			          (long)time(NULL), fl->dumps++ );
+			fl->busy = 1;
+			pthread_cond_signal( &fl->cond );
+		}
+		pthread_mutex_unlock( &fl->lock );
+		if( busy ) PCIO_LOG(LOG_WARNING, "group %s: flight recorder not written after %s, "
+		                    "the last dump is still being written", cx->arg->name, fl->reason);
+	}
+	fl->reason[0] = '\0';
+}
+
+/// Writes flight recorder f out to path, noting reason
+static void pciod_flight_write( pciod_t *cx, pcio_flight_t *f, const char *path,
+                                const char *reason ) {
+	if( pcio_flight_dump(f, path, reason) )
+		PCIO_LOG(LOG_WARNING, "group %s: couldn't write flight recorder %s: %s", cx->arg->name,
+		         path, strerror(errno));
+	else
+		PCIO_LOG(LOG_NOTICE, "group %s: flight recorder written to %s after %s", cx->arg->name,
+		         path, reason);
+}
+
+/// Writes out the copies the cycle hands over, until stopped. This is the body of each group's
+/// flight recorder writer.
+static void *pciod_flight_run( void *arg ) {
+	pciod_t *cx = (pciod_t*)arg;
+	pciod_flight_t *fl = &cx->flight;
+	pthread_mutex_lock( &fl->lock );
+	for( ;; ) {
+		while( ! fl->busy && ! fl->stop ) pthread_cond_wait( &fl->cond, &fl->lock );
+		if( ! fl->busy ) break;
+		pthread_mutex_unlock( &fl->lock );
+		pciod_flight_write( cx, &fl->copy, fl->copy_path, fl->copy_reason );
+		pthread_mutex_lock( &fl->lock );
+		fl->busy = 0;
+	}
+	pthread_mutex_unlock( &fl->lock );
+	return NULL;
+}
+
+/// Adds the cycle whose work started at start to the flight recorder, and writes the recorder
+/// out if something during the cycle called for it
+static void pciod_flight_cycle( pciod_t *cx, const struct timespec *start ) {
+	pcio_flight_t *f = &cx->flight.ring;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	pcio_flight_row_t *row = pcio_flight_next( f );
+	row->t_ns = (uint64_t)cx->tick.tv_sec * 1000000000 + (uint64_t)cx->tick.tv_nsec;
+	row->work_ns = pciod_ns( start, &now );
+	row->ref_seq = cx->ref_msg->header.seq;
+	row->state_seq = cx->state_msg->header.seq;
+	row->ref_mode = (int32_t)cx->ref_msg->mode;
+	row->result = cx->recover.msg->result;
+	row->step = cx->recover.msg->step;
+	row->transactions = cx->group.txid - cx->telemetry.txid;
+	double *u = pcio_flight_u( row ), *pos = pcio_flight_pos( f, row ), *vel = pcio_flight_vel( f, row );
+	for( size_t i = 0; i < cx->n; i++ ) {
+		u[i] = cx->ref_msg->u[i];
+		pos[i] = cx->state_msg->X[i].pos;
+		vel[i] = cx->state_msg->X[i].vel;
+	}
+	memcpy( pcio_flight_state( f, row ), cx->group.flat.state, cx->n );
+	pcio_flight_commit( f );
+
+	pciod_flight_dump( cx );
+}
+
+/// Groups whose flight recorders the fatal signal handler writes out
+static pciod_t *pciod_flight_cxs;
+static size_t pciod_flight_n;
+
+/// Writes the flight recorders out when the daemon crashes, then dies of the signal
+static void pciod_flight_crash( int sig ) {
+	const char *reason = "fatal signal";
+	switch( sig ) {
+	case SIGSEGV: reason = "SIGSEGV"; break;
+	case SIGBUS: reason = "SIGBUS"; break;
+	case SIGFPE: reason = "SIGFPE"; break;
+	case SIGILL: reason = "SIGILL"; break;
+	case SIGABRT: reason = "SIGABRT"; break;
+	}
+	for( size_t i = 0; i < pciod_flight_n; i++ ) {
+		pciod_t *cx = &pciod_flight_cxs[i];
+		if( cx->arg->flight ) pcio_flight_dump( &cx->flight.ring, cx->flight.crash_path, reason );
+	}
+	raise( sig );
+}
+
+/// Has the flight recorders of the n groups of cxs written out on a crash
+static void pciod_flight_arm( pciod_t *cxs, size_t n ) {
+	pciod_flight_cxs = cxs;
+	pciod_flight_n = n;
+	struct sigaction sa;
+	memset( &sa, 0, sizeof(sa) );
+	sa.sa_handler = pciod_flight_crash;
+	sa.sa_flags = (int)SA_RESETHAND;
+	sigemptyset( &sa.sa_mask );
+	const int sigs[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+	for( size_t i = 0; i < sizeof(sigs)/sizeof(sigs[0]); i++ ) sigaction( sigs[i], &sa, NULL );
+}
+
+/// Publish the status every cycle while recovering, when the step changes and once a second
+static void pciod_publish_status( pciod_t *cx ) {
+	pciod_recover_t *rec = &cx->recover;
+	struct pcio_msg_status *msg = rec->msg;
+	if( NULL == cx->arg->status_chan ) return;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	if( PCIO_RECOVER_NONE == msg->step && rec->published_step == msg->step && !rec->fresh &&
+	    pciod_ns( &rec->published, &now ) < PCIOD_STATUS_PERIOD_NS )
+		return;
+	rec->published = now;
+	rec->published_step = msg->step;
+	rec->fresh = 0;
+
+	const pcio_flat_t *f = &cx->group.flat;
+	for( size_t k = 0; k < f->n; k++ ) {
+		msg->joint[k].state = f->state[k];
+		msg->joint[k].affected = (msg->bus_mask >> f->bus[k]) & 1;
+	}
+	msg->header.seq++;
+	sns_msg_set_time( &msg->header, &cx->tick, 2*PCIOD_STATUS_PERIOD_NS );
+	ach_status_t r = ach_put( &cx->status_chan, msg, pcio_msg_status_size(msg) );
+	if( ACH_OK != r ) PCIO_LOG(LOG_WARNING, "status: ach result: %s", ach_result_to_string(r));
+}
+
+/* ******************************************************************************************** */
+// Telemetry: how long the cycles take and what they cost on the busses, published once a second
+// so that the health of the daemons can be trended.
+
+/// Period of the telemetry
+#define PCIOD_TELEMETRY_PERIOD_NS 1000000000
+
+/// Counts a reference read from the command channel; references that were overwritten before
+/// we got to them show as a gap in the sequence numbers
+static void pciod_telemetry_ref( pciod_t *cx, uint64_t seq ) {
+	pciod_telemetry_t *tel = &cx->telemetry;
+	if( tel->ref_seq && seq > tel->ref_seq + 1 ) tel->msg->stale_refs += seq - tel->ref_seq - 1;
+	tel->ref_seq = seq;
+}
+
+/// Accounts for the cycle whose work started at start, which overran if it did not end by the
+/// next tick, and publishes the telemetry when it is due. Returns whether the cycle overran.
+static int pciod_telemetry_cycle( pciod_t *cx, const struct timespec *start ) {
+	pciod_telemetry_t *tel = &cx->telemetry;
+	struct pcio_msg_telemetry *msg = tel->msg;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	// The cycle
+	int64_t work = pciod_ns( start, &now );
+	uint32_t transactions = cx->group.txid - tel->txid;
+	msg->cycles++;
+	struct timespec deadline = pciod_clock_tick( start, 1 );
+	int overran = pciod_ns( &deadline, &now ) > 0;
+	if( overran ) msg->overruns++;
+	tel->cycles++;
+	tel->work_sum += work;
+	tel->work_min = AA_MIN( tel->work_min, work );
+	tel->work_max = AA_MAX( tel->work_max, work );
+	tel->transactions += transactions;
+	tel->transactions_max = AA_MAX( tel->transactions_max, transactions );
+
+	// Publish
+	int64_t elapsed = pciod_ns( &tel->published, &now );
+	if( NULL == cx->arg->telemetry_chan || elapsed < PCIOD_TELEMETRY_PERIOD_NS ) return overran;
+	tel->published = now;
+	msg->retries = 0;
+	for( int s = PCIO_RECOVER_RETRY; s < PCIO_RECOVER_FAULT; s++ )
+		msg->retries += cx->recover.msg->attempts[s];
+	msg->cycle_min_ns = tel->work_min;
+	msg->cycle_max_ns = tel->work_max;
+	msg->cycle_mean_ns = tel->work_sum / (int64_t)tel->cycles;
+	msg->transactions_mean = (float)tel->transactions / (float)tel->cycles;
+	msg->transactions_max = tel->transactions_max;
+	msg->polls_shed = 0;
+	for( size_t i = 0; i < cx->poll.n_field; i++ ) msg->polls_shed += cx->poll.field[i].shed;
+	msg->poll_limit = (uint32_t)cx->poll.limit;
+	for( size_t i = 0; i < cx->group.bus_cnt; i++ ) {
+		const pcio_bus_stats_t *st = &cx->group.bus[i].stats;
+		struct pcio_msg_telemetry_bus *b = &msg->bus[i];
+		b->frames_tx = st->frames_tx;
+		b->frames_rx = st->frames_rx;
+		b->timeouts = st->timeouts;
+		b->errors = st->errors;
+		b->stray = st->stray;
+		b->utilization = (float)((double)(st->bits - tel->bits[i]) * 1e9 /
+		                         ((double)elapsed * PCIO_BITRATE));
+		tel->bits[i] = st->bits;
+	}
+	msg->header.seq++;
+	sns_msg_set_time( &msg->header, &now, 2*PCIOD_TELEMETRY_PERIOD_NS );
+	ach_status_t r = ach_put( &cx->telemetry_chan, msg, pcio_msg_telemetry_size(msg) );
+	if( ACH_OK != r ) PCIO_LOG(LOG_WARNING, "telemetry: ach result: %s", ach_result_to_string(r));
+
+	tel->cycles = 0;
+	tel->work_sum = 0;
+	tel->work_min = INT64_MAX;
+	tel->work_max = 0;
+	tel->transactions = 0;
+	tel->transactions_max = 0;
+	return overran;
+}
+
+/* ******************************************************************************************** */
+// The estimate of the state between polls. The I/O thread corrects it with every measurement and
+// tells it every command it sends; the estimate thread of the group publishes predictions from it
+// at the estimate rate in between. Both publish on the estimate channel.
+
+/// Period of the predicted samples
+static int64_t pciod_estimate_period_ns;
+
+/// Predicts the state at time t into msg and publishes it. Called with the estimate locked, so
+/// that the samples of both threads go out in sequence.
+static void pciod_estimate_put( pciod_t *cx, struct pcio_msg_estimate *msg,
+                                const struct timespec *t, uint32_t flags ) {
+	pcio_estimate_joint_t x[cx->n];
+	int64_t age = pcio_estimate_predict(&cx->estimate, t, x);
+	if( age < 0 ) return;
+	for( size_t i = 0; i < cx->n; i++ ) {
+		msg->joint[i].pos = x[i].pos;
+		msg->joint[i].vel = x[i].vel;
+		msg->joint[i].pos_var = x[i].pos_var;
+		msg->joint[i].vel_var = x[i].vel_var;
+	}
+	msg->flags = flags;
+	msg->age_ns = age;
+	msg->measured = cx->estimate.seq;
+	msg->header.seq = ++cx->estimate_seq;
+	sns_msg_set_time( &msg->header, t, 2*pciod_estimate_period_ns );
+	ach_status_t r = ach_put( &cx->estimate_chan, msg, pcio_msg_estimate_size(msg) );
+	if( ACH_OK != r ) PCIO_LOG(LOG_WARNING, "estimate: ach result: %s", ach_result_to_string(r));
+}
+
+/// Corrects the estimate with the positions and velocities just read, either may be NULL, and
+/// publishes the measured sample. Only the joints with their mask set were read.
+static void pciod_estimate_measure( pciod_t *cx, const double *pos, const uint8_t *pos_mask,
+                                    const double *vel, const uint8_t *vel_mask ) {
+	if( NULL == cx->arg->estimate_chan || (NULL == pos && NULL == vel) ) return;
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	pthread_mutex_lock( &cx->estimate_lock );
+	pcio_estimate_measure( &cx->estimate, &now, pos, pos_mask, vel, vel_mask );
+	pciod_estimate_put( cx, cx->estimate_msg, &now, PCIO_MSG_ESTIMATE_MEASURED );
+	pthread_mutex_unlock( &cx->estimate_lock );
 }
 
+/// Tells the estimate the command just sent to the modules
+static void pciod_estimate_command( pciod_t *cx, pcio_estimate_cmd_t cmd, const double *u ) {
+	if( NULL == cx->arg->estimate_chan ) return;
+	pthread_mutex_lock( &cx->estimate_lock );
+	pcio_estimate_command( &cx->estimate, cmd, u );
+	pthread_mutex_unlock( &cx->estimate_lock );
+}
+
+/// Publishes the predicted state at the estimate rate until shutdown. This is the body of each
+/// group's estimate thread.
+static void *pciod_estimate_run( void *arg ) {
+	pciod_t *cx = (pciod_t*)arg;
+	struct pcio_msg_estimate *msg = pcio_msg_estimate_heap_alloc(cx->n);
+	aa_hard_assert(NULL != msg, "Couldn't allocate the estimate message\n");
+
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	while (!sns_cx.shutdown) {
+
+		// Wait for the next sample; after falling behind, skip the samples that were missed
+		struct timespec now;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		if( pciod_ns(&t, &now) > pciod_estimate_period_ns ) t = now;
+		int64_t ns = t.tv_nsec + pciod_estimate_period_ns;
+		t.tv_sec += (time_t)(ns / 1000000000);
+		t.tv_nsec = (long)(ns % 1000000000);
+		while( EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) );
+
+		pthread_mutex_lock( &cx->estimate_lock );
+		pciod_estimate_put( cx, msg, &t, 0 );
+		pthread_mutex_unlock( &cx->estimate_lock );
+	}
+	free(msg);
+	return NULL;
+}
+
+/* ******************************************************************************************** */
+/// One cycle of a group run by a controller plugin: at the tick the state is read, handed to the
+/// plugin and its reference sent at once. The command channel is only checked, without waiting,
+/// for a halt or a reset, which are sent whatever the read did; a halt keeps the plugin out until
+/// the next reset.
+static void pciod_plugin_update( pciod_t *cx ) {
+	pciod_plugin_t *pl = &cx->plugin;
+	struct timespec currTime;
+	clock_gettime( CLOCK_MONOTONIC, &currTime );
+	cx->tick = pciod_clock_tick(&currTime, 1);
+	while( EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &cx->tick, NULL) );
+	struct timespec workTime;
+	clock_gettime( CLOCK_MONOTONIC, &workTime );
+	cx->telemetry.txid = cx->group.txid;
+	pciod_rate_turn(cx);
+
+	size_t frame_size = 0;
+	ach_status_t r = ach_get(&cx->cmd_chan, cx->ref_msg, sns_msg_motor_ref_size_n(cx->n),
+	                         &frame_size, NULL, ACH_O_LAST);
+	int op = 0;
+	if( ACH_OK == r || ACH_MISSED_FRAME == r ) {
+		pciod_telemetry_ref(cx, cx->ref_msg->header.seq);
+		op = SNS_MOTOR_MODE_HALT == cx->ref_msg->mode || SNS_MOTOR_MODE_RESET == cx->ref_msg->mode;
+		if( !op ) PCIO_LOG(LOG_WARNING, "group %s: command ignored, the controller plugin has the group",
+		                   cx->arg->name);
+	}
+	else if( ACH_STALE_FRAMES != r )
+		PCIO_LOG(LOG_WARNING, "pciod-update: ach result: %s", ach_result_to_string(r));
+
+	// The plugin sees the status of the read it is given and is not stepped after a failed one.
+	// A halt is latched by pciod_recover, and sent by it when the cycle can't go on.
+	if( pciod_recover(cx, op ? cx->ref_msg->mode : 0) ) {
+		int s = update_state(cx, NULL, NULL);
+		pciod_recover_result(cx, s);
+		int k = op;
+		if( NTCAN_SUCCESS == s && !op && !cx->recover.halted ) {
+			cx->ref_msg->header.n = (uint32_t)cx->n;
+			k = pl->api->step(pl->cx, cx->state_msg, cx->recover.msg, cx->ref_msg);
+			if( k < 0 ) {
+				PCIO_LOG(LOG_ERR, "group %s: controller plugin halts: %d", cx->arg->name, k);
+				cx->ref_msg->mode = SNS_MOTOR_MODE_HALT;
+				k = 1;
+			}
+			else if( k > 0 && !(SNS_MOTOR_MODE_POS == cx->ref_msg->mode ||
+			                     SNS_MOTOR_MODE_VEL == cx->ref_msg->mode ||
+			                     SNS_MOTOR_MODE_CUR == cx->ref_msg->mode ||
+			                     SNS_MOTOR_MODE_HALT == cx->ref_msg->mode) ) {
+				PCIO_LOG(LOG_ERR, "group %s: controller plugin gave mode %d", cx->arg->name,
+				         cx->ref_msg->mode);
+				k = 0;
+			}
+			if( k > 0 ) cx->ref_msg->header.seq = ++pl->seq;
+		}
+		if( k > 0 ) {
+			double ack_vals[cx->n];
+			uint8_t ack_mask[cx->n];
+			int got_ack;
+			int e = pciod_execute(cx, ack_vals, ack_mask, &got_ack);
+			if( NTCAN_SUCCESS != e ) pciod_recover_fail(cx, e);
+		}
+	}
+
+	pciod_publish_status(cx);
+	if( cx->arg->flight ) pciod_flight_cycle(cx, &workTime);
+	pcio_poll_end(&cx->poll, pciod_telemetry_cycle(cx, &workTime));
+}
 
 /* ******************************************************************************************** */
 /// READ FROM COMMAND CHANNEL AND CALL EXECUTE IF MESSAGE EXISTS AND IS WELL-FORMED
 static void update( pciod_t *cx ) {
+	if( cx->plugin.api ) {
+		pciod_plugin_update(cx);
+		return;
+	}
 
-	// Compute the absolute time when receive should give up waiting. Note that we need to use 
-	// CLOCK_MONOTONIC because ach uses it and amino does not.
+	// Compute the absolute time when receive should give up waiting: the next tick of the clock
+	// shared by all groups. Note that we need to use CLOCK_MONOTONIC because ach uses it and
+	// amino does not.
 	struct timespec currTime;
 	clock_gettime( CLOCK_MONOTONIC, &currTime);
-	struct timespec abstime = aa_tm_add(aa_tm_sec2timespec(opt_period_sec), currTime);
+	struct timespec abstime = pciod_clock_tick(&currTime, 1);
 
 	// Read current reference from command channel
   const size_t expected_size = sns_msg_motor_ref_size_n(cx->n);
   size_t frame_size = 0;
   ach_status_t r = ach_get(&cx->cmd_chan, cx->ref_msg, expected_size,
                               &frame_size, &abstime, ACH_O_WAIT | ACH_O_LAST);
+	struct timespec workTime;
+	clock_gettime( CLOCK_MONOTONIC, &workTime );
+	cx->telemetry.txid = cx->group.txid;
 
 	// Check message reception
 	int good = (((ACH_OK == r || ACH_MISSED_FRAME == r) && cx->ref_msg) 
 						 || (ACH_TIMEOUT == r));
-	SNS_CHECK(good, LOG_WARNING, 0, "pciod-update: ach result: %s", canResultString(r));
+	if( !good ) PCIO_LOG(LOG_WARNING, "pciod-update: ach result: %s", canResultString(r));
+
+	if( (ACH_OK == r || ACH_MISSED_FRAME == r) && cx->ref_msg )
+		pciod_telemetry_ref(cx, cx->ref_msg->header.seq);
+
+	// A group that failed takes its next recovery step before talking to the modules again
+	int go = pciod_recover(cx, (ACH_OK == r || ACH_MISSED_FRAME == r) && cx->ref_msg ?
+	                       (int)cx->ref_msg->mode : 0);
 
 	// If the message has timed out, request an update
 	if (r == ACH_TIMEOUT) {
 
-     update_state(cx, NULL);
+     cx->tick = abstime;
+     pciod_rate_turn(cx);
+     if( go ) {
+       int s = update_state(cx, NULL, NULL);
 
   //*******************************
   // Check if message is expired in TIMEOUT CASE (Similar to how it is done in can402)
-    if( sns_msg_is_expired(&cx->ref_msg->header, &abstime ) ) {
-
-       // Only if previous message was velocity (i.e. not to interrupt position)
-       if( cx->ref_msg != NULL ) {
-         if( cx->ref_msg->mode == SNS_MOTOR_MODE_VEL ) {
-       		zero_vel(cx);
-         }
+      if( sns_msg_is_expired(&cx->ref_msg->header, &abstime ) ) {
+
+         // Only if previous message was velocity (i.e. not to interrupt position)
+         if( cx->ref_msg != NULL ) {
+           if( cx->ref_msg->mode == SNS_MOTOR_MODE_VEL ) {
+             int z = zero_vel(cx);
+             if( NTCAN_SUCCESS == s ) s = z;
+           }
+        }
       }
-    }
+       pciod_recover_result(cx, s);
+     }
   }
   //*******************************
 
@@ -416,17 +1748,81 @@ static void update( pciod_t *cx ) {
 		SNS_REQUIRE(goodParam, "invalid motor param, val: %d", cx->ref_msg->mode);
 		SNS_REQUIRE(goodValues, "wrong motor count: %d, wanted %d", cx->ref_msg->header.n, cx->n);
 
-		// Execute the command
-		execute_and_update_state(cx);
+		// Execute the command; its state is stamped with the start of the current cycle
+		cx->tick = pciod_clock_tick(&currTime, 0);
+		pciod_rate_turn(cx);
+		if( go ) pciod_recover_result(cx, execute_and_update_state(cx));
 	}
+
+	pciod_publish_status(cx);
+	if( cx->arg->flight ) pciod_flight_cycle(cx, &workTime);
+	// Shed polled fields while the cycles overrun
+	pcio_poll_end(&cx->poll, pciod_telemetry_cycle(cx, &workTime));
 }
 
 /* ******************************************************************************************** */
 static void destroy( pciod_t *cx) {
+	if( cx->arg->flight ) {
+		// The cycles are over, the last dump is written here once the writer is done
+		pciod_flight_t *fl = &cx->flight;
+		pthread_mutex_lock(&fl->lock);
+		fl->stop = 1;
+		pthread_cond_signal(&fl->cond);
+		pthread_mutex_unlock(&fl->lock);
+		pthread_join(fl->writer, NULL);
+		if( fl->dumps < PCIOD_FLIGHT_DUMPS_MAX ) {
+			snprintf(fl->copy_path, strlen(cx->arg->flight) + 48, "%s.%ld.%u", cx->arg->flight,
+			         (long)time(NULL), fl->dumps++);
+			pciod_flight_write(cx, &fl->ring, fl->copy_path, "shutdown");
+		}
+		pthread_cond_destroy(&fl->cond);
+		pthread_mutex_destroy(&fl->lock);
+		pcio_flight_destroy(&fl->ring);
+		pcio_flight_destroy(&fl->copy);
+		free(fl->crash_path);
+		free(fl->copy_path);
+	}
+	pciod_plugin_destroy(cx);
 	pcio_group_destroy(&cx->group); 
+	if( cx->arg->capture ) pcio_trace_close(&cx->trace);
+	if( cx->arg->replay ) {
+		SNS_LOG(LOG_INFO, "group %s replay: %lu frames not in capture, %lu skipped\n", cx->arg->name,
+		        (unsigned long)cx->replay.mismatch, (unsigned long)cx->replay.skipped);
+		pcio_replay_close(&cx->replay);
+	}
+	if( cx->arg->socketcan && ! cx->arg->replay ) pcio_socketcan_destroy(&cx->socketcan);
 	ach_close(&cx->cmd_chan);
 	ach_close(&cx->state_chan);
-	sns_end();
+	if( cx->arg->status_chan ) ach_close(&cx->status_chan);
+	if( cx->arg->telemetry_chan ) ach_close(&cx->telemetry_chan);
+	free(cx->telemetry.msg);
+	pcio_poll_destroy(&cx->poll);
+	free(cx->delta.u);
+	free(cx->delta.sent);
+	free(cx->telemetry.bits);
+	free(cx->rate.divider);
+	free(cx->rate.phase);
+	free(cx->rate.turn);
+	free(cx->rate.pos_t);
+	free(cx->rate.vel_t);
+	if( cx->arg->sample_chan ) {
+		ach_close(&cx->sample_chan);
+		free(cx->rate.msg);
+	}
+	if( cx->arg->estimate_chan ) {
+		ach_close(&cx->estimate_chan);
+		pcio_estimate_destroy(&cx->estimate);
+		pthread_mutex_destroy(&cx->estimate_lock);
+		free(cx->estimate_msg);
+	}
+	if( cx->arg->shm ) pcio_shm_close(&cx->state_shm);
+	if( cx->arg->record ) {
+		uint64_t dropped = cx->record.dropped;
+		int e = pcio_record_close(&cx->record);
+		if( e ) SNS_LOG(LOG_WARNING, "group %s recording: %s\n", cx->arg->name, strerror(e));
+		if( dropped ) SNS_LOG(LOG_WARNING, "group %s recording: %lu rows dropped\n", cx->arg->name,
+		                      (unsigned long)dropped);
+	}
 }
 
 /* ******************************************************************************************** */
@@ -488,7 +1884,7 @@ static void set( pciod_t *cx) {
 
 	// Fill the array backwards based on the parameter type: double or uint32
 	size_t k = n-1;
-	for(pciod_arg_bus_t *bus = opt_bus; bus; bus=bus->next) {
+	for(pciod_arg_bus_t *bus = cx->arg->bus; bus; bus=bus->next) {
 		for(pciod_arg_mod_t *mod = bus->mod; mod; mod=mod->next) {
 			assert(k < n);
 			if(AA_TYPE_DOUBLE == opt_param_type) {
@@ -558,18 +1954,23 @@ static void set_config( pciod_t *cx) {
 /* ******************************************************************************************** */
 /// Listens on the motor command channel, and issue a pcio command for  each incoming message. 
 /// When an acknowledgment is received from the module group, post it on the state channel.
-/// TODO: In addition, set a blocking timeout, and when it expires issue a state update request to 
-/// the modules and update the state channel
-static void run( pciod_t *cx) {
-
-	// Send a "running" notice on the event channel
-	sns_start();
+/// When no command arrives before the next tick of the shared clock, the state is polled and
+/// posted instead. This is the body of each group's I/O thread.
+static void *run( void *arg ) {
+	pciod_t *cx = (pciod_t*)arg;
 
 	// Keep updating
 	while (!sns_cx.shutdown) {
 		update(cx);
 		aa_mem_region_local_release();
+
+		// A replay stops the daemon when the capture runs out
+		if( cx->arg->replay && pcio_replay_done(&cx->replay) ) {
+			SNS_LOG(LOG_INFO, "group %s: end of replay\n", cx->arg->name);
+			sns_cx.shutdown = 1;
+		}
 	}
+	return NULL;
 }
 
 /* ******************************************************************************************** */
@@ -579,37 +1980,49 @@ int main(int argc, char *argv[]) {
 	// ========================================================================
 	// Initial setup
 
-	// Set the options for the daemon
-	static pciod_t cx;
-	memset(&cx,0,sizeof(cx));
-
 	// Parse the arguments
-	argp_parse(&argp, argc, argv, 0, NULL, &cx);
+	argp_parse(&argp, argc, argv, 0, NULL, NULL);
+	check_groups(opt_group);
+
+	// Create a context per group, in the order the groups were given
+	size_t n_cx = 0;
+	for(pciod_arg_group_t *grp = opt_group; grp; grp = grp->next) n_cx++;
+	pciod_t *cxs = AA_NEW0_AR( pciod_t, n_cx );
+	{
+		size_t i = n_cx;
+		for(pciod_arg_group_t *grp = opt_group; grp; grp = grp->next) cxs[--i].arg = grp;
+	}
 
 	// ========================================================================
-	// If any short actions requested, carry them out
+	// If any short actions requested, carry them out on every group
 
 	// Output the results of the query
 	if (opt_query ) {
 		SNS_LOG(LOG_INFO, "Querying %s\n", opt_query);
-		init_group(&cx);
-		query(&cx);
+		for(size_t i = 0; i < n_cx; i++) {
+			init_group(&cxs[i]);
+			query(&cxs[i]);
+		}
 	}
 
 	// Set the requested value
 	else if (opt_set) {
 		SNS_LOG(LOG_INFO, "Setting %s\n", opt_set);
-		init_group(&cx);
-		set(&cx);
+		for(size_t i = 0; i < n_cx; i++) {
+			init_group(&cxs[i]);
+			set(&cxs[i]);
+		}
 	}
 
 	// Reset all the modules
 	else if (opt_reset) {
 		SNS_LOG(LOG_INFO, "Resetting modules\n");
-		init_group(&cx);
-		int r = pcio_group_reset(&cx.group);
-		SNS_LOG(LOG_INFO, "Resetting status: %s (%d)\n",
-						   canResultString(r), r);
+		for(size_t i = 0; i < n_cx; i++) {
+			init_group(&cxs[i]);
+			int r = pcio_group_reset(&cxs[i].group);
+			SNS_LOG(LOG_INFO, "Resetting status %s: %s (%d)\n",
+			        cxs[i].arg->name, canResultString(r), r);
+		}
 
 	// List the state, config and parameter values
 	}else if ( opt_list ) {
@@ -624,8 +2037,10 @@ int main(int argc, char *argv[]) {
 	// Enable or disable the configuration
 	else if (opt_config_enable || opt_config_disable) {
 		SNS_LOG(LOG_INFO, "Setting configuration\n");
-		init_group(&cx);
-		set_config(&cx);
+		for(size_t i = 0; i < n_cx; i++) {
+			init_group(&cxs[i]);
+			set_config(&cxs[i]);
+		}
 	}
 
 	// ========================================================================
@@ -633,37 +2048,77 @@ int main(int argc, char *argv[]) {
 
 	else {
 
-		// Initialize the daemon resources
-		init(&cx);
-
-		// Print the frequency, state and command channels
+		// Initialize the daemon and the resources of each group
+		aa_hard_assert(n_cx > 0, "No groups given, specify busses with -b\n");
+		sns_init();
+		pcio_log_level = SNS_LOG_PRIORITY(LOG_DEBUG) || sns_cx.verbosity >= 3 ? LOG_DEBUG : LOG_INFO;
+		opt_period_sec = 1.0 / opt_frequency;
+		for(size_t i = 0; i < n_cx; i++) {
+			init(&cxs[i]);
+
+			// Print the state and command channels
+			SNS_LOG(LOG_INFO, "group %s: state chan: %s, cmd chan: %s\n",
+			        cxs[i].arg->name, cxs[i].arg->state_chan, cxs[i].arg->cmd_chan);
+		}
 		SNS_LOG(LOG_INFO, "frequency: %f\n", opt_frequency);
-		SNS_LOG(LOG_INFO, "state chan: %s\n", opt_state_chan);
-		SNS_LOG(LOG_INFO, "cmd chan: %s\n", opt_cmd_chan);
+		if( 0 == opt_estimate_rate ) opt_estimate_rate = 4 * opt_frequency;
+		aa_hard_assert(opt_estimate_rate > opt_frequency, "Estimate rate must be above the frequency\n");
+		pciod_estimate_period_ns = (int64_t)(1e9 / opt_estimate_rate);
+
+		// Write the flight recorders out if the daemon crashes
+		for(size_t i = 0; i < n_cx; i++) {
+			if( cxs[i].arg->flight ) {
+				pciod_flight_arm(cxs, n_cx);
+				break;
+			}
+		}
 
-		// Continuously update to get command message and output state 
-		run(&cx);
+		// Keep the log writes out of the group threads from here on
+		int r = pcio_log_start(pciod_log_sink);
+		aa_hard_assert(0 == r, "Couldn't start the log thread: %s\n", strerror(r));
+
+		// Send a "running" notice on the event channel and start the shared clock
+		sns_start();
+		pciod_clock_start(opt_period_sec);
+
+		// Continuously update to get command message and output state, one thread per group
+		for(size_t i = 0; i < n_cx; i++) {
+			r = pthread_create(&cxs[i].thread, NULL, run, &cxs[i]);
+			aa_hard_assert(0 == r, "Couldn't start thread for group %s: %s\n",
+			               cxs[i].arg->name, strerror(r));
+			if( cxs[i].arg->estimate_chan ) {
+				r = pthread_create(&cxs[i].estimate_thread, NULL, pciod_estimate_run, &cxs[i]);
+				aa_hard_assert(0 == r, "Couldn't start estimate thread for group %s: %s\n",
+				               cxs[i].arg->name, strerror(r));
+			}
+		}
+		for(size_t i = 0; i < n_cx; i++) {
+			pthread_join(cxs[i].thread, NULL);
+			if( cxs[i].arg->estimate_chan ) pthread_join(cxs[i].estimate_thread, NULL);
+		}
+		pcio_log_stop();
 
 		// Destroy the resources
-		destroy(&cx);
+		for(size_t i = 0; i < n_cx; i++) destroy(&cxs[i]);
+		sns_end();
 	}
 
+	free(cxs);
 	return 0;
 }
 
 /* ******************************************************************************************** */
-/// Fills out a pcio_group_t using information from arg parsing stored in n_busses, bus_count, 
-/// and pcio_id_map
-int build_pcio_group(pcio_group_t *g) {
+/// Fills out a pcio_group_t using the busses and modules of one group from arg parsing
+int build_pcio_group(pcio_group_t *g, pciod_arg_bus_t *arg_bus) {
 
 	// Create the busses
 	g->bus_cnt=0;
-	for(pciod_arg_bus_t *bus = opt_bus; bus; bus=bus->next) g->bus_cnt++;
+	for(pciod_arg_bus_t *bus = arg_bus; bus; bus=bus->next) g->bus_cnt++;
 	g->bus = AA_NEW0_AR( pcio_bus_t, g->bus_cnt );
 
 	// Allocate space for modules on each bus, while incrementing the module count for each bus
 	size_t i = g->bus_cnt - 1;
-	for(pciod_arg_bus_t *bus = opt_bus; bus; bus=bus->next) {
+	for(pciod_arg_bus_t *bus = arg_bus; bus; bus=bus->next) {
 
 		// Count the number of modules on this bus
 		g->bus[i].module_cnt = 0;
@@ -676,7 +2131,7 @@ int build_pcio_group(pcio_group_t *g) {
 
 	// Set the module information on the allocated spaces
 	i = g->bus_cnt - 1;
-	for(pciod_arg_bus_t *bus = opt_bus; bus; bus=bus->next ){
+	for(pciod_arg_bus_t *bus = arg_bus; bus; bus=bus->next ){
 
 		// Set the network address of the bus in the group and print if requested
 		g->bus[i].net = (int)bus->net;
@@ -696,162 +2151,330 @@ int build_pcio_group(pcio_group_t *g) {
 }
 
 /* ******************************************************************************************** */
-// Generate the pcio calls requested by the specified motor command message, and update the state 
-// with the module acknowledgments. Note: msg size should match group size.
-// HANDLE REF, SEND TO HARDWARE
-int execute_and_update_state(pciod_t *cx) {
+/// Sends the velocities or currents of the reference with motion id to the modules whose turn
+/// it is. mask[i] tells whether ack[i] holds a fresh position, and *got_ack whether any does.
+/// With --delta, a module whose value is within the tolerance of what it was last sent gets no
+/// frame, unless its keepalive is due.
+static int pciod_cmd_ack( pciod_t *cx, double *ack, int motion_id, uint8_t *mask, int *got_ack ) {
+	const double *u = cx->ref_msg->u;
+	pciod_delta_t *d = &cx->delta;
+	memcpy( mask, cx->rate.turn, cx->n );
+	*got_ack = 0;
+	if( opt_delta < 0 ) {
+		*got_ack = 1;
+		if( cx->rate.slow ) return pcio_group_cmd_ack_mask(&cx->group, ack, cx->n, motion_id, u, mask);
+		return pcio_group_cmd_ack(&cx->group, ack, cx->n, motion_id, u);
+	}
+
+	// Pick the modules whose command changed or is due again
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	int64_t keepalive = (int64_t)(1e9 / opt_keepalive);
+	size_t n_turn = 0, n_send = 0;
+	for( size_t i = 0; i < cx->n; i++ ) {
+		if( ! mask[i] ) continue;
+		n_turn++;
+		mask[i] = d->mode != motion_id || fabs(u[i] - d->u[i]) > opt_delta ||
+			pciod_ns(&d->sent[i], &now) >= keepalive;
+		n_send += mask[i];
+	}
+	cx->telemetry.msg->suppressed += n_turn - n_send;
+	if( 0 == n_send ) return NTCAN_SUCCESS;
+
+	// The positions of the modules left out come from the poll
+	int r = pcio_group_cmd_ack_mask(&cx->group, ack, cx->n, motion_id, u, mask);
+	if( NTCAN_SUCCESS != r ) return r;
+	for( size_t i = 0; i < cx->n; i++ ) {
+		if( ! mask[i] ) continue;
+		d->u[i] = u[i];
+		d->sent[i] = now;
+	}
+	d->mode = motion_id;
+	*got_ack = 1;
+	return r;
+}
+
+/* ******************************************************************************************** */
+/// Sends the command of ref_msg to the modules. ack_vals[i] receives the position acked by module
+/// i if ack_mask[i] is set and *got_ack is; both have room for cx->n modules.
+static int pciod_execute(pciod_t *cx, double *ack_vals, uint8_t *ack_mask, int *got_ack) {
 
 	// Switch on the command flag type and execute the command
-	double ack_vals[cx->ref_msg->header.n];
-	int got_ack = 0;
+	*got_ack = 0;
+	memset(ack_mask, 1, cx->n);
 	int r;
+	const char *what;
 	pcio_group_t *g = &cx->group;
+
+	// A commanded halt holds until a reset is commanded, motion is not sent meanwhile
+	if( cx->recover.halted && (SNS_MOTOR_MODE_POS == cx->ref_msg->mode ||
+	                           SNS_MOTOR_MODE_VEL == cx->ref_msg->mode ||
+	                           SNS_MOTOR_MODE_CUR == cx->ref_msg->mode) ) {
+		PCIO_LOG(LOG_WARNING, "group %s: command ignored, the group is halted until a reset",
+		         cx->arg->name);
+		cx->delta.mode = 0;
+		return NTCAN_SUCCESS;
+	}
+
 	switch (cx->ref_msg->mode) {
 
 		// Set the current values
 		case SNS_MOTOR_MODE_CUR: {
-			double data [cx->n];
-			r = pcio_group_cmd_ack(g, ack_vals, cx->ref_msg->header.n, PCIO_FCUR_ACK, cx->ref_msg->u);
-			if(sns_cx.verbosity >= 3) fprintf(stdout, "Setting motor currents: [");
-			got_ack = 1;
+			r = pciod_cmd_ack(cx, ack_vals, PCIO_FCUR_ACK, ack_mask, got_ack);
+			what = "Setting motor currents";
 		} break;
 
 		// Set the velocity values after limiting them using the expected time period (?)
 		case SNS_MOTOR_MODE_VEL: {
 			pcio_group_limit_velocity(g, cx->ref_msg->u, cx->ref_msg->header.n, opt_period_sec);
-			r = pcio_group_cmd_ack(g, ack_vals, cx->ref_msg->header.n, PCIO_FVEL_ACK, cx->ref_msg->u);
-			got_ack = 1;
-			if (sns_cx.verbosity >= 3) fprintf(stdout, "Setting motor velocities: [");
+			r = pciod_cmd_ack(cx, ack_vals, PCIO_FVEL_ACK, ack_mask, got_ack);
+			what = "Setting motor velocities";
 		} break;
 
 		// Set the motor positions after limiting them
 		case SNS_MOTOR_MODE_POS: {
 			pcio_group_limit_position( g, cx->ref_msg->u, cx->ref_msg->header.n);
-			r = pcio_group_setpos_ack( g, cx->ref_msg->u, cx->ref_msg->header.n, 0.5, 4.0, ack_vals);
-			got_ack = 1;
-			if (sns_cx.verbosity >= 3) fprintf(stdout, "Setting motor positions: [");
+			if( opt_step ) {
+				// Each position is a step until the next turn of the module, to the nearest ms
+				// so the module keeps pace with the host; a module whose buffer is full gets the
+				// newest position once it has room
+				uint16_t ms[cx->n];
+				for(size_t i = 0; i < cx->n; i++)
+					ms[i] = (uint16_t)AA_MAX(1, AA_MIN(UINT16_MAX,
+						lround(opt_period_sec * cx->rate.divider[i] * 1e3)));
+				memcpy(ack_mask, cx->rate.turn, cx->n);
+				r = pcio_group_step_ack( g, ack_vals, cx->ref_msg->header.n, cx->ref_msg->u, ms, ack_mask);
+			} else if( cx->rate.slow ) {
+				// Only the modules whose turn it is get a ramp, to the targets set at init
+				memcpy(ack_mask, cx->rate.turn, cx->n);
+				r = pcio_group_cmd_ack_mask( g, ack_vals, cx->n, PCIO_FRAMP, cx->ref_msg->u, ack_mask);
+			} else {
+				r = pcio_group_setpos_ack( g, cx->ref_msg->u, cx->ref_msg->header.n,
+				                           PCIOD_RAMP_ACC, PCIOD_RAMP_VEL, ack_vals);
+			}
+			*got_ack = 1;
+			what = "Setting motor positions";
 		} break;
 
 		// Send a halt message
 		case SNS_MOTOR_MODE_HALT: {
-			r = pcio_group_halt(g);
-			if (sns_cx.verbosity >= 3) fprintf(stdout, "Halting motor: [");
+			pciod_halt_latch(cx);
+			r = pciod_halt_send(cx);
+			what = "Halting motor";
 		} break;
 
 		// Send a reset message
 		case SNS_MOTOR_MODE_RESET: {
 			r = pcio_group_reset(g);
-			if (sns_cx.verbosity >= 3) fprintf(stdout, "Resetting motor: [");
+			if( NTCAN_SUCCESS == r ) {
+				cx->recover.halted = 0;
+				cx->recover.halt_due = 0;
+			}
+			what = "Resetting motor";
 		} break;
 
 		// Should not reach here - if does, set success to attempt to continue
 		default: {
 			SNS_REQUIRE(0, "invalid param: %d", cx->ref_msg->mode);
-			if (sns_cx.verbosity >= 3) fprintf(stdout, "default: [");
+			what = "default";
 			r = NTCAN_SUCCESS; 
 		} break;
 	}
 
 	// If there were not any errors, update the state; otherwise, give an error statement.
 	// NOTE: We reuse the position acknowledgement to save some work in updating
-	SNS_CHECK(r == NTCAN_SUCCESS, LOG_WARNING, 0, "execute_and_update_state: ntcan result: %s", 
+	if( NTCAN_SUCCESS != r ) PCIO_LOG(LOG_WARNING, "execute_and_update_state: ntcan result: %s",
 		canResultString(r));
-	if(r == NTCAN_SUCCESS) update_state(cx, got_ack ? ack_vals : NULL);
-	else pcio_group_dump_error(g);
+	if(r != NTCAN_SUCCESS || (SNS_MOTOR_MODE_VEL != cx->ref_msg->mode && SNS_MOTOR_MODE_CUR != cx->ref_msg->mode))
+		cx->delta.mode = 0;
+	if(r == NTCAN_SUCCESS) {
+
+		// The estimate predicts from what the modules were just told to do
+		switch (cx->ref_msg->mode) {
+			case SNS_MOTOR_MODE_VEL: pciod_estimate_command(cx, PCIO_ESTIMATE_VEL, cx->ref_msg->u); break;
+			case SNS_MOTOR_MODE_POS: pciod_estimate_command(cx, PCIO_ESTIMATE_POS, cx->ref_msg->u); break;
+			case SNS_MOTOR_MODE_HALT:
+			case SNS_MOTOR_MODE_RESET: pciod_estimate_command(cx, PCIO_ESTIMATE_STOP, NULL); break;
+			default: pciod_estimate_command(cx, PCIO_ESTIMATE_FREE, NULL); break;
+		}
+	}
 
 	// Print the message contents
-	if (sns_cx.verbosity >= 3) {
-		size_t i;
-		for (i = 0; i < cx->ref_msg->header.n; ++i) {
-			if (i < cx->ref_msg->header.n-1 ) fprintf(stdout, "%lf::", cx->ref_msg->u[i]);
-			else fprintf(stdout, "%lf]\n", cx->ref_msg->u[i]);
-		}
+	if (LOG_DEBUG <= pcio_log_level) {
+		char buf[PCIO_LOG_LINE];
+		PCIO_LOG(LOG_DEBUG, "%s: %s", what,
+		         pciod_log_vector(buf, sizeof(buf), cx->ref_msg->u, cx->ref_msg->header.n));
 	}
 
 	return r;
 }
 
+// Generate the pcio calls requested by the specified motor command message, and update the state 
+// with the module acknowledgments. Note: msg size should match group size.
+// HANDLE REF, SEND TO HARDWARE
+int execute_and_update_state(pciod_t *cx) {
+	double ack_vals[cx->n];
+	uint8_t ack_mask[cx->n];
+	int got_ack;
+	int r = pciod_execute(cx, ack_vals, ack_mask, &got_ack);
+
+	// NOTE: We reuse the position acknowledgement to save some work in updating
+	if( NTCAN_SUCCESS == r ) r = update_state(cx, got_ack ? ack_vals : NULL, ack_mask);
+	return r;
+}
+
+
 /* ******************************************************************************************** */
-/// Issues a request for position and velocity of the modules, and posts on state channel. 
-/// If pos_acks is NULL, update_state will query both position and velocity from the network  If 
-/// an array is provided, it will pull the position values from this array to save an extra call.
-/// SENDS STATE_MSG TO THE ACK 
-static void update_state(pciod_t *cx, double *pos_acks) {
+/// Returns which modules have field parm_id this cycle, or NULL if it was not read
+static const uint8_t *pciod_poll_got( pciod_t *cx, int parm_id ) {
+	pcio_poll_field_t *f = pcio_poll_find(&cx->poll, parm_id);
+	if( NULL == f || ! ((cx->poll.read >> (f - cx->poll.field)) & 1) ) return NULL;
+	return f->got;
+}
+
+/// Converts the float words of field parm_id to vals if it was read this cycle; returns the
+/// modules it was read or marked for, or NULL if it was not. The others keep their entry of vals.
+static const uint8_t *pciod_poll_get( pciod_t *cx, int parm_id, double *vals ) {
+	const uint8_t *got = pciod_poll_got(cx, parm_id);
+	if( NULL == got ) return NULL;
+	const pcio_poll_field_t *f = pcio_poll_find(&cx->poll, parm_id);
+	for( size_t i = 0; i < cx->n; i++ ) {
+		if( ! got[i] ) continue;
+		float x;
+		memcpy(&x, &f->vals[i], sizeof(x));
+		vals[i] = x;
+	}
+	return got;
+}
+
+/// Copies the error words, currents and bus supply that were read this cycle into the status,
+/// with the error words split into fault and info bits. For the modules whose error word was
+/// not read, the info bits the short state carries are taken from the acks of those with
+/// ack_mask set.
+static void pciod_poll_status( pciod_t *cx, const uint8_t *ack_mask ) {
+	struct pcio_msg_status_joint *joint = cx->recover.msg->joint;
+	double vals[cx->n];
+	const uint8_t *got = pciod_poll_got(cx, PCIO_PARAM_ERROR);
+	const uint32_t *error = got ? pcio_poll_find(&cx->poll, PCIO_PARAM_ERROR)->vals : NULL;
+	for( size_t i = 0; i < cx->n; i++ ) {
+		if( got && got[i] ) {
+			joint[i].error = error[i];
+			pcio_state_decode(error[i], &joint[i].fault, &joint[i].info);
+			cx->recover.fresh = 1;
+		} else if( ack_mask && ack_mask[i] ) {
+			// Between reads of the state word, the acks keep the limit switches and motion current
+			uint32_t info = (joint[i].info & ~(uint32_t)PCIO_STATE_SHORT_INFOS) |
+				pcio_short_state_word(cx->group.flat.state[i]);
+			if( info != joint[i].info ) {
+				joint[i].info = info;
+				cx->recover.fresh = 1;
+			}
+		}
+	}
+	if( (got = pciod_poll_get(cx, PCIO_ACT_FPSEUDOCURRENT, vals)) ) {
+		for( size_t i = 0; i < cx->n; i++ ) if( got[i] ) joint[i].current = (float)vals[i];
+		cx->recover.fresh = 1;
+	}
+	if( (got = pciod_poll_get(cx, PCIO_PARAM_BUSVOLTAGE, vals)) ) {
+		for( size_t i = 0; i < cx->n; i++ ) if( got[i] ) joint[i].bus_voltage = (float)vals[i];
+		cx->recover.fresh = 1;
+	}
+	if( (got = pciod_poll_get(cx, PCIO_PARAM_BUSCURRENT, vals)) ) {
+		for( size_t i = 0; i < cx->n; i++ ) if( got[i] ) joint[i].bus_current = (float)vals[i];
+		cx->recover.fresh = 1;
+	}
+}
+
+/* ******************************************************************************************** */
+/// Polls the fields that are due, and posts the position and velocity on state channel. If
+/// pos_acks is not NULL, the positions of the modules i with ack_mask[i] set, or of all modules
+/// if ack_mask is NULL, are taken from it to save an extra read. The other fields go into the
+/// status. A field that was shed this cycle, or a module whose turn it is not, keeps its last
+/// value; the sample channel tells when each was taken.
+/// SENDS STATE_MSG TO THE ACK. Returns the first CAN failure, if any.
+static int update_state(pciod_t *cx, const double *pos_acks, const uint8_t *ack_mask) {
 
 	// Set the status of the message
 	struct sns_msg_motor_state* msg = cx->state_msg;
-
-	// Set positions into local variable if they are not already provided and place in state_msg
-	int r;
-	double pos_vals[cx->n];
-	if (pos_acks == NULL) {
-
-		// Get the positions
-		r = pcio_group_getd( &cx->group, PCIO_ACT_FPOS, pos_vals, cx->n );
-		SNS_CHECK(r == NTCAN_SUCCESS, LOG_WARNING, 0, "update_state-pos: ntcan result: %s", 
-			canResultString(r));
-		if(r == NTCAN_SUCCESS) 
-			for(size_t i = 0; i < cx->n; i++) msg->X[i].pos = pos_vals[i];
-	} else {
-		for(size_t i = 0; i < cx->n; i++) msg->X[i].pos = pos_acks[i];
+	pcio_poll_t *p = &cx->poll;
+
+	// Read what is due
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	if( pos_acks ) pcio_poll_mark( p, PCIO_ACT_FPOS, &now, ack_mask );
+	int result = pcio_poll_run_turn( p, &cx->group, &now, cx->rate.slow ? cx->rate.turn : NULL );
+	if( NTCAN_SUCCESS != result ) PCIO_LOG(LOG_WARNING, "update_state: ntcan result: %s",
+		canResultString(result));
+
+	// Place the positions and velocities that were read in state_msg, acks first. Joints that
+	// were not read keep their last value, and are left out of the estimate's correction.
+	double pos_vals[cx->n], vel_vals[cx->n];
+	uint8_t pos_mask[cx->n], vel_mask[cx->n];
+	const double *pos_read = NULL, *vel_read = NULL;
+	const uint8_t *got = pciod_poll_get(cx, PCIO_ACT_FPOS, pos_vals);
+	for(size_t i = 0; i < cx->n; i++) {
+		pos_mask[i] = 0;
+		if( pos_acks && (NULL == ack_mask || ack_mask[i]) ) pos_vals[i] = pos_acks[i];
+		else if( !got || !got[i] ) {
+			pos_vals[i] = msg->X[i].pos;
+			continue;
+		}
+		pos_mask[i] = 1;
+		pos_read = pos_vals;
+		msg->X[i].pos = pos_vals[i];
+		cx->rate.pos_t[i] = now;
+	}
+	if( (got = pciod_poll_get(cx, PCIO_ACT_FVEL, vel_vals)) ) {
+		for(size_t i = 0; i < cx->n; i++) {
+			vel_mask[i] = got[i];
+			if( !got[i] ) {
+				vel_vals[i] = msg->X[i].vel;
+				continue;
+			}
+			vel_read = vel_vals;
+			msg->X[i].vel = vel_vals[i];
+			cx->rate.vel_t[i] = now;
+		}
 	}
 
-	// Set velocities into the msg; if failed set the data to zero and update status
-	double vel_vals[cx->n];
-	r = pcio_group_getd( &cx->group, PCIO_ACT_FVEL, vel_vals, cx->n );
-	SNS_CHECK(r == NTCAN_SUCCESS, LOG_WARNING, 0, "update_state-vel: ntcan result: %s", 
-		canResultString(r));
-	if(r == NTCAN_SUCCESS) 
-		for(size_t i = 0; i < cx->n; i++) msg->X[i].vel = vel_vals[i];
+	// Correct the estimate with whatever was read
+	pciod_estimate_measure(cx, pos_read, pos_mask, vel_read, vel_mask);
 
+	// And the status with the rest, and the state bits of the acks
+	uint8_t acked[cx->n];
+	if( pos_acks ) {
+		if( ack_mask ) memcpy(acked, ack_mask, cx->n);
+		else memset(acked, 1, cx->n);
+	}
+	pciod_poll_status(cx, pos_acks ? acked : NULL);
 
-	// Set sequence number and time
+	// Set sequence number and time. The time is the tick of the shared clock, so groups
+	// polled in the same cycle publish the same timestamp.
   cx->state_msg->header.seq++;
-	// sns_msg_set_time( &cx->msg_state->header, &cx->now, (int64_t)(opt_timeout_sec*1e9*2) );
-
-	// Set currents into the msg; if failed set the data to zero and update status
-//	double cur_vals[cx->n];
-//	r = pcio_group_getd( &cx->group, PCIO_ACT_FPSEUDOCURRENT, cur_vals, cx->n );
-//	SNS_CHECK(r == NTCAN_SUCCESS, LOG_WARNING, "update_state-cur: ntcan result: %s", 
-//		canResultString(r));
-//	if(r == NTCAN_SUCCESS)
-//	  msg->current->data = cur_vals;
-//	} else {
-//	  msg->current->data = NULL;
-//	  msg->status |= SOMATIC__MOTOR_STATUS__MOTOR_FAIL | SOMATIC__MOTOR_STATUS__MOTOR_COMM_FAIL;
-//	}
-
-	// Get status words too and check if any of them have an error. TODO: If failed to get, error.
-	//uint32_t status_vals[cx->n];
-	//msg->has_status = 1;
-	//msg->status = SOMATIC__MOTOR_STATUS__MOTOR_OK;
-	//r = pcio_group_getu32( &cx->group, PCIO_PARAM_ERROR, status_vals, cx->n);
-	//SNS_CHECK(r == NTCAN_SUCCESS, LOG_WARNING, "update_state-status: ntcan result: %s", 
-	//	canResultString(r));
-	//if(r == NTCAN_SUCCESS) {
-	//	for(size_t j=0; j < cx->n; j++) {
-	//		if(status_vals[j] & PCIO_STATE_ERROR) {
-	//			msg->status |= SOMATIC__MOTOR_STATUS__MOTOR_FAIL| SOMATIC__MOTOR_STATUS__MOTOR_HW_FAIL;
-	//			break;
-	//		}
-	//	}
-	//}
+	sns_msg_set_time( &cx->state_msg->header, &cx->tick, 2*pciod_clock.period_ns );
 
 	// Print the message contents
-	if (SNS_LOG_PRIORITY(LOG_DEBUG)) {
-		size_t i;
-		printf("\nseq %d: \n", cx->state_msg->header.seq);
-		for (i = 0; i < cx->state_msg->header.n; ++i) {
-			printf("%lf, %lf\n", cx->state_msg->X[i].pos, cx->state_msg->X[i].vel); 
-		}
+	if (LOG_DEBUG <= pcio_log_level) {
+		char buf[PCIO_LOG_LINE];
+		double x[cx->n];
+		for(size_t i = 0; i < cx->n; i++) x[i] = msg->X[i].pos;
+		PCIO_LOG(LOG_DEBUG, "seq %lu pos: %s", (unsigned long)msg->header.seq,
+		         pciod_log_vector(buf, sizeof(buf), x, cx->n));
+		for(size_t i = 0; i < cx->n; i++) x[i] = msg->X[i].vel;
+		PCIO_LOG(LOG_DEBUG, "seq %lu vel: %s", (unsigned long)msg->header.seq,
+		         pciod_log_vector(buf, sizeof(buf), x, cx->n));
 	}
 
 	// Package a state message for the ack returned, and send to state channel
 	// r = SOMATIC_PACK_SEND( &cx->state_chan, somatic__motor_state, msg );
-  r = ach_put( &cx->state_chan, cx->state_msg, sns_msg_motor_state_size(cx->state_msg));
+  int r = ach_put( &cx->state_chan, cx->state_msg, sns_msg_motor_state_size(cx->state_msg));
+	if( cx->arg->shm ) pcio_shm_write(&cx->state_shm, cx->state_msg, sns_msg_motor_state_size(cx->state_msg));
+	if( cx->arg->sample_chan ) pciod_publish_sample(cx);
+	if( cx->arg->record ) pciod_record(cx);
 
 	/// check message transmission
-	SNS_CHECK(r == NTCAN_SUCCESS, LOG_WARNING, 0, "update_state: ntcan result: %s", 
+	if( NTCAN_SUCCESS != r ) PCIO_LOG(LOG_WARNING, "update_state: ntcan result: %s",
 		canResultString(r));
+	return result;
 }
 /* ******************************************************************************************** */
@@ -56,11 +56,19 @@
 #include <stdlib.h>
 #include <ntcan.h>
 #include <math.h>
+#include <time.h>
 #include <ntcanopen.h>
 #include <sched.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 // #include <somatic/util.h>
 #include "pcio.h"
+#include "pcio_trace.h"
+#include "pcio_log.h"
 
 
 
@@ -76,22 +84,38 @@
 #define CHECK_RETURN_MSG(call, MSG) {                   \
         int _pcio_check_return = call;                  \
         if( _pcio_check_return != NTCAN_SUCCESS ) {     \
-            fprintf(stderr, MSG);                       \
+            PCIO_LOG( LOG_ERR, "%s", MSG );             \
             return _pcio_check_return; }}               \
 
 /** Get a parameter value */
 static int pcio_group_get( pcio_group_t *g, int parm_id,
                            void *vals, int bits, size_t n_vals );
 
+/** Get a parameter value from the modules with mask set */
+static int pcio_group_get_mask( pcio_group_t *g, int parm_id,
+                                void *vals, int bits, size_t n_vals, const uint8_t *mask );
+
 static int pcio_group_msg_recv( pcio_group_t *g, int cmd_id, int mot_parm_id,
-                                void *data, int bits, uint8_t *state, size_t cnt );
+                                void *data, int bits, uint8_t *state, size_t cnt,
+                                const uint8_t *mask );
 
-static int pcio_group_msg_send( pcio_group_t *g, int continue_on_error );
+static int pcio_group_msg_send( pcio_group_t *g, int continue_on_error, const uint8_t *mask );
 
 static void pcio_group_msg_setid( pcio_group_t *g, int idmask,
                                   int cmdid, int motion_param_id );
+static int pcio_group_ack_finish( pcio_group_t *g, double *ack, size_t cnt,
+                                  const float *rx, const uint8_t *state );
 static void pcio_group_msg_set32( pcio_group_t *g, const void *data );
 
+static int pcio_bus_burst_send( pcio_group_t *g, pcio_bus_t *bus, int idmask, int cmd_id,
+                                const int *parm_ids, size_t n_parm, const uint8_t *mask );
+static int pcio_bus_burst_recv( pcio_group_t *g, pcio_bus_t *bus, int cmd_id,
+                                const int *parm_ids, size_t n_parm, uint32_t *vals,
+                                const uint8_t *mask );
+
+/// Most requests per module that may be outstanding in one pipelined burst
+#define PCIO_BURST_MAX 8
+
 typedef struct {
     const char *flag;
     const char *type;
@@ -243,6 +267,143 @@ static const config_msg_t configs[] = {
 */
 
 
+/*-----------*/
+/* Transport */
+/*-----------*/
+
+/// How long a read waits for a reply
+#define PCIO_RX_TIMEOUT_MS 100
+
+static int pcio_ntcan_open( void *cx, int net, int32_t queue_size, NTCAN_HANDLE *handle ) {
+    (void)cx;
+    int r = canOpen( net ,   //net
+                     0,   //flags
+                     queue_size,  //txqueue
+                     queue_size,  //rxqueue
+                     PCIO_RX_TIMEOUT_MS, //txtimeout
+                     PCIO_RX_TIMEOUT_MS, //rxtimeout
+                     handle // handle
+        );
+    if( NTCAN_SUCCESS != r ) return r;
+    r = canSetBaudrate( *handle, NTCAN_BAUD_1000 );
+    if( NTCAN_SUCCESS != r ) canClose( *handle );
+    return r;
+}
+
+static int pcio_ntcan_close( void *cx, NTCAN_HANDLE handle ) {
+    (void)cx;
+    return canClose( handle );
+}
+
+static int pcio_ntcan_id_add( void *cx, NTCAN_HANDLE handle, int32_t id ) {
+    (void)cx;
+    return canIdAdd( handle, id );
+}
+
+static int pcio_ntcan_write( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    (void)cx;
+    return canWrite( handle, msg, len, NULL );
+}
+
+static int pcio_ntcan_read( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    (void)cx;
+    return canRead( handle, msg, len, NULL );
+}
+
+static int pcio_ntcan_take( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    (void)cx;
+    return canTake( handle, msg, len );
+}
+
+const pcio_transport_t pcio_transport_ntcan = {
+    .name = "ntcan",
+    .open = pcio_ntcan_open,
+    .close = pcio_ntcan_close,
+    .id_add = pcio_ntcan_id_add,
+    .write = pcio_ntcan_write,
+    .read = pcio_ntcan_read,
+    .take = pcio_ntcan_take,
+};
+
+static const pcio_transport_t *pcio_transport( pcio_group_t *g ) {
+    return g->transport ? g->transport : &pcio_transport_ntcan;
+}
+
+/// Remember the first failure on a bus, so callers can tell which bus failed
+static void pcio_bus_failed( pcio_bus_t *bus, int r ) {
+    if( NTCAN_SUCCESS != r && NTCAN_SUCCESS == bus->result ) bus->result = r;
+}
+
+/// Count the outcome of a write or read of len frames in the traffic of a bus
+static void pcio_bus_count( pcio_bus_t *bus, int r, const CMSG *msg, int32_t len,
+                            uint64_t *frames ) {
+    if( NTCAN_SUCCESS == r ) {
+        *frames += (uint64_t)len;
+        for( int32_t i = 0; i < len; i++ )
+            bus->stats.bits += PCIO_CAN_FRAME_BITS( msg[i].len & 0xf );
+    } else if( NTCAN_RX_TIMEOUT == r || NTCAN_TX_TIMEOUT == r ) {
+        bus->stats.timeouts++;
+    } else {
+        bus->stats.errors++;
+    }
+}
+
+/// Write frames to a bus of g, recording them if g is captured
+static int pcio_can_write( pcio_group_t *g, pcio_bus_t *bus, CMSG *msg, int32_t *len ) {
+    int r = pcio_transport(g)->write( g->transport_cx, bus->handle, msg, len );
+    if( g->trace )
+        pcio_trace_frames( g->trace, bus->net, PCIO_TRACE_TX, bus->txid, r, msg, *len );
+    bus->stats.writes++;
+    pcio_bus_count( bus, r, msg, *len, &bus->stats.frames_tx );
+    pcio_bus_failed( bus, r );
+    return r;
+}
+
+/// Hand the frames written to the busses of g to the driver, if the transport holds them back
+static int pcio_can_flush( pcio_group_t *g ) {
+    const pcio_transport_t *tp = pcio_transport(g);
+    if( NULL == tp->flush ) return NTCAN_SUCCESS;
+    int r = tp->flush( g->transport_cx );
+    if( NTCAN_SUCCESS != r ) PCIO_LOG( LOG_ERR, "CAN error flushing writes: %s", canResultString(r) );
+    return r;
+}
+
+/// Read frames from a bus of g, recording them if g is captured
+static int pcio_can_read( pcio_group_t *g, pcio_bus_t *bus, CMSG *msg, int32_t *len ) {
+    int r = pcio_transport(g)->read( g->transport_cx, bus->handle, msg, len );
+    if( g->trace )
+        pcio_trace_frames( g->trace, bus->net, PCIO_TRACE_RX, bus->txid, r, msg,
+                           NTCAN_SUCCESS == r ? *len : 0 );
+    bus->stats.reads++;
+    pcio_bus_count( bus, r, msg, *len, &bus->stats.frames_rx );
+    pcio_bus_failed( bus, r );
+    return r;
+}
+
+/// Read the frames already waiting on a bus of g, recording them if g is captured
+static int pcio_can_take( pcio_group_t *g, pcio_bus_t *bus, CMSG *msg, int32_t *len ) {
+    int r = pcio_transport(g)->take( g->transport_cx, bus->handle, msg, len );
+    if( g->trace && ( NTCAN_SUCCESS != r || *len > 0 ) )
+        pcio_trace_frames( g->trace, bus->net, PCIO_TRACE_RX, bus->txid, r, msg,
+                           NTCAN_SUCCESS == r ? *len : 0 );
+    bus->stats.reads++;
+    pcio_bus_count( bus, r, msg, *len, &bus->stats.frames_rx );
+    pcio_bus_failed( bus, r );
+    return r;
+}
+
+/// Start a new transaction on one bus; busses are initialized from several threads
+static void pcio_bus_begin( pcio_group_t *g, pcio_bus_t *bus ) {
+    bus->txid = __atomic_add_fetch( &g->txid, 1, __ATOMIC_RELAXED );
+}
+
+/// Start a new transaction on every bus of g
+static void pcio_group_begin( pcio_group_t *g ) {
+    uint32_t txid = __atomic_add_fetch( &g->txid, 1, __ATOMIC_RELAXED );
+    for( size_t i = 0; i < g->bus_cnt; i++ )
+        g->bus[i].txid = txid;
+}
+
 /*--------------------------------------------------*/
 /* helper functions for single-double float changes */
 /*--------------------------------------------------*/
@@ -260,6 +421,15 @@ static void pcio_s2d( double *dst, const float *src, size_t cnt ) {
         dst[i] = (double) src[i];
 }
 
+/// convert raw 32-bit words holding single floats to double floats
+static void pcio_u2d( double *dst, const uint32_t *src, size_t cnt ) {
+    for( size_t i = 0; i < cnt; i++ ) {
+        float f;
+        memcpy( &f, &src[i], sizeof(f) );
+        dst[i] = (double) f;
+    }
+}
+
 /*------------------*/
 /* Group Management */
 /*------------------*/
@@ -284,154 +454,456 @@ int pcio_group_dump_config( pcio_group_t *g ) {
     return 0;
 }
 
-int pcio_group_init( pcio_group_t *g ) {
+/// Parameters fetched from every module in the pipelined init burst
+static const int pcio_init_params[] = {
+    PCIO_PARAM_ERROR, PCIO_PARAM_CONFIG,
+    PCIO_PARAM_MIN_FPOS, PCIO_ACT_FPOS, PCIO_PARAM_MAX_FPOS, PCIO_PARAM_MAX_ACC,
+    PCIO_DEF_CUBE_VERSION
+};
+#define PCIO_INIT_PARAM_CNT (sizeof(pcio_init_params)/sizeof(pcio_init_params[0]))
+
+/// Parameters fetched to verify a snapshot when attaching warm. The limits are read again, they
+/// may have been set since the snapshot was written.
+static const int pcio_warm_params[] = {
+    PCIO_PARAM_ERROR, PCIO_PARAM_CONFIG, PCIO_ACT_FPOS,
+    PCIO_PARAM_MIN_FPOS, PCIO_PARAM_MAX_FPOS, PCIO_PARAM_MAX_ACC
+};
+#define PCIO_WARM_PARAM_CNT (sizeof(pcio_warm_params)/sizeof(pcio_warm_params[0]))
+
+/// Bind the ack ids of the modules on one bus
+static int pcio_bus_bind( pcio_group_t *g, pcio_bus_t *bus ) {
+    for( size_t j = 0; j < bus->module_cnt; j++ ) {
+        int r = pcio_transport(g)->id_add( g->transport_cx, bus->handle,
+                                           PCIO_CANID_CMDACK( bus->module[j].id ) );
+        if( NTCAN_SUCCESS != r && NTCAN_ID_ALREADY_ENABLED != r ) {
+            PCIO_LOG( LOG_ERR, "Couldn't bind CAN id" );
+            return r;
+        }
+    }
+    return NTCAN_SUCCESS;
+}
+
+/// Open the CAN handle of one bus, set the baudrate and bind the ack ids. *opened, if not NULL,
+/// is set once the handle is open, even if the binding fails.
+static int pcio_bus_open( pcio_group_t *g, pcio_bus_t *bus, int *opened ) {
+    const pcio_transport_t *tp = pcio_transport(g);
+
+    // open can handle and set baudrate, queues hold a full burst
+    CHECK_RETURN_MSG( tp->open( g->transport_cx, bus->net,
+                                (int32_t)(PCIO_BURST_MAX*bus->module_cnt),
+                                &bus->handle ),
+                      "Couldn't open net\n" );
+    if( opened ) *opened = 1;
+
+    // bind CAN-IDS
+    return pcio_bus_bind( g, bus );
+}
+
+/// Share of the hard limits the modules are kept within
+static double const SAFE_LIMIT_RATIO = 0.98; // 2% buffer on hard-limits
+
+/** Reset one bus and read the limits of its modules.
+
+    After the reset round trip, everything else is fetched in a single
+    pipelined burst.
+*/
+static int pcio_bus_init_cold( pcio_group_t *g, pcio_bus_t *bus ) {
+    pcio_flat_t *f = &g->flat;
+    size_t off = f->bus_off[bus - g->bus];
 
-    // create message structs
+    // reset and release limits
     {
-        g->msg = AA_NEW0_AR( CMSG*, g->bus_cnt );
+        static const int no_parm = -1;
+        memset( &f->state[off], 0, bus->module_cnt );
+        pcio_bus_begin( g, bus );
+        CHECK_RETURN( pcio_bus_burst_send( g, bus, PCIO_IDMASK_CMDPUT, PCIO_RESET, &no_parm, 1, NULL ) );
+        CHECK_RETURN( pcio_bus_burst_recv( g, bus, PCIO_RESET, &no_parm, 1, NULL, NULL ) );
+    }
 
-        //build messages
-        for( size_t i = 0; i < g->bus_cnt; i++ ) {
-            // allocate messages for this bus
-            g->msg[i] = AA_NEW0_AR( CMSG,  g->bus[i].module_cnt );
-            // fill in module ids
-            for( size_t j = 0; j < g->bus[i].module_cnt; j ++ ) {
-                g->msg[i][j].id = PCIO_CANID_CMDPUT( g->bus[i].module[j].id );
-            }
+    // read error word, config word and joint limit info at once
+    size_t m = bus->module_cnt;
+    uint32_t vals[PCIO_INIT_PARAM_CNT * m];
+    memset( vals, 0, sizeof(vals) );
+    pcio_bus_begin( g, bus );
+    CHECK_RETURN( pcio_bus_burst_send( g, bus, PCIO_IDMASK_CMDGET, PCIO_GET_PARAM,
+                                       pcio_init_params, PCIO_INIT_PARAM_CNT, NULL ) );
+    CHECK_RETURN_MSG( pcio_bus_burst_recv( g, bus, PCIO_GET_PARAM,
+                                           pcio_init_params, PCIO_INIT_PARAM_CNT, vals, NULL ),
+                      "Couldn't read error word and limits\n" );
+    const uint32_t *error = &vals[0*m];
+    const uint32_t *config = &vals[1*m];
+    const uint32_t *cube_version = &vals[6*m];
+    double min_pos[m], act_pos[m], max_pos[m], max_acc[m];
+    pcio_u2d( min_pos, &vals[2*m], m );
+    pcio_u2d( act_pos, &vals[3*m], m );
+    pcio_u2d( max_pos, &vals[4*m], m );
+    pcio_u2d( max_acc, &vals[5*m], m );
+
+    // check errors
+    int r = 0;
+    for( size_t j = 0; j < m; j++ ) {
+        if( LOG_DEBUG <= pcio_log_level ) {
+            char states[PCIO_LOG_LINE];
+            pcio_state_error_to_string( states, sizeof(states), error[j] );
+            PCIO_LOG( LOG_DEBUG, "State of bus %d id %d: 0x%x %s",
+                      bus->net, bus->module[j].id, error[j], states );
+        }
+        // check for power fault
+        if( (error[j] & PCIO_STATE_POWERFAULT) &&
+            (error[j] & PCIO_STATE_POW_VOLT_ERR) ){
+            PCIO_LOG( LOG_ERR, "Power Fault on bus %d ID %d. You may have a blown fuse.",
+                      bus->net, bus->module[j].id );
+            r = -1;
         }
     }
+    if (r) return r;
+
+    // initialize joint limit info
+    for( size_t j = 0; j < m; j++ ) {
+        pcio_module_t * mod = &bus->module[j];
+        mod->config = config[j];
+        mod->cube_version = cube_version[j];
+        mod->min_pos = min_pos[j] * SAFE_LIMIT_RATIO;
+        mod->max_pos = max_pos[j] * SAFE_LIMIT_RATIO;
+        mod->max_acc = max_acc[j] * SAFE_LIMIT_RATIO;
+        f->min_pos[off+j] = mod->min_pos;
+        f->max_pos[off+j] = mod->max_pos;
+        f->max_acc[off+j] = mod->max_acc;
+        f->last_pos[off+j] = act_pos[j];
+    }
 
+    return NTCAN_SUCCESS;
+}
 
-    // open can handles and set baudrate
-    for( size_t i = 0; i < g->bus_cnt; i++ ) {
-        CHECK_RETURN_MSG( canOpen( g->bus[i].net ,   //net
-                                   0,   //flags
-                                   (int32_t)(4*g->bus[i].module_cnt),  //txqueue
-                                   (int32_t)(4*g->bus[i].module_cnt),  //rxqueue
-                                   100, //txtimeout
-                                   100, //rxtimeout
-                                   &g->bus[i].handle // handle
-                              ),
-                          "Couldn't open net\n" );
-        CHECK_RETURN_MSG( canSetBaudrate(g->bus[i].handle, NTCAN_BAUD_1000),
-                          "Couldn't set baud\n" );
+/** Attach to one bus without resetting it.
+
+    One pipelined burst reads the error word, config word, position and
+    limits of every module. The snapshot is only trusted if no module
+    reports an error and every config word matches; the limits are
+    the ones just read.
+
+    \param stale set if the limits differ from the snapshot's
+    \return NTCAN_SUCCESS if attached, 1 if the bus needs a cold init
+*/
+static int pcio_bus_init_warm( pcio_group_t *g, pcio_bus_t *bus,
+                               const pcio_snapshot_module_t *snap, int *stale ) {
+    size_t m = bus->module_cnt;
+    uint32_t vals[PCIO_WARM_PARAM_CNT * m];
+    memset( vals, 0, sizeof(vals) );
+    pcio_bus_begin( g, bus );
+    CHECK_RETURN( pcio_bus_burst_send( g, bus, PCIO_IDMASK_CMDGET, PCIO_GET_PARAM,
+                                       pcio_warm_params, PCIO_WARM_PARAM_CNT, NULL ) );
+    CHECK_RETURN( pcio_bus_burst_recv( g, bus, PCIO_GET_PARAM,
+                                       pcio_warm_params, PCIO_WARM_PARAM_CNT, vals, NULL ) );
+    const uint32_t *error = &vals[0*m];
+    const uint32_t *config = &vals[1*m];
+    double act_pos[m], min_pos[m], max_pos[m], max_acc[m];
+    pcio_u2d( act_pos, &vals[2*m], m );
+    pcio_u2d( min_pos, &vals[3*m], m );
+    pcio_u2d( max_pos, &vals[4*m], m );
+    pcio_u2d( max_acc, &vals[5*m], m );
+
+    for( size_t j = 0; j < m; j++ ) {
+        if( pcio_state_word_contains_errors( error[j] ) ||
+            config[j] != snap[j].config ) {
+            PCIO_LOG( LOG_WARNING, "Can't attach warm to bus %d ID %d: state 0x%x, config 0x%x",
+                      bus->net, bus->module[j].id, error[j], config[j] );
+            return 1;
+        }
     }
 
+    pcio_flat_t *f = &g->flat;
+    size_t off = f->bus_off[bus - g->bus];
+    *stale = 0;
+    for( size_t j = 0; j < m; j++ ) {
+        pcio_module_t * mod = &bus->module[j];
+        mod->config = snap[j].config;
+        mod->cube_version = snap[j].cube_version;
+        mod->min_pos = min_pos[j] * SAFE_LIMIT_RATIO;
+        mod->max_pos = max_pos[j] * SAFE_LIMIT_RATIO;
+        mod->max_acc = max_acc[j] * SAFE_LIMIT_RATIO;
+        if( mod->min_pos != snap[j].min_pos || mod->max_pos != snap[j].max_pos ||
+            mod->max_acc != snap[j].max_acc ) {
+            PCIO_LOG( LOG_NOTICE, "Limits of bus %d ID %d changed since the snapshot",
+                      bus->net, mod->id );
+            *stale = 1;
+        }
+        f->state[off+j] = 0;
+        f->min_pos[off+j] = mod->min_pos;
+        f->max_pos[off+j] = mod->max_pos;
+        f->max_acc[off+j] = mod->max_acc;
+        f->last_pos[off+j] = act_pos[j];
+    }
+    return NTCAN_SUCCESS;
+}
 
-    // bind CAN-IDS
-    for( size_t i = 0; i < g->bus_cnt; i++ ) {
-        for( size_t j = 0; j < g->bus[i].module_cnt; j++ ) {
-            CHECK_RETURN_MSG( canIdAdd(g->bus[i].handle,
-                                       PCIO_CANID_CMDACK( g->bus[i].module[j].id ) ),
-                              "Couldn't bind CAN id\n");
+typedef struct {
+    pcio_group_t *g;
+    pcio_bus_t *bus;
+    const pcio_snapshot_module_t *snap; //< snapshot of this bus's modules, or NULL
+    int warm; //< set if attached without reset
+    int stale; //< set if attached warm with other limits than the snapshot's
+    int opened; //< set once the handle of the bus is open
+    int result;
+} pcio_bus_init_arg_t;
+
+/// Initialize one bus; runs in its own thread and only touches its bus
+static void *pcio_bus_init_thread( void *arg ) {
+    pcio_bus_init_arg_t *a = (pcio_bus_init_arg_t*)arg;
+    a->warm = 0;
+    a->stale = 0;
+    a->opened = 0;
+    a->result = pcio_bus_open( a->g, a->bus, &a->opened );
+    if( NTCAN_SUCCESS != a->result ) return NULL;
+    if( a->snap ) {
+        int r = pcio_bus_init_warm( a->g, a->bus, a->snap, &a->stale );
+        if( NTCAN_SUCCESS == r ) {
+            a->warm = 1;
+            return NULL;
         }
     }
+    a->result = pcio_bus_init_cold( a->g, a->bus );
+    return NULL;
+}
 
+/** Map a snapshot and check it describes the modules of g, in order.
+    \return the module records, or NULL (nothing mapped) if unusable
+*/
+static const pcio_snapshot_module_t *pcio_snapshot_map( pcio_group_t *g, const char *path,
+                                                        size_t *map_size ) {
+    int fd = open( path, O_RDONLY );
+    if( fd < 0 ) return NULL;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if( 0 == fstat( fd, &st ) && (size_t)st.st_size >= sizeof(pcio_snapshot_header_t) ) {
+        *map_size = (size_t)st.st_size;
+        p = mmap( NULL, *map_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+    if( MAP_FAILED == p ) return NULL;
+
+    const pcio_snapshot_header_t *h = (const pcio_snapshot_header_t*)p;
+    const pcio_snapshot_module_t *snap = (const pcio_snapshot_module_t*)(h + 1);
+    int ok = ( PCIO_SNAPSHOT_MAGIC == h->magic &&
+               PCIO_SNAPSHOT_VERSION == h->version &&
+               pcio_group_size(g) == h->module_cnt &&
+               sizeof(*h) + h->module_cnt * sizeof(*snap) <= *map_size );
+    size_t k = 0;
+    for( size_t i = 0; ok && i < g->bus_cnt; i++ ) {
+        for( size_t j = 0; ok && j < g->bus[i].module_cnt; j++, k++ ) {
+            ok = ( snap[k].net == g->bus[i].net && snap[k].id == g->bus[i].module[j].id );
+        }
+    }
+    if( !ok ) {
+        PCIO_LOG( LOG_WARNING, "Snapshot %s does not match the group", path );
+        munmap( p, *map_size );
+        return NULL;
+    }
+    return snap;
+}
 
-    // reset and release limits
-    CHECK_RETURN( pcio_group_reset( g ) );
-    {
-        size_t n = pcio_group_size(g);
-
-        // check errors
-        {
-            uint32_t error[n];
-            CHECK_RETURN_MSG( pcio_group_getu32(g, PCIO_PARAM_ERROR, error, n),
-                              "Couldn't read error word\n");
-            size_t k = 0;
-            int r = 0;
-            for( size_t i = 0; i < g->bus_cnt; i++ ) {
-                for( size_t j = 0; j < g->bus[i].module_cnt; j++ ) {
-                    assert( k < n );
-                    // somatic_verbprintf(1, "STATE OF BUS %d ID %d:  0x%x\n",
-                    //                    g->bus[i].net, g->bus[i].module[j].id, error[k] );
-                    pcio_resolve_module_state_word(2, error[k]);
-/*
-                    // check to make sure we get home_oks
-                    if(!(error[k] & PCIO_STATE_HOME_OK)) {
-	                    fprintf(stderr, "Did not get HOME_OK from BUS %d ID %d\n",
-	                            g->bus[i].net, g->bus[i].module[j].id);
-	                    r = -1;
-                    }
+/** Build the flat module table of g and its message structs.
+
+    The bus threads of the initialization then fill in the limits and
+    positions, each in its own slice.
 */
-                    // check for power fault
-                    if( (error[k] & PCIO_STATE_POWERFAULT) &&
-                        (error[k] & PCIO_STATE_POW_VOLT_ERR) ){
-                        fprintf(stderr, "Power Fault on bus %d ID %d\n",
-                                g->bus[i].net, g->bus[i].module[j].id );
-                        fprintf(stderr, "You may have a blown fuse.\n");
-                        r = -1;
-                    }
-                    k++;
-                }
-            }
-            if (r) return r;
+static void pcio_flat_build( pcio_group_t *g ) {
+    pcio_flat_t *f = &g->flat;
+    size_t n = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ )
+        n += g->bus[i].module_cnt;
+
+    f->n = n;
+    f->bus_off = AA_NEW0_AR( size_t, g->bus_cnt + 1 );
+    f->slot = AA_NEW0_AR( uint16_t, 32 * g->bus_cnt );
+    f->id = AA_NEW0_AR( int, n );
+    f->bus = AA_NEW0_AR( size_t, n );
+    f->min_pos = AA_NEW0_AR( double, n );
+    f->max_pos = AA_NEW0_AR( double, n );
+    f->max_acc = AA_NEW0_AR( double, n );
+    f->last_pos = AA_NEW0_AR( double, n );
+    f->state = AA_NEW0_AR( uint8_t, n );
+    f->step_run = AA_NEW0_AR( double, n );
+    f->step_buf = AA_NEW0_AR( double, n );
+    f->msg = AA_NEW0_AR( CMSG, n );
+    g->msg = AA_NEW0_AR( CMSG*, g->bus_cnt );
+
+    size_t k = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        f->bus_off[i] = k;
+        g->msg[i] = &f->msg[k];
+        for( size_t j = 0; j < g->bus[i].module_cnt; j++, k++ ) {
+            int id = g->bus[i].module[j].id;
+            f->id[k] = id;
+            f->bus[k] = i;
+            f->slot[32*i + (size_t)PCIO_CANID_MODID(id)] = (uint16_t)(k + 1);
+            f->msg[k].id = PCIO_CANID_CMDPUT( id );
         }
+    }
+    f->bus_off[g->bus_cnt] = n;
+}
 
-        // initialize joint limit info
-        {
-            double min_pos[n]; AA_ZERO_AR(min_pos);
-            double act_pos[n]; AA_ZERO_AR(act_pos);
-            double max_pos[n]; AA_ZERO_AR(max_pos);
-            double max_acc[n]; AA_ZERO_AR(max_acc);
-
-            CHECK_RETURN_MSG( pcio_group_getd( g, PCIO_PARAM_MIN_FPOS, min_pos, n ),
-                                "Couldn't read minimum position limits\n");
-            CHECK_RETURN_MSG( pcio_group_getd( g, PCIO_ACT_FPOS, act_pos, n ),
-                                "Couldn't read actual initial position\n");
-            CHECK_RETURN_MSG( pcio_group_getd( g, PCIO_PARAM_MAX_FPOS, max_pos, n ),
-                                "Couldn't read maximum position limits\n");
-            CHECK_RETURN_MSG( pcio_group_getd( g, PCIO_PARAM_MAX_ACC, max_acc, n ),
-                                "Couldn't read maximum acceleration limits\n" );
-
-            static double const SAFE_LIMIT_RATIO = 0.98; // 2% buffer on hard-limits
-            size_t i_val = 0;
-            for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-                pcio_bus_t * bus = &g->bus[i_bus];
-                for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod, ++i_val ) {
-                    pcio_module_t * mod = &bus->module[i_bus_mod];
-                    mod->min_pos = min_pos[i_val] * SAFE_LIMIT_RATIO;
-                    mod->last_pos = act_pos[i_val];
-                    mod->max_pos = max_pos[i_val] * SAFE_LIMIT_RATIO;
-                    mod->max_acc = max_acc[i_val] * SAFE_LIMIT_RATIO;
-//                    fprintf( stderr, "Limits[b=%d,m=%d]:  min=%f  max=%f    max_acc=%f\n",
-//                             bus->net, mod->id,
-//                             mod->min_pos, mod->max_pos, mod->max_acc );
-                }
-            }
+static void pcio_flat_free( pcio_group_t *g ) {
+    pcio_flat_t *f = &g->flat;
+    free( f->bus_off );
+    free( f->slot );
+    free( f->id );
+    free( f->bus );
+    free( f->min_pos );
+    free( f->max_pos );
+    free( f->max_acc );
+    free( f->last_pos );
+    free( f->state );
+    free( f->step_run );
+    free( f->step_buf );
+    free( f->msg );
+    free( g->msg );
+    memset( f, 0, sizeof(*f) );
+    g->msg = NULL;
+}
+
+int pcio_group_init_warm( pcio_group_t *g, const char *snapshot, int *warm ) {
+
+    // create the flat module table and message structs
+    pcio_flat_build( g );
+
+    // the previous run's module info, if it still fits
+    size_t snap_size = 0;
+    const pcio_snapshot_module_t *snap = snapshot ? pcio_snapshot_map( g, snapshot, &snap_size ) : NULL;
+
+    // open, reset and read every bus concurrently
+    pcio_bus_init_arg_t args[g->bus_cnt];
+    pthread_t threads[g->bus_cnt];
+    int started[g->bus_cnt];
+    size_t k = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        args[i].g = g;
+        args[i].bus = &g->bus[i];
+        args[i].snap = snap ? &snap[k] : NULL;
+        args[i].result = NTCAN_SUCCESS;
+        k += g->bus[i].module_cnt;
+        started[i] = ( 0 == pthread_create( &threads[i], NULL, pcio_bus_init_thread, &args[i] ) );
+        if( ! started[i] ) pcio_bus_init_thread( &args[i] );
+    }
+    int r = NTCAN_SUCCESS;
+    int all_warm = 1, stale = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        if( started[i] ) pthread_join( threads[i], NULL );
+        if( NTCAN_SUCCESS == r ) r = args[i].result;
+        all_warm = all_warm && args[i].warm;
+        stale = stale || args[i].stale;
+    }
+    if( snap ) munmap( (void*)((const pcio_snapshot_header_t*)snap - 1), snap_size );
+    if( warm ) *warm = all_warm;
+
+    // a failed init leaves nothing open, so that it may be tried again
+    if( NTCAN_SUCCESS != r ) {
+        for( size_t i = 0; i < g->bus_cnt; i++ )
+            if( args[i].opened ) pcio_transport(g)->close( g->transport_cx, g->bus[i].handle );
+        pcio_flat_free( g );
+        return r;
+    }
+
+    // remember what we read for the next run
+    if( snapshot && (!all_warm || stale) ) {
+        if( pcio_group_save_snapshot( g, snapshot ) )
+            PCIO_LOG( LOG_WARNING, "Couldn't write snapshot %s: %s", snapshot, strerror(errno) );
+    }
+
+    return r; // NTCAN_SUCCESS is 0
+}
+
+int pcio_group_init( pcio_group_t *g ) {
+    return pcio_group_init_warm( g, NULL, NULL );
+}
+
+int pcio_group_save_snapshot( pcio_group_t *g, const char *path ) {
+    size_t n = pcio_group_size(g);
+    size_t size = sizeof(pcio_snapshot_header_t) + n * sizeof(pcio_snapshot_module_t);
+
+    // write a temporary file and rename it, so a crash never leaves a torn snapshot
+    char tmp[strlen(path) + 8];
+    snprintf( tmp, sizeof(tmp), "%s.XXXXXX", path );
+    int fd = mkstemp( tmp );
+    if( fd < 0 ) return -1;
+    void *p = MAP_FAILED;
+    if( 0 == fchmod( fd, 0644 ) && 0 == ftruncate( fd, (off_t)size ) )
+        p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( MAP_FAILED == p ) {
+        int e = errno;
+        close( fd );
+        unlink( tmp );
+        errno = e;
+        return -1;
+    }
+
+    pcio_snapshot_header_t *h = (pcio_snapshot_header_t*)p;
+    pcio_snapshot_module_t *snap = (pcio_snapshot_module_t*)(h + 1);
+    memset( p, 0, size );
+    h->magic = PCIO_SNAPSHOT_MAGIC;
+    h->version = PCIO_SNAPSHOT_VERSION;
+    h->module_cnt = (uint32_t)n;
+    size_t k = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        for( size_t j = 0; j < g->bus[i].module_cnt; j++, k++ ) {
+            const pcio_module_t *mod = &g->bus[i].module[j];
+            snap[k].net = g->bus[i].net;
+            snap[k].id = mod->id;
+            snap[k].config = mod->config;
+            snap[k].cube_version = mod->cube_version;
+            snap[k].min_pos = mod->min_pos;
+            snap[k].max_pos = mod->max_pos;
+            snap[k].max_acc = mod->max_acc;
         }
     }
 
-    return NTCAN_SUCCESS; // this is 0
+    int r = msync( p, size, MS_SYNC );
+    munmap( p, size );
+    close( fd );
+    if( 0 == r ) r = rename( tmp, path );
+    if( r ) {
+        int e = errno;
+        unlink( tmp );
+        errno = e;
+    }
+    return r;
 }
 
 int pcio_group_set_fullcur( pcio_group_t *g, int enable ) {
     size_t n = pcio_group_size(g);
 
     {
-        // release limits
+        // release limits, using the config words cached by pcio_group_init
         uint32_t config[n];
-        CHECK_RETURN( pcio_group_getu32(g, PCIO_PARAM_CONFIG, config, n) );
+        uint8_t changed[n];
+        int n_changed = 0;
         size_t k = 0;
         for( size_t i = 0; i < g->bus_cnt; i++ ) {
             for( size_t j = 0; j < g->bus[i].module_cnt; j++ ) {
                 assert( k < n );
-                // somatic_verbprintf(1, "CONFIG OF BUS %d ID %d: 0x%x\n",
-                //                    g->bus[i].net, g->bus[i].module[j].id, config[k]);
-                pcio_resolve_module_config_word(2, config[k]);
+                uint32_t old = g->bus[i].module[j].config;
+                pcio_resolve_module_config_word(2, old);
                 if( 1 == enable ) {
                     // release current limit, clear undocumented flags
-                    config[k] = (config[i] | 0x00080000) & 0xFFFFFFF ;
+                    config[k] = (old | 0x00080000) & 0xFFFFFFF ;
                 } else {
                     // set current limit, clear undocumented flags
-                    config[k] = (config[i] & 0xFFF7FFFF) & 0xFFFFFFF ;
-
+                    config[k] = (old & 0xFFF7FFFF) & 0xFFFFFFF ;
                 }
-
+                changed[k] = ((config[k] ^ old) & 0x00080000) ? 1 : 0;
+                n_changed += changed[k];
                 k++;
             }
         }
-        CHECK_RETURN( pcio_group_setu32(g, PCIO_PARAM_CONFIG, config, n) );
+
+        // only the modules whose bit is not in the requested state yet are written
+        if( n_changed ) {
+            CHECK_RETURN( pcio_group_setu32_mask(g, PCIO_PARAM_CONFIG, config, n, changed) );
+            k = 0;
+            for( size_t i = 0; i < g->bus_cnt; i++ )
+                for( size_t j = 0; j < g->bus[i].module_cnt; j++, k++ )
+                    if( changed[k] ) g->bus[i].module[j].config = config[k];
+        }
     }
 
 
@@ -442,6 +914,7 @@ int pcio_group_set_fullcur( pcio_group_t *g, int enable ) {
 
 /// return number of modules in the group
 size_t pcio_group_size( pcio_group_t *g ) {
+    if( g->flat.bus_off ) return g->flat.n;
     size_t s = 0;
     for( size_t i = 0; i < g->bus_cnt; i ++ )
         s += g->bus[i].module_cnt;
@@ -450,15 +923,16 @@ size_t pcio_group_size( pcio_group_t *g ) {
 
 int pcio_group_destroy ( pcio_group_t *g ) {
 
+    // nothing is open after a failed init
+    if( NULL == g->flat.bus_off ) return 0;
+
     // stop the modules
     pcio_group_halt( g );
 
     // close handles and free()
-    for( size_t i = 0; i < g->bus_cnt; i++ ) {
-        canClose( g->bus[i].handle );
-        free( g->msg[i] );
-    }
-    free( g->msg );
+    for( size_t i = 0; i < g->bus_cnt; i++ )
+        pcio_transport(g)->close( g->transport_cx, g->bus[i].handle );
+    pcio_flat_free( g );
     return 0;
 }
 
@@ -471,19 +945,18 @@ int pcio_group_destroy ( pcio_group_t *g ) {
  */
 static void pcio_group_msg_setid( pcio_group_t *g, int idmask,
                                   int cmdid, int motionid ) {
-    for( size_t i = 0; i < g->bus_cnt; i++ ) {
-        assert( g->msg[i] );
-        for( size_t j = 0; j < g->bus[i].module_cnt; j ++ ) {
-            assert( g->bus[i].module[j].id );
-            g->msg[i][j].id = idmask + g->bus[i].module[j].id ;
-            assert( PCIO_CANID_MODID( g->msg[i][j].id ) == g->bus[i].module[j].id );
-            g->msg[i][j].data[0] = (uint8_t)cmdid;
-            if( motionid > 0 ) { // normal commands
-                g->msg[i][j].data[1] = (uint8_t)motionid;
-                g->msg[i][j].len = 2;
-            } else { //special commands (reset, home...)
-                g->msg[i][j].len = 1;
-            }
+    const pcio_flat_t *f = &g->flat;
+    CMSG *msg = f->msg;
+    for( size_t k = 0; k < f->n; k++ ) {
+        assert( f->id[k] );
+        msg[k].id = idmask + f->id[k];
+        assert( PCIO_CANID_MODID( msg[k].id ) == f->id[k] );
+        msg[k].data[0] = (uint8_t)cmdid;
+        if( motionid > 0 ) { // normal commands
+            msg[k].data[1] = (uint8_t)motionid;
+            msg[k].len = 2;
+        } else { //special commands (reset, home...)
+            msg[k].len = 1;
         }
     }
 }
@@ -491,108 +964,313 @@ static void pcio_group_msg_setid( pcio_group_t *g, int idmask,
 
 /** Sets bytes 2-5 of each message with little-endian 32-bit values in data array. */
 static void pcio_group_msg_set32( pcio_group_t *g, const void *data ) {
-    size_t ia = 0;
-    uint32_t *data32 = (uint32_t*)data;
-    for( size_t i = 0; i < g->bus_cnt; i++ ) {
-        assert( g->msg[i] );
-        for( size_t j = 0; j < g->bus[i].module_cnt; j ++ ) {
-            g->msg[i][j].len =  6 ;
-            aa_endconv_st_le_u32( & (g->msg[i][j].data[2]), data32[ia++] );
-        }
+    const uint32_t *data32 = (const uint32_t*)data;
+    CMSG *msg = g->flat.msg;
+    for( size_t k = 0; k < g->flat.n; k++ ) {
+        msg[k].len = 6;
+        aa_endconv_st_le_u32( &msg[k].data[2], data32[k] );
     }
 }
 
 
-/** Sends all messages in g->msg */
-static int pcio_group_msg_send( pcio_group_t *g, int continue_on_error ) {
+/** Sends all messages in g->msg, or those of modules k with mask[k] set if mask is not NULL */
+static int pcio_group_msg_send( pcio_group_t *g, int continue_on_error, const uint8_t *mask ) {
     // send messages
     int status = NTCAN_SUCCESS; // bug, only gets the last error
-    for( size_t i = 0; i < g->bus_cnt; i++ ) {
-        // the wrong way, should send multiple messages with each canWrite or interleave buses
-        for( size_t j = 0; j < g->bus[i].module_cnt; j ++ ) {
-            assert( PCIO_CANID_MODID( g->msg[i][j].id ) == g->bus[i].module[j].id );
-            assert( g->msg[i][j].id > g->bus[i].module[j].id );
-            int n = 1;
-            int r = canWrite( g->bus[i].handle, &g->msg[i][j], &n, NULL );
-            //int is_error =  pcio_state_word_contains_errors(r); // probably wrong -ntd
-            int is_error = r;
-            if( is_error ) {
-                fprintf(stderr, "CAN error sending message: %d -- %s\n",
-                        r, canResultString(r) );
-                if( ! continue_on_error ) {
-                    return r;
-                } else {
-                    status = r;
+    const pcio_flat_t *f = &g->flat;
+    // the wrong way, should send multiple messages with each canWrite or interleave buses
+    for( size_t k = 0; k < f->n; k++ ) {
+        if( mask && ! mask[k] ) continue;
+        assert( PCIO_CANID_MODID( f->msg[k].id ) == f->id[k] );
+        assert( f->msg[k].id > f->id[k] );
+        int32_t n = 1;
+        int r = pcio_can_write( g, &g->bus[f->bus[k]], &f->msg[k], &n );
+        //int is_error =  pcio_state_word_contains_errors(r); // probably wrong -ntd
+        int is_error = r;
+        if( is_error ) {
+            PCIO_LOG( LOG_ERR, "CAN error sending message: %d -- %s",
+                      r, canResultString(r) );
+            if( ! continue_on_error ) {
+                pcio_can_flush( g );
+                return r;
+            } else {
+                status = r;
+            }
+        }
+    }
+    int r = pcio_can_flush( g );
+    return NTCAN_SUCCESS != status ? status : r;
+}
+
+/// Where pcio_group_msg_recv puts the replies
+typedef struct {
+    int cmd_id;
+    int mot_parm_id;
+    void *data;
+    int bits;
+    uint8_t *state;
+    uint8_t *got; //< a module that answers twice must not count for another one
+} pcio_recv_t;
+
+/** Take frame msg of bus i if it is the awaited reply of a module that
+    has not answered yet; returns whether it was. Other frames count as
+    stray. */
+static int pcio_group_msg_accept( pcio_group_t *g, size_t i, const CMSG *msg,
+                                  const pcio_recv_t *rx ) {
+    assert( msg->len <= 8 );
+    int msg_cmd_id = msg->data[0];
+    int msg_mot_parm_id = msg->data[1];
+    if( ! (( msg->len >= 2 &&  // maybe get a parameter
+             msg_cmd_id == rx->cmd_id &&
+             msg_mot_parm_id == rx->mot_parm_id ) ||
+           ( 1 == msg->len &&  // special no param id commands
+             msg_cmd_id == rx->cmd_id &&
+             rx->mot_parm_id < 0 )) ) {
+        g->bus[i].stats.stray++;
+        return 0;
+    }
+    assert( msg->len - 2 >= rx->bits/8 ||
+            ( 1 == msg->len && rx->mot_parm_id < 0 ) ); // ensures msg has enough bytes for requested data bits in data
+    size_t k = g->flat.slot[32*i + PCIO_CANID_MODID( msg->id )]; // find right module
+    if( 0 == k || rx->got[k-1] ) { // not in the group, or a duplicate
+        g->bus[i].stats.stray++;
+        return 0;
+    }
+    k--;
+    rx->got[k] = 1;
+    if( NULL != rx->data ) {
+        if( 8 == rx->bits )
+            ((uint8_t*)rx->data)[k] = msg->data[2];
+        else if( 16 == rx->bits )
+            ((uint16_t*)rx->data)[k] = aa_endconv_ld_le_u16( &msg->data[2] );
+        else if (32 == rx->bits)
+            ((uint32_t*)rx->data)[k] = aa_endconv_ld_le_u32( &msg->data[2] );
+        else assert(0);
+    } // data
+    if( NULL != rx->state && msg->len >= 7) {
+        rx->state[k] = msg->data[6];
+    }
+    return 1;
+}
+
+/** Collect left[i] replies from each bus i in the order they arrive on
+    any bus, with the wait of the transport. Frames on a bus that owes
+    nothing are drained as stray. */
+static int pcio_group_msg_recv_any( pcio_group_t *g, const pcio_recv_t *rx, size_t *left ) {
+    const pcio_transport_t *tp = pcio_transport(g);
+    size_t n_left = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ ) n_left += left[i];
+    while( n_left ) {
+        int progress = 0;
+        for( size_t i = 0; i < g->bus_cnt; i++ ) {
+            int32_t n = (int32_t)(left[i] ? left[i] : AA_MAX( (size_t)1, g->bus[i].module_cnt ));
+            // Must init CMSG to zero, the esd library will not!
+            CMSG msg[n];
+            memset( msg, 0, sizeof(msg) );
+            int r = pcio_can_take( g, &g->bus[i], msg, &n );
+            if( NTCAN_SUCCESS != r ) {
+                PCIO_LOG( LOG_ERR, "bus index: %lu, canstring: %s", i, canResultString(r) );
+                return r;
+            }
+            for( int32_t m = 0; m < n; m++ ) {
+                if( left[i] && pcio_group_msg_accept( g, i, &msg[m], rx ) ) {
+                    left[i]--;
+                    n_left--;
+                    progress = 1;
+                } else if( ! left[i] ) {
+                    g->bus[i].stats.stray++;
                 }
             }
         }
+        if( progress || ! n_left ) continue;
+
+        // nothing waiting, sleep until a frame arrives on any bus
+        int r = tp->wait( g->transport_cx, PCIO_RX_TIMEOUT_MS );
+        if( NTCAN_SUCCESS != r ) {
+            for( size_t i = 0; i < g->bus_cnt; i++ ) {
+                if( ! left[i] ) continue;
+                pcio_bus_count( &g->bus[i], r, NULL, 0, NULL );
+                pcio_bus_failed( &g->bus[i], r );
+                PCIO_LOG( LOG_ERR, "bus index: %lu, %lu replies missing, canstring: %s",
+                          i, left[i], canResultString(r) );
+            }
+            return r;
+        }
     }
-    return status;
+    return NTCAN_SUCCESS;
 }
 
+/** Collects one reply from every module, or from those k with mask[k] set if mask is not NULL;
+    the entries of data and state of the other modules are left alone */
 static int pcio_group_msg_recv( pcio_group_t *g,
                                 int cmd_id, int mot_parm_id,
-                                void *data, int bits, uint8_t *state, size_t cnt ) {
+                                void *data, int bits, uint8_t *state, size_t cnt,
+                                const uint8_t *mask ) {
     assert( 32 == bits || 16 == bits || 8 == bits || 0 == bits );
     assert( (pcio_group_size( g ) == cnt && NULL != data) ||
             (0 == cnt && NULL == data ) );
 
-    uint8_t  *data8 = (uint8_t*)data;
-    uint16_t *data16 = (uint16_t*)data;
-    uint32_t *data32 = (uint32_t*)data;
-    size_t ia = 0;
+    const pcio_flat_t *f = &g->flat;
+    uint8_t got[f->n];
+    size_t skip[g->bus_cnt];
+    memset( got, 0, sizeof(got) );
+    memset( skip, 0, sizeof(skip) );
+    if( mask ) {
+        for( size_t k = 0; k < f->n; k++ ) {
+            if( ! mask[k] ) {
+                got[k] = 1;
+                skip[f->bus[k]]++;
+            }
+        }
+    }
+    pcio_recv_t rx = { cmd_id, mot_parm_id, data, bits, state, got };
+
+    // a transport that can wait on all busses at once takes the replies as they come
+    if( pcio_transport(g)->wait ) {
+        size_t left[g->bus_cnt];
+        for( size_t i = 0; i < g->bus_cnt; i++ )
+            left[i] = f->bus_off[i+1] - f->bus_off[i] - skip[i];
+        return pcio_group_msg_recv_any( g, &rx, left );
+    }
+
     for( size_t i = 0; i < g->bus_cnt; i ++ ) { // loop through buses
-        for( size_t j = 0; j < g->bus[i].module_cnt; ) { // count through modules
+        for( size_t j = f->bus_off[i] + skip[i]; j < f->bus_off[i+1]; ) { // count through modules
             // Must init CMSG to zero, the esd library will not!
             CMSG msg;
             memset( &msg, 0, sizeof(msg) );
-            int n = 1;
-            int r = canRead( g->bus[i].handle, &msg, &n, NULL );
+            int32_t n = 1;
+            int r = pcio_can_read( g, &g->bus[i], &msg, &n );
             if( NTCAN_SUCCESS != r ) { 
-						printf("bus index: %lu, module id: %lu, canstring: %s\n", i, j, canResultString(r) ); return r;}
-            assert( msg.len <= 8 );
-            int mod_id = PCIO_CANID_MODID( msg.id );
-            int msg_cmd_id = msg.data[0];
-            int msg_mot_parm_id = msg.data[1];
-            if(( msg.len >= 2 &&  // maybe get a parameter
-                 msg_cmd_id == cmd_id &&
-                 msg_mot_parm_id == mot_parm_id ) ||
-               ( 1 == msg.len &&  // special no param id commands
-                 msg_cmd_id == cmd_id &&
-                 mot_parm_id < 0 ) ) {
-                assert( msg.len - 2 >= bits/8 ||
-                        ( 1 == msg.len && mot_parm_id < 0 ) ); // ensures msg has enough bytes for requested data bits in data
-                for( size_t k = 0; k < g->bus[i].module_cnt; k++ ) { // find right module
-                    if(g->bus[i].module[k].id == mod_id ) {
-                        if( NULL != data ) {
-                            if( 8 == bits )
-                                data8[ia + k] = msg.data[2];
-                            else if( 16 == bits )
-                                data16[ia + k] = aa_endconv_ld_le_u16( &msg.data[2] );
-                            else if (32 == bits)
-                                data32[ia + k] = aa_endconv_ld_le_u32( &msg.data[2] );
-                            else assert(0);
-                        } // data
-                        if( NULL != state && msg.len >= 7) {
-                            state[ia + k] = msg.data[6];
-                        }
-                        j++;
-                        break;
-                    } // mod_id
-                } // for g->bus
-            } // msg
+						PCIO_LOG( LOG_ERR, "bus index: %lu, module id: %lu, canstring: %s", i, j - f->bus_off[i], canResultString(r) ); return r;}
+            if( pcio_group_msg_accept( g, i, &msg, &rx ) ) j++;
         } // for( size_t j...)
-        ia += g->bus[i].module_cnt;
     } // for( size_t i...)
     return NTCAN_SUCCESS;
 }
 
+/** Write one request per parameter to every module on the bus, back to
+    back, without waiting for any reply. A parameter id below zero
+    sends a special command without parameter (reset, home...). If mask
+    is not NULL, parameter p is only requested from the modules j with
+    mask[p*module_cnt + j] set.
+*/
+static int pcio_bus_burst_send( pcio_group_t *g, pcio_bus_t *bus, int idmask, int cmd_id,
+                                const int *parm_ids, size_t n_parm, const uint8_t *mask ) {
+    assert( n_parm <= PCIO_BURST_MAX );
+    size_t cnt = n_parm * bus->module_cnt;
+    CMSG msg[cnt];
+    memset( msg, 0, sizeof(msg) );
+    size_t k = 0;
+    for( size_t p = 0; p < n_parm; p++ ) {
+        for( size_t j = 0; j < bus->module_cnt; j++ ) {
+            if( mask && ! mask[p*bus->module_cnt + j] ) continue;
+            msg[k].id = idmask + bus->module[j].id;
+            msg[k].data[0] = (uint8_t)cmd_id;
+            if( parm_ids[p] >= 0 ) {
+                msg[k].data[1] = (uint8_t)parm_ids[p];
+                msg[k].len = 2;
+            } else {
+                msg[k].len = 1;
+            }
+            k++;
+        }
+    }
+
+    cnt = k;
+
+    // the driver may take fewer frames than offered
+    for( size_t sent = 0; sent < cnt; ) {
+        int32_t n = (int32_t)(cnt - sent);
+        int r = pcio_can_write( g, bus, &msg[sent], &n );
+        // a write that took nothing would have us spin, take it as a timeout
+        if( NTCAN_SUCCESS == r && n <= 0 ) r = NTCAN_TX_TIMEOUT;
+        if( NTCAN_SUCCESS != r ) {
+            PCIO_LOG( LOG_ERR, "CAN error sending burst on net %d: %d -- %s",
+                      bus->net, r, canResultString(r) );
+            pcio_can_flush( g );
+            return r;
+        }
+        sent += (size_t)n;
+    }
+    return pcio_can_flush( g );
+}
+
+/** Collect the replies to a burst, in whatever order they arrive.
+
+    vals[p*module_cnt + j] receives the 32-bit value of parameter
+    parm_ids[p] from module j; vals may be NULL for commands without
+    data. Replies that match no outstanding request are dropped, as are
+    replies to parameter p from modules j without mask[p*module_cnt + j]
+    set when mask is not NULL.
+*/
+static int pcio_bus_burst_recv( pcio_group_t *g, pcio_bus_t *bus, int cmd_id,
+                                const int *parm_ids, size_t n_parm, uint32_t *vals,
+                                const uint8_t *mask ) {
+    size_t m = bus->module_cnt;
+    size_t cnt = n_parm * m;
+    uint8_t got[cnt];
+    memset( got, 0, sizeof(got) );
+    size_t remaining = cnt;
+    size_t i = (size_t)(bus - g->bus);
+    const uint16_t *slot = &g->flat.slot[32*i];
+    size_t off = g->flat.bus_off[i];
+    if( mask ) {
+        for( size_t p = 0; p < n_parm; p++ ) {
+            for( size_t j = 0; j < m; j++ ) {
+                if( ! mask[p*m + j] ) {
+                    got[p*m + j] = 1;
+                    remaining--;
+                }
+            }
+        }
+    }
+
+    while( remaining > 0 ) {
+        // Must init CMSG to zero, the esd library will not!
+        CMSG msg[remaining];
+        memset( msg, 0, sizeof(msg) );
+        int32_t n = (int32_t)remaining;
+        int r = pcio_can_read( g, bus, msg, &n );
+        if( NTCAN_SUCCESS != r ) {
+            PCIO_LOG( LOG_ERR, "CAN error reading burst on net %d, %lu replies missing: %s",
+                      bus->net, (unsigned long)remaining, canResultString(r) );
+            return r;
+        }
+        for( int32_t f = 0; f < n; f++ ) {
+            // count the replies that match no outstanding request
+            bus->stats.stray++;
+            if( msg[f].len < 1 || msg[f].data[0] != cmd_id ) continue;
+            size_t j = slot[PCIO_CANID_MODID( msg[f].id )], p;
+            if( 0 == j ) continue;
+            j -= off + 1;
+            if( 1 == msg[f].len ) { // special no param id commands
+                for( p = 0; p < n_parm && parm_ids[p] >= 0; p++ );
+            } else {
+                for( p = 0; p < n_parm && parm_ids[p] != msg[f].data[1]; p++ );
+            }
+            if( p == n_parm || got[p*m + j] ) continue;
+            if( vals && parm_ids[p] >= 0 ) {
+                // 8 and 16-bit parameters come in shorter replies
+                uint8_t raw[4] = {0, 0, 0, 0};
+                if( msg[f].len < 3 ) continue;
+                memcpy( raw, &msg[f].data[2], (size_t)AA_MIN( msg[f].len - 2, 4 ) );
+                vals[p*m + j] = aa_endconv_ld_le_u32( raw );
+            }
+            got[p*m + j] = 1;
+            remaining--;
+            bus->stats.stray--;
+        }
+    }
+    return NTCAN_SUCCESS;
+}
+
 /*-------------------------*/
 /* Command/Param Send/Recv */
 /*-------------------------*/
 
 int pcio_group_all( pcio_group_t *g,
                     int cmd_id, int parm_id ) {
+    pcio_group_begin( g );
 
     for( size_t i = 0; i < g->bus_cnt; i++ ) {
         CMSG msg;
@@ -606,12 +1284,15 @@ int pcio_group_all( pcio_group_t *g,
             msg.len = 1;
         }
 
-        int n = 1;
-        int r = canWrite( g->bus[i].handle, &msg, &n, NULL );
+        int32_t n = 1;
+        int r = pcio_can_write( g, &g->bus[i], &msg, &n );
 
-        if( NTCAN_SUCCESS != r ) return r;
+        if( NTCAN_SUCCESS != r ) {
+            pcio_can_flush( g );
+            return r;
+        }
     }
-    return NTCAN_SUCCESS;
+    return pcio_can_flush( g );
 }
 
 int pcio_group_do( pcio_group_t *g, int id_mask,
@@ -619,6 +1300,15 @@ int pcio_group_do( pcio_group_t *g, int id_mask,
                    const void *txvals, int tx_bits, size_t n_tx,
                    void *rxvals, int rx_bits, uint8_t *state, size_t n_rx,
                    int continue_on_error ) {
+    return pcio_group_do_mask( g, id_mask, cmd_id, parm_id, txvals, tx_bits, n_tx,
+                               rxvals, rx_bits, state, n_rx, continue_on_error, NULL );
+}
+
+int pcio_group_do_mask( pcio_group_t *g, int id_mask,
+                        int cmd_id, int parm_id,
+                        const void *txvals, int tx_bits, size_t n_tx,
+                        void *rxvals, int rx_bits, uint8_t *state, size_t n_rx,
+                        int continue_on_error, const uint8_t *mask ) {
     assert( 32 == tx_bits || 0 == tx_bits );
     assert( 32 == rx_bits || 16 == rx_bits || 8 == rx_bits || 0 == rx_bits );
     assert( ( pcio_group_size(g) == n_tx && NULL != txvals ) ||
@@ -627,13 +1317,14 @@ int pcio_group_do( pcio_group_t *g, int id_mask,
             ( 0 == n_rx && NULL == rxvals ) );
 
     // build messages
+    pcio_group_begin( g );
     pcio_group_msg_setid( g, id_mask, cmd_id, parm_id );
     if( txvals )
         pcio_group_msg_set32( g, txvals );
 
     // send messages
     {
-        int r = pcio_group_msg_send( g, continue_on_error );
+        int r = pcio_group_msg_send( g, continue_on_error, mask );
         if( NTCAN_SUCCESS != r ) {
             return r;
         }
@@ -642,7 +1333,7 @@ int pcio_group_do( pcio_group_t *g, int id_mask,
     // collect response
     {
         int r = pcio_group_msg_recv( g, cmd_id, parm_id,
-                                     rxvals, rx_bits, state, n_rx );
+                                     rxvals, rx_bits, state, n_rx, mask );
         if( NTCAN_SUCCESS != r ) return r;
     }
 
@@ -652,6 +1343,11 @@ int pcio_group_do( pcio_group_t *g, int id_mask,
 
 int pcio_group_cmd_ack( pcio_group_t *g, double *ack, size_t cnt,
                         int motion_id, const double *cmd ) {
+    return pcio_group_cmd_ack_mask( g, ack, cnt, motion_id, cmd, NULL );
+}
+
+int pcio_group_cmd_ack_mask( pcio_group_t *g, double *ack, size_t cnt,
+                             int motion_id, const double *cmd, const uint8_t *mask ) {
     //somatic_verbprintf(2, "pcio_group_cmd_ack(0x%x)\n", motion_id);
     assert( PCIO_FVEL_ACK == motion_id || /* velocity command */
             PCIO_FCUR_ACK == motion_id || /* current command */
@@ -659,55 +1355,57 @@ int pcio_group_cmd_ack( pcio_group_t *g, double *ack, size_t cnt,
 
     assert( pcio_group_size(g) == cnt );
 
+    pcio_flat_t *f = &g->flat;
     float tx[cnt];
     float rx[cnt];
     uint8_t state[cnt];
-    memset(state,0,sizeof(state));
+    // modules left out keep their last state and position
+    memcpy(state,f->state,sizeof(state));
     memset(tx,0,sizeof(tx));
-    memset(rx,0,sizeof(rx));
+    pcio_d2s( rx, f->last_pos, cnt );
     pcio_d2s( tx, cmd, cnt );
 
-    for( size_t i = 0; i < g->bus_cnt; i ++ ) { // loop through buses
-        for( size_t j = 0; j < g->bus[i].module_cnt; j++) { // count through modules
-            if(g->bus[i].module[j].state % 2 == 1) {
-                fprintf(stderr, "Found error in bus, %d, id %d\n",
-                        g->bus[i].net, g->bus[i].module[j].id);
-                pcio_group_halt( g );
-                return 1;
-            }
+    for( size_t k = 0; k < cnt; k++ ) {
+        if(f->state[k] % 2 == 1) {
+            PCIO_LOG( LOG_ERR, "Found error in bus, %d, id %d",
+                      g->bus[f->bus[k]].net, f->id[k] );
+            pcio_group_halt( g );
+            return 1;
         }
     }
 
-    int r = pcio_group_do( g, PCIO_IDMASK_CMDPUT,
-                           PCIO_SET_MOTION, motion_id,
-                           tx, 32, (NULL != tx) ? cnt : 0,
-                           rx, 32, state, cnt,
-                           0 );
+    int r = pcio_group_do_mask( g, PCIO_IDMASK_CMDPUT,
+                                PCIO_SET_MOTION, motion_id,
+                                tx, 32, (NULL != tx) ? cnt : 0,
+                                rx, 32, state, cnt,
+                                0, mask );
     if( NTCAN_SUCCESS != r ) {
-        fprintf(stderr, "Couldn't send message, halting group\n");
+        PCIO_LOG( LOG_ERR, "Couldn't send message, halting group" );
         pcio_group_halt( g );
         return r;
     }
 
-    size_t k = 0;
+    return pcio_group_ack_finish( g, ack, cnt, rx, state );
+}
+
+/** Take the positions and short states of a motion ack, halting the
+    group if a module reports an error. */
+static int pcio_group_ack_finish( pcio_group_t *g, double *ack, size_t cnt,
+                                  const float *rx, const uint8_t *state ) {
+    pcio_flat_t *f = &g->flat;
+    memcpy( f->state, state, cnt );
     int halt = 0;
-    for( size_t i = 0; i < g->bus_cnt; i ++ ) { // loop through buses
-        for( size_t j = 0; j < g->bus[i].module_cnt; j++) { // count through modules
-            uint8_t s = state[k++];
-            g->bus[i].module[j].state = s;
-            if(s & PCIO_SHORT_NOT_OK) {
-                halt = 1;
-                fprintf(stderr, "Error in bus net %d, module id %d: "
-                        "short state 0x%x\n",
-                        g->bus[i].net, g->bus[i].module[j].id, s );
-            }
-            //printf("%x ", state[i]);
+    for( size_t k = 0; k < cnt; k++ ) {
+        if(state[k] & PCIO_SHORT_NOT_OK) {
+            halt = 1;
+            PCIO_LOG( LOG_ERR, "Error in bus net %d, module id %d: "
+                      "short state 0x%x",
+                      g->bus[f->bus[k]].net, f->id[k], state[k] );
         }
     }
-    //printf("\n");
 
     if(halt) {
-        fprintf(stderr, "Found error, halting group\n");
+        PCIO_LOG( LOG_ERR, "Found error, halting group" );
         pcio_group_halt( g );
         return PCIO_ERR_MODULE; // error
     }
@@ -720,7 +1418,89 @@ int pcio_group_cmd_ack( pcio_group_t *g, double *ack, size_t cnt,
         pcio_s2d( pos, rx, cnt );
         pcio_group_set_last_position( g, pos, cnt );
     }
-    return r;
+    return NTCAN_SUCCESS;
+}
+
+int pcio_group_step_ack( pcio_group_t *g, double *ack, size_t cnt,
+                         const double *pos, const uint16_t *time_ms, uint8_t *sent ) {
+    assert( pcio_group_size(g) == cnt );
+
+    pcio_flat_t *f = &g->flat;
+    float rx[cnt];
+    uint8_t state[cnt];
+    uint8_t mask[cnt];
+    memcpy(state,f->state,sizeof(state));
+    pcio_d2s( rx, f->last_pos, cnt );
+
+    // only the modules with room in their step buffer get a frame. The
+    // ack of the last step shows the buffer just after it was filled, so
+    // when it empties is told by the durations of the steps sent since.
+    double now = aa_tm_timespec2sec( aa_tm_now() );
+    uint16_t ms[cnt];
+    size_t n_room = 0;
+    for( size_t k = 0; k < cnt; k++ ) {
+        if(f->state[k] % 2 == 1) {
+            PCIO_LOG( LOG_ERR, "Found error in bus, %d, id %d",
+                      g->bus[f->bus[k]].net, f->id[k] );
+            pcio_group_halt( g );
+            return 1;
+        }
+        if( f->step_buf[k] && now >= f->step_run[k] ) {
+            f->step_run[k] = f->step_buf[k];
+            f->step_buf[k] = 0;
+        }
+        if( now >= f->step_run[k] ) f->step_run[k] = 0;
+
+        mask[k] = 0;
+        if( sent && ! sent[k] ) continue;
+        if( f->step_buf[k] ) continue;
+        // behind a running step, shorten this one to end when it would
+        // have from now
+        double start = AA_MAX( now, f->step_run[k] );
+        ms[k] = (uint16_t)AA_MAX( 1, lround( (now - start) * 1e3 ) + time_ms[k] );
+        mask[k] = 1;
+        n_room++;
+    }
+    if( sent ) memcpy( sent, mask, cnt );
+    if( 0 == n_room ) return pcio_group_ack_finish( g, ack, cnt, rx, state );
+
+    pcio_group_begin( g );
+    pcio_group_msg_setid( g, PCIO_IDMASK_CMDPUT, PCIO_SET_MOTION, PCIO_FSTEP_ACK );
+    for( size_t k = 0; k < cnt; k++ ) {
+        if( ! mask[k] ) continue;
+        float x = (float)pos[k];
+        uint32_t u;
+        memcpy( &u, &x, sizeof(u) );
+        f->msg[k].len = 8;
+        aa_endconv_st_le_u32( &f->msg[k].data[2], u );
+        aa_endconv_st_le_u16( &f->msg[k].data[6], ms[k] );
+    }
+
+    int r = pcio_group_msg_send( g, 0, mask );
+    if( NTCAN_SUCCESS == r )
+        r = pcio_group_msg_recv( g, PCIO_SET_MOTION, PCIO_FSTEP_ACK,
+                                 rx, 32, state, cnt, mask );
+    if( NTCAN_SUCCESS != r ) {
+        PCIO_LOG( LOG_ERR, "Couldn't send message, halting group" );
+        pcio_group_halt( g );
+        return r;
+    }
+
+    // the step starts at once on an idle module and is buffered behind a
+    // running one; the ack tells which, the running step ending soon
+    for( size_t k = 0; k < cnt; k++ ) {
+        if( ! mask[k] ) continue;
+        double d = (double)ms[k] / 1e3;
+        if( state[k] & PCIO_SHORT_FULLBUFFER ) {
+            f->step_run[k] = AA_MAX( now, f->step_run[k] );
+            f->step_buf[k] = f->step_run[k] + d;
+        } else {
+            f->step_run[k] = now + d;
+            f->step_buf[k] = 0;
+        }
+    }
+
+    return pcio_group_ack_finish( g, ack, cnt, rx, state );
 }
 
 int pcio_group_dump_error (pcio_group_t *g ) {
@@ -751,26 +1531,36 @@ int pcio_group_dump_error (pcio_group_t *g ) {
 
 int pcio_group_get( pcio_group_t *g, int parm_id,
                     void *vals, int bits, size_t n_vals ) {
+    return pcio_group_get_mask( g, parm_id, vals, bits, n_vals, NULL );
+}
 
-    return  pcio_group_do( g, PCIO_IDMASK_CMDGET,
-                           PCIO_GET_PARAM, parm_id,
-                           NULL, 32, 0,
-                           vals, bits, NULL, n_vals,
-                           0 );
+static int pcio_group_get_mask( pcio_group_t *g, int parm_id,
+                                void *vals, int bits, size_t n_vals, const uint8_t *mask ) {
+
+    return  pcio_group_do_mask( g, PCIO_IDMASK_CMDGET,
+                                PCIO_GET_PARAM, parm_id,
+                                NULL, 32, 0,
+                                vals, bits, NULL, n_vals,
+                                0, mask );
 }
 
 
 int pcio_group_setd( pcio_group_t *g, int parm_id,
                      const double *vals, size_t n_vals ) {
+    return pcio_group_setd_mask( g, parm_id, vals, n_vals, NULL );
+}
+
+int pcio_group_setd_mask( pcio_group_t *g, int parm_id,
+                          const double *vals, size_t n_vals, const uint8_t *mask ) {
     float svals[n_vals];
     pcio_d2s( svals, vals, n_vals );
     uint8_t ret[n_vals];
     //FIXME: should check status in ret
-    return  pcio_group_do( g, PCIO_IDMASK_CMDPUT,
-                           PCIO_SET_PARAM, parm_id,
-                           svals, 32, n_vals,
-                           ret, 8, NULL, n_vals,
-                           0 );
+    return  pcio_group_do_mask( g, PCIO_IDMASK_CMDPUT,
+                                PCIO_SET_PARAM, parm_id,
+                                svals, 32, n_vals,
+                                ret, 8, NULL, n_vals,
+                                0, mask );
 }
 
 int pcio_group_set32( pcio_group_t *g, int parm_id,
@@ -786,27 +1576,93 @@ int pcio_group_set32( pcio_group_t *g, int parm_id,
 
 int pcio_group_setu32( pcio_group_t *g, int parm_id,
                        const uint32_t *vals, size_t n_vals ) {
+    return pcio_group_setu32_mask( g, parm_id, vals, n_vals, NULL );
+}
+
+int pcio_group_setu32_mask( pcio_group_t *g, int parm_id,
+                            const uint32_t *vals, size_t n_vals, const uint8_t *mask ) {
     uint8_t ret[n_vals];
     //FIXME: should check status in ret
-    return  pcio_group_do( g, PCIO_IDMASK_CMDPUT,
-                           PCIO_SET_PARAM, parm_id,
-                           vals, 32, n_vals,
-                           ret, 8, NULL, n_vals,
-                           0 );
+    return  pcio_group_do_mask( g, PCIO_IDMASK_CMDPUT,
+                                PCIO_SET_PARAM, parm_id,
+                                vals, 32, n_vals,
+                                ret, 8, NULL, n_vals,
+                                0, mask );
 }
 
 
 int pcio_group_getd( pcio_group_t *g, int parm_id,
                      double *vals, size_t n_vals ) {
+    return pcio_group_getd_mask( g, parm_id, vals, n_vals, NULL );
+}
+
+int pcio_group_getd_mask( pcio_group_t *g, int parm_id,
+                          double *vals, size_t n_vals, const uint8_t *mask ) {
     float svals[n_vals];
-    int r = pcio_group_get( g, parm_id, svals, 32, n_vals );
-    pcio_s2d( vals, svals, n_vals );
-    if( (NTCAN_SUCCESS == r) && (PCIO_ACT_FPOS == parm_id) ) {
-        pcio_group_set_last_position( g, vals, n_vals );
+    int r = pcio_group_get_mask( g, parm_id, svals, 32, n_vals, mask );
+    for( size_t k = 0; k < n_vals; k++ ) {
+        if( mask && ! mask[k] ) continue;
+        vals[k] = svals[k];
+        if( (NTCAN_SUCCESS == r) && (PCIO_ACT_FPOS == parm_id) ) g->flat.last_pos[k] = vals[k];
     }
     return r;
 }
 
+int pcio_group_getv( pcio_group_t *g, const int *parm_ids, size_t n_parm,
+                     uint32_t *vals, size_t n_vals ) {
+    return pcio_group_getv_mask( g, parm_ids, n_parm, vals, n_vals, NULL );
+}
+
+int pcio_group_getv_mask( pcio_group_t *g, const int *parm_ids, size_t n_parm,
+                          uint32_t *vals, size_t n_vals, const uint8_t *mask ) {
+    assert( pcio_group_size(g) == n_vals );
+    const pcio_flat_t *f = &g->flat;
+
+    // send every request on every bus first, so the busses and modules work in parallel
+    pcio_group_begin( g );
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        size_t m = g->bus[i].module_cnt, off = f->bus_off[i];
+        uint8_t bmask[n_parm * m];
+        if( mask )
+            for( size_t p = 0; p < n_parm; p++ )
+                memcpy( &bmask[p*m], &mask[p*n_vals + off], m );
+        CHECK_RETURN( pcio_bus_burst_send( g, &g->bus[i], PCIO_IDMASK_CMDGET, PCIO_GET_PARAM,
+                                           parm_ids, n_parm, mask ? bmask : NULL ) );
+    }
+
+    // then collect, scattering each bus into the group-wide rows
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        size_t m = g->bus[i].module_cnt, off = f->bus_off[i];
+        uint32_t bvals[n_parm * m];
+        uint8_t bmask[n_parm * m];
+        if( mask )
+            for( size_t p = 0; p < n_parm; p++ )
+                memcpy( &bmask[p*m], &mask[p*n_vals + off], m );
+        CHECK_RETURN( pcio_bus_burst_recv( g, &g->bus[i], PCIO_GET_PARAM,
+                                           parm_ids, n_parm, bvals, mask ? bmask : NULL ) );
+        for( size_t p = 0; p < n_parm; p++ ) {
+            if( mask ) {
+                for( size_t j = 0; j < m; j++ )
+                    if( mask[p*n_vals + off + j] ) vals[p*n_vals + off + j] = bvals[p*m + j];
+            } else {
+                memcpy( &vals[p*n_vals + off], &bvals[p*m], m * sizeof(bvals[0]) );
+            }
+        }
+    }
+
+    for( size_t p = 0; p < n_parm; p++ ) {
+        if( PCIO_ACT_FPOS == parm_ids[p] ) {
+            for( size_t k = 0; k < n_vals; k++ ) {
+                if( mask && ! mask[p*n_vals + k] ) continue;
+                float x;
+                memcpy( &x, &vals[p*n_vals + k], sizeof(x) );
+                f->last_pos[k] = x;
+            }
+        }
+    }
+    return NTCAN_SUCCESS;
+}
+
 int pcio_group_get16( pcio_group_t *g, int parm_id,
                       int16_t *vals, size_t n_vals ) {
     return  pcio_group_get( g, parm_id, vals, 16, n_vals );
@@ -822,6 +1678,11 @@ int pcio_group_getu32( pcio_group_t *g, int parm_id,
     return  pcio_group_get( g, parm_id, vals, 32, n_vals );
 }
 
+int pcio_group_getu32_mask( pcio_group_t *g, int parm_id,
+                            uint32_t *vals, size_t n_vals, const uint8_t *mask ) {
+    return  pcio_group_get_mask( g, parm_id, vals, 32, n_vals, mask );
+}
+
 
 /*-------------------*/
 /* Specific Commands */
@@ -829,11 +1690,7 @@ int pcio_group_getu32( pcio_group_t *g, int parm_id,
 
 int pcio_group_reset( pcio_group_t *g ) {
     // somatic_verbprintf(2, "pcio_group_reset()\n");
-    for( size_t i = 0; i < g->bus_cnt; i ++ ) { // loop through buses
-        for( size_t j = 0; j < g->bus[i].module_cnt; j++ ) { // count through modules
-            g->bus[i].module[j].state = 0;
-        }
-    }
+    memset( g->flat.state, 0, g->flat.n );
     return pcio_group_do( g, PCIO_IDMASK_CMDPUT,
                           PCIO_RESET, -1,
                           NULL, 0, 0,
@@ -857,6 +1714,165 @@ int pcio_group_home( pcio_group_t *g ) {
                           0 );
 }
 
+/// Long state bits that end a homing run in failure
+#define PCIO_HOME_FAILED ( PCIO_STATE_ERROR | PCIO_STATE_POWERFAULT | PCIO_STATE_HALTED )
+
+/// How long pcio_group_home_wait sleeps between polls of the state words
+#define PCIO_HOME_POLL_US 20000
+
+int pcio_group_home_wait( pcio_group_t *g, size_t batch, double timeout, double *elapsed ) {
+    const pcio_flat_t *f = &g->flat;
+    size_t n = f->n;
+    const int parm = PCIO_PARAM_ERROR;
+    // 0: waiting to start, 1: started, 2: homing seen, 3: homed, 4: failed
+    uint8_t phase[n];
+    uint8_t mask[n];
+    uint32_t error[n];
+    struct timespec start[n];
+    size_t left = n;
+    memset( phase, 0, sizeof(phase) );
+    for( size_t k = 0; k < n; k++ ) elapsed[k] = -1;
+
+    struct timespec t0 = aa_tm_now();
+    while( left ) {
+        // start the next modules of each bus while fewer than batch are homing
+        size_t n_start = 0;
+        memset( mask, 0, sizeof(mask) );
+        for( size_t i = 0; i < g->bus_cnt; i++ ) {
+            size_t homing = 0;
+            for( size_t k = f->bus_off[i]; k < f->bus_off[i+1]; k++ ) {
+                if( 1 == phase[k] || 2 == phase[k] ) homing++;
+                else if( 0 == phase[k] && (0 == batch || homing < batch) ) {
+                    mask[k] = 1;
+                    homing++;
+                    n_start++;
+                }
+            }
+        }
+        if( n_start ) {
+            CHECK_RETURN( pcio_group_do_mask( g, PCIO_IDMASK_CMDPUT,
+                                              PCIO_HOME, -1,
+                                              NULL, 0, 0,
+                                              NULL, 0, NULL, 0,
+                                              0, mask ) );
+            struct timespec now = aa_tm_now();
+            for( size_t k = 0; k < n; k++ ) {
+                if( mask[k] ) {
+                    phase[k] = 1;
+                    start[k] = now;
+                }
+            }
+        }
+
+        usleep( PCIO_HOME_POLL_US );
+
+        // one pipelined read of the state words of the modules still homing
+        for( size_t k = 0; k < n; k++ ) mask[k] = (1 == phase[k] || 2 == phase[k]);
+        CHECK_RETURN( pcio_group_getv_mask( g, &parm, 1, error, n, mask ) );
+        struct timespec now = aa_tm_now();
+        for( size_t k = 0; k < n; k++ ) {
+            if( ! mask[k] ) continue;
+            // HOME_OK left over from an earlier homing does not count
+            // until the module has shown this run
+            if( (error[k] & PCIO_STATE_MOTION) || !(error[k] & PCIO_STATE_HOME_OK) )
+                phase[k] = 2;
+            if( error[k] & PCIO_HOME_FAILED ) {
+                PCIO_LOG( LOG_ERR, "Homing failed on bus net %d, module id %d: "
+                          "state 0x%x", g->bus[f->bus[k]].net, f->id[k], error[k] );
+                phase[k] = 4;
+                left--;
+            } else if( 2 == phase[k] && !(error[k] & PCIO_STATE_MOTION) &&
+                       (error[k] & PCIO_STATE_HOME_OK) ) {
+                phase[k] = 3;
+                elapsed[k] = aa_tm_timespec2sec( aa_tm_sub( now, start[k] ) );
+                left--;
+            }
+        }
+
+        if( left && aa_tm_timespec2sec( aa_tm_sub( now, t0 ) ) > timeout ) {
+            for( size_t k = 0; k < n; k++ ) {
+                if( phase[k] < 3 )
+                    PCIO_LOG( LOG_ERR, "Homing timed out on bus net %d, module id %d",
+                              g->bus[f->bus[k]].net, f->id[k] );
+            }
+            return NTCAN_RX_TIMEOUT;
+        }
+    }
+
+    for( size_t k = 0; k < n; k++ )
+        if( 4 == phase[k] ) return PCIO_ERR_MODULE;
+    return NTCAN_SUCCESS;
+}
+
+
+/*--------------*/
+/* Bus Recovery */
+/*--------------*/
+
+int pcio_bus_flush( pcio_group_t *g, size_t i, size_t *n ) {
+    pcio_bus_t *bus = &g->bus[i];
+    size_t cnt = 0;
+    // a babbling bus must not keep us here, stop after a full queue
+    size_t max = PCIO_BURST_MAX * bus->module_cnt;
+    int r = NTCAN_SUCCESS;
+    while( cnt <= max ) {
+        CMSG msg[16];
+        memset( msg, 0, sizeof(msg) );
+        int32_t len = 16;
+        r = pcio_can_take( g, bus, msg, &len );
+        if( NTCAN_SUCCESS != r || 0 == len ) break;
+        cnt += (size_t)len;
+    }
+    bus->stats.stray += cnt;
+    if( n ) *n = cnt;
+    return r;
+}
+
+int pcio_bus_rebind( pcio_group_t *g, size_t i ) {
+    pcio_bus_t *bus = &g->bus[i];
+    pcio_bus_begin( g, bus );
+    return pcio_bus_bind( g, bus );
+}
+
+int pcio_bus_reopen( pcio_group_t *g, size_t i ) {
+    pcio_bus_t *bus = &g->bus[i];
+    pcio_bus_begin( g, bus );
+    // the old handle may be dead already, that's why we are here
+    pcio_transport(g)->close( g->transport_cx, bus->handle );
+    return pcio_bus_open( g, bus, NULL );
+}
+
+int pcio_bus_get_error( pcio_group_t *g, size_t i, uint32_t *error ) {
+    pcio_bus_t *bus = &g->bus[i];
+    const int parm = PCIO_PARAM_ERROR;
+    pcio_bus_begin( g, bus );
+    CHECK_RETURN( pcio_bus_burst_send( g, bus, PCIO_IDMASK_CMDGET, PCIO_GET_PARAM,
+                                       &parm, 1, NULL ) );
+    return pcio_bus_burst_recv( g, bus, PCIO_GET_PARAM, &parm, 1, error, NULL );
+}
+
+int pcio_bus_reset( pcio_group_t *g, size_t i, const uint8_t *reset ) {
+    pcio_bus_t *bus = &g->bus[i];
+    const int no_parm = -1;
+    pcio_bus_begin( g, bus );
+    CHECK_RETURN( pcio_bus_burst_send( g, bus, PCIO_IDMASK_CMDPUT, PCIO_RESET,
+                                       &no_parm, 1, reset ) );
+    CHECK_RETURN( pcio_bus_burst_recv( g, bus, PCIO_RESET, &no_parm, 1, NULL, reset ) );
+    uint8_t *state = &g->flat.state[g->flat.bus_off[i]];
+    for( size_t j = 0; j < bus->module_cnt; j++ )
+        if( NULL == reset || reset[j] ) state[j] = 0;
+    return NTCAN_SUCCESS;
+}
+
+int pcio_bus_halt( pcio_group_t *g, size_t i ) {
+    pcio_bus_t *bus = &g->bus[i];
+    const int no_parm = -1;
+    pcio_bus_begin( g, bus );
+    CHECK_RETURN( pcio_bus_burst_send( g, bus, PCIO_IDMASK_CMDPUT, PCIO_HALT,
+                                       &no_parm, 1, NULL ) );
+    return pcio_bus_burst_recv( g, bus, PCIO_HALT, &no_parm, 1, NULL, NULL );
+}
+
 
 int pcio_group_at_home( pcio_group_t *g ) {
     // set the new home position be the the current position plus the
@@ -963,52 +1979,36 @@ int pcio_group_at_pos( pcio_group_t *g, const double *pos ) {
 }
 
 void pcio_group_set_last_position( pcio_group_t *g, const double *pos, size_t cnt ) {
-    assert( cnt = pcio_group_size(g) );
-
-    size_t i_val = 0;
-    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-        pcio_bus_t * bus = &g->bus[i_bus];
-        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod, ++i_val ) {
-            pcio_module_t * mod = &bus->module[i_bus_mod];
-//            if( mod->last_pos != pos[i_val] ) {
-                mod->last_pos = pos[i_val];
-//                fprintf( stderr, "%u,%u: position change: %f\n",
-//                         bus->net, mod->id, pos[i_val] );
-//            }
-        }
-    }
+    assert( cnt == pcio_group_size(g) );
+    memcpy( g->flat.last_pos, pos, cnt * sizeof(pos[0]) );
 }
 
 void pcio_group_limit_current( pcio_group_t *g, double * cur, size_t cnt ) {
     assert( pcio_group_size(g) == cnt );
 
-    fprintf(stderr, "Limiting current...\n");
+    PCIO_LOG( LOG_DEBUG, "Limiting current..." );
 
     //// std. motion equation with x_0 = 0
     //const double delta_pos = vel * delta_t + acc * delta_t * delta_t / 2;
 
-    size_t i_val = 0;
-    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-        pcio_bus_t * bus = &g->bus[i_bus];
-        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod, ++i_val ) {
-            pcio_module_t * mod = &bus->module[i_bus_mod];
-
-            fprintf( stderr, "%u,%u:\t%f <= %f <= %f\t\t%f\n",
-                     bus->net, mod->id, mod->min_pos, mod->last_pos,
-                     mod->max_pos, cur[i_val] );
-            if( mod->last_pos < mod->min_pos ) {
-                if( cur[i_val] > 0.0 ) {
-                    fprintf( stderr, "%u,%u caused MIN limit with: %f   at: %f\n",
-                             bus->net, mod->id, cur[i_val], mod->last_pos );
-                    cur[i_val] = 0.0;
-                }
+    const pcio_flat_t *f = &g->flat;
+    for( size_t k = 0; k < cnt; k++ ) {
+        int net = g->bus[f->bus[k]].net;
+        PCIO_LOG( LOG_DEBUG, "%u,%u:\t%f <= %f <= %f\t\t%f",
+                  net, f->id[k], f->min_pos[k], f->last_pos[k],
+                  f->max_pos[k], cur[k] );
+        if( f->last_pos[k] < f->min_pos[k] ) {
+            if( cur[k] > 0.0 ) {
+                PCIO_LOG( LOG_WARNING, "%u,%u caused MIN limit with: %f   at: %f",
+                          net, f->id[k], cur[k], f->last_pos[k] );
+                cur[k] = 0.0;
             }
-            else if( mod->last_pos > mod->max_pos ) {
-                if( cur[i_val] < 0.0 ) {
-                    fprintf( stderr, "%u,%u caused MAX limit with: %f   at: %f\n",
-                             bus->net, mod->id, cur[i_val], mod->last_pos );
-                    cur[i_val] = 0.0;
-                }
+        }
+        else if( f->last_pos[k] > f->max_pos[k] ) {
+            if( cur[k] < 0.0 ) {
+                PCIO_LOG( LOG_WARNING, "%u,%u caused MAX limit with: %f   at: %f",
+                          net, f->id[k], cur[k], f->last_pos[k] );
+                cur[k] = 0.0;
             }
         }
     }
@@ -1018,70 +2018,14 @@ void pcio_group_limit_velocity( pcio_group_t *g, double *vel, size_t cnt,
                                 double delta_t ) {
     assert( pcio_group_size(g) == cnt );
 
-//    fprintf( stderr, "Min:");
-//    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-//        pcio_bus_t * bus = &g->bus[i_bus];
-//        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod )
-//            fprintf( stderr, " %f", bus->module[i_bus_mod].min_pos );
-//    }
-//    fprintf( stderr, "\n" );
-//
-//    fprintf( stderr, "Act:");
-//    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-//        pcio_bus_t * bus = &g->bus[i_bus];
-//        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod )
-//            fprintf( stderr, " %f", bus->module[i_bus_mod].last_pos );
-//    }
-//    fprintf( stderr, "\n" );
-//
-//    fprintf( stderr, "Max:");
-//    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-//        pcio_bus_t * bus = &g->bus[i_bus];
-//        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod )
-//            fprintf( stderr, " %f", bus->module[i_bus_mod].max_pos );
-//    }
-//    fprintf( stderr, "\n" );
-//
-//    fprintf( stderr, "Vel:");
-//    for( size_t i = 0; i < cnt; ++i )
-//        fprintf( stderr, " %f", vel[i] );
-//    fprintf( stderr, "\n" );
-
-    size_t i_val = 0;
-    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-        pcio_bus_t * bus = &g->bus[i_bus];
-        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod, ++i_val ) {
-            pcio_module_t * mod = &bus->module[i_bus_mod];
-
-//            // The distance to the limit
-//            const double dist = ( vel[i_val] < 0.0 )
-//                    ? (mod->last_pos - mod->min_pos)
-//                    : (mod->max_pos - mod->last_pos);
-//
-//            // The time it would take to get from the limit to here,
-//            // from a full stop at max acceleration
-//            const double time_to_pos = (dist / mod->max_acc / mod->max_acc);
-//
-//            // acceleration time excluding this step
-//            const double slack_time = (time_to_pos < delta_t) ? 0.0 : (time_to_pos - delta_t);
-//
-//            // Max speed given max acceleration at the end of this step
-//            const double max_speed = slack_time * mod->max_acc;
-//
-//            if( fabs(vel[i_val]) > max_speed ) {
-//                fprintf( stderr, "%u,%u caused velocity limit: %f\t%f\n",
-//                        bus->net, mod->id, vel[i_val], max_speed );
-//                if( vel[i_val] < 0 )
-//                    vel[i_val] = -max_speed;
-//                else
-//                    vel[i_val] = max_speed;
-//            }
-            const double new_pos = mod->last_pos + vel[i_val] * delta_t;
-            if(new_pos < mod->min_pos) {
-                vel[i_val] = (mod->min_pos - mod->last_pos) / delta_t;
-            } else if( new_pos > mod->max_pos ) {
-                vel[i_val] = (mod->max_pos - mod->last_pos) / delta_t;
-            }
+    // don't run past a limit within this step
+    const pcio_flat_t *f = &g->flat;
+    for( size_t k = 0; k < cnt; k++ ) {
+        const double new_pos = f->last_pos[k] + vel[k] * delta_t;
+        if(new_pos < f->min_pos[k]) {
+            vel[k] = (f->min_pos[k] - f->last_pos[k]) / delta_t;
+        } else if( new_pos > f->max_pos[k] ) {
+            vel[k] = (f->max_pos[k] - f->last_pos[k]) / delta_t;
         }
     }
 }
@@ -1090,26 +2034,13 @@ void pcio_group_limit_position( pcio_group_t *g, double *pos, size_t cnt )
 {
     assert( pcio_group_size(g) == cnt );
 
-//    fprintf(stderr, "Limiting position...\n");
-
-//    // std. motion equation with x_0 = 0
-//    const double delta_pos = vel * delta_t + acc * delta_t * delta_t / 2;
-
-    size_t i_val = 0;
-    for( size_t i_bus = 0; i_bus < g->bus_cnt; ++i_bus ) {
-        pcio_bus_t * bus = &g->bus[i_bus];
-        for( size_t i_bus_mod = 0; i_bus_mod < bus->module_cnt; ++i_bus_mod, ++i_val ) {
-            pcio_module_t * mod = &bus->module[i_bus_mod];
-            if( pos[i_val] < mod->min_pos ) {
-//                fprintf( stderr, "%u,%u caused MIN limit with: %f\n",
-//                         bus->net, mod->id, pos[i_val] );
-                pos[i_val] = mod->min_pos;
-            }
-            else if( pos[i_val] > mod->max_pos ) {
-//                fprintf( stderr, "%u,%u caused MIN limit with: %f\n",
-//                                         bus->net, mod->id, pos[i_val] );
-                pos[i_val] = mod->max_pos;
-            }
+    const pcio_flat_t *f = &g->flat;
+    for( size_t k = 0; k < cnt; k++ ) {
+        if( pos[k] < f->min_pos[k] ) {
+            pos[k] = f->min_pos[k];
+        }
+        else if( pos[k] > f->max_pos[k] ) {
+            pos[k] = f->max_pos[k];
         }
     }
 }
@@ -1217,14 +2148,26 @@ void pcio_resolve_module_state_word(int level, uint32_t msg) {
 }
 
 int pcio_state_word_contains_errors( uint32_t msg ) {
-    size_t i;
-    for ( i = 0; i < sizeof(states) / sizeof(state_msg_t); i++) {
-        if ( (msg & states[i].value) == states[i].value
-             && 0 == strcmp(states[i].type, ERROR_MSG) ) {
-            return 1;
-        }
-    }
-    return 0;
+    return 0 != (msg & PCIO_STATE_FAULTS);
+}
+
+/// Long state bit of each bit of the short state byte
+static const uint32_t short_state_bits[8] = {
+    0, /* PCIO_SHORT_NOT_OK */
+    PCIO_STATE_SWR,
+    PCIO_STATE_SW1,
+    PCIO_STATE_SW2,
+    PCIO_STATE_MOTION,
+    PCIO_STATE_RAMP_END,
+    PCIO_STATE_INPROGRESS,
+    PCIO_STATE_FULLBUFFER
+};
+
+uint32_t pcio_short_state_word( uint8_t state ) {
+    uint32_t word = 0;
+    for( unsigned b = 0; state; b++, state >>= 1 )
+        if( state & 1 ) word |= short_state_bits[b];
+    return word;
 }
 
 
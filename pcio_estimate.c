@@ -0,0 +1,225 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/**
+ * \file pcio_estimate.c
+ * \brief Per joint Kalman filter predicting the state between polls
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "pcio_estimate.h"
+
+/// Default variance of the acceleration the command model does not explain, (rad/s^2)^2
+#define PCIO_ESTIMATE_ACC_VAR 1.0
+/// Default variance of a position read, rad^2
+#define PCIO_ESTIMATE_POS_VAR 1e-6
+/// Default variance of a velocity read, (rad/s)^2
+#define PCIO_ESTIMATE_VEL_VAR 1e-4
+/// Variance of a position not yet read when the filter is seeded, rad^2
+#define PCIO_ESTIMATE_UNREAD_VAR 1.0
+
+static double pcio_estimate_dt( const struct timespec *a, const struct timespec *b ) {
+    return (double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec) * 1e-9;
+}
+
+int pcio_estimate_init( pcio_estimate_t *est, size_t n, const double *max_acc,
+                        double pos_vel, double pos_acc ) {
+    memset( est, 0, sizeof(*est) );
+    double *buf = (double*)calloc( 7 * (n ? n : 1), sizeof(double) );
+    if( NULL == buf ) return -1;
+    est->n = n;
+    est->pos = buf;
+    est->vel = buf + n;
+    est->p_pp = buf + 2*n;
+    est->p_pv = buf + 3*n;
+    est->p_vv = buf + 4*n;
+    est->max_acc = buf + 5*n;
+    est->u = buf + 6*n;
+    if( max_acc ) memcpy( est->max_acc, max_acc, n * sizeof(double) );
+    est->pos_vel = pos_vel;
+    est->pos_acc = pos_acc;
+    est->acc_var = PCIO_ESTIMATE_ACC_VAR;
+    est->pos_var = PCIO_ESTIMATE_POS_VAR;
+    est->vel_var = PCIO_ESTIMATE_VEL_VAR;
+    est->cmd = PCIO_ESTIMATE_FREE;
+    return 0;
+}
+
+void pcio_estimate_destroy( pcio_estimate_t *est ) {
+    free( est->pos );
+    memset( est, 0, sizeof(*est) );
+}
+
+void pcio_estimate_command( pcio_estimate_t *est, pcio_estimate_cmd_t cmd, const double *u ) {
+    est->cmd = cmd;
+    if( (PCIO_ESTIMATE_VEL == cmd || PCIO_ESTIMATE_POS == cmd) && u )
+        memcpy( est->u, u, est->n * sizeof(double) );
+}
+
+/// Motion of joint i over dt under the last command, from position x and velocity v
+static void pcio_estimate_move( const pcio_estimate_t *est, size_t i, double dt,
+                                double *x, double *v ) {
+    double vt;
+    switch( est->cmd ) {
+    case PCIO_ESTIMATE_VEL: vt = est->u[i]; break;
+    case PCIO_ESTIMATE_STOP: vt = 0; break;
+    case PCIO_ESTIMATE_POS:
+        vt = est->u[i] > *x ? est->pos_vel : (est->u[i] < *x ? -est->pos_vel : 0);
+        break;
+    default:
+        *x += *v * dt;
+        return;
+    }
+
+    // Ramp to the target velocity, then hold it
+    double a = PCIO_ESTIMATE_POS == est->cmd && est->pos_acc > 0 ? est->pos_acc : est->max_acc[i];
+    double tr = a > 0 ? fabs(vt - *v) / a : 0;
+    if( tr > dt ) {
+        double s = vt > *v ? a : -a;
+        *x += *v * dt + 0.5 * s * dt * dt;
+        *v += s * dt;
+    } else {
+        *x += 0.5 * (*v + vt) * tr + vt * (dt - tr);
+        *v = vt;
+    }
+
+    // A position command stops at its target
+    if( PCIO_ESTIMATE_POS == est->cmd && vt != 0 &&
+        (vt > 0 ? *x >= est->u[i] : *x <= est->u[i]) ) {
+        *x = est->u[i];
+        *v = 0;
+    }
+}
+
+/// Covariance of joint i after dt under the constant velocity model
+static void pcio_estimate_grow( const pcio_estimate_t *est, size_t i, double dt,
+                                double *pp, double *pv, double *vv ) {
+    double q = est->acc_var;
+    double dt2 = dt * dt;
+    *pp = est->p_pp[i] + 2 * dt * est->p_pv[i] + dt2 * est->p_vv[i] + q * dt2 * dt2 / 4;
+    *pv = est->p_pv[i] + dt * est->p_vv[i] + q * dt2 * dt / 2;
+    *vv = est->p_vv[i] + q * dt2;
+}
+
+void pcio_estimate_measure( pcio_estimate_t *est, const struct timespec *t,
+                            const double *pos, const uint8_t *pos_mask,
+                            const double *vel, const uint8_t *vel_mask ) {
+    if( NULL == pos && NULL == vel ) return;
+
+    // The first measurement sets the state; an unread velocity starts at rest and unknown
+    if( !est->measured ) {
+        if( NULL == pos ) return;
+        for( size_t i = 0; i < est->n; i++ ) {
+            int read_vel = vel && (NULL == vel_mask || vel_mask[i]);
+            est->pos[i] = pos[i];
+            est->vel[i] = read_vel ? vel[i] : 0;
+            est->p_pp[i] = (NULL == pos_mask || pos_mask[i]) ? est->pos_var : PCIO_ESTIMATE_UNREAD_VAR;
+            est->p_pv[i] = 0;
+            est->p_vv[i] = read_vel ? est->vel_var : est->pos_vel * est->pos_vel;
+        }
+        est->measured = 1;
+        est->t = *t;
+        est->seq++;
+        return;
+    }
+
+    double dt = pcio_estimate_dt( &est->t, t );
+    if( dt < 0 ) dt = 0;
+    for( size_t i = 0; i < est->n; i++ ) {
+        double x = est->pos[i], v = est->vel[i];
+        double pp, pv, vv;
+        pcio_estimate_move( est, i, dt, &x, &v );
+        pcio_estimate_grow( est, i, dt, &pp, &pv, &vv );
+
+        // Position read
+        if( pos && (NULL == pos_mask || pos_mask[i]) ) {
+            double s = pp + est->pos_var;
+            double kx = pp / s, kv = pv / s;
+            double y = pos[i] - x;
+            x += kx * y;
+            v += kv * y;
+            vv -= kv * pv;
+            pv *= 1 - kx;
+            pp *= 1 - kx;
+        }
+
+        // Velocity read
+        if( vel && (NULL == vel_mask || vel_mask[i]) ) {
+            double s = vv + est->vel_var;
+            double kx = pv / s, kv = vv / s;
+            double y = vel[i] - v;
+            x += kx * y;
+            v += kv * y;
+            pp -= kx * pv;
+            pv *= 1 - kv;
+            vv *= 1 - kv;
+        }
+
+        est->pos[i] = x;
+        est->vel[i] = v;
+        est->p_pp[i] = pp;
+        est->p_pv[i] = pv;
+        est->p_vv[i] = vv;
+    }
+    est->t = *t;
+    est->seq++;
+}
+
+int64_t pcio_estimate_predict( const pcio_estimate_t *est, const struct timespec *t,
+                               pcio_estimate_joint_t *x ) {
+    if( !est->measured ) return -1;
+    int64_t age = (int64_t)(t->tv_sec - est->t.tv_sec) * 1000000000 + (t->tv_nsec - est->t.tv_nsec);
+    if( age < 0 ) age = 0;
+    double dt = (double)age * 1e-9;
+    for( size_t i = 0; i < est->n; i++ ) {
+        double pv;
+        x[i].pos = est->pos[i];
+        x[i].vel = est->vel[i];
+        pcio_estimate_move( est, i, dt, &x[i].pos, &x[i].vel );
+        pcio_estimate_grow( est, i, dt, &x[i].pos_var, &pv, &x[i].vel_var );
+    }
+    return age;
+}
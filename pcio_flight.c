@@ -0,0 +1,200 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+/**
+ * \file pcio_flight.c
+ * \brief In-memory ring of the last cycles of a group, dumped on faults
+ */
+
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "pcio_flight.h"
+
+static uint64_t pcio_flight_ns( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/// Bytes of a row of n joints, kept a multiple of 8 so the arrays of every row are aligned
+static size_t pcio_flight_row_size( size_t n ) {
+    size_t size = sizeof(pcio_flight_row_t) + 3 * n * sizeof(double) + n;
+    return (size + 7) & ~(size_t)7;
+}
+
+int pcio_flight_init( pcio_flight_t *f, const char *name, size_t n, size_t capacity ) {
+    memset( f, 0, sizeof(*f) );
+    if( 0 == n || 0 == capacity ) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t row_size = pcio_flight_row_size( n );
+    f->size = sizeof(pcio_flight_header_t) + capacity * row_size;
+
+    // touch every page now, so adding rows never faults
+    f->hdr = (pcio_flight_header_t*)malloc( f->size );
+    if( NULL == f->hdr ) return -1;
+    memset( f->hdr, 0, f->size );
+
+    pcio_flight_header_t *h = f->hdr;
+    h->magic = PCIO_FLIGHT_MAGIC;
+    h->version = PCIO_FLIGHT_VERSION;
+    h->n = (uint32_t)n;
+    h->row_size = (uint32_t)row_size;
+    h->capacity = capacity;
+    h->t0_ns = pcio_flight_ns( CLOCK_MONOTONIC );
+    h->t0_realtime_ns = (int64_t)pcio_flight_ns( CLOCK_REALTIME );
+    if( name ) strncpy( h->name, name, sizeof(h->name) - 1 );
+    return 0;
+}
+
+void pcio_flight_destroy( pcio_flight_t *f ) {
+    free( f->hdr );
+    f->hdr = NULL;
+    f->size = 0;
+}
+
+void pcio_flight_commit( pcio_flight_t *f ) {
+    __atomic_store_n( &f->hdr->head, f->hdr->head + 1, __ATOMIC_RELEASE );
+}
+
+void pcio_flight_copy( pcio_flight_t *dst, const pcio_flight_t *src ) {
+    assert( dst->size == src->size );
+    memcpy( dst->hdr, src->hdr, src->size );
+}
+
+static int pcio_flight_write( int fd, const void *buf, size_t len ) {
+    while( len ) {
+        ssize_t k = write( fd, buf, len );
+        if( k < 0 && EINTR == errno ) continue;
+        if( k < 0 ) return -1;
+        buf = (const uint8_t*)buf + k;
+        len -= (size_t)k;
+    }
+    return 0;
+}
+
+int pcio_flight_dump( pcio_flight_t *f, const char *path, const char *reason ) {
+    pcio_flight_header_t *h = f->hdr;
+
+    // only what is signal safe from here: no stdio, no allocation
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    h->dump_ns = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+    size_t i = 0;
+    for( ; reason && reason[i] && i < sizeof(h->reason) - 1; i++ ) h->reason[i] = reason[i];
+    for( ; i < sizeof(h->reason); i++ ) h->reason[i] = '\0';
+
+    int e = errno;
+    int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( fd < 0 ) return -1;
+    int r = pcio_flight_write( fd, h, f->size );
+    if( r ) e = errno;
+    close( fd );
+    errno = e;
+    return r;
+}
+
+int pcio_flight_open( pcio_flight_t *f, const char *path ) {
+    memset( f, 0, sizeof(*f) );
+    int fd = open( path, O_RDONLY );
+    if( fd < 0 ) return -1;
+    pcio_flight_header_t h;
+    struct stat st;
+    ssize_t k = read( fd, &h, sizeof(h) );
+    int ok = ( (ssize_t)sizeof(h) == k && 0 == fstat( fd, &st ) &&
+               PCIO_FLIGHT_MAGIC == h.magic && PCIO_FLIGHT_VERSION == h.version && h.n > 0 &&
+               h.capacity > 0 && h.row_size == pcio_flight_row_size( h.n ) &&
+               h.capacity <= (uint64_t)st.st_size / h.row_size &&
+               sizeof(h) + h.capacity * h.row_size == (uint64_t)st.st_size );
+    if( ok ) {
+        f->size = (size_t)st.st_size;
+        f->hdr = (pcio_flight_header_t*)malloc( f->size );
+        ok = ( NULL != f->hdr );
+    } else {
+        errno = EINVAL;
+    }
+    if( ok ) {
+        memcpy( f->hdr, &h, sizeof(h) );
+        uint8_t *p = (uint8_t*)(f->hdr + 1);
+        size_t left = f->size - sizeof(h);
+        while( left && ok ) {
+            k = read( fd, p, left );
+            if( k < 0 && EINTR == errno ) continue;
+            if( k <= 0 ) {
+                if( 0 == k ) errno = EINVAL;
+                ok = 0;
+                break;
+            }
+            p += k;
+            left -= (size_t)k;
+        }
+    }
+    int e = errno;
+    close( fd );
+    if( ! ok ) {
+        pcio_flight_destroy( f );
+        errno = e;
+        return -1;
+    }
+    return 0;
+}
+
+/// A dump taken by a signal may have caught the oldest row being overwritten, so a full ring
+/// leaves it out
+uint64_t pcio_flight_count( const pcio_flight_t *f ) {
+    const pcio_flight_header_t *h = f->hdr;
+    return h->head < h->capacity ? h->head : h->capacity - 1;
+}
+
+pcio_flight_row_t *pcio_flight_get( const pcio_flight_t *f, uint64_t k ) {
+    return pcio_flight_row( f, f->hdr->head - pcio_flight_count( f ) + k );
+}
@@ -0,0 +1,214 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+/**
+ * \file pcio_log.c
+ * \brief Lock-free ring of log messages, written out by an idle priority thread
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // SCHED_IDLE
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "pcio_log.h"
+
+/// A message in the ring. seq is the ticket of the writer that may fill it,
+/// or that ticket plus one once the message is in.
+typedef struct {
+    uint64_t seq;
+    int level;
+    char line[PCIO_LOG_LINE];
+} pcio_log_slot_t;
+
+int pcio_log_level = LOG_INFO;
+
+static struct {
+    pcio_log_slot_t slot[PCIO_LOG_SLOTS];
+    uint64_t tail;          //< next ticket to hand to a writer
+    uint64_t head;          //< next message to write out, only touched by the thread
+    uint64_t dropped;
+    int running;            //< messages go through the ring
+    int inflight;           //< writers that saw running and have yet to fill their slot
+    int stop;
+    pcio_log_sink_fun *sink;
+    pthread_t thread;
+} pcio_log;
+
+static void pcio_log_stderr( int level, const char *line ) {
+    (void)level;
+    fputs( line, stderr );
+    fputc( '\n', stderr );
+}
+
+/// Write out the messages in the ring; returns how many
+static size_t pcio_log_drain( void ) {
+    size_t n = 0;
+    for( ;; ) {
+        pcio_log_slot_t *s = &pcio_log.slot[pcio_log.head % PCIO_LOG_SLOTS];
+        if( __atomic_load_n( &s->seq, __ATOMIC_ACQUIRE ) != pcio_log.head + 1 ) return n;
+        pcio_log.sink( s->level, s->line );
+        __atomic_store_n( &s->seq, pcio_log.head + PCIO_LOG_SLOTS, __ATOMIC_RELEASE );
+        pcio_log.head++;
+        n++;
+    }
+}
+
+static void *pcio_log_run( void *arg ) {
+    (void)arg;
+    struct sched_param param;
+    memset( &param, 0, sizeof(param) );
+    pthread_setschedparam( pthread_self(), SCHED_IDLE, &param );
+
+    const struct timespec pause = { 0, PCIO_LOG_DRAIN_NS };
+    while( ! __atomic_load_n( &pcio_log.stop, __ATOMIC_ACQUIRE ) ) {
+        if( 0 == pcio_log_drain() ) nanosleep( &pause, NULL );
+    }
+    pcio_log_drain();
+    return NULL;
+}
+
+int pcio_log_start( pcio_log_sink_fun *sink ) {
+    if( pcio_log.running ) return EBUSY;
+    pcio_log.sink = sink ? sink : pcio_log_stderr;
+    for( uint64_t i = 0; i < PCIO_LOG_SLOTS; i++ )
+        pcio_log.slot[(pcio_log.tail + i) % PCIO_LOG_SLOTS].seq = pcio_log.tail + i;
+    pcio_log.head = pcio_log.tail;
+    pcio_log.stop = 0;
+    int r = pthread_create( &pcio_log.thread, NULL, pcio_log_run, NULL );
+    if( r ) return r;
+    __atomic_store_n( &pcio_log.running, 1, __ATOMIC_RELEASE );
+    return 0;
+}
+
+void pcio_log_stop( void ) {
+    if( ! pcio_log.running ) return;
+    __atomic_store_n( &pcio_log.running, 0, __ATOMIC_SEQ_CST );
+    // writers that still saw the ring fill their slot before the last drain
+    while( __atomic_load_n( &pcio_log.inflight, __ATOMIC_SEQ_CST ) ) sched_yield();
+    __atomic_store_n( &pcio_log.stop, 1, __ATOMIC_RELEASE );
+    pthread_join( pcio_log.thread, NULL );
+}
+
+uint64_t pcio_log_dropped( void ) {
+    return __atomic_load_n( &pcio_log.dropped, __ATOMIC_RELAXED );
+}
+
+/// Whether site may log another message this second. Sites shared by
+/// threads may let a message too many through at the turn of a second.
+static int pcio_log_pass( pcio_log_site_t *site ) {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    int64_t second = (int64_t)now.tv_sec;
+    if( __atomic_load_n( &site->second, __ATOMIC_RELAXED ) != second ) {
+        __atomic_store_n( &site->second, second, __ATOMIC_RELAXED );
+        __atomic_store_n( &site->count, 0, __ATOMIC_RELAXED );
+    }
+    if( __atomic_add_fetch( &site->count, 1, __ATOMIC_RELAXED ) > PCIO_LOG_SITE_BURST ) {
+        __atomic_add_fetch( &site->suppressed, 1, __ATOMIC_RELAXED );
+        return 0;
+    }
+    return 1;
+}
+
+/// Format a message into line, noting the messages suppressed before it
+static void pcio_log_format( char *line, pcio_log_site_t *site, const char *fmt, va_list ap ) {
+    int k = vsnprintf( line, PCIO_LOG_LINE, fmt, ap );
+    if( k < 0 ) k = 0;
+    size_t len = (size_t)k < PCIO_LOG_LINE - 1 ? (size_t)k : PCIO_LOG_LINE - 1;
+    // the sinks end the line
+    while( len && '\n' == line[len-1] ) line[--len] = '\0';
+    uint32_t suppressed = __atomic_exchange_n( &site->suppressed, 0, __ATOMIC_RELAXED );
+    if( suppressed )
+        snprintf( line + len, PCIO_LOG_LINE - len, " (%u suppressed)", suppressed );
+}
+
+void pcio_log_site( pcio_log_site_t *site, int level, const char *fmt, ... ) {
+    if( ! pcio_log_pass( site ) ) return;
+    va_list ap;
+    va_start( ap, fmt );
+
+    __atomic_add_fetch( &pcio_log.inflight, 1, __ATOMIC_SEQ_CST );
+    if( ! __atomic_load_n( &pcio_log.running, __ATOMIC_SEQ_CST ) ) {
+        __atomic_sub_fetch( &pcio_log.inflight, 1, __ATOMIC_RELEASE );
+        char line[PCIO_LOG_LINE];
+        pcio_log_format( line, site, fmt, ap );
+        va_end( ap );
+        pcio_log_stderr( level, line );
+        return;
+    }
+
+    // take a ticket whose slot has been written out
+    uint64_t pos = __atomic_load_n( &pcio_log.tail, __ATOMIC_RELAXED );
+    pcio_log_slot_t *s;
+    for( ;; ) {
+        s = &pcio_log.slot[pos % PCIO_LOG_SLOTS];
+        int64_t d = (int64_t)(__atomic_load_n( &s->seq, __ATOMIC_ACQUIRE ) - pos);
+        if( 0 == d ) {
+            if( __atomic_compare_exchange_n( &pcio_log.tail, &pos, pos + 1, 1,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        } else if( d < 0 ) {
+            va_end( ap );
+            __atomic_add_fetch( &pcio_log.dropped, 1, __ATOMIC_RELAXED );
+            __atomic_sub_fetch( &pcio_log.inflight, 1, __ATOMIC_RELEASE );
+            return;
+        } else {
+            pos = __atomic_load_n( &pcio_log.tail, __ATOMIC_RELAXED );
+        }
+    }
+
+    s->level = level;
+    pcio_log_format( s->line, site, fmt, ap );
+    va_end( ap );
+    __atomic_store_n( &s->seq, pos + 1, __ATOMIC_RELEASE );
+    __atomic_sub_fetch( &pcio_log.inflight, 1, __ATOMIC_RELEASE );
+}
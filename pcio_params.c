@@ -0,0 +1,268 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+
+/**
+ * \file pcio_params.c
+ * \brief Dump and restore of the parameters of a group
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <amino.h>
+#include <ntcan.h>
+#include "pcio.h"
+#include "pcio_log.h"
+#include "pcio_params.h"
+
+/// Parameters a restore writes back, the config word first
+static const int pcio_params_restored[] = {
+    PCIO_PARAM_CONFIG,
+    PCIO_PARAM_MIN_FPOS,
+    PCIO_PARAM_MAX_FPOS,
+    PCIO_PARAM_MAX_VEL,
+    PCIO_PARAM_MAX_ACC,
+    PCIO_PARAM_MAX_CUR,
+    PCIO_PARAM_MAX_DELTA_POS,
+    PCIO_HOME_OFFSET
+};
+
+/// Parameters pcio_group_getv reads in one burst
+#define PCIO_PARAMS_BURST 8
+
+int pcio_params_dump( pcio_group_t *g, const char *path ) {
+    size_t n = pcio_group_size( g );
+    size_t n_parm = 0;
+    while( pcio_param_codes[n_parm].name ) n_parm++;
+
+    int parm_ids[n_parm];
+    uint32_t vals[n_parm * n];
+    for( size_t p = 0; p < n_parm; p++ )
+        parm_ids[p] = (int)pcio_param_codes[p].flag;
+    for( size_t p = 0; p < n_parm; p += PCIO_PARAMS_BURST ) {
+        size_t cnt = AA_MIN( n_parm - p, (size_t)PCIO_PARAMS_BURST );
+        int r = pcio_group_getv( g, &parm_ids[p], cnt, &vals[p*n], n );
+        if( NTCAN_SUCCESS != r ) return r;
+    }
+
+    FILE *f = strcmp( path, "-" ) ? fopen( path, "w" ) : stdout;
+    if( NULL == f ) {
+        PCIO_LOG( LOG_ERR, "Couldn't open %s: %s", path, strerror(errno) );
+        return -1;
+    }
+    fprintf( f, "{\n  \"modules\": [" );
+    size_t k = 0;
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        for( size_t j = 0; j < g->bus[i].module_cnt; j++, k++ ) {
+            fprintf( f, "%s\n    {\"bus\": %d, \"id\": %d, \"params\": {",
+                     k ? "," : "", g->bus[i].net, g->bus[i].module[j].id );
+            for( size_t p = 0; p < n_parm; p++ ) {
+                uint32_t u = vals[p*n + k];
+                fprintf( f, "%s\n      \"%s\": ", p ? "," : "", pcio_param_codes[p].name );
+                if( AA_TYPE_DOUBLE == pcio_param_codes[p].type ) {
+                    float x;
+                    memcpy( &x, &u, sizeof(x) );
+                    fprintf( f, "%.9g", x );
+                } else {
+                    fprintf( f, "%u", u );
+                }
+            }
+            fprintf( f, "}}" );
+        }
+    }
+    fprintf( f, "\n  ]\n}\n" );
+    if( f != stdout && fclose( f ) ) {
+        PCIO_LOG( LOG_ERR, "Couldn't write %s: %s", path, strerror(errno) );
+        return -1;
+    }
+    return NTCAN_SUCCESS;
+}
+
+/// Skip white space and the given punctuation
+static const char *pcio_params_skip( const char *s, const char *punct ) {
+    while( *s && (' ' == *s || '\t' == *s || '\n' == *s || '\r' == *s || strchr( punct, *s )) ) s++;
+    return s;
+}
+
+/// Read the values of pcio_params_restored for the modules of g from the dump in text
+static int pcio_params_parse( pcio_group_t *g, const char *path, const char *s,
+                              uint32_t *vals, uint8_t *have ) {
+    size_t n = pcio_group_size( g );
+    size_t n_restore = sizeof(pcio_params_restored) / sizeof(pcio_params_restored[0]);
+
+    // walk the members in order: bus and id select the module, the
+    // members after them are its parameters
+    int bus = -1;
+    long k = -1;
+    while( *(s = pcio_params_skip( s, "{}[],:" )) ) {
+        if( '"' != *s ) {
+            PCIO_LOG( LOG_ERR, "%s: unexpected '%c'", path, *s );
+            return -1;
+        }
+        const char *key = ++s;
+        while( *s && '"' != *s ) s++;
+        size_t len = (size_t)(s - key);
+        if( *s ) s++;
+        s = pcio_params_skip( s, ":" );
+        if( '{' == *s || '[' == *s ) continue;
+
+        char *end;
+        double x = strtod( s, &end );
+        if( end == s ) {
+            PCIO_LOG( LOG_ERR, "%s: no value for %.*s", path, (int)len, key );
+            return -1;
+        }
+        s = end;
+
+        if( 3 == len && 0 == strncmp( key, "bus", 3 ) ) {
+            bus = (int)x;
+        } else if( 2 == len && 0 == strncmp( key, "id", 2 ) ) {
+            k = -1;
+            size_t m = 0;
+            for( size_t i = 0; i < g->bus_cnt; i++ )
+                for( size_t j = 0; j < g->bus[i].module_cnt; j++, m++ )
+                    if( g->bus[i].net == bus && g->bus[i].module[j].id == (int)x )
+                        k = (long)m;
+            if( k < 0 )
+                PCIO_LOG( LOG_WARNING, "%s: skipping bus %d module %d, not in the group",
+                          path, bus, (int)x );
+        } else if( k >= 0 ) {
+            for( size_t c = 0; pcio_param_codes[c].name; c++ ) {
+                if( strlen( pcio_param_codes[c].name ) != len ||
+                    strncmp( pcio_param_codes[c].name, key, len ) ) continue;
+                for( size_t p = 0; p < n_restore; p++ ) {
+                    if( pcio_params_restored[p] != (int)pcio_param_codes[c].flag ) continue;
+                    uint32_t u = (uint32_t)x;
+                    if( AA_TYPE_DOUBLE == pcio_param_codes[c].type ) {
+                        float fx = (float)x;
+                        memcpy( &u, &fx, sizeof(u) );
+                    }
+                    vals[p*n + (size_t)k] = u;
+                    have[p*n + (size_t)k] = 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int pcio_params_restore( pcio_group_t *g, const char *path ) {
+    size_t n = pcio_group_size( g );
+    size_t n_restore = sizeof(pcio_params_restored) / sizeof(pcio_params_restored[0]);
+    uint32_t vals[n_restore * n];
+    uint8_t have[n_restore * n];
+    memset( have, 0, sizeof(have) );
+
+    FILE *f = fopen( path, "r" );
+    if( NULL == f ) {
+        PCIO_LOG( LOG_ERR, "Couldn't open %s: %s", path, strerror(errno) );
+        return -1;
+    }
+    char *text = NULL;
+    size_t size = 0;
+    int r = -1 == getdelim( &text, &size, '\0', f ) ? -1 : 0;
+    fclose( f );
+    if( 0 != r ) PCIO_LOG( LOG_ERR, "Couldn't read %s", path );
+    else r = pcio_params_parse( g, path, text, vals, have );
+    free( text );
+    if( 0 != r ) return r;
+
+    // a module is either in the dump with all of its parameters or left alone
+    for( size_t k = 0; k < n; k++ ) {
+        size_t n_have = 0;
+        for( size_t p = 0; p < n_restore; p++ ) n_have += have[p*n + k];
+        if( 0 == n_have ) {
+            PCIO_LOG( LOG_WARNING, "%s: module %zu not in the dump, left alone", path, k );
+            continue;
+        }
+        for( size_t p = 0; p < n_restore; p++ ) {
+            if( ! have[p*n + k] ) {
+                PCIO_LOG( LOG_ERR, "%s: parameter 0x%x missing for module %zu", path,
+                          pcio_params_restored[p], k );
+                return -1;
+            }
+        }
+    }
+
+    // write what differs from the modules, a burst of reads at a time
+    uint32_t check[n_restore * n];
+    for( size_t p = 0; p < n_restore; p += PCIO_PARAMS_BURST ) {
+        size_t cnt = AA_MIN( n_restore - p, (size_t)PCIO_PARAMS_BURST );
+        r = pcio_group_getv_mask( g, &pcio_params_restored[p], cnt, &check[p*n], n, &have[p*n] );
+        if( NTCAN_SUCCESS != r ) return r;
+    }
+    uint8_t differ[n_restore * n];
+    size_t n_written = 0;
+    for( size_t p = 0; p < n_restore; p++ ) {
+        size_t n_differ = 0;
+        for( size_t k = 0; k < n; k++ ) {
+            differ[p*n + k] = have[p*n + k] && check[p*n + k] != vals[p*n + k];
+            n_differ += differ[p*n + k];
+        }
+        if( 0 == n_differ ) continue;
+        r = pcio_group_setu32_mask( g, pcio_params_restored[p], &vals[p*n], n, &differ[p*n] );
+        if( NTCAN_SUCCESS != r ) return r;
+        n_written += n_differ;
+    }
+    PCIO_LOG( LOG_INFO, "%s: wrote %zu values", path, n_written );
+
+    // read back what was written
+    for( size_t p = 0; n_written && p < n_restore; p += PCIO_PARAMS_BURST ) {
+        size_t cnt = AA_MIN( n_restore - p, (size_t)PCIO_PARAMS_BURST );
+        r = pcio_group_getv_mask( g, &pcio_params_restored[p], cnt, &check[p*n], n, &differ[p*n] );
+        if( NTCAN_SUCCESS != r ) return r;
+    }
+    r = NTCAN_SUCCESS;
+    for( size_t i = 0; i < n_restore * n; i++ ) {
+        if( have[i] && check[i] != vals[i] ) {
+            PCIO_LOG( LOG_ERR, "module %zu: parameter 0x%x is 0x%x after writing 0x%x",
+                      i % n, pcio_params_restored[i / n], check[i], vals[i] );
+            r = -1;
+        }
+    }
+    return r;
+}
@@ -0,0 +1,221 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/**
+ * \file pcio_poll.c
+ * \brief Rate and priority scheduling of the parameters read every cycle
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "pcio.h"
+#include "pcio_poll.h"
+
+static int64_t pcio_poll_ns( const struct timespec *a, const struct timespec *b ) {
+    return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000 + (b->tv_nsec - a->tv_nsec);
+}
+
+static struct timespec pcio_poll_add_ns( const struct timespec *t, int64_t ns ) {
+    int64_t nsec = t->tv_nsec + ns;
+    struct timespec r;
+    r.tv_sec = t->tv_sec + (time_t)(nsec / 1000000000);
+    r.tv_nsec = (long)(nsec % 1000000000);
+    return r;
+}
+
+void pcio_poll_init( pcio_poll_t *p, size_t n, size_t budget ) {
+    memset( p, 0, sizeof(*p) );
+    p->n = n;
+    p->budget = budget;
+    p->limit = budget;
+}
+
+void pcio_poll_destroy( pcio_poll_t *p ) {
+    for( size_t i = 0; i < p->n_field; i++ ) {
+        free( p->field[i].vals );
+        free( p->field[i].got );
+        free( p->field[i].owed );
+    }
+    memset( p, 0, sizeof(*p) );
+}
+
+size_t pcio_poll_budget( const pcio_group_t *g, double period_sec, double share ) {
+    // a field is a request and a reply per module of the bus
+    size_t m = 1;
+    for( size_t i = 0; i < g->bus_cnt; i++ )
+        if( g->bus[i].module_cnt > m ) m = g->bus[i].module_cnt;
+    double bits = (double)m * (PCIO_CAN_FRAME_BITS(2) + PCIO_CAN_FRAME_BITS(6));
+    double fields = share * period_sec * PCIO_BITRATE / bits;
+    if( fields < 1 ) return 1;
+    if( fields > 8 ) return 8;
+    return (size_t)fields;
+}
+
+int pcio_poll_add( pcio_poll_t *p, int parm_id, double rate, int priority ) {
+    if( p->n_field >= PCIO_POLL_FIELD_MAX ) return -1;
+    pcio_poll_field_t *f = &p->field[p->n_field];
+    memset( f, 0, sizeof(*f) );
+    f->vals = (uint32_t*)calloc( p->n ? p->n : 1, sizeof(uint32_t) );
+    f->got = (uint8_t*)calloc( p->n ? p->n : 1, sizeof(uint8_t) );
+    f->owed = (uint8_t*)calloc( p->n ? p->n : 1, sizeof(uint8_t) );
+    if( NULL == f->vals || NULL == f->got || NULL == f->owed ) {
+        free( f->vals );
+        free( f->got );
+        free( f->owed );
+        return -1;
+    }
+    f->parm_id = parm_id;
+    f->priority = priority;
+    f->period_ns = rate > 0 ? (int64_t)(1e9 / rate) : 0;
+    return (int)p->n_field++;
+}
+
+pcio_poll_field_t *pcio_poll_find( pcio_poll_t *p, int parm_id ) {
+    for( size_t i = 0; i < p->n_field; i++ )
+        if( p->field[i].parm_id == parm_id ) return &p->field[i];
+    return NULL;
+}
+
+/// Field f was read at now; schedule the next read, without catching up on missed ones
+static void pcio_poll_done( pcio_poll_t *p, size_t i, const struct timespec *now ) {
+    pcio_poll_field_t *f = &p->field[i];
+    f->t = *now;
+    f->reads++;
+    f->due = pcio_poll_add_ns( &f->due, f->period_ns );
+    if( pcio_poll_ns( &f->due, now ) > 0 ) f->due = pcio_poll_add_ns( now, f->period_ns );
+    p->read |= (uint32_t)1 << i;
+}
+
+void pcio_poll_mark( pcio_poll_t *p, int parm_id, const struct timespec *now,
+                     const uint8_t *mask ) {
+    pcio_poll_field_t *f = pcio_poll_find( p, parm_id );
+    if( NULL == f ) return;
+    size_t n_got = 0;
+    for( size_t k = 0; k < p->n; k++ ) {
+        if( NULL == mask || mask[k] ) {
+            f->got[k] = 1;
+            f->owed[k] = 0;
+        }
+        n_got += f->got[k];
+    }
+    if( n_got == p->n ) pcio_poll_done( p, (size_t)(f - p->field), now );
+}
+
+int pcio_poll_run( pcio_poll_t *p, pcio_group_t *g, const struct timespec *now ) {
+    return pcio_poll_run_turn( p, g, now, NULL );
+}
+
+int pcio_poll_run_turn( pcio_poll_t *p, pcio_group_t *g, const struct timespec *now,
+                        const uint8_t *turn ) {
+    // the fields that are due, or owed to a module whose turn it is, most important first
+    size_t due[PCIO_POLL_FIELD_MAX], n_due = 0;
+    uint32_t timely = 0;
+    for( size_t i = 0; i < p->n_field; i++ ) {
+        const pcio_poll_field_t *f = &p->field[i];
+        if( (p->read >> i) & 1 ) continue;
+        if( pcio_poll_ns( &f->due, now ) >= 0 ) {
+            timely |= (uint32_t)1 << i;
+        } else {
+            size_t j = 0;
+            while( j < p->n && !(turn && turn[j] && f->owed[j] && !f->got[j]) ) j++;
+            if( j == p->n ) continue;
+        }
+        size_t k = n_due++;
+        for( ; k > 0 && p->field[due[k-1]].priority < f->priority; k-- ) due[k] = due[k-1];
+        due[k] = i;
+    }
+
+    // shed what does not fit
+    size_t n_read = n_due < p->limit ? n_due : p->limit;
+    for( size_t k = n_read; k < n_due; k++ ) p->field[due[k]].shed++;
+    if( 0 == n_read ) return NTCAN_SUCCESS;
+
+    // read the rest in one burst, skipping the modules that were marked or whose turn it is not
+    int parm_ids[n_read];
+    uint8_t mask[n_read * p->n];
+    int masked = 0;
+    for( size_t k = 0; k < n_read; k++ ) {
+        const pcio_poll_field_t *f = &p->field[due[k]];
+        int on_time = (timely >> due[k]) & 1;
+        parm_ids[k] = f->parm_id;
+        for( size_t j = 0; j < p->n; j++ ) {
+            uint8_t *m = &mask[k * p->n + j];
+            *m = ! f->got[j] && (NULL == turn || turn[j]) && (on_time || f->owed[j]);
+            masked |= ! *m;
+        }
+    }
+    uint32_t vals[n_read * p->n];
+    int r = pcio_group_getv_mask( g, parm_ids, n_read, vals, p->n, masked ? mask : NULL );
+    if( NTCAN_SUCCESS != r ) return r;
+    for( size_t k = 0; k < n_read; k++ ) {
+        pcio_poll_field_t *f = &p->field[due[k]];
+        int on_time = (timely >> due[k]) & 1;
+        for( size_t j = 0; j < p->n; j++ ) {
+            if( mask[k * p->n + j] ) {
+                f->vals[j] = vals[k * p->n + j];
+                f->got[j] = 1;
+                f->owed[j] = 0;
+            } else if( on_time && ! f->got[j] ) {
+                f->owed[j] = 1;
+            }
+        }
+        // a read of owed modules only does not move the schedule
+        if( on_time ) pcio_poll_done( p, due[k], now );
+        else p->read |= (uint32_t)1 << due[k];
+    }
+    return NTCAN_SUCCESS;
+}
+
+void pcio_poll_end( pcio_poll_t *p, int overran ) {
+    p->read = 0;
+    for( size_t i = 0; i < p->n_field; i++ ) memset( p->field[i].got, 0, p->n );
+    if( overran ) {
+        // shed one more field per cycle
+        if( p->limit > 1 ) p->limit--;
+        p->calm = 0;
+    } else if( p->limit < p->budget && ++p->calm >= PCIO_POLL_CALM_CYCLES ) {
+        p->limit++;
+        p->calm = 0;
+    }
+}
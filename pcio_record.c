@@ -0,0 +1,539 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+/**
+ * \file pcio_record.c
+ * \brief Columnar, delta encoded recording of the state of a group
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "pcio_record.h"
+
+/// Quantized value of a missing or non-finite sample
+#define PCIO_RECORD_NAN INT64_MIN
+
+/// Longest variable length integer
+#define PCIO_RECORD_VARINT_MAX 10
+
+static uint64_t pcio_record_ns( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*----------*/
+/* Encoding */
+/*----------*/
+
+static uint64_t pcio_record_zigzag( int64_t v ) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t pcio_record_unzigzag( uint64_t v ) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t *pcio_record_put_varint( uint8_t *p, uint64_t v ) {
+    while( v >= 0x80 ) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/// Reads a variable length integer at p into v; NULL if it runs past end
+static const uint8_t *pcio_record_get_varint( const uint8_t *p, const uint8_t *end, uint64_t *v ) {
+    uint64_t x = 0;
+    for( unsigned shift = 0; p < end && shift < 64; shift += 7 ) {
+        uint8_t b = *p++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if( ! (b & 0x80) ) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int64_t pcio_record_quantize( double x, double step ) {
+    double q = x / step;
+    if( q > -9e18 && q < 9e18 ) return llround( q );
+    return PCIO_RECORD_NAN;
+}
+
+static double pcio_record_dequantize( int64_t q, double step ) {
+    return PCIO_RECORD_NAN == q ? NAN : (double)q * step;
+}
+
+/// Bytes a block of rows rows of n joints may take at most
+static size_t pcio_record_block_max( size_t rows, size_t n ) {
+    return rows * (1 + n * (PCIO_RECORD_QUANTITIES + 1)) * PCIO_RECORD_VARINT_MAX;
+}
+
+/*---------*/
+/* Writing */
+/*---------*/
+
+static void pcio_record_write( pcio_record_t *r, const struct iovec *iov, int cnt ) {
+    size_t left = 0;
+    for( int i = 0; i < cnt; i++ ) left += iov[i].iov_len;
+    struct iovec v[cnt];
+    memcpy( v, iov, sizeof(v) );
+    struct iovec *p = v;
+    while( left && ! r->error ) {
+        ssize_t k = writev( r->fd, p, cnt );
+        if( k < 0 ) {
+            if( EINTR != errno ) r->error = errno;
+            continue;
+        }
+        r->offset += (uint64_t)k;
+        left -= (size_t)k;
+        while( cnt && (size_t)k >= p->iov_len ) {
+            k -= (ssize_t)p->iov_len;
+            p++;
+            cnt--;
+        }
+        if( cnt ) {
+            p->iov_base = (uint8_t*)p->iov_base + k;
+            p->iov_len -= (size_t)k;
+        }
+    }
+}
+
+/// Encode the rows gathered so far as a block and write it out
+static void pcio_record_flush( pcio_record_t *r ) {
+    size_t rows = r->blk_rows, n = r->n, stride = r->hdr.block_rows;
+    r->blk_rows = 0;
+    if( 0 == rows || r->error ) return;
+
+    // times as the change of their difference, the rest as the change from the row before
+    uint8_t *p = r->buf;
+    int64_t dt = 0;
+    for( size_t i = 1; i < rows; i++ ) {
+        int64_t d = (int64_t)(r->blk_t[i] - r->blk_t[i-1]);
+        p = pcio_record_put_varint( p, pcio_record_zigzag( d - dt ) );
+        dt = d;
+    }
+    for( size_t c = 0; c < PCIO_RECORD_QUANTITIES * n; c++ ) {
+        const int64_t *q = &r->blk_q[c * stride];
+        p = pcio_record_put_varint( p, pcio_record_zigzag( q[0] ) );
+        for( size_t i = 1; i < rows; i++ )
+            p = pcio_record_put_varint( p, pcio_record_zigzag( (int64_t)((uint64_t)q[i] - (uint64_t)q[i-1]) ) );
+    }
+    for( size_t j = 0; j < n; j++ ) {
+        const uint32_t *s = &r->blk_status[j * stride];
+        p = pcio_record_put_varint( p, s[0] );
+        for( size_t i = 1; i < rows; i++ ) p = pcio_record_put_varint( p, s[i] ^ s[i-1] );
+    }
+
+    if( r->n_index == r->cap_index ) {
+        size_t cap = r->cap_index ? 2 * r->cap_index : 256;
+        pcio_record_index_t *index = (pcio_record_index_t*)realloc( r->index, cap * sizeof(*index) );
+        if( NULL == index ) {
+            r->error = ENOMEM;
+            return;
+        }
+        r->index = index;
+        r->cap_index = cap;
+    }
+    pcio_record_index_t *e = &r->index[r->n_index++];
+    e->offset = r->offset;
+    e->row = r->rows;
+    e->t_first_ns = r->blk_t[0];
+    e->t_last_ns = r->blk_t[rows-1];
+
+    pcio_record_block_t blk;
+    memset( &blk, 0, sizeof(blk) );
+    blk.magic = PCIO_RECORD_BLOCK_MAGIC;
+    blk.rows = (uint32_t)rows;
+    blk.size = (uint64_t)(p - r->buf);
+    blk.row = e->row;
+    blk.t_first_ns = e->t_first_ns;
+    blk.t_last_ns = e->t_last_ns;
+    struct iovec iov[2] = { { &blk, sizeof(blk) }, { r->buf, (size_t)blk.size } };
+    pcio_record_write( r, iov, 2 );
+    r->rows += rows;
+}
+
+/// Move the rows in the ring into blocks; returns how many
+static size_t pcio_record_drain( pcio_record_t *r ) {
+    size_t n = r->n, rows = r->hdr.block_rows, got = 0;
+    uint64_t head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+    for( uint64_t k = r->tail; k < head; k++, got++ ) {
+        size_t s = (size_t)(k % PCIO_RECORD_RING_ROWS), i = r->blk_rows;
+        const double *val = &r->ring_val[s * PCIO_RECORD_QUANTITIES * n];
+        r->blk_t[i] = r->ring_t[s];
+        for( size_t c = 0; c < PCIO_RECORD_QUANTITIES * n; c++ )
+            r->blk_q[c * rows + i] = pcio_record_quantize( val[c], r->hdr.step[c / n] );
+        for( size_t j = 0; j < n; j++ )
+            r->blk_status[j * rows + i] = r->ring_status[s * n + j];
+        __atomic_store_n( &r->tail, k + 1, __ATOMIC_RELEASE );
+        if( ++r->blk_rows == rows ) pcio_record_flush( r );
+    }
+    return got;
+}
+
+static void *pcio_record_run( void *arg ) {
+    pcio_record_t *r = (pcio_record_t*)arg;
+    const struct timespec pause = { 0, PCIO_RECORD_DRAIN_NS };
+    for( ;; ) {
+        int stop = __atomic_load_n( &r->stop, __ATOMIC_ACQUIRE );
+        size_t got = pcio_record_drain( r );
+        if( stop ) break;
+        if( 0 == got ) nanosleep( &pause, NULL );
+    }
+    pcio_record_flush( r );
+    return NULL;
+}
+
+static void pcio_record_free( pcio_record_t *r ) {
+    free( r->ring_t );
+    free( r->ring_val );
+    free( r->ring_status );
+    free( r->blk_t );
+    free( r->blk_q );
+    free( r->blk_status );
+    free( r->buf );
+    free( r->index );
+    if( r->fd >= 0 ) close( r->fd );
+    r->fd = -1;
+}
+
+int pcio_record_create( pcio_record_t *r, const char *path, const char *name, size_t n,
+                        size_t block_rows ) {
+    memset( r, 0, sizeof(*r) );
+    r->fd = -1;
+    if( 0 == block_rows ) block_rows = PCIO_RECORD_DEFAULT_BLOCK_ROWS;
+    if( 0 == n || block_rows > UINT32_MAX ) {
+        errno = EINVAL;
+        return -1;
+    }
+    r->n = n;
+    r->ring_t = (uint64_t*)calloc( PCIO_RECORD_RING_ROWS, sizeof(uint64_t) );
+    r->ring_val = (double*)calloc( PCIO_RECORD_RING_ROWS * PCIO_RECORD_QUANTITIES * n, sizeof(double) );
+    r->ring_status = (uint32_t*)calloc( PCIO_RECORD_RING_ROWS * n, sizeof(uint32_t) );
+    r->blk_t = (uint64_t*)calloc( block_rows, sizeof(uint64_t) );
+    r->blk_q = (int64_t*)calloc( block_rows * PCIO_RECORD_QUANTITIES * n, sizeof(int64_t) );
+    r->blk_status = (uint32_t*)calloc( block_rows * n, sizeof(uint32_t) );
+    r->buf = (uint8_t*)malloc( pcio_record_block_max( block_rows, n ) );
+    if( !r->ring_t || !r->ring_val || !r->ring_status || !r->blk_t || !r->blk_q ||
+        !r->blk_status || !r->buf ) {
+        pcio_record_free( r );
+        errno = ENOMEM;
+        return -1;
+    }
+
+    r->hdr.magic = PCIO_RECORD_MAGIC;
+    r->hdr.version = PCIO_RECORD_VERSION;
+    r->hdr.n = (uint32_t)n;
+    r->hdr.block_rows = (uint32_t)block_rows;
+    r->hdr.step[PCIO_RECORD_POS] = PCIO_RECORD_POS_STEP;
+    r->hdr.step[PCIO_RECORD_VEL] = PCIO_RECORD_VEL_STEP;
+    r->hdr.step[PCIO_RECORD_CUR] = PCIO_RECORD_CUR_STEP;
+    r->hdr.t0_ns = pcio_record_ns( CLOCK_MONOTONIC );
+    r->hdr.t0_realtime_ns = (int64_t)pcio_record_ns( CLOCK_REALTIME );
+    if( name ) strncpy( r->hdr.name, name, sizeof(r->hdr.name) - 1 );
+
+    r->fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( r->fd >= 0 ) {
+        struct iovec iov = { &r->hdr, sizeof(r->hdr) };
+        pcio_record_write( r, &iov, 1 );
+        if( 0 == r->error ) r->error = pthread_create( &r->thread, NULL, pcio_record_run, r );
+    }
+    if( r->fd < 0 || r->error ) {
+        int e = r->fd < 0 ? errno : r->error;
+        pcio_record_free( r );
+        unlink( path );
+        errno = e;
+        return -1;
+    }
+    return 0;
+}
+
+void pcio_record_put( pcio_record_t *r, uint64_t t_ns, const double *pos, const double *vel,
+                      const double *cur, const uint32_t *status ) {
+    uint64_t head = r->head;
+    if( head - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE ) >= PCIO_RECORD_RING_ROWS ) {
+        __atomic_add_fetch( &r->dropped, 1, __ATOMIC_RELAXED );
+        return;
+    }
+    size_t n = r->n, s = (size_t)(head % PCIO_RECORD_RING_ROWS);
+    double *val = &r->ring_val[s * PCIO_RECORD_QUANTITIES * n];
+    r->ring_t[s] = t_ns;
+    memcpy( &val[PCIO_RECORD_POS * n], pos, n * sizeof(double) );
+    memcpy( &val[PCIO_RECORD_VEL * n], vel, n * sizeof(double) );
+    memcpy( &val[PCIO_RECORD_CUR * n], cur, n * sizeof(double) );
+    if( status ) memcpy( &r->ring_status[s * n], status, n * sizeof(uint32_t) );
+    else memset( &r->ring_status[s * n], 0, n * sizeof(uint32_t) );
+    __atomic_store_n( &r->head, head + 1, __ATOMIC_RELEASE );
+}
+
+int pcio_record_close( pcio_record_t *r ) {
+    if( r->fd < 0 ) return r->error;
+    __atomic_store_n( &r->stop, 1, __ATOMIC_RELEASE );
+    pthread_join( r->thread, NULL );
+
+    pcio_record_trailer_t tr;
+    memset( &tr, 0, sizeof(tr) );
+    tr.magic = PCIO_RECORD_INDEX_MAGIC;
+    tr.blocks = r->n_index;
+    tr.index_offset = r->offset;
+    tr.dropped = __atomic_load_n( &r->dropped, __ATOMIC_RELAXED );
+    struct iovec iov[2] = { { r->index, r->n_index * sizeof(r->index[0]) }, { &tr, sizeof(tr) } };
+    pcio_record_write( r, iov, 2 );
+    if( 0 != close( r->fd ) && 0 == r->error ) r->error = errno;
+    r->fd = -1;
+    int e = r->error;
+    pcio_record_free( r );
+    return e;
+}
+
+/*---------*/
+/* Reading */
+/*---------*/
+
+static int pcio_record_pread( int fd, void *buf, size_t len, uint64_t offset ) {
+    while( len ) {
+        ssize_t k = pread( fd, buf, len, (off_t)offset );
+        if( k < 0 && EINTR == errno ) continue;
+        if( k <= 0 ) {
+            if( 0 == k ) errno = EINVAL;
+            return -1;
+        }
+        buf = (uint8_t*)buf + k;
+        len -= (size_t)k;
+        offset += (uint64_t)k;
+    }
+    return 0;
+}
+
+/// Read the index the recording was closed with; 0 if it has none
+static int pcio_record_load_index( pcio_record_reader_t *r ) {
+    pcio_record_trailer_t tr;
+    if( r->size < sizeof(r->hdr) + sizeof(tr) ||
+        pcio_record_pread( r->fd, &tr, sizeof(tr), r->size - sizeof(tr) ) ||
+        PCIO_RECORD_INDEX_MAGIC != tr.magic || tr.index_offset < sizeof(r->hdr) ||
+        tr.index_offset > r->size ||
+        tr.blocks > (r->size - tr.index_offset) / sizeof(pcio_record_index_t) ||
+        tr.index_offset + tr.blocks * sizeof(pcio_record_index_t) + sizeof(tr) != r->size )
+        return 0;
+    r->index = (pcio_record_index_t*)calloc( tr.blocks ? tr.blocks : 1, sizeof(pcio_record_index_t) );
+    if( NULL == r->index ||
+        pcio_record_pread( r->fd, r->index, tr.blocks * sizeof(pcio_record_index_t), tr.index_offset ) )
+        return 0;
+    r->blocks = tr.blocks;
+    r->dropped = tr.dropped;
+    return 1;
+}
+
+/// Rebuild the index of a recording that was not closed from the headers of its complete blocks
+static int pcio_record_scan( pcio_record_reader_t *r ) {
+    size_t cap = 0;
+    uint64_t off = sizeof(r->hdr);
+    pcio_record_block_t blk;
+    while( off + sizeof(blk) <= r->size && 0 == pcio_record_pread( r->fd, &blk, sizeof(blk), off ) ) {
+        if( PCIO_RECORD_BLOCK_MAGIC != blk.magic || blk.rows > r->hdr.block_rows ||
+            blk.size > r->size - off - sizeof(blk) )
+            break;
+        if( r->blocks == cap ) {
+            cap = cap ? 2 * cap : 256;
+            pcio_record_index_t *index = (pcio_record_index_t*)realloc( r->index, cap * sizeof(*index) );
+            if( NULL == index ) {
+                errno = ENOMEM;
+                return -1;
+            }
+            r->index = index;
+        }
+        pcio_record_index_t *e = &r->index[r->blocks++];
+        e->offset = off;
+        e->row = blk.row;
+        e->t_first_ns = blk.t_first_ns;
+        e->t_last_ns = blk.t_last_ns;
+        off += sizeof(blk) + blk.size;
+    }
+    return 0;
+}
+
+int pcio_record_open( pcio_record_reader_t *r, const char *path ) {
+    memset( r, 0, sizeof(*r) );
+    r->fd = open( path, O_RDONLY );
+    if( r->fd < 0 ) return -1;
+    struct stat st;
+    int ok = ( 0 == fstat( r->fd, &st ) &&
+               0 == pcio_record_pread( r->fd, &r->hdr, sizeof(r->hdr), 0 ) );
+    if( ok ) {
+        r->size = (uint64_t)st.st_size;
+        const pcio_record_header_t *h = &r->hdr;
+        ok = ( PCIO_RECORD_MAGIC == h->magic && PCIO_RECORD_VERSION == h->version &&
+               h->n > 0 && h->block_rows > 0 );
+        if( ! ok ) errno = EINVAL;
+    }
+    if( ok ) {
+        r->indexed = pcio_record_load_index( r );
+        if( ! r->indexed ) {
+            free( r->index );
+            r->index = NULL;
+            r->blocks = 0;
+            ok = ( 0 == pcio_record_scan( r ) );
+        }
+    }
+    if( ok ) {
+        size_t rows = r->hdr.block_rows, n = r->hdr.n;
+        r->rows.t_ns = (uint64_t*)calloc( rows, sizeof(uint64_t) );
+        r->rows.status = (uint32_t*)calloc( rows * n, sizeof(uint32_t) );
+        ok = r->rows.t_ns && r->rows.status;
+        for( int c = 0; c < PCIO_RECORD_QUANTITIES; c++ ) {
+            r->rows.val[c] = (double*)calloc( rows * n, sizeof(double) );
+            ok = ok && r->rows.val[c];
+        }
+        r->q = (int64_t*)calloc( rows, sizeof(int64_t) );
+        ok = ok && r->q;
+        if( ! ok ) errno = ENOMEM;
+    }
+    if( ! ok ) {
+        int e = errno;
+        pcio_record_reader_close( r );
+        errno = e;
+        return -1;
+    }
+    return 0;
+}
+
+void pcio_record_reader_close( pcio_record_reader_t *r ) {
+    if( r->fd >= 0 ) close( r->fd );
+    free( r->index );
+    free( r->buf );
+    free( r->q );
+    free( r->rows.t_ns );
+    free( r->rows.status );
+    for( int c = 0; c < PCIO_RECORD_QUANTITIES; c++ ) free( r->rows.val[c] );
+    memset( r, 0, sizeof(*r) );
+    r->fd = -1;
+}
+
+size_t pcio_record_find( const pcio_record_reader_t *r, uint64_t t_ns ) {
+    size_t lo = 0, hi = r->blocks;
+    while( lo < hi ) {
+        size_t mid = lo + (hi - lo) / 2;
+        if( r->index[mid].t_last_ns < t_ns ) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+const pcio_record_rows_t *pcio_record_read( pcio_record_reader_t *r, size_t k ) {
+    if( k >= r->blocks ) {
+        errno = ERANGE;
+        return NULL;
+    }
+    pcio_record_block_t blk;
+    if( pcio_record_pread( r->fd, &blk, sizeof(blk), r->index[k].offset ) ) return NULL;
+    if( PCIO_RECORD_BLOCK_MAGIC != blk.magic || 0 == blk.rows || blk.rows > r->hdr.block_rows ||
+        blk.size > r->size ) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if( blk.size > r->cap_buf ) {
+        uint8_t *buf = (uint8_t*)realloc( r->buf, (size_t)blk.size );
+        if( NULL == buf ) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        r->buf = buf;
+        r->cap_buf = (size_t)blk.size;
+    }
+    if( pcio_record_pread( r->fd, r->buf, (size_t)blk.size, r->index[k].offset + sizeof(blk) ) )
+        return NULL;
+
+    pcio_record_rows_t *out = &r->rows;
+    size_t rows = blk.rows, n = r->hdr.n;
+    const uint8_t *p = r->buf, *end = r->buf + blk.size;
+    uint64_t v;
+    int64_t dt = 0;
+    out->t_ns[0] = blk.t_first_ns;
+    for( size_t i = 1; i < rows && p; i++ ) {
+        if( (p = pcio_record_get_varint( p, end, &v )) ) {
+            dt += pcio_record_unzigzag( v );
+            out->t_ns[i] = out->t_ns[i-1] + (uint64_t)dt;
+        }
+    }
+    for( size_t c = 0; c < PCIO_RECORD_QUANTITIES * n && p; c++ ) {
+        double step = r->hdr.step[c / n];
+        double *val = out->val[c / n];
+        size_t j = c % n;
+        for( size_t i = 0; i < rows && p; i++ ) {
+            if( (p = pcio_record_get_varint( p, end, &v )) ) {
+                r->q[i] = i ? (int64_t)((uint64_t)r->q[i-1] + (uint64_t)pcio_record_unzigzag( v ))
+                            : pcio_record_unzigzag( v );
+                val[i * n + j] = pcio_record_dequantize( r->q[i], step );
+            }
+        }
+    }
+    for( size_t j = 0; j < n && p; j++ ) {
+        uint32_t s = 0;
+        for( size_t i = 0; i < rows && p; i++ ) {
+            if( (p = pcio_record_get_varint( p, end, &v )) ) {
+                s = i ? s ^ (uint32_t)v : (uint32_t)v;
+                out->status[i * n + j] = s;
+            }
+        }
+    }
+    if( NULL == p ) {
+        errno = EINVAL;
+        return NULL;
+    }
+    out->rows = rows;
+    out->row = blk.row;
+    return out;
+}
@@ -0,0 +1,301 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/** \file pcio_record_util.c
+ *
+ *  Shell tool that reads a recording written by pcio-sns --record, or
+ *  a flight recorder dump written by pcio-sns --flight, and prints a
+ *  range of it as CSV, or a summary of what it holds.
+ *
+ *  Times of a recording are in seconds from its start; only the blocks
+ *  that overlap the range are read. Times of a dump are in seconds
+ *  from the dump, so the cycles that led up to it are negative.
+ */
+
+#include <argp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "pcio_record.h"
+#include "pcio_flight.h"
+
+/* ---------- */
+/* ARGP Junk  */
+/* ---------- */
+
+static double opt_from = -INFINITY;
+static double opt_to = INFINITY;
+static int opt_info = 0;
+static const char *opt_file = NULL;
+
+static struct argp_option options[] = {
+    {
+        .name = "from",
+        .key = 'f',
+        .arg = "seconds",
+        .flags = 0,
+        .doc = "Start of the range (default the start of the recording)"
+    },
+    {
+        .name = "to",
+        .key = 't',
+        .arg = "seconds",
+        .flags = 0,
+        .doc = "End of the range (default the end of the recording)"
+    },
+    {
+        .name = "info",
+        .key = 'i',
+        .arg = NULL,
+        .flags = 0,
+        .doc = "Print a summary instead of the rows"
+    },
+    {
+        .name = NULL,
+        .key = 0,
+        .arg = NULL,
+        .flags = 0,
+        .doc = NULL
+    }
+};
+
+static int parse_opt( int key, char *arg, struct argp_state *state ) {
+    switch(key) {
+    case 'f':
+        opt_from = atof(arg);
+        break;
+    case 't':
+        opt_to = atof(arg);
+        break;
+    case 'i':
+        opt_info = 1;
+        break;
+    case ARGP_KEY_ARG:
+        if( opt_file ) argp_error( state, "only one recording at a time" );
+        opt_file = arg;
+        break;
+    case ARGP_KEY_END:
+        if( NULL == opt_file ) argp_usage( state );
+        if( opt_to < opt_from ) argp_error( state, "the range ends before it starts" );
+        break;
+    }
+    return 0;
+}
+
+const char *argp_program_version = "pcio_record_util v0.0.1";
+static char args_doc[] = "RECORDING";
+static char doc[] = "Exports the rows of a pcio state recording or flight recorder dump as CSV\n";
+static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+/* ------ */
+/* OUTPUT */
+/* ------ */
+
+static const char *quantity_name[PCIO_RECORD_QUANTITIES] = { "pos", "vel", "cur" };
+
+/// Decimals that resolve quantization step step
+static int digits( double step ) {
+    int d = (int)ceil( -log10( step ) - 1e-9 );
+    return d < 0 ? 0 : d;
+}
+
+static void print_info( pcio_record_reader_t *r ) {
+    const pcio_record_header_t *h = &r->hdr;
+
+    // blocks hold up to block_rows rows, only the last may be short
+    uint64_t rows = 0;
+    if( r->blocks ) {
+        const pcio_record_rows_t *last = pcio_record_read( r, r->blocks - 1 );
+        rows = r->index[r->blocks-1].row + (last ? last->rows : 0);
+    }
+    uint64_t data = r->size - sizeof(*h);
+    if( r->indexed ) data -= r->blocks * sizeof(pcio_record_index_t) + sizeof(pcio_record_trailer_t);
+    double span = r->blocks ?
+        (double)(r->index[r->blocks-1].t_last_ns - r->index[0].t_first_ns) / 1e9 : 0;
+    double raw = (double)(sizeof(uint64_t) + h->n * (PCIO_RECORD_QUANTITIES * sizeof(double) +
+                                                    sizeof(uint32_t)));
+
+    printf("recording %s: group %s, %u joints, %lu blocks of up to %u rows%s\n",
+           opt_file, h->name, h->n, (unsigned long)r->blocks, h->block_rows,
+           r->indexed ? "" : ", not closed: index rebuilt" );
+    printf("  %lu rows over %.3f s", (unsigned long)rows, span);
+    if( r->indexed ) printf(", %lu dropped", (unsigned long)r->dropped);
+    printf("\n  %lu bytes, %.1f bytes per row, %.1f times smaller than raw rows\n",
+           (unsigned long)r->size, rows ? (double)data / (double)rows : 0,
+           data ? raw * (double)rows / (double)data : 0 );
+    printf("  steps: pos %g rad, vel %g rad/s, cur %g A\n", h->step[PCIO_RECORD_POS],
+           h->step[PCIO_RECORD_VEL], h->step[PCIO_RECORD_CUR]);
+}
+
+static void print_header( const pcio_record_header_t *h ) {
+    printf("t");
+    for( int c = 0; c < PCIO_RECORD_QUANTITIES; c++ )
+        for( uint32_t j = 0; j < h->n; j++ ) printf(",%s%u", quantity_name[c], j);
+    for( uint32_t j = 0; j < h->n; j++ ) printf(",status%u", j);
+    printf("\n");
+}
+
+static void print_rows( const pcio_record_header_t *h, const pcio_record_rows_t *b,
+                        uint64_t from, uint64_t to ) {
+    int d[PCIO_RECORD_QUANTITIES];
+    for( int c = 0; c < PCIO_RECORD_QUANTITIES; c++ ) d[c] = digits( h->step[c] );
+    for( size_t i = 0; i < b->rows; i++ ) {
+        if( b->t_ns[i] < from || b->t_ns[i] > to ) continue;
+        printf("%.6f", (double)(b->t_ns[i] - h->t0_ns) / 1e9);
+        for( int c = 0; c < PCIO_RECORD_QUANTITIES; c++ )
+            for( uint32_t j = 0; j < h->n; j++ ) printf(",%.*f", d[c], b->val[c][i * h->n + j]);
+        for( uint32_t j = 0; j < h->n; j++ ) printf(",0x%08x", b->status[i * h->n + j]);
+        printf("\n");
+    }
+}
+
+/* ------ */
+/* FLIGHT */
+/* ------ */
+
+/// Seconds from the dump to row r
+static double flight_t( const pcio_flight_t *f, const pcio_flight_row_t *r ) {
+    return ((double)r->t_ns - (double)f->hdr->dump_ns) / 1e9;
+}
+
+static void print_flight_info( const pcio_flight_t *f ) {
+    const pcio_flight_header_t *h = f->hdr;
+    uint64_t cnt = pcio_flight_count( f );
+    printf("flight recorder %s: group %s, %u joints, written after %s\n",
+           opt_file, h->name, h->n, h->reason);
+    if( cnt ) {
+        pcio_flight_row_t *first = pcio_flight_get( f, 0 ), *last = pcio_flight_get( f, cnt - 1 );
+        printf("  %lu cycles from %.3f s to %.3f s, %.3f s after the start of the daemon\n",
+               (unsigned long)cnt, flight_t( f, first ), flight_t( f, last ),
+               ((double)h->dump_ns - (double)h->t0_ns) / 1e9);
+    }
+}
+
+static int export_flight( void ) {
+    pcio_flight_t f;
+    if( pcio_flight_open( &f, opt_file ) ) {
+        fprintf(stderr, "Couldn't open flight recorder %s: %s\n", opt_file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if( opt_info ) {
+        print_flight_info( &f );
+        pcio_flight_destroy( &f );
+        return 0;
+    }
+
+    uint32_t n = f.hdr->n;
+    printf("t,work_us,transactions,step,result,ref_seq,ref_mode");
+    for( uint32_t j = 0; j < n; j++ ) printf(",u%u", j);
+    printf(",state_seq");
+    for( uint32_t j = 0; j < n; j++ ) printf(",pos%u", j);
+    for( uint32_t j = 0; j < n; j++ ) printf(",vel%u", j);
+    for( uint32_t j = 0; j < n; j++ ) printf(",short%u", j);
+    printf("\n");
+
+    uint64_t cnt = pcio_flight_count( &f );
+    for( uint64_t k = 0; k < cnt; k++ ) {
+        pcio_flight_row_t *r = pcio_flight_get( &f, k );
+        double t = flight_t( &f, r );
+        if( t < opt_from || t > opt_to ) continue;
+        printf("%.6f,%.1f,%u,%u,%d,%lu,%d", t, (double)r->work_ns / 1e3, r->transactions, r->step,
+               r->result, (unsigned long)r->ref_seq, r->ref_mode);
+        const double *u = pcio_flight_u( r ), *pos = pcio_flight_pos( &f, r ), *vel = pcio_flight_vel( &f, r );
+        const uint8_t *state = pcio_flight_state( &f, r );
+        for( uint32_t j = 0; j < n; j++ ) printf(",%.6f", u[j]);
+        printf(",%lu", (unsigned long)r->state_seq);
+        for( uint32_t j = 0; j < n; j++ ) printf(",%.6f", pos[j]);
+        for( uint32_t j = 0; j < n; j++ ) printf(",%.6f", vel[j]);
+        for( uint32_t j = 0; j < n; j++ ) printf(",0x%02x", state[j]);
+        printf("\n");
+    }
+    pcio_flight_destroy( &f );
+    return 0;
+}
+
+/* ---- */
+/* MAIN */
+/* ---- */
+int main(int argc, char **argv) {
+    argp_parse( &argp, argc, argv, 0, NULL, NULL );
+
+    // the first word tells a dump from a recording
+    uint32_t magic = 0;
+    FILE *fp = fopen( opt_file, "rb" );
+    if( fp ) {
+        if( 1 != fread( &magic, sizeof(magic), 1, fp ) ) magic = 0;
+        fclose( fp );
+    }
+    if( PCIO_FLIGHT_MAGIC == magic ) return export_flight();
+
+    pcio_record_reader_t r;
+    if( pcio_record_open( &r, opt_file ) ) {
+        fprintf(stderr, "Couldn't open recording %s: %s\n", opt_file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if( opt_info ) {
+        print_info( &r );
+        pcio_record_reader_close( &r );
+        return 0;
+    }
+
+    uint64_t from = opt_from <= 0 ? r.hdr.t0_ns : r.hdr.t0_ns + (uint64_t)(opt_from * 1e9);
+    uint64_t to = isinf( opt_to ) ? UINT64_MAX : r.hdr.t0_ns + (uint64_t)(opt_to * 1e9);
+    print_header( &r.hdr );
+    int status = 0;
+    for( size_t k = pcio_record_find( &r, from ); k < r.blocks && r.index[k].t_first_ns <= to; k++ ) {
+        const pcio_record_rows_t *b = pcio_record_read( &r, k );
+        if( NULL == b ) {
+            fprintf(stderr, "Couldn't read block %lu: %s\n", (unsigned long)k, strerror(errno));
+            status = EXIT_FAILURE;
+            break;
+        }
+        print_rows( &r.hdr, b, from, to );
+    }
+
+    pcio_record_reader_close( &r );
+    return status;
+}
@@ -0,0 +1,171 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * \file pcio_shm.c
+ * \brief Seqlock shared memory mirror of published messages
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcio_shm.h"
+
+/// Payload starts on its own cache line
+#define PCIO_SHM_DATA_OFFSET 64
+
+/// Attempts a reader makes before giving up on a region that keeps changing
+#define PCIO_SHM_READ_TRIES 1000
+
+static int pcio_shm_map( pcio_shm_t *shm, const char *name, int prot ) {
+    shm->map_size = 0;
+    {
+        struct stat st;
+        if( fstat(shm->fd, &st) ) return -1;
+        shm->map_size = (size_t)st.st_size;
+    }
+    void *p = mmap( NULL, shm->map_size, prot, MAP_SHARED, shm->fd, 0 );
+    if( MAP_FAILED == p ) return -1;
+    shm->hdr = (pcio_shm_header_t*)p;
+    shm->data = (uint8_t*)p + PCIO_SHM_DATA_OFFSET;
+    shm->name = strdup(name);
+    return 0;
+}
+
+int pcio_shm_create( pcio_shm_t *shm, const char *name, size_t size ) {
+    memset( shm, 0, sizeof(*shm) );
+    shm->writer = 1;
+    // only the daemon writes the state; a region left by an older run keeps its mode, set it
+    shm->fd = shm_open( name, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( shm->fd < 0 ) return -1;
+    if( fchmod( shm->fd, 0644 ) ||
+        ftruncate( shm->fd, (off_t)(PCIO_SHM_DATA_OFFSET + size) ) ||
+        pcio_shm_map( shm, name, PROT_READ | PROT_WRITE ) ) {
+        int e = errno;
+        close( shm->fd );
+        shm_unlink( name );
+        errno = e;
+        return -1;
+    }
+
+    shm->hdr->size = size;
+    shm->hdr->data_offset = PCIO_SHM_DATA_OFFSET;
+    shm->hdr->seq = 0;
+    shm->hdr->version = PCIO_SHM_VERSION;
+    // readers check the magic last
+    __atomic_store_n( &shm->hdr->magic, PCIO_SHM_MAGIC, __ATOMIC_RELEASE );
+    return 0;
+}
+
+int pcio_shm_open( pcio_shm_t *shm, const char *name ) {
+    memset( shm, 0, sizeof(*shm) );
+    shm->fd = shm_open( name, O_RDONLY, 0 );
+    if( shm->fd < 0 ) return -1;
+    if( pcio_shm_map( shm, name, PROT_READ ) ) {
+        int e = errno;
+        close( shm->fd );
+        errno = e;
+        return -1;
+    }
+    if( shm->map_size < PCIO_SHM_DATA_OFFSET ||
+        PCIO_SHM_MAGIC != __atomic_load_n( &shm->hdr->magic, __ATOMIC_ACQUIRE ) ||
+        PCIO_SHM_VERSION != shm->hdr->version ||
+        PCIO_SHM_DATA_OFFSET + shm->hdr->size > shm->map_size ) {
+        pcio_shm_close( shm );
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void pcio_shm_close( pcio_shm_t *shm ) {
+    if( shm->hdr ) munmap( shm->hdr, shm->map_size );
+    if( shm->fd >= 0 ) close( shm->fd );
+    if( shm->writer && shm->name ) shm_unlink( shm->name );
+    free( shm->name );
+    memset( shm, 0, sizeof(*shm) );
+    shm->fd = -1;
+}
+
+void pcio_shm_write( pcio_shm_t *shm, const void *buf, size_t size ) {
+    pcio_shm_header_t *h = shm->hdr;
+    if( size > h->size ) size = h->size;
+
+    // odd sequence: readers that overlap with the copy will retry
+    uint64_t seq = __atomic_load_n( &h->seq, __ATOMIC_RELAXED );
+    __atomic_store_n( &h->seq, seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    memcpy( shm->data, buf, size );
+
+    __atomic_store_n( &h->seq, seq + 2, __ATOMIC_RELEASE );
+}
+
+int pcio_shm_read( const pcio_shm_t *shm, void *buf, size_t size, uint64_t *last_seq ) {
+    const pcio_shm_header_t *h = shm->hdr;
+    if( size < h->size ) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for( int i = 0; i < PCIO_SHM_READ_TRIES; i++ ) {
+        uint64_t s0 = __atomic_load_n( &h->seq, __ATOMIC_ACQUIRE );
+        if( s0 & 1 ) continue; // writer is in the middle of an update
+        if( last_seq && *last_seq == s0 ) return PCIO_SHM_UNCHANGED;
+
+        memcpy( buf, shm->data, h->size );
+
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        uint64_t s1 = __atomic_load_n( &h->seq, __ATOMIC_RELAXED );
+        if( s0 == s1 ) {
+            if( last_seq ) *last_seq = s0;
+            return 0;
+        }
+    }
+    errno = EAGAIN;
+    return -1;
+}
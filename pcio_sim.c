@@ -0,0 +1,587 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/**
+ * \file pcio_sim.c
+ * \brief Simulated PowerCube busses with fault injection
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <amino.h>
+#include "pcio_sim.h"
+
+/// Bus bit time in ns, 1 Mbit/s
+#define PCIO_SIM_BIT_NS 1000
+
+/// Nominal bits of a standard frame without stuffing, excluding data
+#define PCIO_SIM_FRAME_BITS 47
+
+/// Bits of the state word that a reset clears
+#define PCIO_SIM_RESET_CLEARS ( PCIO_STATE_ERROR | PCIO_STATE_TOW_ERROR | PCIO_STATE_COMM_ERROR | \
+                                PCIO_STATE_HALTED | PCIO_STATE_BEYOND_SOFT )
+
+static uint64_t pcio_sim_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void pcio_sim_sleep_until( uint64_t t_ns ) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(t_ns / 1000000000);
+    ts.tv_nsec = (long)(t_ns % 1000000000);
+    while( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) );
+}
+
+static uint64_t pcio_sim_frame_ns( int len ) {
+    return (uint64_t)(PCIO_SIM_FRAME_BITS + 8 * len) * PCIO_SIM_BIT_NS;
+}
+
+/// splitmix64, to spread the seed over the generator state
+static uint64_t pcio_sim_mix( uint64_t x ) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/// xorshift64*, one draw per call whatever p is so the sequence only depends on the writes
+static int pcio_sim_chance( pcio_sim_bus_t *b, double p ) {
+    b->rng ^= b->rng >> 12;
+    b->rng ^= b->rng << 25;
+    b->rng ^= b->rng >> 27;
+    uint64_t x = b->rng * 0x2545f4914f6cdd1dULL;
+    return (double)(x >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+static void pcio_sim_count( uint64_t *c ) {
+    __atomic_add_fetch( c, 1, __ATOMIC_RELAXED );
+}
+
+static float pcio_sim_ldf( const uint8_t *p ) {
+    uint32_t u = aa_endconv_ld_le_u32( p );
+    float f;
+    memcpy( &f, &u, sizeof(f) );
+    return f;
+}
+
+static void pcio_sim_stf( uint8_t *p, float f ) {
+    uint32_t u;
+    memcpy( &u, &f, sizeof(u) );
+    aa_endconv_st_le_u32( p, u );
+}
+
+/*---------*/
+/* Modules */
+/*---------*/
+
+static uint8_t pcio_sim_short_state( const pcio_sim_module_t *m ) {
+    uint8_t s = 0;
+    if( (m->state & (PCIO_STATE_ERROR | PCIO_STATE_HALTED)) ||
+        ! (m->state & PCIO_STATE_HOME_OK) )
+        s |= PCIO_SHORT_NOT_OK;
+    if( m->state & PCIO_STATE_SWR ) s |= PCIO_SHORT_SWR;
+    if( m->state & PCIO_STATE_SW1 ) s |= PCIO_SHORT_SW1;
+    if( m->state & PCIO_STATE_SW2 ) s |= PCIO_SHORT_SW2;
+    if( m->vel != 0 || m->step_t1_ns ) s |= PCIO_SHORT_MOTION;
+    if( m->step_t1_ns ) s |= PCIO_SHORT_INPROGRESS;
+    if( m->next ) s |= PCIO_SHORT_FULLBUFFER;
+    return s;
+}
+
+/// Start a step from the current position to pos, taking ms milliseconds from t_ns
+static void pcio_sim_step_start( pcio_sim_module_t *m, float pos, uint16_t ms, uint64_t t_ns ) {
+    m->step_from = m->pos;
+    m->step_to = AA_MAX( m->min_pos, AA_MIN( m->max_pos, pos ) );
+    m->step_t0_ns = t_ns;
+    m->step_t1_ns = t_ns + (uint64_t)AA_MAX( ms, 1 ) * 1000000;
+    m->vel = 0;
+}
+
+/// Run the steps up to time t_ns, starting the buffered one when the running one ends
+static void pcio_sim_step( pcio_sim_module_t *m, uint64_t t_ns ) {
+    while( m->step_t1_ns && t_ns >= m->step_t1_ns ) {
+        m->pos = m->step_to;
+        uint64_t end = m->step_t1_ns;
+        m->step_t1_ns = 0;
+        if( m->next ) {
+            m->next = 0;
+            pcio_sim_step_start( m, m->next_pos, m->next_ms, end );
+        }
+    }
+    if( m->step_t1_ns ) {
+        double a = (double)(t_ns - m->step_t0_ns) / (double)(m->step_t1_ns - m->step_t0_ns);
+        m->pos = m->step_from + (float)a * (m->step_to - m->step_from);
+    }
+}
+
+/// Move the module along its velocity up to time t_ns
+static void pcio_sim_integrate( pcio_sim_module_t *m, uint64_t t_ns ) {
+    if( m->step_t1_ns ) {
+        pcio_sim_step( m, t_ns );
+        m->t_ns = t_ns;
+        return;
+    }
+    if( m->homed_ns && t_ns >= m->homed_ns ) {
+        m->homed_ns = 0;
+        m->state = (m->state & ~(uint32_t)PCIO_STATE_MOTION) | PCIO_STATE_HOME_OK;
+        m->pos = 0;
+    }
+    if( t_ns > m->t_ns && 0 != m->vel ) {
+        m->pos += m->vel * (float)((double)(t_ns - m->t_ns) / 1e9);
+        if( m->pos < m->min_pos || m->pos > m->max_pos ) {
+            m->pos = AA_MAX( m->min_pos, AA_MIN( m->max_pos, m->pos ) );
+            m->vel = 0;
+        }
+    }
+    m->t_ns = t_ns;
+}
+
+static float pcio_sim_param( const pcio_sim_module_t *m, int parm, uint32_t *u ) {
+    switch( parm ) {
+    case PCIO_PARAM_ERROR:
+        *u = m->state;
+        if( m->step_t1_ns ) *u |= PCIO_STATE_MOTION | PCIO_STATE_INPROGRESS;
+        if( m->next ) *u |= PCIO_STATE_FULLBUFFER;
+        return 0;
+    case PCIO_PARAM_CONFIG: *u = m->config; return 0;
+    case PCIO_DEF_CUBE_VERSION: *u = 0x3507; return 0;
+    case PCIO_ACT_FPOS: return m->pos;
+    case PCIO_ACT_FVEL: return m->vel;
+    case PCIO_ACT_FPSEUDOCURRENT: return m->cur;
+    case PCIO_PARAM_MIN_FPOS: return m->min_pos;
+    case PCIO_PARAM_MAX_FPOS: return m->max_pos;
+    case PCIO_PARAM_MAX_ACC: return m->max_acc;
+    case PCIO_PARAM_BUSVOLTAGE: return 24.0f;
+    case PCIO_PARAM_BUSCURRENT: return 0.1f;
+    default: return 0;
+    }
+}
+
+/** Carry out one request on module m at time t_ns.
+    \return 1 if the module answers with reply
+*/
+static int pcio_sim_execute( pcio_sim_t *s, pcio_sim_bus_t *b, pcio_sim_module_t *m, int id,
+                             const CMSG *req, CMSG *reply, uint64_t t_ns ) {
+    pcio_sim_integrate( m, t_ns );
+    memset( reply, 0, sizeof(*reply) );
+    reply->id = PCIO_CANID_CMDACK( id );
+    reply->data[0] = req->data[0];
+    reply->len = 1;
+
+    switch( req->data[0] ) {
+    case PCIO_RESET:
+        if( ! (m->state & PCIO_STATE_POWERFAULT) ) m->state &= ~(uint32_t)PCIO_SIM_RESET_CLEARS;
+        m->vel = 0;
+        m->cur = 0;
+        return 1;
+    case PCIO_HOME:
+        if( m->home_ns ) {
+            m->state = (m->state & ~(uint32_t)PCIO_STATE_HOME_OK) | PCIO_STATE_MOTION;
+            m->homed_ns = t_ns + m->home_ns;
+        } else {
+            m->state |= PCIO_STATE_HOME_OK;
+            m->pos = 0;
+        }
+        return 1;
+    case PCIO_HALT:
+        m->state = (m->state & ~(uint32_t)PCIO_STATE_MOTION) | PCIO_STATE_HALTED;
+        m->vel = 0;
+        m->homed_ns = 0;
+        m->step_t1_ns = 0;
+        m->next = 0;
+        return 1;
+    case PCIO_GET_PARAM: {
+        uint32_t u = 0;
+        float f = pcio_sim_param( m, req->data[1], &u );
+        reply->data[1] = req->data[1];
+        reply->len = 6;
+        if( u ) aa_endconv_st_le_u32( &reply->data[2], u );
+        else pcio_sim_stf( &reply->data[2], f );
+        return 1;
+    }
+    case PCIO_SET_PARAM:
+        switch( req->data[1] ) {
+        case PCIO_PARAM_CONFIG: m->config = aa_endconv_ld_le_u32( &req->data[2] ); break;
+        case PCIO_PARAM_MIN_FPOS: m->min_pos = pcio_sim_ldf( &req->data[2] ); break;
+        case PCIO_PARAM_MAX_FPOS: m->max_pos = pcio_sim_ldf( &req->data[2] ); break;
+        case PCIO_PARAM_MAX_ACC: m->max_acc = pcio_sim_ldf( &req->data[2] ); break;
+        default: break;
+        }
+        reply->data[1] = req->data[1];
+        reply->data[2] = 0x64;
+        reply->len = 3;
+        return 1;
+    case PCIO_SET_MOTION: {
+        float v = pcio_sim_ldf( &req->data[2] );
+        if( ! (m->state & (PCIO_STATE_ERROR | PCIO_STATE_HALTED)) ) {
+            if( pcio_sim_chance( b, s->faults.error ) ) {
+                pcio_sim_count( &s->count.error );
+                m->state |= PCIO_STATE_ERROR | PCIO_STATE_TOW_ERROR;
+            }
+            if( pcio_sim_chance( b, s->faults.power_fault ) ) {
+                pcio_sim_count( &s->count.power_fault );
+                m->state |= PCIO_STATE_ERROR | PCIO_STATE_POWERFAULT | PCIO_STATE_POW_VOLT_ERR;
+            }
+        }
+        if( m->state & (PCIO_STATE_ERROR | PCIO_STATE_HALTED) ) {
+            m->vel = 0;
+            m->step_t1_ns = 0;
+            m->next = 0;
+        } else if( PCIO_FSTEP_ACK == req->data[1] ) {
+            // a step received while the buffer is full replaces the buffered one
+            uint16_t ms = aa_endconv_ld_le_u16( &req->data[6] );
+            if( m->step_t1_ns ) {
+                m->next_pos = v;
+                m->next_ms = ms;
+                m->next = 1;
+            } else {
+                pcio_sim_step_start( m, v, ms, t_ns );
+            }
+        } else if( PCIO_FRAMP == req->data[1] ) {
+            m->pos = AA_MAX( m->min_pos, AA_MIN( m->max_pos, v ) );
+            m->vel = 0;
+        } else if( PCIO_FVEL_ACK == req->data[1] ) {
+            m->vel = v;
+        } else if( PCIO_FCUR_ACK == req->data[1] ) {
+            m->cur = v;
+        }
+        if( PCIO_FSTEP_ACK != req->data[1] ) {
+            m->step_t1_ns = 0;
+            m->next = 0;
+        }
+        reply->data[1] = req->data[1];
+        pcio_sim_stf( &reply->data[2], m->pos );
+        reply->data[6] = pcio_sim_short_state( m );
+        reply->len = 8;
+        return 1;
+    }
+    default:
+        return 0;
+    }
+}
+
+static void pcio_sim_push( pcio_sim_bus_t *b, uint64_t due_ns, const CMSG *msg ) {
+    if( PCIO_SIM_QUEUE_MAX == b->n_reply ) return; // the receive queue overflows
+    b->reply[b->n_reply].due_ns = due_ns;
+    b->reply[b->n_reply].msg = *msg;
+    b->n_reply++;
+}
+
+/*-----------*/
+/* Transport */
+/*-----------*/
+
+static pcio_sim_bus_t *pcio_sim_handle( pcio_sim_t *s, NTCAN_HANDLE handle ) {
+    if( handle < 0 || (size_t)handle >= s->bus_cnt || ! s->bus[handle].open ) return NULL;
+    return &s->bus[handle];
+}
+
+static int pcio_sim_open( void *cx, int net, int32_t queue_size, NTCAN_HANDLE *handle ) {
+    pcio_sim_t *s = (pcio_sim_t*)cx;
+    (void)queue_size;
+    for( size_t i = 0; i < s->bus_cnt; i++ ) {
+        pcio_sim_bus_t *b = &s->bus[i];
+        if( b->net != net ) continue;
+        pthread_mutex_lock( &b->mutex );
+        b->open = 1;
+        // reopening is what brings a bus back that stays off
+        if( UINT64_MAX == b->off_ns ) b->off_ns = 0;
+        b->n_reply = 0;
+        pthread_mutex_unlock( &b->mutex );
+        *handle = (NTCAN_HANDLE)i;
+        return NTCAN_SUCCESS;
+    }
+    return NTCAN_NET_NOT_FOUND;
+}
+
+static int pcio_sim_close( void *cx, NTCAN_HANDLE handle ) {
+    pcio_sim_bus_t *b = pcio_sim_handle( (pcio_sim_t*)cx, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    b->open = 0;
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_sim_id_add( void *cx, NTCAN_HANDLE handle, int32_t id ) {
+    (void)id;
+    return pcio_sim_handle( (pcio_sim_t*)cx, handle ) ? NTCAN_SUCCESS : NTCAN_INVALID_HANDLE;
+}
+
+static int pcio_sim_write( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    pcio_sim_t *s = (pcio_sim_t*)cx;
+    pcio_sim_bus_t *b = pcio_sim_handle( s, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    pthread_mutex_lock( &b->mutex );
+    uint64_t now = pcio_sim_now();
+    int r = NTCAN_SUCCESS;
+
+    int32_t f;
+    for( f = 0; f < *len; f++ ) {
+        if( b->off_ns > now ) {
+            r = NTCAN_CONTR_OFF_BUS;
+            break;
+        }
+        if( pcio_sim_chance( b, s->faults.bus_off ) ) {
+            pcio_sim_count( &s->count.bus_off );
+            b->off_ns = s->faults.bus_off_ns ? now + s->faults.bus_off_ns : UINT64_MAX;
+            b->n_reply = 0;
+            r = NTCAN_CONTR_OFF_BUS;
+            break;
+        }
+
+        uint64_t t = AA_MAX( now, b->busy_ns ) + pcio_sim_frame_ns( msg[f].len );
+        b->busy_ns = t;
+
+        // broadcasts reach every module and are not answered
+        int bcast = ( PCIO_CANID_CMDALL == msg[f].id );
+        for( int id = 0; id < 32; id++ ) {
+            pcio_sim_module_t *m = &b->module[id];
+            if( ! m->present ) continue;
+            if( ! bcast && ( PCIO_CANID_MODID( msg[f].id ) != id ||
+                             ( (msg[f].id & ~0x1f) != PCIO_IDMASK_CMDPUT &&
+                               (msg[f].id & ~0x1f) != PCIO_IDMASK_CMDGET ) ) )
+                continue;
+            if( pcio_sim_chance( b, s->faults.drop ) ) {
+                pcio_sim_count( &s->count.drop );
+                continue;
+            }
+            CMSG reply;
+            if( ! pcio_sim_execute( s, b, m, id, &msg[f], &reply, t ) || bcast ) continue;
+            if( pcio_sim_chance( b, s->faults.drop ) ) {
+                pcio_sim_count( &s->count.drop );
+                continue;
+            }
+            uint64_t due = AA_MAX( t + s->turnaround_ns, b->busy_ns ) + pcio_sim_frame_ns( reply.len );
+            b->busy_ns = due;
+            if( pcio_sim_chance( b, s->faults.delay ) ) {
+                pcio_sim_count( &s->count.delay );
+                due += s->faults.delay_ns;
+            }
+            pcio_sim_push( b, due, &reply );
+            if( pcio_sim_chance( b, s->faults.duplicate ) ) {
+                pcio_sim_count( &s->count.duplicate );
+                b->busy_ns += pcio_sim_frame_ns( reply.len );
+                pcio_sim_push( b, due + pcio_sim_frame_ns( reply.len ), &reply );
+            }
+        }
+    }
+    *len = f;
+    pthread_mutex_unlock( &b->mutex );
+    return r;
+}
+
+/// Hand out the replies that are due; unless take is set, wait up to the read timeout for one
+static int pcio_sim_get( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len, int take ) {
+    pcio_sim_t *s = (pcio_sim_t*)cx;
+    pcio_sim_bus_t *b = pcio_sim_handle( s, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    uint64_t deadline = pcio_sim_now() + s->rx_timeout_ns;
+
+    for( ;; ) {
+        pthread_mutex_lock( &b->mutex );
+        uint64_t now = pcio_sim_now();
+        if( b->off_ns > now ) {
+            pthread_mutex_unlock( &b->mutex );
+            *len = 0;
+            return NTCAN_CONTR_OFF_BUS;
+        }
+
+        // hand out the replies that are due, earliest first
+        int32_t got = 0;
+        uint64_t next = UINT64_MAX;
+        while( got < *len && b->n_reply > 0 ) {
+            size_t k = 0;
+            for( size_t i = 1; i < b->n_reply; i++ )
+                if( b->reply[i].due_ns < b->reply[k].due_ns ) k = i;
+            if( b->reply[k].due_ns > now ) {
+                next = b->reply[k].due_ns;
+                break;
+            }
+            msg[got++] = b->reply[k].msg;
+            memmove( &b->reply[k], &b->reply[k+1], (b->n_reply - k - 1) * sizeof(b->reply[0]) );
+            b->n_reply--;
+        }
+        pthread_mutex_unlock( &b->mutex );
+
+        if( got > 0 || take ) {
+            *len = got;
+            return NTCAN_SUCCESS;
+        }
+        if( next > deadline ) {
+            pcio_sim_sleep_until( deadline );
+            *len = 0;
+            return NTCAN_RX_TIMEOUT;
+        }
+        pcio_sim_sleep_until( next );
+    }
+}
+
+static int pcio_sim_read( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_sim_get( cx, handle, msg, len, 0 );
+}
+
+static int pcio_sim_take( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_sim_get( cx, handle, msg, len, 1 );
+}
+
+/// Wait until a reply is due on any open bus, or a bus is off
+static int pcio_sim_wait( void *cx, int timeout_ms ) {
+    pcio_sim_t *s = (pcio_sim_t*)cx;
+    uint64_t deadline = pcio_sim_now() + (uint64_t)timeout_ms * 1000000;
+
+    for( ;; ) {
+        uint64_t now = pcio_sim_now();
+        uint64_t next = UINT64_MAX;
+        for( size_t i = 0; i < s->bus_cnt; i++ ) {
+            pcio_sim_bus_t *b = &s->bus[i];
+            if( ! b->open ) continue;
+            pthread_mutex_lock( &b->mutex );
+            if( b->off_ns > now ) next = now; // take reports it
+            for( size_t k = 0; k < b->n_reply; k++ )
+                next = AA_MIN( next, b->reply[k].due_ns );
+            pthread_mutex_unlock( &b->mutex );
+        }
+        if( next <= now ) return NTCAN_SUCCESS;
+        if( next > deadline ) {
+            pcio_sim_sleep_until( deadline );
+            return NTCAN_RX_TIMEOUT;
+        }
+        pcio_sim_sleep_until( next );
+    }
+}
+
+const pcio_transport_t pcio_transport_sim = {
+    .name = "sim",
+    .open = pcio_sim_open,
+    .close = pcio_sim_close,
+    .id_add = pcio_sim_id_add,
+    .write = pcio_sim_write,
+    .read = pcio_sim_read,
+    .take = pcio_sim_take,
+    .wait = pcio_sim_wait,
+};
+
+/*------------*/
+/* Simulation */
+/*------------*/
+
+void pcio_sim_init( pcio_sim_t *s, uint64_t seed ) {
+    memset( s, 0, sizeof(*s) );
+    s->seed = seed;
+    s->turnaround_ns = 50000;
+    s->rx_timeout_ns = 100000000; // same as pcio.c gives canOpen
+}
+
+void pcio_sim_destroy( pcio_sim_t *s ) {
+    for( size_t i = 0; i < s->bus_cnt; i++ )
+        pthread_mutex_destroy( &s->bus[i].mutex );
+    s->bus_cnt = 0;
+}
+
+pcio_sim_module_t *pcio_sim_module( pcio_sim_t *s, int net, int id ) {
+    if( id < 0 || id >= 32 ) return NULL;
+    for( size_t i = 0; i < s->bus_cnt; i++ ) {
+        if( s->bus[i].net == net )
+            return s->bus[i].module[id].present ? &s->bus[i].module[id] : NULL;
+    }
+    return NULL;
+}
+
+pcio_sim_module_t *pcio_sim_add_module( pcio_sim_t *s, int net, int id ) {
+    if( id < 0 || id >= 32 ) return NULL;
+    size_t i;
+    for( i = 0; i < s->bus_cnt && s->bus[i].net != net; i++ );
+    if( i == s->bus_cnt ) {
+        if( PCIO_SIM_BUS_MAX == s->bus_cnt ) return NULL;
+        pcio_sim_bus_t *b = &s->bus[s->bus_cnt++];
+        memset( b, 0, sizeof(*b) );
+        b->net = net;
+        b->rng = pcio_sim_mix( s->seed ^ pcio_sim_mix( (uint64_t)net ) ) | 1;
+        pthread_mutex_init( &b->mutex, NULL );
+    }
+    pcio_sim_module_t *m = &s->bus[i].module[id];
+    memset( m, 0, sizeof(*m) );
+    m->present = 1;
+    m->state = PCIO_STATE_HOME_OK;
+    m->min_pos = -3.0f;
+    m->max_pos = 3.0f;
+    m->max_acc = 2.0f;
+    m->t_ns = pcio_sim_now();
+    return m;
+}
+
+int pcio_sim_attach( pcio_sim_t *s, pcio_group_t *g ) {
+    for( size_t i = 0; i < g->bus_cnt; i++ ) {
+        for( size_t j = 0; j < g->bus[i].module_cnt; j++ ) {
+            if( NULL == pcio_sim_add_module( s, g->bus[i].net, g->bus[i].module[j].id ) ) {
+                errno = ERANGE;
+                return -1;
+            }
+        }
+    }
+    g->transport = &pcio_transport_sim;
+    g->transport_cx = s;
+    return 0;
+}
+
+void pcio_sim_power_cycle( pcio_sim_t *s ) {
+    for( size_t i = 0; i < s->bus_cnt; i++ ) {
+        pcio_sim_bus_t *b = &s->bus[i];
+        pthread_mutex_lock( &b->mutex );
+        for( int id = 0; id < 32; id++ ) {
+            pcio_sim_module_t *m = &b->module[id];
+            if( ! m->present ) continue;
+            m->state = PCIO_STATE_HOME_OK;
+            m->vel = 0;
+            m->cur = 0;
+            m->homed_ns = 0;
+            m->step_t1_ns = 0;
+            m->next = 0;
+        }
+        pthread_mutex_unlock( &b->mutex );
+    }
+}
@@ -0,0 +1,774 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+/**
+ * \file pcio_socketcan.c
+ * \brief CAN transport over Linux SocketCAN
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sendmmsg, recvmmsg
+#endif
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+#include <amino.h>
+#include "pcio_socketcan.h"
+
+/// How long a write waits for room in a full transmit queue; about one frame
+#define PCIO_SOCKETCAN_TX_RETRY_NS 100000
+
+static pcio_socketcan_bus_t *pcio_socketcan_handle( pcio_socketcan_t *s, NTCAN_HANDLE handle ) {
+    if( handle < 0 || handle >= PCIO_SOCKETCAN_BUS_MAX || s->bus[handle].fd < 0 ) return NULL;
+    return &s->bus[handle];
+}
+
+/// The NTCAN result for errno err of a failed socket call, or fallback
+static int pcio_socketcan_result( int err, int fallback ) {
+    switch( err ) {
+    case ENETDOWN: return NTCAN_CONTR_OFF_BUS;
+    case ENODEV:
+    case ENXIO: return NTCAN_NET_NOT_FOUND;
+    case EBADF: return NTCAN_INVALID_HANDLE;
+    case ENOMEM:
+    case EMFILE:
+    case ENFILE: return NTCAN_INSUFFICIENT_RESOURCES;
+    default: return fallback;
+    }
+}
+
+/// Pass the ids of b, and nothing else, to its socket
+static int pcio_socketcan_filter( pcio_socketcan_bus_t *b ) {
+    struct can_filter f[PCIO_SOCKETCAN_ID_MAX];
+    for( size_t i = 0; i < b->n_id; i++ ) {
+        f[i].can_id = b->id[i];
+        f[i].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+    // an empty filter list receives no frames at all
+    return setsockopt( b->fd, SOL_CAN_RAW, CAN_RAW_FILTER, f,
+                       (socklen_t)(b->n_id * sizeof(f[0])) );
+}
+
+/*-----------*/
+/* Transport */
+/*-----------*/
+
+static int pcio_socketcan_open( void *cx, int net, int32_t queue_size, NTCAN_HANDLE *handle ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    (void)queue_size; // the socket buffers are sized by the kernel
+
+    char name[IFNAMSIZ];
+    snprintf( name, sizeof(name), s->ifname, net );
+    unsigned idx = if_nametoindex( name );
+    if( 0 == idx ) return NTCAN_NET_NOT_FOUND;
+
+    int fd = socket( PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW );
+    if( fd < 0 ) return pcio_socketcan_result( errno, NTCAN_INVALID_DRIVER );
+
+    pthread_mutex_lock( &s->mutex );
+    size_t h;
+    for( h = 0; h < PCIO_SOCKETCAN_BUS_MAX && s->bus[h].fd >= 0; h++ );
+    if( PCIO_SOCKETCAN_BUS_MAX == h ) {
+        pthread_mutex_unlock( &s->mutex );
+        close( fd );
+        return NTCAN_INSUFFICIENT_RESOURCES;
+    }
+    pcio_socketcan_bus_t *b = &s->bus[h];
+    b->fd = fd;
+    b->net = net;
+    b->n_id = 0;
+    pthread_mutex_unlock( &s->mutex );
+
+    // bus off comes as an error frame, which take and read report
+    can_err_mask_t err = CAN_ERR_BUSOFF;
+    struct sockaddr_can addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = (int)idx;
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof(ev) );
+    ev.events = EPOLLIN;
+    ev.data.u32 = (uint32_t)h;
+    if( pcio_socketcan_filter( b ) ||
+        setsockopt( fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err, sizeof(err) ) ||
+        bind( fd, (struct sockaddr*)&addr, sizeof(addr) ) ||
+        epoll_ctl( s->epoll_fd, EPOLL_CTL_ADD, fd, &ev ) ) {
+        int e = errno;
+        close( fd );
+        b->fd = -1;
+        return pcio_socketcan_result( e, NTCAN_INVALID_DRIVER );
+    }
+    *handle = (NTCAN_HANDLE)h;
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_socketcan_close( void *cx, NTCAN_HANDLE handle ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_bus_t *b = pcio_socketcan_handle( s, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    epoll_ctl( s->epoll_fd, EPOLL_CTL_DEL, b->fd, NULL );
+    close( b->fd );
+    pthread_mutex_lock( &s->mutex );
+    b->fd = -1;
+    pthread_mutex_unlock( &s->mutex );
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_socketcan_id_add( void *cx, NTCAN_HANDLE handle, int32_t id ) {
+    pcio_socketcan_bus_t *b = pcio_socketcan_handle( (pcio_socketcan_t*)cx, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    if( id < 0 || (uint32_t)id > CAN_SFF_MASK ) return NTCAN_INVALID_PARAMETER;
+    for( size_t i = 0; i < b->n_id; i++ )
+        if( b->id[i] == (uint32_t)id ) return NTCAN_ID_ALREADY_ENABLED;
+    if( PCIO_SOCKETCAN_ID_MAX == b->n_id ) return NTCAN_INSUFFICIENT_RESOURCES;
+    b->id[b->n_id++] = (uint32_t)id;
+    if( pcio_socketcan_filter( b ) ) {
+        b->n_id--;
+        return pcio_socketcan_result( errno, NTCAN_INVALID_PARAMETER );
+    }
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_socketcan_write( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_bus_t *b = pcio_socketcan_handle( s, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    int32_t n = *len;
+    *len = 0;
+    if( n <= 0 ) return NTCAN_SUCCESS;
+
+    struct can_frame frame[n];
+    struct iovec iov[n];
+    struct mmsghdr mh[n];
+    memset( frame, 0, sizeof(frame) );
+    memset( mh, 0, sizeof(mh) );
+    for( int32_t i = 0; i < n; i++ ) {
+        frame[i].can_id = (canid_t)msg[i].id & CAN_SFF_MASK;
+        frame[i].can_dlc = AA_MIN( msg[i].len & 0x0f, 8 );
+        memcpy( frame[i].data, msg[i].data, frame[i].can_dlc );
+        iov[i].iov_base = &frame[i];
+        iov[i].iov_len = sizeof(frame[i]);
+        mh[i].msg_hdr.msg_iov = &iov[i];
+        mh[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // the whole burst in one call, unless the transmit queue fills up
+    long retries = (long)s->timeout_ms * 1000000 / PCIO_SOCKETCAN_TX_RETRY_NS;
+    while( *len < n ) {
+        int k = sendmmsg( b->fd, &mh[*len], (unsigned)(n - *len), 0 );
+        if( k > 0 ) {
+            *len += k;
+        } else if( EAGAIN == errno || ENOBUFS == errno ) {
+            if( retries-- <= 0 ) return NTCAN_TX_TIMEOUT;
+            struct timespec t = { 0, PCIO_SOCKETCAN_TX_RETRY_NS };
+            nanosleep( &t, NULL );
+        } else if( EINTR != errno ) {
+            return pcio_socketcan_result( errno, NTCAN_TX_ERROR );
+        }
+    }
+    return NTCAN_SUCCESS;
+}
+
+/// Receive the frames waiting on a bus; unless take is set, wait up to the timeout for one
+static int pcio_socketcan_get( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len, int take ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_bus_t *b = pcio_socketcan_handle( s, handle );
+    if( NULL == b ) return NTCAN_INVALID_HANDLE;
+    int32_t n = *len;
+    *len = 0;
+    if( n <= 0 ) return NTCAN_SUCCESS;
+
+    struct can_frame frame[n];
+    struct iovec iov[n];
+    struct mmsghdr mh[n];
+    memset( mh, 0, sizeof(mh) );
+    for( int32_t i = 0; i < n; i++ ) {
+        iov[i].iov_base = &frame[i];
+        iov[i].iov_len = sizeof(frame[i]);
+        mh[i].msg_hdr.msg_iov = &iov[i];
+        mh[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int k;
+    for( ;; ) {
+        k = recvmmsg( b->fd, mh, (unsigned)n, MSG_DONTWAIT, NULL );
+        if( k > 0 ) break;
+        if( k < 0 && EINTR == errno ) continue;
+        if( k < 0 && EAGAIN != errno ) return pcio_socketcan_result( errno, NTCAN_INVALID_DRIVER );
+        if( take ) return NTCAN_SUCCESS;
+        struct pollfd p = { b->fd, POLLIN, 0 };
+        int r = poll( &p, 1, s->timeout_ms );
+        if( 0 == r ) return NTCAN_RX_TIMEOUT;
+        if( r < 0 && EINTR != errno ) return pcio_socketcan_result( errno, NTCAN_INVALID_DRIVER );
+    }
+
+    for( int i = 0; i < k; i++ ) {
+        const struct can_frame *f = &frame[i];
+        if( f->can_id & CAN_ERR_FLAG ) {
+            if( f->can_id & CAN_ERR_BUSOFF ) {
+                *len = 0;
+                return NTCAN_CONTR_OFF_BUS;
+            }
+            continue;
+        }
+        CMSG *m = &msg[(*len)++];
+        memset( m, 0, sizeof(*m) );
+        m->id = (int32_t)(f->can_id & CAN_SFF_MASK);
+        m->len = AA_MIN( f->can_dlc, 8 );
+        memcpy( m->data, f->data, m->len );
+    }
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_socketcan_read( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_socketcan_get( cx, handle, msg, len, 0 );
+}
+
+static int pcio_socketcan_take( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_socketcan_get( cx, handle, msg, len, 1 );
+}
+
+/// Sleep on the epoll set until a frame waits on any open bus
+static int pcio_socketcan_wait( void *cx, int timeout_ms ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    struct epoll_event ev[PCIO_SOCKETCAN_BUS_MAX];
+    for( ;; ) {
+        int k = epoll_wait( s->epoll_fd, ev, PCIO_SOCKETCAN_BUS_MAX, timeout_ms );
+        if( k > 0 ) return NTCAN_SUCCESS;
+        if( 0 == k ) return NTCAN_RX_TIMEOUT;
+        if( EINTR != errno ) return pcio_socketcan_result( errno, NTCAN_INVALID_DRIVER );
+    }
+}
+
+const pcio_transport_t pcio_transport_socketcan = {
+    .name = "socketcan",
+    .open = pcio_socketcan_open,
+    .close = pcio_socketcan_close,
+    .id_add = pcio_socketcan_id_add,
+    .write = pcio_socketcan_write,
+    .read = pcio_socketcan_read,
+    .take = pcio_socketcan_take,
+    .wait = pcio_socketcan_wait,
+};
+
+/*-----------------*/
+/* io_uring engine */
+/*-----------------*/
+
+/// What a completion of the io_uring engine finishes
+enum {
+    PCIO_SOCKETCAN_RECV = 1,
+    PCIO_SOCKETCAN_SEND = 2,
+    PCIO_SOCKETCAN_CANCEL = 3,
+    PCIO_SOCKETCAN_WAKE = 4,
+};
+
+/// Buffer group of the receive buffers
+#define PCIO_SOCKETCAN_BGID 0
+
+static uint64_t pcio_socketcan_ud( int kind, uint32_t gen, int handle, size_t slot ) {
+    return (uint64_t)kind << 56 | (uint64_t)(gen & 0xffffff) << 32 |
+        (uint64_t)handle << 16 | (uint64_t)slot;
+}
+
+static uint64_t pcio_socketcan_now( void ) {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+/// A submission entry, submitting the queued ones first if there is no room
+static struct io_uring_sqe *pcio_socketcan_sqe( pcio_socketcan_uring_t *e ) {
+    struct io_uring_sqe *sqe = pcio_uring_sqe( &e->ring );
+    if( NULL == sqe ) {
+        e->last = NULL;
+        if( pcio_uring_submit( &e->ring ) ) return NULL;
+        sqe = pcio_uring_sqe( &e->ring );
+    }
+    return sqe;
+}
+
+/// Start the multishot receive of bus h
+static void pcio_socketcan_arm( pcio_socketcan_t *s, int h ) {
+    pcio_socketcan_uring_t *e = s->uring;
+    struct io_uring_sqe *sqe = pcio_socketcan_sqe( e );
+    if( NULL == sqe ) return; // tried again with the next flush
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = s->bus[h].fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = PCIO_SOCKETCAN_BGID;
+    sqe->user_data = pcio_socketcan_ud( PCIO_SOCKETCAN_RECV, e->bus[h].gen, h, 0 );
+    e->bus[h].armed = 1;
+    e->last = NULL;
+}
+
+/// Queue the write of tx buffer slot, after the frames queued before it on the same bus
+static int pcio_socketcan_tx_queue( pcio_socketcan_t *s, size_t slot ) {
+    pcio_socketcan_uring_t *e = s->uring;
+    pcio_socketcan_uring_tx_t *tx = &e->tx_slot[slot];
+    struct io_uring_sqe *sqe = pcio_socketcan_sqe( e );
+    if( NULL == sqe ) return 0;
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = s->bus[tx->handle].fd;
+    sqe->addr = (uint64_t)(uintptr_t)&e->tx[slot];
+    sqe->len = sizeof(e->tx[slot]);
+    sqe->buf_index = 0;
+    sqe->user_data = pcio_socketcan_ud( PCIO_SOCKETCAN_SEND, tx->gen, tx->handle, slot );
+    // a link keeps the frames of a bus in order even if one has to wait
+    if( e->last && e->last_handle == tx->handle ) e->last->flags |= IOSQE_IO_LINK;
+    e->last = sqe;
+    e->last_handle = tx->handle;
+    return 1;
+}
+
+/// Give receive buffer bid back to the kernel
+static void pcio_socketcan_rx_give( pcio_socketcan_uring_t *e, uint16_t bid ) {
+    struct io_uring_buf_ring *br = e->rx_ring;
+    uint16_t tail = br->tail;
+    struct io_uring_buf *b = &br->bufs[tail & (PCIO_SOCKETCAN_URING_RX - 1)];
+    b->addr = (uint64_t)(uintptr_t)&e->rx[bid];
+    b->len = sizeof(e->rx[bid]);
+    b->bid = bid;
+    __atomic_store_n( &br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE );
+}
+
+static void pcio_socketcan_rx_frame( pcio_socketcan_uring_t *e, pcio_socketcan_uring_bus_t *ub,
+                                     const struct can_frame *f ) {
+    if( f->can_id & CAN_ERR_FLAG ) {
+        if( f->can_id & CAN_ERR_BUSOFF ) ub->result = NTCAN_CONTR_OFF_BUS;
+        return;
+    }
+    if( ub->tail - ub->head == PCIO_SOCKETCAN_URING_QUEUE ) {
+        e->overruns++;
+        return;
+    }
+    CMSG *m = &ub->q[ub->tail++ % PCIO_SOCKETCAN_URING_QUEUE];
+    memset( m, 0, sizeof(*m) );
+    m->id = (int32_t)(f->can_id & CAN_SFF_MASK);
+    m->len = AA_MIN( f->can_dlc, 8 );
+    memcpy( m->data, f->data, m->len );
+}
+
+static void pcio_socketcan_tx_done( pcio_socketcan_t *s, size_t slot, int32_t res ) {
+    pcio_socketcan_uring_t *e = s->uring;
+    pcio_socketcan_uring_tx_t *tx = &e->tx_slot[slot];
+    pcio_socketcan_uring_bus_t *ub = &e->bus[tx->handle];
+    int current = s->bus[tx->handle].fd >= 0 && ub->gen == tx->gen;
+    if( current && ( -ENOBUFS == res || -EAGAIN == res || -ECANCELED == res ) ) {
+        // the interface queue is full, or an earlier frame of the link found it so
+        uint64_t now = pcio_socketcan_now();
+        if( 0 == tx->full_ns ) tx->full_ns = now;
+        if( now - tx->full_ns < (uint64_t)s->timeout_ms * 1000000 &&
+            pcio_socketcan_tx_queue( s, slot ) ) {
+            e->retries++;
+            return;
+        }
+        ub->result = NTCAN_TX_TIMEOUT;
+    } else if( current && res < 0 ) {
+        ub->result = pcio_socketcan_result( -res, NTCAN_TX_ERROR );
+    }
+    e->tx_free[e->n_tx_free++] = (uint16_t)slot;
+}
+
+/// Sort the completions into the busses; called with the mutex held
+static void pcio_socketcan_reap( pcio_socketcan_t *s ) {
+    pcio_socketcan_uring_t *e = s->uring;
+    struct io_uring_cqe *cqe;
+    size_t n = 0;
+    while( NULL != (cqe = pcio_uring_cqe( &e->ring )) ) {
+        uint64_t ud = cqe->user_data;
+        int32_t res = cqe->res;
+        uint32_t flags = cqe->flags;
+        pcio_uring_cqe_seen( &e->ring );
+
+        int kind = (int)(ud >> 56);
+        uint32_t gen = (uint32_t)(ud >> 32) & 0xffffff;
+        int h = (int)(ud >> 16) & 0xffff;
+        pcio_socketcan_uring_bus_t *ub = &e->bus[h];
+        int current = s->bus[h].fd >= 0 && (ub->gen & 0xffffff) == gen;
+        n += PCIO_SOCKETCAN_RECV == kind || PCIO_SOCKETCAN_SEND == kind;
+        if( PCIO_SOCKETCAN_RECV == kind ) {
+            if( flags & IORING_CQE_F_BUFFER ) {
+                uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+                if( current && res > 0 ) pcio_socketcan_rx_frame( e, ub, &e->rx[bid] );
+                pcio_socketcan_rx_give( e, bid );
+            }
+            if( current && ! (flags & IORING_CQE_F_MORE) ) {
+                // running out of buffers only pauses the receive, the next flush arms it again
+                ub->armed = 0;
+                if( res < 0 && -ENOBUFS != res )
+                    ub->result = pcio_socketcan_result( -res, NTCAN_INVALID_DRIVER );
+            }
+        } else if( PCIO_SOCKETCAN_SEND == kind ) {
+            pcio_socketcan_tx_done( s, ud & 0xffff, res );
+        }
+    }
+    // what was sorted may be what another thread waits for; the one sleeping in the ring is
+    // woken by a completion of its own
+    if( n ) pthread_cond_broadcast( &e->reaped );
+    if( n && e->in_ring && ! e->woken ) {
+        struct io_uring_sqe *sqe = pcio_socketcan_sqe( e );
+        if( sqe ) {
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = pcio_socketcan_ud( PCIO_SOCKETCAN_WAKE, 0, 0, 0 );
+            e->last = NULL;
+            e->woken = 0 == pcio_uring_submit( &e->ring );
+        }
+    }
+}
+
+/// Wait for completions until deadline, in ns of CLOCK_MONOTONIC; called with the mutex held.
+/// One thread sleeps in the ring and the others on reaped, so that none sleeps on completions
+/// another thread has already taken: those are broadcast on reaped, and the thread in the ring
+/// gets a no-op completion.
+static int pcio_socketcan_block( pcio_socketcan_t *s, uint64_t deadline ) {
+    pcio_socketcan_uring_t *e = s->uring;
+    uint64_t now = pcio_socketcan_now();
+    if( now >= deadline ) return -ETIME;
+    if( e->in_ring ) {
+        struct timespec t = { (time_t)(deadline / 1000000000), (long)(deadline % 1000000000) };
+        int r = pthread_cond_timedwait( &e->reaped, &e->mutex, &t );
+        return ETIMEDOUT == r ? -ETIME : 0;
+    }
+    e->in_ring = 1;
+    e->woken = 0;
+    pthread_mutex_unlock( &e->mutex );
+    int w = pcio_uring_wait( &e->ring, (int)((deadline - now + 999999) / 1000000) );
+    pthread_mutex_lock( &e->mutex );
+    e->in_ring = 0;
+    pcio_socketcan_reap( s );
+    // one of the others takes over the ring
+    pthread_cond_broadcast( &e->reaped );
+    return w;
+}
+
+/// Arm the receives that stopped and submit everything queued; called with the mutex held
+static int pcio_socketcan_flush_locked( pcio_socketcan_t *s ) {
+    pcio_socketcan_uring_t *e = s->uring;
+    for( int h = 0; h < PCIO_SOCKETCAN_BUS_MAX; h++ )
+        if( s->bus[h].fd >= 0 && ! e->bus[h].armed ) pcio_socketcan_arm( s, h );
+    e->last = NULL;
+    if( 0 == pcio_uring_queued( &e->ring ) ) return NTCAN_SUCCESS;
+    int r = pcio_uring_submit( &e->ring );
+    return r ? pcio_socketcan_result( -r, NTCAN_TX_ERROR ) : NTCAN_SUCCESS;
+}
+
+static int pcio_socketcan_uring_open( void *cx, int net, int32_t queue_size, NTCAN_HANDLE *handle ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    int r = pcio_socketcan_open( cx, net, queue_size, handle );
+    if( NTCAN_SUCCESS != r ) return r;
+    // io_uring waits for room on a blocking socket itself, instead of failing with EAGAIN
+    int fd = s->bus[*handle].fd;
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_NONBLOCK );
+
+    pthread_mutex_lock( &s->uring->mutex );
+    r = pcio_socketcan_flush_locked( s );
+    pthread_mutex_unlock( &s->uring->mutex );
+    return r;
+}
+
+static int pcio_socketcan_uring_close( void *cx, NTCAN_HANDLE handle ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_uring_t *e = s->uring;
+    int r = pcio_socketcan_close( cx, handle );
+    if( NTCAN_SUCCESS != r ) return r;
+
+    // the receive holds the socket open until it is cancelled
+    pthread_mutex_lock( &e->mutex );
+    pcio_socketcan_uring_bus_t *ub = &e->bus[handle];
+    if( ub->armed ) {
+        struct io_uring_sqe *sqe = pcio_socketcan_sqe( e );
+        if( sqe ) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = pcio_socketcan_ud( PCIO_SOCKETCAN_RECV, ub->gen, handle, 0 );
+            sqe->user_data = pcio_socketcan_ud( PCIO_SOCKETCAN_CANCEL, ub->gen, handle, 0 );
+        }
+        e->last = NULL;
+    }
+    ub->gen++;
+    ub->armed = 0;
+    ub->head = ub->tail = 0;
+    ub->result = NTCAN_SUCCESS;
+    pcio_socketcan_flush_locked( s );
+    pthread_mutex_unlock( &e->mutex );
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_socketcan_uring_write( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_uring_t *e = s->uring;
+    if( NULL == pcio_socketcan_handle( s, handle ) ) return NTCAN_INVALID_HANDLE;
+    int32_t n = *len;
+    *len = 0;
+
+    int r = NTCAN_SUCCESS;
+    uint64_t deadline = 0;
+    pthread_mutex_lock( &e->mutex );
+    while( *len < n ) {
+        if( 0 == e->n_tx_free ) {
+            // every buffer is in flight, hand them over and take back the finished ones
+            r = pcio_socketcan_flush_locked( s );
+            if( NTCAN_SUCCESS != r ) break;
+            pcio_socketcan_reap( s );
+            if( 0 == e->n_tx_free ) {
+                if( 0 == deadline )
+                    deadline = pcio_socketcan_now() + (uint64_t)s->timeout_ms * 1000000;
+                if( -ETIME == pcio_socketcan_block( s, deadline ) && 0 == e->n_tx_free ) {
+                    r = NTCAN_TX_TIMEOUT;
+                    break;
+                }
+                continue;
+            }
+        }
+        size_t slot = e->tx_free[--e->n_tx_free];
+        struct can_frame *f = &e->tx[slot];
+        memset( f, 0, sizeof(*f) );
+        f->can_id = (canid_t)msg[*len].id & CAN_SFF_MASK;
+        f->can_dlc = AA_MIN( msg[*len].len & 0x0f, 8 );
+        memcpy( f->data, msg[*len].data, f->can_dlc );
+        e->tx_slot[slot].handle = handle;
+        e->tx_slot[slot].gen = e->bus[handle].gen;
+        e->tx_slot[slot].full_ns = 0;
+        if( ! pcio_socketcan_tx_queue( s, slot ) ) {
+            e->tx_free[e->n_tx_free++] = (uint16_t)slot;
+            r = NTCAN_TX_ERROR;
+            break;
+        }
+        (*len)++;
+    }
+    pthread_mutex_unlock( &e->mutex );
+    return r;
+}
+
+/// Take the received frames of a bus; unless take is set, wait up to the timeout for one
+static int pcio_socketcan_uring_get( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len,
+                                     int take ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_uring_t *e = s->uring;
+    if( NULL == pcio_socketcan_handle( s, handle ) ) return NTCAN_INVALID_HANDLE;
+    pcio_socketcan_uring_bus_t *ub = &e->bus[handle];
+    int32_t n = *len;
+    *len = 0;
+
+    // the queue of the bus is looked at under the mutex before each wait, as another thread may
+    // have sorted its frames in
+    uint64_t deadline = 0;
+    int r;
+    pthread_mutex_lock( &e->mutex );
+    for( ;; ) {
+        pcio_socketcan_reap( s );
+        r = pcio_socketcan_flush_locked( s );
+        if( NTCAN_SUCCESS == r && NTCAN_SUCCESS != ub->result ) {
+            r = ub->result;
+            ub->result = NTCAN_SUCCESS;
+        }
+        while( NTCAN_SUCCESS == r && *len < n && ub->head != ub->tail )
+            msg[(*len)++] = ub->q[ub->head++ % PCIO_SOCKETCAN_URING_QUEUE];
+        if( NTCAN_SUCCESS != r || *len > 0 || take || n <= 0 ) break;
+
+        uint64_t now = pcio_socketcan_now();
+        if( 0 == deadline ) deadline = now + (uint64_t)s->timeout_ms * 1000000;
+        else if( now >= deadline ) {
+            r = NTCAN_RX_TIMEOUT;
+            break;
+        }
+        int w = pcio_socketcan_block( s, deadline );
+        if( w && -ETIME != w && -EINTR != w ) {
+            r = pcio_socketcan_result( -w, NTCAN_INVALID_DRIVER );
+            break;
+        }
+    }
+    pthread_mutex_unlock( &e->mutex );
+    return r;
+}
+
+static int pcio_socketcan_uring_read( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_socketcan_uring_get( cx, handle, msg, len, 0 );
+}
+
+static int pcio_socketcan_uring_take( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_socketcan_uring_get( cx, handle, msg, len, 1 );
+}
+
+/// Wait until a frame or a failure waits on any open bus
+static int pcio_socketcan_uring_wait( void *cx, int timeout_ms ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pcio_socketcan_uring_t *e = s->uring;
+    uint64_t deadline = pcio_socketcan_now() + (uint64_t)timeout_ms * 1000000;
+    pthread_mutex_lock( &e->mutex );
+    for( ;; ) {
+        int ready = 0;
+        pcio_socketcan_reap( s );
+        int r = pcio_socketcan_flush_locked( s );
+        for( int h = 0; h < PCIO_SOCKETCAN_BUS_MAX; h++ )
+            if( s->bus[h].fd >= 0 && ( e->bus[h].head != e->bus[h].tail ||
+                                       NTCAN_SUCCESS != e->bus[h].result ) ) ready = 1;
+        if( ready ) r = NTCAN_SUCCESS;
+        else if( NTCAN_SUCCESS == r && pcio_socketcan_now() >= deadline ) r = NTCAN_RX_TIMEOUT;
+        else if( NTCAN_SUCCESS == r ) {
+            int w = pcio_socketcan_block( s, deadline );
+            if( ! w || -ETIME == w || -EINTR == w ) continue;
+            r = pcio_socketcan_result( -w, NTCAN_INVALID_DRIVER );
+        }
+        pthread_mutex_unlock( &e->mutex );
+        return r;
+    }
+}
+
+/// Submit the writes of all busses at once
+static int pcio_socketcan_uring_flush( void *cx ) {
+    pcio_socketcan_t *s = (pcio_socketcan_t*)cx;
+    pthread_mutex_lock( &s->uring->mutex );
+    int r = pcio_socketcan_flush_locked( s );
+    pthread_mutex_unlock( &s->uring->mutex );
+    return r;
+}
+
+const pcio_transport_t pcio_transport_socketcan_uring = {
+    .name = "socketcan-uring",
+    .open = pcio_socketcan_uring_open,
+    .close = pcio_socketcan_uring_close,
+    .id_add = pcio_socketcan_id_add,
+    .write = pcio_socketcan_uring_write,
+    .read = pcio_socketcan_uring_read,
+    .take = pcio_socketcan_uring_take,
+    .wait = pcio_socketcan_uring_wait,
+    .flush = pcio_socketcan_uring_flush,
+};
+
+/*---------*/
+/* Context */
+/*---------*/
+
+int pcio_socketcan_init( pcio_socketcan_t *s, const char *ifname ) {
+    memset( s, 0, sizeof(*s) );
+    s->ifname = ifname ? ifname : "can%d";
+    s->timeout_ms = 100; // same as pcio.c gives canOpen
+    for( size_t i = 0; i < PCIO_SOCKETCAN_BUS_MAX; i++ ) s->bus[i].fd = -1;
+    s->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if( s->epoll_fd < 0 ) return -1;
+    pthread_mutex_init( &s->mutex, NULL );
+    return 0;
+}
+
+int pcio_socketcan_init_uring( pcio_socketcan_t *s, const char *ifname ) {
+    if( pcio_socketcan_init( s, ifname ) ) return -1;
+    pcio_socketcan_uring_t *e = AA_NEW0( pcio_socketcan_uring_t );
+    if( NULL == e ) goto fail;
+    e->rx_ring = (struct io_uring_buf_ring*)
+        mmap( NULL, PCIO_SOCKETCAN_URING_RX * sizeof(struct io_uring_buf),
+              PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( MAP_FAILED == (void*)e->rx_ring ) {
+        e->rx_ring = NULL;
+        goto fail_e;
+    }
+    if( pcio_uring_init( &e->ring, 2 * PCIO_SOCKETCAN_URING_TX ) ) goto fail_ring;
+
+    struct iovec iov = { e->tx, sizeof(e->tx) };
+    int r = pcio_uring_register_buffers( &e->ring, &iov, 1 );
+    if( 0 == r ) r = pcio_uring_register_buf_ring( &e->ring, e->rx_ring, PCIO_SOCKETCAN_URING_RX,
+                                                   PCIO_SOCKETCAN_BGID );
+    if( r ) {
+        pcio_uring_destroy( &e->ring );
+        errno = -r;
+        goto fail_ring;
+    }
+    for( size_t i = 0; i < PCIO_SOCKETCAN_URING_RX; i++ ) pcio_socketcan_rx_give( e, (uint16_t)i );
+    for( size_t i = 0; i < PCIO_SOCKETCAN_URING_TX; i++ )
+        e->tx_free[e->n_tx_free++] = (uint16_t)(PCIO_SOCKETCAN_URING_TX - 1 - i);
+    pthread_mutex_init( &e->mutex, NULL );
+    pthread_condattr_t ca;
+    pthread_condattr_init( &ca );
+    pthread_condattr_setclock( &ca, CLOCK_MONOTONIC );
+    pthread_cond_init( &e->reaped, &ca );
+    pthread_condattr_destroy( &ca );
+    s->uring = e;
+    return 0;
+
+fail_ring:
+    munmap( e->rx_ring, PCIO_SOCKETCAN_URING_RX * sizeof(struct io_uring_buf) );
+fail_e:
+    free( e );
+fail:
+    {
+        int err = errno;
+        pcio_socketcan_destroy( s );
+        errno = err;
+    }
+    return -1;
+}
+
+void pcio_socketcan_destroy( pcio_socketcan_t *s ) {
+    if( s->uring ) {
+        // closing the ring cancels the receives
+        pcio_uring_destroy( &s->uring->ring );
+        munmap( s->uring->rx_ring, PCIO_SOCKETCAN_URING_RX * sizeof(struct io_uring_buf) );
+        pthread_mutex_destroy( &s->uring->mutex );
+        pthread_cond_destroy( &s->uring->reaped );
+        free( s->uring );
+        s->uring = NULL;
+    }
+    for( size_t i = 0; i < PCIO_SOCKETCAN_BUS_MAX; i++ ) {
+        if( s->bus[i].fd < 0 ) continue;
+        close( s->bus[i].fd );
+        s->bus[i].fd = -1;
+    }
+    if( s->epoll_fd >= 0 ) close( s->epoll_fd );
+    s->epoll_fd = -1;
+    pthread_mutex_destroy( &s->mutex );
+}
@@ -0,0 +1,393 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/**
+ * \file pcio_trace.c
+ * \brief CAN frame capture and replay
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcio_trace.h"
+
+/// Records start on their own cache line
+#define PCIO_TRACE_RECORD_OFFSET 64
+
+/// How far ahead a replay looks for a written frame before calling it a mismatch
+#define PCIO_REPLAY_SEARCH 4096
+
+static uint64_t pcio_trace_ns( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/// Slot holding the i-th record ever written
+static uint64_t pcio_trace_slot( const pcio_trace_header_t *h, uint64_t i ) {
+    return ( i < h->pinned ) ? i : h->pinned + (i - h->pinned) % (h->capacity - h->pinned);
+}
+
+/*---------*/
+/* Capture */
+/*---------*/
+
+int pcio_trace_create( pcio_trace_t *t, const char *path, size_t capacity, size_t pinned ) {
+    memset( t, 0, sizeof(*t) );
+    t->fd = -1;
+    if( 0 == capacity || pinned >= capacity ) {
+        errno = EINVAL;
+        return -1;
+    }
+    t->fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( t->fd < 0 ) return -1;
+    t->writer = 1;
+    t->map_size = PCIO_TRACE_RECORD_OFFSET + capacity * sizeof(pcio_trace_record_t);
+
+    // allocate the blocks and fault the pages in now, so recording never does
+    int e = posix_fallocate( t->fd, 0, (off_t)t->map_size );
+    void *p = MAP_FAILED;
+    if( 0 == e ) {
+        p = mmap( NULL, t->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, t->fd, 0 );
+        if( MAP_FAILED == p ) e = errno;
+    }
+    if( MAP_FAILED == p ) {
+        close( t->fd );
+        unlink( path );
+        t->fd = -1;
+        errno = e;
+        return -1;
+    }
+
+    t->hdr = (pcio_trace_header_t*)p;
+    t->rec = (pcio_trace_record_t*)((uint8_t*)p + PCIO_TRACE_RECORD_OFFSET);
+    t->hdr->version = PCIO_TRACE_VERSION;
+    t->hdr->capacity = capacity;
+    t->hdr->pinned = pinned;
+    t->hdr->record_offset = PCIO_TRACE_RECORD_OFFSET;
+    t->hdr->head = 0;
+    t->hdr->t0_ns = pcio_trace_ns( CLOCK_MONOTONIC );
+    t->hdr->t0_realtime_ns = (int64_t)pcio_trace_ns( CLOCK_REALTIME );
+    __atomic_store_n( &t->hdr->magic, PCIO_TRACE_MAGIC, __ATOMIC_RELEASE );
+    return 0;
+}
+
+int pcio_trace_open( pcio_trace_t *t, const char *path ) {
+    memset( t, 0, sizeof(*t) );
+    t->fd = open( path, O_RDONLY );
+    if( t->fd < 0 ) return -1;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if( 0 == fstat( t->fd, &st ) && (size_t)st.st_size >= sizeof(pcio_trace_header_t) ) {
+        t->map_size = (size_t)st.st_size;
+        p = mmap( NULL, t->map_size, PROT_READ, MAP_SHARED, t->fd, 0 );
+    } else {
+        errno = EINVAL;
+    }
+    if( MAP_FAILED == p ) {
+        int e = errno;
+        close( t->fd );
+        t->fd = -1;
+        errno = e;
+        return -1;
+    }
+
+    const pcio_trace_header_t *h = (const pcio_trace_header_t*)p;
+    if( PCIO_TRACE_MAGIC != h->magic || PCIO_TRACE_VERSION != h->version ||
+        h->pinned >= h->capacity ||
+        h->record_offset + h->capacity * sizeof(pcio_trace_record_t) > t->map_size ) {
+        munmap( p, t->map_size );
+        close( t->fd );
+        t->fd = -1;
+        errno = EINVAL;
+        return -1;
+    }
+    t->hdr = (pcio_trace_header_t*)p;
+    t->rec = (pcio_trace_record_t*)((uint8_t*)p + h->record_offset);
+    return 0;
+}
+
+void pcio_trace_close( pcio_trace_t *t ) {
+    if( t->hdr ) munmap( t->hdr, t->map_size );
+    if( t->fd >= 0 ) close( t->fd );
+    t->hdr = NULL;
+    t->rec = NULL;
+    t->fd = -1;
+}
+
+static void pcio_trace_put( pcio_trace_t *t, uint64_t t_ns, int net, int flags,
+                            uint32_t txid, int result, const CMSG *msg ) {
+    pcio_trace_header_t *h = t->hdr;
+    uint64_t i = __atomic_fetch_add( &h->head, 1, __ATOMIC_RELAXED );
+    pcio_trace_record_t *rec = &t->rec[pcio_trace_slot( h, i )];
+
+    // readers skip the record until seq is set again
+    __atomic_store_n( &rec->seq, 0, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    rec->t_ns = t_ns;
+    rec->txid = txid;
+    rec->result = result;
+    rec->net = (int16_t)net;
+    rec->flags = (uint8_t)flags;
+    if( msg ) {
+        rec->id = msg->id;
+        rec->len = (uint8_t)(msg->len & 0xf);
+        memcpy( rec->data, msg->data, sizeof(rec->data) );
+    } else {
+        rec->id = 0;
+        rec->len = 0;
+        memset( rec->data, 0, sizeof(rec->data) );
+    }
+    __atomic_store_n( &rec->seq, i + 1, __ATOMIC_RELEASE );
+}
+
+void pcio_trace_frames( pcio_trace_t *t, int net, int dir, uint32_t txid, int result,
+                        const CMSG *msg, int32_t n ) {
+    uint64_t now = pcio_trace_ns( CLOCK_MONOTONIC );
+    for( int32_t f = 0; f < n; f++ )
+        pcio_trace_put( t, now, net, dir, txid, result, &msg[f] );
+    if( NTCAN_SUCCESS != result )
+        pcio_trace_put( t, now, net, dir | PCIO_TRACE_ERR, txid, result, NULL );
+}
+
+uint64_t pcio_trace_count( const pcio_trace_t *t ) {
+    uint64_t head = __atomic_load_n( &t->hdr->head, __ATOMIC_ACQUIRE );
+    return head < t->hdr->capacity ? head : t->hdr->capacity;
+}
+
+const pcio_trace_record_t *pcio_trace_get( const pcio_trace_t *t, uint64_t k ) {
+    const pcio_trace_header_t *h = t->hdr;
+    uint64_t head = __atomic_load_n( &h->head, __ATOMIC_ACQUIRE );
+    if( k >= head || k >= h->capacity ) return NULL;
+    uint64_t i = ( head <= h->capacity || k < h->pinned ) ?
+        k : head - (h->capacity - h->pinned) + (k - h->pinned);
+    const pcio_trace_record_t *rec = &t->rec[pcio_trace_slot( h, i )];
+    return ( __atomic_load_n( &rec->seq, __ATOMIC_ACQUIRE ) == i + 1 ) ? rec : NULL;
+}
+
+/*--------*/
+/* Replay */
+/*--------*/
+
+int pcio_replay_open( pcio_replay_t *r, const char *path, int timed ) {
+    memset( r, 0, sizeof(*r) );
+    if( pcio_trace_open( &r->trace, path ) ) return -1;
+    r->timed = timed;
+
+    // every net in the capture becomes a handle
+    uint64_t cnt = pcio_trace_count( &r->trace );
+    for( uint64_t k = 0; k < cnt; k++ ) {
+        const pcio_trace_record_t *rec = pcio_trace_get( &r->trace, k );
+        if( NULL == rec ) continue;
+        size_t h;
+        for( h = 0; h < r->net_cnt && r->net[h].net != rec->net; h++ );
+        if( h == r->net_cnt ) {
+            if( PCIO_REPLAY_NET_MAX == r->net_cnt ) {
+                pcio_trace_close( &r->trace );
+                errno = ERANGE;
+                return -1;
+            }
+            r->net[h].net = rec->net;
+            r->net_cnt++;
+        }
+        r->net[h].last = k + 1;
+    }
+    return 0;
+}
+
+void pcio_replay_close( pcio_replay_t *r ) {
+    pcio_trace_close( &r->trace );
+}
+
+int pcio_replay_done( const pcio_replay_t *r ) {
+    for( size_t h = 0; h < r->net_cnt; h++ )
+        if( r->net[h].cursor < r->net[h].last ) return 0;
+    return 1;
+}
+
+/// The next record of net n at or after *k, or NULL at the end of the capture
+static const pcio_trace_record_t *pcio_replay_next( pcio_replay_t *r, pcio_replay_net_t *n,
+                                                    uint64_t *k ) {
+    for( ; *k < n->last; (*k)++ ) {
+        const pcio_trace_record_t *rec = pcio_trace_get( &r->trace, *k );
+        if( rec && rec->net == n->net ) return rec;
+    }
+    return NULL;
+}
+
+/// Writes are matched by CAN id, command and parameter, the payload may differ
+static int pcio_replay_match( const pcio_trace_record_t *rec, const CMSG *msg ) {
+    uint8_t len = (uint8_t)(msg->len & 0xf);
+    return ( rec->id == msg->id && rec->len == len &&
+             ( len < 1 || rec->data[0] == msg->data[0] ) &&
+             ( len < 2 || rec->data[1] == msg->data[1] ) );
+}
+
+static int pcio_replay_open_net( void *cx, int net, int32_t queue_size, NTCAN_HANDLE *handle ) {
+    pcio_replay_t *r = (pcio_replay_t*)cx;
+    (void)queue_size;
+    for( size_t h = 0; h < r->net_cnt; h++ ) {
+        if( r->net[h].net == net ) {
+            *handle = (NTCAN_HANDLE)h;
+            return NTCAN_SUCCESS;
+        }
+    }
+    return NTCAN_NET_NOT_FOUND;
+}
+
+static int pcio_replay_close_net( void *cx, NTCAN_HANDLE handle ) {
+    (void)cx; (void)handle;
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_replay_id_add( void *cx, NTCAN_HANDLE handle, int32_t id ) {
+    (void)cx; (void)handle; (void)id;
+    return NTCAN_SUCCESS;
+}
+
+static int pcio_replay_write( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    pcio_replay_t *r = (pcio_replay_t*)cx;
+    if( handle < 0 || (size_t)handle >= r->net_cnt ) return NTCAN_INVALID_HANDLE;
+    pcio_replay_net_t *n = &r->net[handle];
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    for( int32_t f = 0; f < *len; f++ ) {
+        uint64_t k = n->cursor;
+        uint64_t skip = 0;
+        const pcio_trace_record_t *rec;
+        for( ; (rec = pcio_replay_next( r, n, &k )) && skip < PCIO_REPLAY_SEARCH; k++, skip++ ) {
+            // a write that failed at this point in the capture fails again
+            if( 0 == skip && (PCIO_TRACE_TX | PCIO_TRACE_ERR) == rec->flags ) {
+                n->cursor = k + 1;
+                *len = f;
+                return rec->result;
+            }
+            if( PCIO_TRACE_TX == rec->flags && pcio_replay_match( rec, &msg[f] ) ) break;
+        }
+        if( rec && skip < PCIO_REPLAY_SEARCH ) {
+            r->skipped += skip;
+            n->cursor = k + 1;
+            n->tx_ns = rec->t_ns;
+            n->tx_now = now;
+        } else {
+            r->mismatch++;
+        }
+    }
+    return NTCAN_SUCCESS;
+}
+
+/// Sleep until the replay time of captured record rec; 0 if it is not due yet and wait is not set
+static int pcio_replay_due( pcio_replay_t *r, pcio_replay_net_t *n,
+                            const pcio_trace_record_t *rec, int wait ) {
+    if( ! r->timed || 0 == n->tx_ns || rec->t_ns <= n->tx_ns ) return 1;
+    uint64_t ns = (uint64_t)n->tx_now.tv_nsec + (rec->t_ns - n->tx_ns);
+    struct timespec due;
+    due.tv_sec = n->tx_now.tv_sec + (time_t)(ns / 1000000000);
+    due.tv_nsec = (long)(ns % 1000000000);
+    if( wait ) {
+        while( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL ) );
+        return 1;
+    }
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec > due.tv_sec ||
+             ( now.tv_sec == due.tv_sec && now.tv_nsec >= due.tv_nsec ) );
+}
+
+/// Hand out the received frames of the capture up to the next write; take does not wait
+static int pcio_replay_get( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len, int take ) {
+    pcio_replay_t *r = (pcio_replay_t*)cx;
+    if( handle < 0 || (size_t)handle >= r->net_cnt ) return NTCAN_INVALID_HANDLE;
+    pcio_replay_net_t *n = &r->net[handle];
+
+    int32_t got = 0;
+    while( got < *len ) {
+        uint64_t k = n->cursor;
+        const pcio_trace_record_t *rec = pcio_replay_next( r, n, &k );
+        // stop at the end, or where the capture shows the host writing next
+        if( NULL == rec || ( rec->flags & PCIO_TRACE_TX ) ) break;
+        if( ! pcio_replay_due( r, n, rec, 0 == got && ! take ) ) break;
+        if( rec->flags & PCIO_TRACE_ERR ) {
+            // a failed read, e.g. a timeout, is reported on its own
+            if( 0 == got && ! take ) {
+                n->cursor = k + 1;
+                *len = 0;
+                return rec->result;
+            }
+            break;
+        }
+        memset( &msg[got], 0, sizeof(msg[got]) );
+        msg[got].id = rec->id;
+        msg[got].len = rec->len;
+        memcpy( msg[got].data, rec->data, sizeof(rec->data) );
+        got++;
+        n->cursor = k + 1;
+    }
+    *len = got;
+    return ( got > 0 || take ) ? NTCAN_SUCCESS : NTCAN_RX_TIMEOUT;
+}
+
+static int pcio_replay_read( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_replay_get( cx, handle, msg, len, 0 );
+}
+
+static int pcio_replay_take( void *cx, NTCAN_HANDLE handle, CMSG *msg, int32_t *len ) {
+    return pcio_replay_get( cx, handle, msg, len, 1 );
+}
+
+const pcio_transport_t pcio_transport_replay = {
+    .name = "replay",
+    .open = pcio_replay_open_net,
+    .close = pcio_replay_close_net,
+    .id_add = pcio_replay_id_add,
+    .write = pcio_replay_write,
+    .read = pcio_replay_read,
+    .take = pcio_replay_take,
+};
@@ -0,0 +1,449 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/** \file pcio_trace_util.c
+ *
+ *  Shell tool that reads a capture written by pcio-sns --capture and
+ *  reports, per bus and per module, how long replies take, which
+ *  replies are missing or late, and how busy the bus is.
+ *
+ *  Requests are paired with replies by module id, command and
+ *  parameter. A reply is first matched to a request of its own
+ *  transaction; one that answers a request of an earlier transaction
+ *  is counted as an overlap, since it arrived while the host had
+ *  already moved on.
+ */
+
+#include <argp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <amino.h>
+#include "pcio.h"
+#include "pcio_trace.h"
+
+/// Outstanding requests remembered per module
+#define PENDING_MAX 16
+
+/// Nominal bits of a standard CAN frame without stuffing, excluding data
+#define CAN_FRAME_BITS 47
+
+/// Bus bit rate
+#define CAN_BITRATE 1e6
+
+/* ---------- */
+/* ARGP Junk  */
+/* ---------- */
+
+static double opt_late_ms = 5.0;
+static double opt_window_ms = 10.0;
+static int opt_series = 0;
+static const char *opt_file = NULL;
+
+static struct argp_option options[] = {
+    {
+        .name = "late",
+        .key = 'l',
+        .arg = "ms",
+        .flags = 0,
+        .doc = "Replies slower than this are late (default 5)"
+    },
+    {
+        .name = "window",
+        .key = 'w',
+        .arg = "ms",
+        .flags = 0,
+        .doc = "Window for bus occupancy (default 10)"
+    },
+    {
+        .name = "series",
+        .key = 's',
+        .arg = NULL,
+        .flags = 0,
+        .doc = "Also print the occupancy of every window"
+    },
+    {
+        .name = NULL,
+        .key = 0,
+        .arg = NULL,
+        .flags = 0,
+        .doc = NULL
+    }
+};
+
+static int parse_opt( int key, char *arg, struct argp_state *state ) {
+    switch(key) {
+    case 'l':
+        opt_late_ms = atof(arg);
+        break;
+    case 'w':
+        opt_window_ms = atof(arg);
+        if( opt_window_ms <= 0 ) argp_error( state, "window must be positive" );
+        break;
+    case 's':
+        opt_series = 1;
+        break;
+    case ARGP_KEY_ARG:
+        if( opt_file ) argp_error( state, "only one capture at a time" );
+        opt_file = arg;
+        break;
+    case ARGP_KEY_END:
+        if( NULL == opt_file ) argp_usage( state );
+        break;
+    }
+    return 0;
+}
+
+const char *argp_program_version = "pcio_trace_util v0.0.1";
+static char args_doc[] = "CAPTURE";
+static char doc[] = "Reports per-module reply latency and bus timing from a pcio capture\n";
+static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+/* ---------- */
+/* STATISTICS */
+/* ---------- */
+
+/// Growable array of nanosecond samples
+typedef struct {
+    uint64_t *x;
+    size_t n;
+    size_t cap;
+} samples_t;
+
+static void samples_add( samples_t *s, uint64_t v ) {
+    if( s->n == s->cap ) {
+        s->cap = s->cap ? 2*s->cap : 64;
+        s->x = (uint64_t*)realloc( s->x, s->cap * sizeof(s->x[0]) );
+        if( NULL == s->x ) { perror("realloc"); exit(EXIT_FAILURE); }
+    }
+    s->x[s->n++] = v;
+}
+
+static int cmp_u64( const void *a, const void *b ) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/// Sort, then read percentiles with samples_pct
+static void samples_sort( samples_t *s ) {
+    qsort( s->x, s->n, sizeof(s->x[0]), cmp_u64 );
+}
+
+static uint64_t samples_pct( const samples_t *s, double p ) {
+    if( 0 == s->n ) return 0;
+    size_t i = (size_t)(p / 100.0 * (double)(s->n - 1) + 0.5);
+    return s->x[i];
+}
+
+static double samples_mean( const samples_t *s ) {
+    double sum = 0;
+    for( size_t i = 0; i < s->n; i++ ) sum += (double)s->x[i];
+    return s->n ? sum / (double)s->n : 0;
+}
+
+/// A request awaiting its reply
+typedef struct {
+    uint64_t t_ns;
+    uint32_t txid;
+    uint8_t cmd;
+    int16_t parm; //< -1 for commands without parameter
+} request_t;
+
+typedef struct {
+    int used;
+    uint64_t requests;
+    uint64_t replies;
+    uint64_t missing;   //< never answered
+    uint64_t late;      //< answered after opt_late_ms
+    uint64_t overlap;   //< answered during a later transaction
+    uint64_t stray;     //< replies matching no request
+    samples_t latency;
+    request_t pending[PENDING_MAX];
+    size_t n_pending;
+} module_stat_t;
+
+typedef struct {
+    int net;
+    uint64_t tx;
+    uint64_t rx;
+    uint64_t broadcast;
+    uint64_t tx_errors;
+    uint64_t rx_errors;   //< mostly read timeouts
+    uint64_t last_t;      //< time of the previous frame, 0 before the first
+    samples_t gap;
+    uint32_t txid;        //< transaction in progress
+    uint64_t txn_start;
+    uint64_t txn_end;
+    samples_t txn;        //< transaction durations
+    double *busy;         //< seconds on the wire per window
+    size_t n_win;
+    module_stat_t mod[32];
+} bus_stat_t;
+
+static bus_stat_t busses[PCIO_REPLAY_NET_MAX];
+static size_t n_busses = 0;
+static uint64_t t_first = 0;
+
+static bus_stat_t *bus_lookup( int net ) {
+    for( size_t i = 0; i < n_busses; i++ )
+        if( busses[i].net == net ) return &busses[i];
+    if( PCIO_REPLAY_NET_MAX == n_busses ) {
+        fprintf(stderr, "Too many busses in capture\n");
+        exit(EXIT_FAILURE);
+    }
+    bus_stat_t *b = &busses[n_busses++];
+    b->net = net;
+    return b;
+}
+
+static void bus_busy( bus_stat_t *b, uint64_t t_ns, int len ) {
+    size_t w = (size_t)((double)(t_ns - t_first) / (opt_window_ms * 1e6));
+    if( w >= b->n_win ) {
+        size_t n = AA_MAX( w + 1, 2 * b->n_win );
+        b->busy = (double*)realloc( b->busy, n * sizeof(b->busy[0]) );
+        if( NULL == b->busy ) { perror("realloc"); exit(EXIT_FAILURE); }
+        memset( &b->busy[b->n_win], 0, (n - b->n_win) * sizeof(b->busy[0]) );
+        b->n_win = n;
+    }
+    b->busy[w] += (CAN_FRAME_BITS + 8 * len) / CAN_BITRATE;
+}
+
+/// Close the transaction in progress on b
+static void bus_end_txn( bus_stat_t *b ) {
+    if( b->txid ) samples_add( &b->txn, b->txn_end - b->txn_start );
+    b->txid = 0;
+}
+
+static void module_drop( module_stat_t *m, size_t p ) {
+    memmove( &m->pending[p], &m->pending[p+1], (m->n_pending - p - 1) * sizeof(m->pending[0]) );
+    m->n_pending--;
+}
+
+static void on_request( bus_stat_t *b, const pcio_trace_record_t *rec ) {
+    if( PCIO_CANID_CMDALL == rec->id ) {
+        b->broadcast++;
+        return;
+    }
+    module_stat_t *m = &b->mod[PCIO_CANID_MODID( rec->id )];
+    m->used = 1;
+    m->requests++;
+    if( PENDING_MAX == m->n_pending ) {
+        m->missing++;
+        module_drop( m, 0 );
+    }
+    request_t *q = &m->pending[m->n_pending++];
+    q->t_ns = rec->t_ns;
+    q->txid = rec->txid;
+    q->cmd = rec->len > 0 ? rec->data[0] : 0;
+    q->parm = rec->len > 1 ? rec->data[1] : -1;
+}
+
+static void on_reply( bus_stat_t *b, const pcio_trace_record_t *rec ) {
+    module_stat_t *m = &b->mod[PCIO_CANID_MODID( rec->id )];
+    m->used = 1;
+    uint8_t cmd = rec->len > 0 ? rec->data[0] : 0;
+    int parm = rec->len > 1 ? rec->data[1] : -1;
+
+    // prefer a request of the same transaction, then the oldest earlier one
+    size_t hit = m->n_pending;
+    for( int pass = 0; pass < 2 && hit == m->n_pending; pass++ ) {
+        for( size_t p = 0; p < m->n_pending; p++ ) {
+            const request_t *q = &m->pending[p];
+            if( (0 == pass) != (q->txid == rec->txid) ) continue;
+            if( q->cmd != cmd ) continue;
+            if( parm >= 0 && q->parm >= 0 && q->parm != parm ) continue;
+            hit = p;
+            break;
+        }
+    }
+    if( hit == m->n_pending ) {
+        m->stray++;
+        return;
+    }
+
+    const request_t *q = &m->pending[hit];
+    uint64_t lat = rec->t_ns - q->t_ns;
+    m->replies++;
+    samples_add( &m->latency, lat );
+    if( (double)lat > opt_late_ms * 1e6 ) m->late++;
+    if( q->txid != rec->txid ) m->overlap++;
+    module_drop( m, hit );
+}
+
+static void on_record( const pcio_trace_record_t *rec ) {
+    bus_stat_t *b = bus_lookup( rec->net );
+
+    if( rec->txid != b->txid ) {
+        bus_end_txn( b );
+        b->txid = rec->txid;
+        b->txn_start = rec->t_ns;
+    }
+    b->txn_end = rec->t_ns;
+
+    if( rec->flags & PCIO_TRACE_ERR ) {
+        if( rec->flags & PCIO_TRACE_TX ) b->tx_errors++;
+        else b->rx_errors++;
+        return;
+    }
+
+    if( b->last_t ) samples_add( &b->gap, rec->t_ns - b->last_t );
+    b->last_t = rec->t_ns;
+    bus_busy( b, rec->t_ns, rec->len );
+
+    if( rec->flags & PCIO_TRACE_TX ) {
+        b->tx++;
+        on_request( b, rec );
+    } else {
+        b->rx++;
+        on_reply( b, rec );
+    }
+}
+
+/// Forget what was outstanding across the gap between the pinned records and the ring
+static void on_gap( void ) {
+    for( size_t i = 0; i < n_busses; i++ ) {
+        bus_stat_t *b = &busses[i];
+        bus_end_txn( b );
+        b->last_t = 0;
+        for( size_t j = 0; j < 32; j++ ) b->mod[j].n_pending = 0;
+    }
+}
+
+/* ------ */
+/* REPORT */
+/* ------ */
+
+static void print_dist( const char *what, samples_t *s, double scale ) {
+    samples_sort( s );
+    printf("  %-16s n %-8lu mean %9.1f  p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f\n",
+           what, (unsigned long)s->n, samples_mean(s) / scale,
+           (double)samples_pct(s, 50) / scale, (double)samples_pct(s, 90) / scale,
+           (double)samples_pct(s, 99) / scale, (double)samples_pct(s, 100) / scale );
+}
+
+static void report_bus( bus_stat_t *b ) {
+    bus_end_txn( b );
+    printf("\nbus %d: %lu sent, %lu received, %lu broadcast, %lu write errors, %lu read errors\n",
+           b->net, (unsigned long)b->tx, (unsigned long)b->rx, (unsigned long)b->broadcast,
+           (unsigned long)b->tx_errors, (unsigned long)b->rx_errors );
+    print_dist( "transaction us", &b->txn, 1e3 );
+    print_dist( "frame gap us", &b->gap, 1e3 );
+
+    // occupancy, over the windows that saw any traffic
+    samples_t occ = {NULL, 0, 0};
+    for( size_t w = 0; w < b->n_win; w++ ) {
+        if( b->busy[w] > 0 )
+            samples_add( &occ, (uint64_t)(b->busy[w] / (opt_window_ms * 1e-3) * 1e4) );
+    }
+    print_dist( "occupancy %", &occ, 1e2 );
+    free( occ.x );
+
+    printf("  %6s %8s %8s %7s %6s %7s %6s   %s\n",
+           "module", "requests", "replies", "missing", "late", "overlap", "stray",
+           "latency us: p50 p90 p99 max");
+    for( size_t j = 0; j < 32; j++ ) {
+        module_stat_t *m = &b->mod[j];
+        if( ! m->used ) continue;
+        m->missing += m->n_pending;
+        samples_sort( &m->latency );
+        printf("  %6lu %8lu %8lu %7lu %6lu %7lu %6lu   %.1f %.1f %.1f %.1f\n",
+               (unsigned long)j, (unsigned long)m->requests, (unsigned long)m->replies,
+               (unsigned long)m->missing, (unsigned long)m->late, (unsigned long)m->overlap,
+               (unsigned long)m->stray,
+               (double)samples_pct(&m->latency, 50) / 1e3, (double)samples_pct(&m->latency, 90) / 1e3,
+               (double)samples_pct(&m->latency, 99) / 1e3, (double)samples_pct(&m->latency, 100) / 1e3 );
+    }
+
+    if( opt_series ) {
+        printf("  occupancy series (ms %%):\n");
+        for( size_t w = 0; w < b->n_win; w++ ) {
+            if( b->busy[w] > 0 )
+                printf("  %10.1f %6.2f\n", (double)w * opt_window_ms,
+                       100.0 * b->busy[w] / (opt_window_ms * 1e-3) );
+        }
+    }
+}
+
+/* ---- */
+/* MAIN */
+/* ---- */
+int main(int argc, char **argv) {
+    argp_parse( &argp, argc, argv, 0, NULL, NULL );
+
+    pcio_trace_t t;
+    if( pcio_trace_open( &t, opt_file ) ) {
+        fprintf(stderr, "Couldn't open capture %s: %s\n", opt_file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    uint64_t cnt = pcio_trace_count( &t );
+    uint64_t torn = 0;
+    uint64_t t_last = 0;
+    uint64_t seq = 0;
+    for( uint64_t k = 0; k < cnt; k++ ) {
+        const pcio_trace_record_t *rec = pcio_trace_get( &t, k );
+        if( NULL == rec ) {
+            torn++;
+            continue;
+        }
+        if( seq && rec->seq != seq + 1 ) on_gap();
+        seq = rec->seq;
+        if( 0 == t_first ) t_first = rec->t_ns;
+        t_last = rec->t_ns;
+        on_record( rec );
+    }
+
+    printf("capture %s: %lu records (%lu written, %lu pinned, %lu incomplete), %.3f s%s\n",
+           opt_file, (unsigned long)cnt, (unsigned long)t.hdr->head,
+           (unsigned long)t.hdr->pinned, (unsigned long)torn,
+           (double)(t_last - t_first) / 1e9,
+           t.hdr->head > t.hdr->capacity ? ", wrapped" : "" );
+    printf("latency late above %.1f ms, occupancy window %.1f ms\n", opt_late_ms, opt_window_ms);
+    for( size_t i = 0; i < n_busses; i++ )
+        report_bus( &busses[i] );
+
+    pcio_trace_close( &t );
+    return 0;
+}
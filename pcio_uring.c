@@ -0,0 +1,186 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+
+/**
+ * \file pcio_uring.c
+ * \brief Minimal io_uring through the raw system calls
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "pcio_uring.h"
+
+static int pcio_uring_enter( int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                             const void *arg, size_t argsz ) {
+    return (int)syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz );
+}
+
+int pcio_uring_init( pcio_uring_t *u, unsigned entries ) {
+    memset( u, 0, sizeof(*u) );
+    struct io_uring_params p;
+    memset( &p, 0, sizeof(p) );
+    u->fd = (int)syscall( __NR_io_uring_setup, entries, &p );
+    if( u->fd < 0 ) return -1;
+    u->features = p.features;
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        if( u->cq_map_len > u->sq_map_len ) u->sq_map_len = u->cq_map_len;
+        u->cq_map_len = u->sq_map_len;
+    }
+    u->sq_map = mmap( NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      u->fd, IORING_OFF_SQ_RING );
+    if( MAP_FAILED == u->sq_map ) goto fail;
+    if( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        u->cq_map = u->sq_map;
+    } else {
+        u->cq_map = mmap( NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          u->fd, IORING_OFF_CQ_RING );
+        if( MAP_FAILED == u->cq_map ) goto fail;
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe*)mmap( NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES );
+    if( MAP_FAILED == (void*)u->sqes ) goto fail;
+
+    uint8_t *sq = (uint8_t*)u->sq_map;
+    uint8_t *cq = (uint8_t*)u->cq_map;
+    u->sq_head = (unsigned*)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    u->sq_array = (unsigned*)(sq + p.sq_off.array);
+    u->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_local = *u->sq_tail;
+    u->cq_head = (unsigned*)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    u->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    return 0;
+
+fail:
+    {
+        int e = errno;
+        pcio_uring_destroy( u );
+        errno = e;
+    }
+    return -1;
+}
+
+void pcio_uring_destroy( pcio_uring_t *u ) {
+    if( u->sqes && MAP_FAILED != (void*)u->sqes ) munmap( u->sqes, u->sqes_len );
+    if( u->cq_map && MAP_FAILED != u->cq_map && u->cq_map != u->sq_map )
+        munmap( u->cq_map, u->cq_map_len );
+    if( u->sq_map && MAP_FAILED != u->sq_map ) munmap( u->sq_map, u->sq_map_len );
+    if( u->fd >= 0 ) close( u->fd );
+    memset( u, 0, sizeof(*u) );
+    u->fd = -1;
+}
+
+struct io_uring_sqe *pcio_uring_sqe( pcio_uring_t *u ) {
+    if( pcio_uring_queued( u ) >= u->sq_entries ) return NULL;
+    unsigned i = u->sq_local & u->sq_mask;
+    u->sq_array[i] = i;
+    u->sq_local++;
+    memset( &u->sqes[i], 0, sizeof(u->sqes[i]) );
+    return &u->sqes[i];
+}
+
+int pcio_uring_submit( pcio_uring_t *u ) {
+    __atomic_store_n( u->sq_tail, u->sq_local, __ATOMIC_RELEASE );
+    while( pcio_uring_queued( u ) ) {
+        u->enters++;
+        int r = pcio_uring_enter( u->fd, pcio_uring_queued( u ), 0, 0, NULL, 0 );
+        if( r < 0 && EINTR != errno ) return -errno;
+        if( 0 == r ) return -EAGAIN;
+    }
+    return 0;
+}
+
+int pcio_uring_wait( pcio_uring_t *u, int timeout_ms ) {
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    struct io_uring_getevents_arg arg;
+    memset( &arg, 0, sizeof(arg) );
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    u->enters++;
+    int r = pcio_uring_enter( u->fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                              &arg, sizeof(arg) );
+    return r < 0 ? -errno : 0;
+}
+
+struct io_uring_cqe *pcio_uring_cqe( pcio_uring_t *u ) {
+    unsigned head = *u->cq_head;
+    if( head == __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE ) ) return NULL;
+    return &u->cqes[head & u->cq_mask];
+}
+
+void pcio_uring_cqe_seen( pcio_uring_t *u ) {
+    __atomic_store_n( u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE );
+}
+
+int pcio_uring_register_buffers( pcio_uring_t *u, const struct iovec *iov, unsigned n ) {
+    int r = (int)syscall( __NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, n );
+    return r < 0 ? -errno : 0;
+}
+
+int pcio_uring_register_buf_ring( pcio_uring_t *u, struct io_uring_buf_ring *br,
+                                  unsigned entries, uint16_t bgid ) {
+    struct io_uring_buf_reg reg;
+    memset( &reg, 0, sizeof(reg) );
+    reg.ring_addr = (uint64_t)(uintptr_t)br;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    int r = (int)syscall( __NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1 );
+    return r < 0 ? -errno : 0;
+}
@@ -46,6 +46,9 @@
  *  messages to the CAN network, rather than running as a motor
  *  daemon.
  *
+ *  --dump writes every parameter of all modules to a JSON file after a
+ *  single group init, and --restore writes the settable ones back.
+ *
  *  \author Jon Scholz
  */
 
@@ -54,10 +57,15 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
 
-#include <somatic/util.h>
+#include <amino.h>
+#include <ntcan.h>
+#include <ntcanopen.h>
 
-#include "include/pcio.h"
+#include "pcio.h"
+#include "pcio_params.h"
 
 #define MAX_BUSSES 4
 
@@ -82,6 +90,8 @@ typedef struct pcio_modinfo_t pcio_module_list_t; ///< A nice typedef for our mo
 /* Option Vars */
 static int opt_verbosity = 0;
 static int opt_homeset = 0;
+static const char *opt_dump = NULL;
+static const char *opt_restore = NULL;
 static size_t n_busses = 0;
 static size_t n_modules = 0;
 static size_t bus_count[MAX_BUSSES];    // number of modules per bus
@@ -105,6 +115,20 @@ static struct argp_option options[] = {
         .flags = 0,
         .doc = "Defines the current joint values as the home position"
     },
+    {
+        .name = "dump",
+        .key = 'D',
+        .arg = "file",
+        .flags = 0,
+        .doc = "Writes every parameter and the config word of all modules to file as JSON, - for stdout"
+    },
+    {
+        .name = "restore",
+        .key = 'r',
+        .arg = "file",
+        .flags = 0,
+        .doc = "Writes back the settable parameters of all modules from a dump"
+    },
     {
         .name = "index",
         .key = 'i',
@@ -162,6 +186,12 @@ static int parse_opt( int key, char *arg, struct argp_state *state) {
     case 'h':
         opt_homeset = 1;
         break;
+    case 'D':
+        opt_dump = arg;
+        break;
+    case 'r':
+        opt_restore = arg;
+        break;
     case 'i':
         current_index = atoi(arg);
         break;
@@ -215,7 +245,6 @@ static int parse_opt( int key, char *arg, struct argp_state *state) {
 /* FUNCTION DECLARATIONS */
 /* --------------------- */
 int build_pcio_group(pcio_group_t *group, pcio_module_list_t *module_list);
-
 /* ---- */
 /* MAIN */
 /* ---- */
@@ -233,6 +262,7 @@ int main(int argc, char **argv) {
 
     /// Declare a pcio_group_t to hold the information on all the modules and busses.
     pcio_group_t pcio_group;
+    memset( &pcio_group, 0, sizeof(pcio_group) );
 
     /// Use pcio_mod_list to build a pcio_group_t
     pcio_mod_list = pcio_mod_list->head;
@@ -240,7 +270,7 @@ int main(int argc, char **argv) {
 
     /// Initialize the CAN network
     int r = pcio_group_init( &pcio_group );
-    somatic_hard_assert(r == NTCAN_SUCCESS, "pcio group initialization failed\n");
+    aa_hard_assert(r == NTCAN_SUCCESS, "pcio group initialization failed\n");
 
     if (opt_verbosity) {
         fprintf(stderr, "\n* pcio_util *\n");
@@ -268,6 +298,16 @@ int main(int argc, char **argv) {
 
     }
 
+    if (opt_dump) {
+        r = pcio_params_dump( &pcio_group, opt_dump );
+        aa_hard_assert(r == NTCAN_SUCCESS, "dump failed: %s\n", canResultString(r));
+    }
+
+    if (opt_restore) {
+        r = pcio_params_restore( &pcio_group, opt_restore );
+        aa_hard_assert(r == NTCAN_SUCCESS, "restore failed\n");
+    }
+
     return 0;
 }
 
@@ -280,13 +320,13 @@ int main(int argc, char **argv) {
 int build_pcio_group(pcio_group_t *group, pcio_module_list_t *module_list)
 {
     // 1) use n_busses to create an array of busses of the appropriate size
-    group->bus = (pcio_bus_t*)malloc(sizeof(pcio_bus_t) * n_busses);
+    group->bus = (pcio_bus_t*)calloc(n_busses, sizeof(pcio_bus_t));
     group->bus_cnt = n_busses;
 
     // 2) loop through this array, and for each bus create module_t using bus_counts
     size_t i;
     for (i = 0; i < n_busses; ++i) {
-        group->bus[i].module = (pcio_module_t*)malloc(sizeof(pcio_module_t) * bus_count[i]);
+        group->bus[i].module = (pcio_module_t*)calloc(bus_count[i], sizeof(pcio_module_t));
         group->bus[i].module_cnt = bus_count[i];
         group->bus[i].net = bus_ids[i];
     }
@@ -303,7 +343,7 @@ int build_pcio_group(pcio_group_t *group, pcio_module_list_t *module_list)
         for (m = 0; (size_t)m < group->bus_cnt; ++m)
             if (group->bus[m].net == bus)
                 bus_idx = m;
-        somatic_hard_assert(bus_idx != -1,"No busses in group.  Please specify with the \"-b\" flag\n");
+        aa_hard_assert(bus_idx != -1,"No busses in group.  Please specify with the \"-b\" flag\n");
 
         group->bus[bus_idx].module[modules_added[bus_idx]].id = id;
         modules_added[bus_idx]++;
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/** 
+ * @file params_bench.c
+ * @date 2014
+ * @brief Dumps the parameters of a simulated group, changes some on the modules, restores the
+ * dump and checks the modules are back where they were, timing the dump and the restore.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <amino.h>
+#include <ntcanopen.h>
+
+#include "pcio.h"
+#include "pcio_sim.h"
+#include "pcio_params.h"
+
+static int nets[2] = { 0, 1 };
+static size_t module_cnts[2] = { 4, 3 };
+static int module_ids[7] = { 3, 4, 5, 6, 3, 4, 5 };
+
+/* ******************************************************************************************** */
+static double now_ms() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec * 1e3 + (double)t.tv_nsec / 1e6;
+}
+
+/* ******************************************************************************************** */
+int main(int argc, char *argv[]) {
+	uint64_t seed = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+	char path[] = "/tmp/params_bench_XXXXXX";
+	int fd = mkstemp(path);
+	aa_hard_assert(fd >= 0, "Couldn't create a temporary file\n");
+	close(fd);
+
+	pcio_sim_t sim;
+	pcio_sim_init(&sim, seed);
+	pcio_group_t *g = pcio_group_alloc(2, nets, module_cnts, module_ids);
+	aa_hard_assert(0 == pcio_sim_attach(&sim, g), "pcio_sim_attach failed\n");
+	aa_hard_assert(NTCAN_SUCCESS == pcio_group_init(g), "pcio_group_init failed\n");
+	size_t n = pcio_group_size(g);
+
+	double t0 = now_ms();
+	int r = pcio_params_dump(g, path);
+	double t_dump = now_ms() - t0;
+	aa_hard_assert(NTCAN_SUCCESS == r, "dump failed: %s\n", canResultString(r));
+
+	// Change what the simulated modules keep of the restored parameters
+	pcio_sim_module_t *saved = AA_NEW_AR(pcio_sim_module_t, n);
+	size_t k = 0;
+	for(size_t i = 0; i < g->bus_cnt; i++) {
+		for(size_t j = 0; j < g->bus[i].module_cnt; j++, k++) {
+			pcio_sim_module_t *m = pcio_sim_module(&sim, g->bus[i].net, g->bus[i].module[j].id);
+			saved[k] = *m;
+			m->config ^= 0x5a;
+			m->min_pos -= 0.25f;
+			m->max_pos += 0.125f;
+			m->max_acc *= 0.5f;
+		}
+	}
+
+	t0 = now_ms();
+	r = pcio_params_restore(g, path);
+	double t_restore = now_ms() - t0;
+	aa_hard_assert(NTCAN_SUCCESS == r, "restore failed: %s\n", canResultString(r));
+
+	size_t wrong = 0;
+	k = 0;
+	for(size_t i = 0; i < g->bus_cnt; i++) {
+		for(size_t j = 0; j < g->bus[i].module_cnt; j++, k++) {
+			const pcio_sim_module_t *m = pcio_sim_module(&sim, g->bus[i].net, g->bus[i].module[j].id);
+			wrong += m->config != saved[k].config || m->min_pos != saved[k].min_pos ||
+				m->max_pos != saved[k].max_pos || m->max_acc != saved[k].max_acc;
+		}
+	}
+	printf("%zu modules: dump %.1f ms, restore %.1f ms, %zu not restored, %s\n",
+	       n, t_dump, t_restore, wrong, wrong ? "ROUND TRIP FAILED" : "round trip ok");
+
+	unlink(path);
+	free(saved);
+	pcio_group_destroy(g);
+	pcio_group_free(g);
+	pcio_sim_destroy(&sim);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
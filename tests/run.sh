@@ -14,9 +14,9 @@
 # 0. Set variables
 #************************
 
-# ARMS + TORSO: SocketCAN interfaces
-CAN_L=can0
-CAN_R=can1
+# ARMS + TORSO: CAN nets (can0, can1)
+NET_L=0
+NET_R=1
 
 
 #***********************
@@ -67,34 +67,28 @@ oldschunk_start() {
     # Create channels
     oldschunk_ach_mk
 
-    # Run daemons can402 for left and right arm
-    $SNS run -d -r lwa-left -- \
-	pcio-sns -f $CAN_L -R 1 -C 0 -n 3 -n 4 -n 5 -n 6 -n 7 -n 8 -n 9 -c ref-left -s state-left -v
-    $SNS run -d -r lwa-right -- \
-	pcio-sns -f $CAN_R -R 1 -C 0 -n 3 -n 4 -n 5 -n 6 -n 7 -n 8 -n 9 -c ref-right -s state-right -v
+    # Run one daemon for both arms, each arm is a group with its own thread
+    $SNS run -d -r lwa -- \
+	pcio-sns \
+	-g left -b $NET_L -m 3 -m 4 -m 5 -m 6 -m 7 -m 8 -m 9 -c ref-left -s state-left \
+	-g right -b $NET_R -m 3 -m 4 -m 5 -m 6 -m 7 -m 8 -m 9 -c ref-right -s state-right -v
 }
 
 # Expunge: Remove temporal folders for log
 oldschunk_expunge() {
-    sudo rm -rf /var/tmp/sns/lwa-left
-    sudo rm -rf /var/tmp/sns/lwa-right
-
-    sudo rm -rf /var/run/sns/lwa-left
-    sudo rm -rf /var/run/sns/lwa-right
+    sudo rm -rf /var/tmp/sns/lwa
+    sudo rm -rf /var/run/sns/lwa
 }
 
 # Stop: Stop daemons and programs
 oldschunk_stop() {
-    $SNS kill lwa-left
-    $SNS kill lwa-right
+    $SNS kill lwa
 }
 
 # Change ownerships of SNS temporal files
 oldschunk_steal() {
-    chown -R $1 /var/run/sns/lwa-left \
-	/var/run/sns/lwa-right \
-	/var/tmp/sns/lwa-left \
-	/var/tmp/sns/lwa-right  
+    chown -R $1 /var/run/sns/lwa \
+	/var/tmp/sns/lwa
 }
 
 #*************************
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/** 
+ * @file shm_bench.c
+ * @date 2014
+ * @brief Compares the latency of reading the latest motor state through ach_get and through the 
+ * seqlock shared memory mirror of pcio-sns, while a writer thread publishes to both.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <amino.h>
+#include <ach.h>
+#include <sns.h>
+
+#include "pcio_shm.h"
+
+/* ******************************************************************************************** */
+// Benchmark settings
+
+#define BENCH_CHAN "pcio-shm-bench"
+#define BENCH_SHM "/pcio-shm-bench"
+
+static size_t opt_n = 7;              // joints per message
+static size_t opt_iters = 100000;     // reads per method
+static double opt_write_hz = 1000;    // publish rate of the writer thread
+
+static ach_channel_t chan;
+static pcio_shm_t shm;
+static volatile int done = 0;
+
+/* ******************************************************************************************** */
+static int64_t now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/* ******************************************************************************************** */
+/// Publishes a changing state to both the ach channel and the shared memory
+static void *writer(void *arg) {
+	(void) arg;
+	struct sns_msg_motor_state *msg = sns_msg_motor_state_heap_alloc(opt_n);
+	size_t size = sns_msg_motor_state_size(msg);
+	int64_t period = (int64_t)(1e9 / opt_write_hz);
+	while(!done) {
+		msg->header.seq++;
+		for(size_t i = 0; i < opt_n; i++) msg->X[i].pos = (double)msg->header.seq + (double)i;
+		ach_put(&chan, msg, size);
+		pcio_shm_write(&shm, msg, size);
+		struct timespec t = { 0, period };
+		nanosleep(&t, NULL);
+	}
+	free(msg);
+	return NULL;
+}
+
+/* ******************************************************************************************** */
+/// Prints the latency distribution of one method
+static void report(const char *name, int64_t *lat, size_t n, size_t fails) {
+	qsort(lat, n, sizeof(lat[0]), cmp_i64);
+	double sum = 0;
+	for(size_t i = 0; i < n; i++) sum += (double)lat[i];
+	printf("%-6s reads: %zu  fails: %zu  min: %ld ns  mean: %.0f ns  p50: %ld ns  "
+	       "p99: %ld ns  max: %ld ns\n",
+	       name, n, fails, (long)lat[0], sum / (double)n, (long)lat[n/2],
+	       (long)lat[(n*99)/100], (long)lat[n-1]);
+}
+
+/* ******************************************************************************************** */
+int main(int argc, char *argv[]) {
+
+	if(argc > 1) opt_iters = strtoul(argv[1], NULL, 10);
+	if(argc > 2) opt_n = strtoul(argv[2], NULL, 10);
+
+	// Create the channel and the shared memory
+	size_t size = sns_msg_motor_state_size_n(opt_n);
+	ach_unlink(BENCH_CHAN);
+	ach_status_t r = ach_create(BENCH_CHAN, 10, size, NULL);
+	aa_hard_assert(ACH_OK == r, "ach_create: %s\n", ach_result_to_string(r));
+	r = ach_open(&chan, BENCH_CHAN, NULL);
+	aa_hard_assert(ACH_OK == r, "ach_open: %s\n", ach_result_to_string(r));
+	aa_hard_assert(0 == pcio_shm_create(&shm, BENCH_SHM, size), "pcio_shm_create failed\n");
+
+	// Open the shared memory again as a reader would
+	pcio_shm_t rd;
+	aa_hard_assert(0 == pcio_shm_open(&rd, BENCH_SHM), "pcio_shm_open failed\n");
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, writer, NULL);
+	struct timespec settle = { 0, 10000000 };
+	nanosleep(&settle, NULL);
+
+	struct sns_msg_motor_state *msg = sns_msg_motor_state_heap_alloc(opt_n);
+	int64_t *lat = AA_NEW_AR(int64_t, opt_iters);
+
+	// ach_get of the newest frame
+	size_t fails = 0;
+	for(size_t i = 0; i < opt_iters; i++) {
+		size_t frame_size;
+		int64_t t0 = now_ns();
+		r = ach_get(&chan, msg, size, &frame_size, NULL, ACH_O_LAST | ACH_O_COPY);
+		lat[i] = now_ns() - t0;
+		if(ACH_OK != r && ACH_MISSED_FRAME != r && ACH_STALE_FRAMES != r) fails++;
+	}
+	report("ach", lat, opt_iters, fails);
+
+	// seqlock copy of the newest state
+	fails = 0;
+	for(size_t i = 0; i < opt_iters; i++) {
+		int64_t t0 = now_ns();
+		int s = pcio_shm_read(&rd, msg, size, NULL);
+		lat[i] = now_ns() - t0;
+		if(s < 0) fails++;
+	}
+	report("shm", lat, opt_iters, fails);
+
+	// seqlock freshness check only, as a reader polling faster than the writer would do
+	fails = 0;
+	uint64_t seq = 0;
+	for(size_t i = 0; i < opt_iters; i++) {
+		int64_t t0 = now_ns();
+		int s = pcio_shm_read(&rd, msg, size, &seq);
+		lat[i] = now_ns() - t0;
+		if(s < 0) fails++;
+	}
+	report("shm-ck", lat, opt_iters, fails);
+
+	done = 1;
+	pthread_join(thread, NULL);
+	pcio_shm_close(&rd);
+	pcio_shm_close(&shm);
+	ach_close(&chan);
+	ach_unlink(BENCH_CHAN);
+	free(lat);
+	free(msg);
+	return 0;
+}
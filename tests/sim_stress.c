@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/** 
+ * @file sim_stress.c
+ * @date 2014
+ * @brief Drives a two bus group on the simulated transport under several fault mixes and reports
+ * cycle times, overruns and how long it takes to get a clean cycle again after a failure.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include <amino.h>
+#include <ntcanopen.h>
+
+#include "pcio.h"
+#include "pcio_sim.h"
+
+/* ******************************************************************************************** */
+// Benchmark settings
+
+static size_t opt_cycles = 1000;      // cycles per fault mix
+static double opt_period_ms = 5;      // cycle period
+static uint64_t opt_seed = 1;         // fault generator seed
+
+/// A named fault mix
+typedef struct {
+	const char *name;
+	pcio_sim_faults_t faults;
+} mix_t;
+
+static const mix_t mixes[] = {
+	{ "clean",      { 0 } },
+	{ "drop",       { .drop = 1e-3 } },
+	{ "delay",      { .delay = 1e-2, .delay_ns = 20000000 } },
+	{ "duplicate",  { .duplicate = 1e-2 } },
+	{ "error",      { .error = 5e-4 } },
+	{ "bus-off",    { .bus_off = 2e-4, .bus_off_ns = 50000000 } },
+	{ "bus-off-reopen", { .bus_off = 2e-4, .bus_off_ns = 0 } },
+	{ "mixed",      { .drop = 5e-4, .delay = 5e-3, .delay_ns = 10000000, .duplicate = 5e-3,
+	                  .error = 2e-4, .bus_off = 1e-4, .bus_off_ns = 20000000 } },
+};
+
+static int nets[2] = { 0, 1 };
+static size_t module_cnts[2] = { 7, 7 };
+static int module_ids[14] = { 3, 4, 5, 6, 7, 8, 9, 3, 4, 5, 6, 7, 8, 9 };
+
+/* ******************************************************************************************** */
+static int64_t now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void sleep_until(int64_t t_ns) {
+	struct timespec t = { (time_t)(t_ns / 1000000000), (long)(t_ns % 1000000000) };
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/* ******************************************************************************************** */
+/// Gets the group going again bus by bus: drop late replies and reset, or reopen the bus if even
+/// that fails
+static void recover(pcio_group_t *g) {
+	for(size_t i = 0; i < g->bus_cnt; i++) {
+		g->bus[i].result = NTCAN_SUCCESS;
+		if(NTCAN_SUCCESS == pcio_bus_flush(g, i, NULL) && NTCAN_SUCCESS == pcio_bus_reset(g, i, NULL))
+			continue;
+		if(NTCAN_SUCCESS == pcio_bus_reopen(g, i)) pcio_bus_reset(g, i, NULL);
+	}
+}
+
+/* ******************************************************************************************** */
+/// Runs the cycles of one fault mix and prints a line of results
+static void run_mix(const mix_t *mix) {
+	pcio_sim_t sim;
+	pcio_sim_init(&sim, opt_seed);
+	pcio_group_t *g = pcio_group_alloc(2, nets, module_cnts, module_ids);
+	aa_hard_assert(0 == pcio_sim_attach(&sim, g), "pcio_sim_attach failed\n");
+	aa_hard_assert(NTCAN_SUCCESS == pcio_group_init(g), "pcio_group_init failed\n");
+
+	// faults start after a clean init
+	sim.faults = mix->faults;
+
+	size_t n = pcio_group_size(g);
+	double u[n], ack[n];
+	int64_t *cycle = AA_NEW_AR(int64_t, opt_cycles);
+	int64_t *recovery = AA_NEW_AR(int64_t, opt_cycles);
+	size_t n_recovery = 0, failed = 0, overruns = 0;
+	int64_t period = (int64_t)(opt_period_ms * 1e6);
+	int64_t fail_start = -1;
+
+	int64_t next = now_ns();
+	for(size_t c = 0; c < opt_cycles; c++) {
+		for(size_t i = 0; i < n; i++) u[i] = 0.05 * sin(2 * M_PI * (double)c / 200.0);
+		int64_t t0 = now_ns();
+		int r = pcio_group_cmd_ack(g, ack, n, PCIO_FVEL_ACK, u);
+		if(NTCAN_SUCCESS != r) {
+			failed++;
+			if(fail_start < 0) fail_start = t0;
+			recover(g);
+		} else if(fail_start >= 0) {
+			recovery[n_recovery++] = now_ns() - fail_start;
+			fail_start = -1;
+		}
+		int64_t t1 = now_ns();
+		cycle[c] = t1 - t0;
+		if(cycle[c] > period) overruns++;
+		next += period;
+		if(next > t1) sleep_until(next);
+		else next = t1;
+	}
+
+	qsort(cycle, opt_cycles, sizeof(cycle[0]), cmp_i64);
+	double rec_sum = 0;
+	int64_t rec_max = 0;
+	for(size_t i = 0; i < n_recovery; i++) {
+		rec_sum += (double)recovery[i];
+		rec_max = AA_MAX(rec_max, recovery[i]);
+	}
+	printf("%-15s %7zu %6zu %8zu %9.0f %9.0f %9.0f %5zu %8.2f %8.2f   "
+	       "%lu/%lu/%lu/%lu/%lu/%lu\n",
+	       mix->name, opt_cycles, failed, overruns,
+	       (double)cycle[opt_cycles/2] / 1e3, (double)cycle[(opt_cycles*99)/100] / 1e3,
+	       (double)cycle[opt_cycles-1] / 1e3,
+	       n_recovery, n_recovery ? rec_sum / (double)n_recovery / 1e6 : 0, (double)rec_max / 1e6,
+	       (unsigned long)sim.count.drop, (unsigned long)sim.count.delay,
+	       (unsigned long)sim.count.duplicate, (unsigned long)sim.count.error,
+	       (unsigned long)sim.count.power_fault, (unsigned long)sim.count.bus_off);
+
+	sim.faults = mixes[0].faults;
+	pcio_group_destroy(g);
+	pcio_group_free(g);
+	pcio_sim_destroy(&sim);
+	free(cycle);
+	free(recovery);
+}
+
+/* ******************************************************************************************** */
+/// Checks that pcio_group_init refuses a group with a power fault
+static void check_init_power_fault() {
+	pcio_sim_t sim;
+	pcio_sim_init(&sim, opt_seed);
+	pcio_group_t *g = pcio_group_alloc(2, nets, module_cnts, module_ids);
+	aa_hard_assert(0 == pcio_sim_attach(&sim, g), "pcio_sim_attach failed\n");
+	pcio_sim_module(&sim, 1, 5)->state |= PCIO_STATE_ERROR | PCIO_STATE_POWERFAULT | PCIO_STATE_POW_VOLT_ERR;
+	int r = pcio_group_init(g);
+	printf("power fault at init: %s\n", NTCAN_SUCCESS == r ? "NOT DETECTED" : "detected");
+	pcio_group_destroy(g);
+	pcio_group_free(g);
+	pcio_sim_destroy(&sim);
+}
+
+/* ******************************************************************************************** */
+/// Sends a trajectory as step motions on a 10 ms grid with +-4 ms of jitter on each send, and
+/// checks that the modules stay within 0.02 rad of the trajectory delayed by one step, with at
+/// most one position in ten held back for a full buffer
+static void check_step_jitter() {
+	const double period = 0.01, jitter = 0.004, bound = 0.02;
+	const size_t cycles = 300;
+	pcio_sim_t sim;
+	pcio_sim_init(&sim, opt_seed);
+	pcio_group_t *g = pcio_group_alloc(2, nets, module_cnts, module_ids);
+	aa_hard_assert(0 == pcio_sim_attach(&sim, g), "pcio_sim_attach failed\n");
+	aa_hard_assert(NTCAN_SUCCESS == pcio_group_init(g), "pcio_group_init failed\n");
+
+	size_t n = pcio_group_size(g);
+	double u[n], ack[n];
+	uint16_t ms[n];
+	uint8_t sent[n];
+	for(size_t i = 0; i < n; i++) ms[i] = (uint16_t)lround(period * 1e3);
+	uint64_t rng = opt_seed;
+	double err = 0;
+	size_t held = 0, checked = 0;
+	int r = NTCAN_SUCCESS;
+	int64_t start = now_ns();
+	for(size_t c = 0; c < cycles && NTCAN_SUCCESS == r; c++) {
+		rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+		double j = jitter * ((double)(rng >> 11) / (double)(1ull << 53) * 2 - 1);
+		sleep_until(start + (int64_t)(((double)c * period + j) * 1e9));
+		double t = (double)(now_ns() - start) / 1e9;
+		for(size_t i = 0; i < n; i++) u[i] = 0.3 * sin(M_PI * (double)c * period + (double)i);
+		memset(sent, 1, n);
+		r = pcio_group_step_ack(g, ack, n, u, ms, sent);
+		// past the start, the acked position against the trajectory one step back
+		for(size_t i = 0; i < n && c > 10; i++, checked++) {
+			if(!sent[i]) { held++; continue; }
+			err = AA_MAX(err, fabs(ack[i] - 0.3 * sin(M_PI * (t - period) + (double)i)));
+		}
+	}
+	printf("step jitter: %s, max error %.4f rad, %zu/%zu held, %s\n",
+	       NTCAN_SUCCESS == r ? "ok" : canResultString(r), err, held, checked,
+	       NTCAN_SUCCESS == r && err <= bound && 10 * held <= checked ? "within bound" : "OUT OF BOUND");
+	pcio_group_destroy(g);
+	pcio_group_free(g);
+	pcio_sim_destroy(&sim);
+}
+
+/* ******************************************************************************************** */
+int main(int argc, char *argv[]) {
+
+	if(argc > 1) opt_cycles = strtoul(argv[1], NULL, 10);
+	if(argc > 2) opt_period_ms = strtod(argv[2], NULL);
+	if(argc > 3) opt_seed = strtoull(argv[3], NULL, 10);
+	aa_hard_assert(opt_cycles > 0, "Need at least one cycle\n");
+
+	check_init_power_fault();
+	check_step_jitter();
+
+	printf("%zu cycles at %.1f ms, seed %lu\n", opt_cycles, opt_period_ms, (unsigned long)opt_seed);
+	printf("%-15s %7s %6s %8s %9s %9s %9s %5s %8s %8s   %s\n",
+	       "mix", "cycles", "failed", "overruns", "p50 us", "p99 us", "max us",
+	       "recov", "mean ms", "max ms", "drop/delay/dup/error/power/bus-off");
+	for(size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) run_mix(&mixes[i]);
+	return 0;
+}
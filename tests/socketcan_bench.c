@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2014, Georgia Tech Research Corporation
+ * All rights reserved.
+ *
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/** 
+ * @file socketcan_bench.c
+ * @date 2014
+ * @brief Compares the plain socket and the io_uring engines of the SocketCAN transport on a
+ * request and reply cycle like that of pcio-sns. A thread per bus answers every request the way
+ * a module acknowledges it. Run it on virtual busses, e.g. for two busses:
+ *
+ *   ip link add dev vcan0 type vcan && ip link set up vcan0
+ *   ip link add dev vcan1 type vcan && ip link set up vcan1
+ *   socketcan_bench vcan%d 2 7 10000
+ */
+
+#define _GNU_SOURCE // RUSAGE_THREAD
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include <amino.h>
+
+#include "pcio.h"
+#include "pcio_socketcan.h"
+
+/* ******************************************************************************************** */
+// Benchmark settings
+
+static const char *opt_ifname = "vcan%d"; // interface name format
+static size_t opt_busses = 2;             // busses, nets 0 to opt_busses-1
+static size_t opt_modules = 7;            // modules per bus, ids 3 and up
+static size_t opt_cycles = 10000;         // cycles per engine
+
+static volatile int done = 0;
+
+/* ******************************************************************************************** */
+static int64_t now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int64_t cpu_ns() {
+	struct rusage u;
+	getrusage(RUSAGE_THREAD, &u);
+	return ((int64_t)u.ru_utime.tv_sec + u.ru_stime.tv_sec) * 1000000000 +
+		((int64_t)u.ru_utime.tv_usec + u.ru_stime.tv_usec) * 1000;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/* ******************************************************************************************** */
+/// Acknowledges every get and put request on one interface, echoing the command byte
+static void *responder(void *arg) {
+	int net = (int)(intptr_t)arg;
+	char name[IFNAMSIZ];
+	snprintf(name, sizeof(name), opt_ifname, net);
+	int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	aa_hard_assert(fd >= 0, "Couldn't open a CAN socket\n");
+	struct can_filter f[2] = { { PCIO_IDMASK_CMDGET, CAN_SFF_MASK & ~0x1f },
+	                           { PCIO_IDMASK_CMDPUT, CAN_SFF_MASK & ~0x1f } };
+	setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, f, sizeof(f));
+	struct timeval tv = { 0, 100000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	struct sockaddr_can addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = (int)if_nametoindex(name);
+	aa_hard_assert(0 == bind(fd, (struct sockaddr*)&addr, sizeof(addr)), "Couldn't bind to %s\n", name);
+
+	while(!done) {
+		struct can_frame frame;
+		if(read(fd, &frame, sizeof(frame)) != sizeof(frame)) continue;
+		frame.can_id = PCIO_CANID_CMDACK(PCIO_CANID_MODID(frame.can_id));
+		frame.can_dlc = 6;
+		if(write(fd, &frame, sizeof(frame)) != sizeof(frame)) continue;
+	}
+	close(fd);
+	return NULL;
+}
+
+/* ******************************************************************************************** */
+/// Runs the cycles on one engine and prints a line of results
+static void run(const pcio_transport_t *tp, pcio_socketcan_t *s) {
+	NTCAN_HANDLE h[opt_busses];
+	for(size_t i = 0; i < opt_busses; i++) {
+		aa_hard_assert(NTCAN_SUCCESS == tp->open(s, (int)i, 128, &h[i]),
+		               "Couldn't open net %lu\n", (unsigned long)i);
+		for(size_t j = 0; j < opt_modules; j++)
+			tp->id_add(s, h[i], PCIO_CANID_CMDACK(3 + (int)j));
+	}
+
+	int64_t *cycle = AA_NEW_AR(int64_t, opt_cycles);
+	uint64_t enters = s->uring ? s->uring->ring.enters : 0;
+	size_t lost = 0;
+	int64_t cpu = cpu_ns();
+	for(size_t c = 0; c < opt_cycles; c++) {
+		int64_t t0 = now_ns();
+		// one write per module and one flush, as pcio_group_msg_send does
+		for(size_t i = 0; i < opt_busses; i++) {
+			for(size_t j = 0; j < opt_modules; j++) {
+				CMSG msg;
+				memset(&msg, 0, sizeof(msg));
+				msg.id = PCIO_CANID_CMDGET(3 + (int)j);
+				msg.len = 2;
+				msg.data[0] = PCIO_GET_PARAM;
+				msg.data[1] = PCIO_ACT_FPOS;
+				int32_t n = 1;
+				tp->write(s, h[i], &msg, &n);
+			}
+		}
+		if(tp->flush) tp->flush(s);
+
+		// and the replies as they arrive, as pcio_group_msg_recv does
+		size_t left = opt_busses * opt_modules;
+		while(left) {
+			int progress = 0;
+			for(size_t i = 0; i < opt_busses; i++) {
+				CMSG msg[opt_modules];
+				int32_t n = (int32_t)opt_modules;
+				if(NTCAN_SUCCESS != tp->take(s, h[i], msg, &n)) n = 0;
+				left -= AA_MIN(left, (size_t)n);
+				progress |= n > 0;
+			}
+			if(!progress && NTCAN_SUCCESS != tp->wait(s, 100)) {
+				lost += left;
+				break;
+			}
+		}
+		cycle[c] = now_ns() - t0;
+	}
+	cpu = cpu_ns() - cpu;
+	enters = s->uring ? s->uring->ring.enters - enters : 0;
+
+	qsort(cycle, opt_cycles, sizeof(cycle[0]), cmp_i64);
+	printf("%-16s %9.1f %9.1f %9.1f %9.1f %9.2f %7lu\n", tp->name,
+	       (double)cycle[opt_cycles/2] / 1e3, (double)cycle[(opt_cycles*99)/100] / 1e3,
+	       (double)cycle[opt_cycles-1] / 1e3, (double)cpu / 1e3 / (double)opt_cycles,
+	       (double)enters / (double)opt_cycles, (unsigned long)lost);
+
+	for(size_t i = 0; i < opt_busses; i++) tp->close(s, h[i]);
+	free(cycle);
+}
+
+/* ******************************************************************************************** */
+int main(int argc, char *argv[]) {
+	if(argc > 1) opt_ifname = argv[1];
+	if(argc > 2) opt_busses = strtoul(argv[2], NULL, 10);
+	if(argc > 3) opt_modules = strtoul(argv[3], NULL, 10);
+	if(argc > 4) opt_cycles = strtoul(argv[4], NULL, 10);
+	aa_hard_assert(opt_busses > 0 && opt_modules > 0 && opt_modules <= 29 && opt_cycles > 0,
+	               "Need 1 or more busses and 1 to 29 modules\n");
+
+	pthread_t threads[opt_busses];
+	for(size_t i = 0; i < opt_busses; i++)
+		pthread_create(&threads[i], NULL, responder, (void*)(intptr_t)i);
+	usleep(100000);
+
+	printf("%lu cycles, %lu busses of %lu modules on %s\n", (unsigned long)opt_cycles,
+	       (unsigned long)opt_busses, (unsigned long)opt_modules, opt_ifname);
+	printf("%-16s %9s %9s %9s %9s %9s %7s\n", "engine", "p50 us", "p99 us", "max us", "cpu us",
+	       "enters", "lost");
+
+	pcio_socketcan_t s;
+	aa_hard_assert(0 == pcio_socketcan_init(&s, opt_ifname), "Couldn't set up SocketCAN\n");
+	run(&pcio_transport_socketcan, &s);
+	pcio_socketcan_destroy(&s);
+
+	if(0 == pcio_socketcan_init_uring(&s, opt_ifname)) {
+		run(&pcio_transport_socketcan_uring, &s);
+		pcio_socketcan_destroy(&s);
+	} else {
+		printf("%-16s no io_uring\n", pcio_transport_socketcan_uring.name);
+	}
+
+	done = 1;
+	for(size_t i = 0; i < opt_busses; i++) pthread_join(threads[i], NULL);
+	return 0;
+}